@@ -40,17 +40,25 @@
 #include <epicsTime.h>
 #include <epicsThread.h>
 #include <epicsEvent.h>
-#include <epicsEndian.h>
 #include <iocsh.h>
 
 /* Dependency support modules includes:
- * asyn, areaDetector, CMU 1394 camera library */
+ * asyn, areaDetector */
 #include <ADDriver.h>
 
-#include <stdafx.h>
-
-/* 1394Camera includes */
-#include <1394Camera.h>
+/* Camera backends: the CMU 1394 camera library and the simulator */
+#include "firewireWinDCAMCamera.h"
+#include "firewireWinDCAMSim.h"
+#include "firewireWinDCAMCapCache.h"
+#include "firewireWinDCAMEnum.h"
+#include "firewireWinDCAMFault.h"
+#include "firewireWinDCAMRecord.h"
+#include "firewireWinDCAMReplay.h"
+#include "firewireWinDCAMConvert.h"
+#include "firewireWinDCAMIso.h"
+#include "firewireWinDCAMReactor.h"
+#include "firewireWinDCAMSched.h"
+#include "firewireWinDCAMBayer.h"
 
 #include <epicsExport.h>
 
@@ -58,11 +66,19 @@
 #define PERR(errCode) this->err(errCode, __LINE__)
 
 #define MAX_1394_BUFFERS 6
+/** Limits of the DMA ring depth, see dmaBufferCount() */
+#define MIN_DMA_BUFFERS 2
+#define MAX_DMA_BUFFERS 256
+/** Default memory budget of a DMA ring sized automatically, in MB */
+#define DEFAULT_DMA_MEMORY 256.0
+/** Time between attempts to allocate an NDArray with the wait pool policy, in seconds */
+#define POOL_WAIT_POLL 0.002
 #define MAX_1394_VIDEO_FORMATS 8
 #define MAX_1394_VIDEO_MODES 8
 #define MAX_1394_FRAME_RATES 8
 
 #define MAX(x,y) ((x)>(y)?(x):(y))
+#define MIN(x,y) ((x)<(y)?(x):(y))
 
 /** Specific asyn commands for this support module. These will be used and
  * managed by the parameter library (part of areaDetector). */
@@ -93,10 +109,186 @@
 #define FDC_current_colorcodeString  "FDC_CURRENT_COLORCODE"
 #define FDC_readout_timeString       "FDC_READOUT_TIME"
 #define FDC_dropped_framesString     "FDC_DROPPED_FRAMES"
+#define FDC_reconfig_gapString       "FDC_RECONFIG_GAP"
+#define FDC_roi_move_latencyString   "FDC_ROI_MOVE_LATENCY"
+#define FDC_caps_sourceString        "FDC_CAPS_SOURCE"
+#define FDC_caps_refreshString       "FDC_CAPS_REFRESH"
+#define FDC_caps_timeString          "FDC_CAPS_TIME"
+#define FDC_init_stateString         "FDC_INIT_STATE"
+#define FDC_init_enum_timeString     "FDC_INIT_ENUM_TIME"
+#define FDC_init_open_timeString     "FDC_INIT_OPEN_TIME"
+#define FDC_init_probe_timeString    "FDC_INIT_PROBE_TIME"
+#define FDC_bus_camerasString        "FDC_BUS_CAMERAS"
+#define FDC_bus_scan_timeString      "FDC_BUS_SCAN_TIME"
+#define FDC_faults_injectedString    "FDC_FAULTS_INJECTED"
+#define FDC_rec_fileString           "FDC_REC_FILE"
+#define FDC_rec_enableString         "FDC_REC_ENABLE"
+#define FDC_rec_framesString         "FDC_REC_FRAMES"
+#define FDC_wd_enableString          "FDC_WD_ENABLE"
+#define FDC_wd_timeoutString         "FDC_WD_TIMEOUT"
+#define FDC_wd_retriesString         "FDC_WD_RETRIES"
+#define FDC_wd_restartsString        "FDC_WD_RESTARTS"
+#define FDC_wd_reinitsString         "FDC_WD_REINITS"
+#define FDC_wd_downtimeString        "FDC_WD_DOWNTIME"
+#define FDC_wd_last_downtimeString   "FDC_WD_LAST_DOWNTIME"
+#define FDC_wd_reconnectsString      "FDC_WD_RECONNECTS"
+#define FDC_wd_reconnect_timeString  "FDC_WD_RECONNECT_TIME"
+#define FDC_drain_policyString       "FDC_DRAIN_POLICY"
+#define FDC_stall_toleranceString    "FDC_STALL_TOLERANCE"
+#define FDC_dma_buffersString        "FDC_DMA_BUFFERS"
+#define FDC_backlogString            "FDC_BACKLOG"
+#define FDC_backlog_maxString        "FDC_BACKLOG_MAX"
+#define FDC_dropped_staleString      "FDC_DROPPED_STALE"
+#define FDC_dropped_overrunString    "FDC_DROPPED_OVERRUN"
+#define FDC_dma_depthString          "FDC_DMA_DEPTH"
+#define FDC_dma_memoryString         "FDC_DMA_MEMORY"
+#define FDC_dma_peakString           "FDC_DMA_PEAK"
+#define FDC_pool_policyString        "FDC_POOL_POLICY"
+#define FDC_pool_timeoutString       "FDC_POOL_TIMEOUT"
+#define FDC_pool_dropsString         "FDC_POOL_DROPS"
+#define FDC_pool_waitsString         "FDC_POOL_WAITS"
+#define FDC_pool_reclaimsString      "FDC_POOL_RECLAIMS"
+#define FDC_pool_buffersString       "FDC_POOL_BUFFERS"
+#define FDC_pool_freeString          "FDC_POOL_FREE"
+#define FDC_pool_memoryString        "FDC_POOL_MEMORY"
+#define FDC_pool_memory_useString    "FDC_POOL_MEMORY_USE"
+#define FDC_publish_autoString       "FDC_PUBLISH_AUTO"
+#define FDC_publish_decimationString "FDC_PUBLISH_DECIMATION"
+#define FDC_publish_max_decimString  "FDC_PUBLISH_MAX_DECIM"
+#define FDC_publish_held_maxString   "FDC_PUBLISH_HELD_MAX"
+#define FDC_publish_heldString       "FDC_PUBLISH_HELD"
+#define FDC_publish_slowString       "FDC_PUBLISH_SLOW"
+#define FDC_publish_skippedString    "FDC_PUBLISH_SKIPPED"
+#define FDC_publish_rateString       "FDC_PUBLISH_RATE"
+#define FDC_frames_capturedString    "FDC_FRAMES_CAPTURED"
+#define FDC_capture_rateString       "FDC_CAPTURE_RATE"
+#define FDC_packet_modeString        "FDC_PACKET_MODE"
+#define FDC_packet_sizeString        "FDC_PACKET_SIZE"
+#define FDC_packets_per_frameString  "FDC_PACKETS_PER_FRAME"
+#define FDC_packet_limitedString     "FDC_PACKET_LIMITED"
+#define FDC_predicted_fpsString      "FDC_PREDICTED_FPS"
+#define FDC_iso_policyString         "FDC_ISO_POLICY"
+#define FDC_iso_busString            "FDC_ISO_BUS"
+#define FDC_iso_unitsString          "FDC_ISO_UNITS"
+#define FDC_iso_shrunkString         "FDC_ISO_SHRUNK"
+#define FDC_iso_bus_useString        "FDC_ISO_BUS_USE"
+#define FDC_iso_bus_camerasString    "FDC_ISO_BUS_CAMERAS"
+#define FDC_1394b_modeString         "FDC_1394B_MODE"
+#define FDC_1394bString              "FDC_1394B"
+#define FDC_link_speedString         "FDC_LINK_SPEED"
+#define FDC_iso_speedString          "FDC_ISO_SPEED"
+#define FDC_max_mbytesString         "FDC_MAX_MBYTES"
+#define FDC_reactorString            "FDC_REACTOR"
+#define FDC_grab_priorityString      "FDC_GRAB_PRIORITY"
+#define FDC_grab_cpusString          "FDC_GRAB_CPUS"
+#define FDC_grab_cpuString           "FDC_GRAB_CPU"
+#define FDC_grab_nodeString          "FDC_GRAB_NODE"
+#define FDC_numa_buffersString       "FDC_NUMA_BUFFERS"
+#define FDC_wake_latencyString       "FDC_WAKE_LATENCY"
+#define FDC_wake_latency_maxString   "FDC_WAKE_LATENCY_MAX"
+#define FDC_convert_threadsString    "FDC_CONVERT_THREADS"
+#define FDC_convert_timeString       "FDC_CONVERT_TIME"
+#define FDC_demosaicString           "FDC_DEMOSAIC"
+#define FDC_bayer_patternString      "FDC_BAYER_PATTERN"
+#define FDC_color_filterString       "FDC_COLOR_FILTER"
+#define FDC_data_bitsString          "FDC_DATA_BITS"
+#define FDC_data_depthString         "FDC_DATA_DEPTH"
+#define FDC_sent_alignString         "FDC_SENT_ALIGN"
+#define FDC_sample_alignString       "FDC_SAMPLE_ALIGN"
+#define FDC_unused_bitsString        "FDC_UNUSED_BITS"
+
+/** Camera initialization states, reported in FDC_INIT_STATE */
+typedef enum {
+    FDCInitDiscovering,
+    FDCInitOpening,
+    FDCInitProbing,
+    FDCInitReady,
+    FDCInitFailed
+} FDCInitState_t;
+
+/** How the frames queued in the DMA ring are taken, selected with FDC_DRAIN_POLICY */
+typedef enum {
+    FDCDrainLatest,             /**< Only the newest frame, older ones are discarded */
+    FDCDrainLossless            /**< Every frame in order; only frames that overflow the ring are lost */
+} FDCDrainPolicy_t;
+
+/** What is done when the NDArrayPool has no array for a frame, selected with FDC_POOL_POLICY */
+typedef enum {
+    FDCPoolDrop,                /**< The frame is dropped */
+    FDCPoolWait,                /**< Wait up to FDC_POOL_TIMEOUT for an array to be released, then drop */
+    FDCPoolFreeMemory           /**< Free the memory of the unused arrays of other sizes, then drop */
+} FDCPoolPolicy_t;
+
+/** How the Format 7 packet size is chosen, selected with FDC_PACKET_MODE */
+typedef enum {
+    FDCPacketRecommended,       /**< The size recommended by the camera */
+    FDCPacketPlanned            /**< The smallest size that reaches ADAcquirePeriod, the largest if it is 0 */
+} FDCPacketMode_t;
+
+/** What is done when a camera does not fit in the bandwidth left on its bus, selected with FDC_ISO_POLICY */
+typedef enum {
+    FDCIsoOff,                  /**< The bandwidth is not checked */
+    FDCIsoRefuse,               /**< The stream is not started */
+    FDCIsoShrink                /**< In Format 7 the packet size is reduced to fit, otherwise refuse */
+} FDCIsoPolicy_t;
+
+/** Whether 1394b operation mode is used, selected with FDC_1394B_MODE */
+typedef enum {
+    FDC1394bLegacy,             /**< 1394b mode off, at most S400 */
+    FDC1394bAuto                /**< 1394b mode on if the camera has it and the link is faster than S400 */
+} FDC1394bMode_t;
+
+/** The publish decimation is adjusted after this many published frames */
+#define PUBLISH_WINDOW 8
+/** A callback is slow if it takes more than this fraction of the time between published frames */
+#define PUBLISH_SLOW_FRACTION 0.8
+/** Consecutive windows without pressure before the publish decimation is lowered */
+#define PUBLISH_RECOVER_WINDOWS 3
+/** The capture and publish rates are measured over this time in seconds */
+#define PUBLISH_RATE_PERIOD 1.0
+
+/** The frame timeout is this many times the expected time between frames plus a margin in seconds */
+#define WATCHDOG_TIMEOUT_FACTOR 3.0
+#define WATCHDOG_TIMEOUT_MARGIN 0.5
+/** Consecutive failed grabs that are only retried before the stream is restarted */
+#define WATCHDOG_RETRIES 2
+/** Time between attempts to find a lost camera on the bus again, in seconds */
+#define WATCHDOG_RECONNECT_POLL 1.0
+
+/** Settings of the camera restored when it comes back after it was lost, see reconnectCamera() */
+typedef struct {
+    int format, mode, rate, colorCode;
+    int sizeX, sizeY, minX, minY;
+} FDCShadow;
+
+/** State of a feature restored when the camera comes back */
+typedef struct {
+    int available;
+    int mode;                   /**< 0=manual, 1=auto */
+    int absolute;               /**< The value was last written with absolute control */
+    int value;
+    double absValue;
+} FDCFeatureShadow;
+
+/** Maximum number of records that can be written before the camera is ready */
+#define MAX_PENDING_WRITES 256
+
+/** A write received before the camera is ready */
+typedef struct {
+    asynUser *pasynUser;
+    int isFloat;
+    epicsInt32 ival;
+    epicsFloat64 dval;
+} FDCPendingWrite;
 
 /** Only used for debugging/error messages to identify where the message comes from*/
 static const char *driverName = "FirewireWinDCAM";
 
+/** Directory for the capability cache files, NULL to disable the cache. Set with WinFDC_CapabilityCache. */
+static char *capCacheDirectory = NULL;
+/** Ignore existing cache files and probe the cameras, rewriting the cache files */
+static int capCacheForceRefresh = 0;
+
 /** Main driver class inherited from areaDetectors ADDriver class.
  * One instance of this class will control one firewire camera on the bus.
  */
@@ -105,13 +297,16 @@ class FirewireWinDCAM : public ADDriver
 public:
     FirewireWinDCAM(const char *portName, const char* camid,
                  int maxBuffers, size_t maxMemory,
-                 int priority, int stackSize);
+                 int priority, int stackSize, int dmaBuffers);
 
     /* virtual methods to override from ADDriver */
     virtual asynStatus writeInt32( asynUser *pasynUser, epicsInt32 value);
     virtual asynStatus writeFloat64( asynUser *pasynUser, epicsFloat64 value);
+    virtual asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual);
     void report(FILE *fp, int details);
     void imageGrabTask();  /**< This should be private but is called from C callback function, must be public. */
+    void reactorService(int timedOut, FDCReactorArm *pArm);  /**< Called from C callback function, must be public. */
+    void reconnectTask();  /**< Called from C callback function, must be public. */
 
 protected:
     int FDC_feat_val;                       /** Feature value (int32 read/write) addr: 0-17 */
@@ -142,23 +337,155 @@ protected:
     int FDC_current_colorcode;             /** Read back the current color mcde (octet, read)*/
     int FDC_readout_time;                  /** Readout time (float64, read/write)*/
     int FDC_dropped_frames;                /** Number of dropped frames (int32, read)*/
-    #define LAST_FDC_PARAM FDC_dropped_frames
+    int FDC_reconfig_gap;                  /** Stream gap of the last reconfiguration while acquiring in seconds (float64, read)*/
+    int FDC_roi_move_latency;              /** Frames between the last ROI position command and the first frame with the new position (int32, read)*/
+    int FDC_caps_source;                   /** Where the camera capabilities came from: 0=probed, 1=cache file (int32, read)*/
+    int FDC_caps_refresh;                  /** Probe the camera capabilities again and rewrite the cache file (int32, write)*/
+    int FDC_caps_time;                     /** Time taken to obtain the camera capabilities in seconds (float64, read)*/
+    int FDC_init_state;                    /** Camera initialization state, see FDCInitState_t (int32, read)*/
+    int FDC_init_enum_time;                /** Time taken to enumerate the bus and find the camera in seconds (float64, read)*/
+    int FDC_init_open_time;                /** Time taken to open the camera in seconds (float64, read)*/
+    int FDC_init_probe_time;               /** Time taken to read the capabilities and current settings in seconds (float64, read)*/
+    int FDC_bus_cameras;                   /** Number of cameras found by the last bus scan (int32, read)*/
+    int FDC_bus_scan_time;                 /** Time taken by the last bus scan in seconds (float64, read)*/
+    int FDC_faults_injected;               /** Number of faults injected into the camera, see WinFDC_FaultInject (int32, read)*/
+    int FDC_rec_file;                      /** File the raw frames are recorded to (octet, read/write)*/
+    int FDC_rec_enable;                    /** Record the raw frames to FDC_rec_file: 0=stop, 1=record (int32, read/write)*/
+    int FDC_rec_frames;                    /** Number of frames recorded to the current file (int32, read)*/
+    int FDC_wd_enable;                     /** Recover from failed grabs instead of stopping acquisition: 0=off, 1=on (int32, read/write)*/
+    int FDC_wd_timeout;                    /** Time to wait for a frame before the grab fails in seconds (float64, read)*/
+    int FDC_wd_retries;                    /** Number of failed grabs that were retried (int32, read)*/
+    int FDC_wd_restarts;                   /** Number of times the stream was restarted to recover (int32, read)*/
+    int FDC_wd_reinits;                    /** Number of times the camera was re-initialized to recover (int32, read)*/
+    int FDC_wd_downtime;                   /** Total time without frames because of failed grabs in seconds (float64, read)*/
+    int FDC_wd_last_downtime;              /** Time without frames of the last recovery in seconds (float64, read)*/
+    int FDC_wd_reconnects;                 /** Number of times the camera was lost and opened again (int32, read)*/
+    int FDC_wd_reconnect_time;             /** Time from the loss of the camera to its stream running again in seconds (float64, read)*/
+    int FDC_drain_policy;                  /** Frame queue policy, see FDCDrainPolicy_t (int32, read/write)*/
+    int FDC_stall_tolerance;               /** Time the grab thread may stall without losing frames in lossless mode in seconds (float64, read/write)*/
+    int FDC_dma_buffers;                   /** Number of DMA buffers the stream was started with (int32, read)*/
+    int FDC_backlog;                       /** Estimated number of frames waiting in the DMA ring (int32, read)*/
+    int FDC_backlog_max;                   /** Largest backlog since acquisition was started (int32, read)*/
+    int FDC_dropped_stale;                 /** Number of frames discarded by the latest-only policy (int32, read)*/
+    int FDC_dropped_overrun;               /** Number of frames lost because the DMA ring overflowed in lossless mode (int32, read)*/
+    int FDC_dma_depth;                     /** Number of DMA buffers, 0=sized automatically (int32, read/write)*/
+    int FDC_dma_memory;                    /** Memory budget of an automatically sized DMA ring in MB (float64, read/write)*/
+    int FDC_dma_peak;                      /** Peak occupancy of the DMA ring since acquisition was started in percent (float64, read)*/
+    int FDC_pool_policy;                   /** What to do when the NDArrayPool is exhausted, see FDCPoolPolicy_t (int32, read/write)*/
+    int FDC_pool_timeout;                  /** Longest wait for an NDArray with the wait policy in seconds (float64, read/write)*/
+    int FDC_pool_drops;                    /** Number of frames dropped because the NDArrayPool was exhausted (int32, read)*/
+    int FDC_pool_waits;                    /** Number of frames that had to wait for an NDArray (int32, read)*/
+    int FDC_pool_reclaims;                 /** Number of frames that got an NDArray after the memory of the free list was freed (int32, read)*/
+    int FDC_pool_buffers;                  /** Number of NDArrays allocated by the pool (int32, read)*/
+    int FDC_pool_free;                     /** Number of NDArrays in the free list of the pool (int32, read)*/
+    int FDC_pool_memory;                   /** Memory allocated by the pool in MB (float64, read)*/
+    int FDC_pool_memory_use;               /** Memory allocated by the pool in percent of maxMemory, 0 if unlimited (float64, read)*/
+    int FDC_publish_auto;                  /** Adjust the publish decimation to the load of the plugins (int32, read/write)*/
+    int FDC_publish_decimation;            /** Only one frame in this many is passed to the plugins (int32, read/write)*/
+    int FDC_publish_max_decim;             /** Largest decimation the automatic control may use (int32, read/write)*/
+    int FDC_publish_held_max;              /** Number of published arrays held by plugins above which publishing is slowed down (int32, read/write)*/
+    int FDC_publish_held;                  /** Number of published arrays still held by plugins (int32, read)*/
+    int FDC_publish_slow;                  /** Number of callbacks slower than the time between published frames (int32, read)*/
+    int FDC_publish_skipped;               /** Number of frames not published because of the decimation (int32, read)*/
+    int FDC_publish_rate;                  /** Rate at which frames are passed to the plugins in frames/s (float64, read)*/
+    int FDC_frames_captured;               /** Number of frames received from the camera since acquisition was started (int32, read)*/
+    int FDC_capture_rate;                  /** Rate at which frames are received from the camera in frames/s (float64, read)*/
+    int FDC_packet_mode;                   /** How the Format 7 packet size is chosen, see FDCPacketMode_t (int32, read/write)*/
+    int FDC_packet_size;                   /** Format 7 packet size in bytes (int32, read)*/
+    int FDC_packets_per_frame;             /** Number of isochronous packets a Format 7 frame is sent in (int32, read)*/
+    int FDC_packet_limited;                /** The packet size can not reach the requested ADAcquirePeriod (int32, read)*/
+    int FDC_predicted_fps;                 /** Frame rate expected from the video settings and exposure in frames/s (float64, read)*/
+    int FDC_iso_policy;                    /** What to do when the bus has not enough bandwidth left, see FDCIsoPolicy_t (int32, read/write)*/
+    int FDC_iso_bus;                       /** Bus the bandwidth of the camera is counted on, -1 for none (int32, read/write)*/
+    int FDC_iso_units;                     /** Bandwidth units reserved for the camera (int32, read)*/
+    int FDC_iso_shrunk;                    /** The packet size was reduced to fit in the bus bandwidth (int32, read)*/
+    int FDC_iso_bus_use;                   /** Bandwidth reserved on the bus by all the cameras in percent (float64, read)*/
+    int FDC_iso_bus_cameras;               /** Number of cameras streaming on the bus (int32, read)*/
+    int FDC_1394b_mode;                    /** Whether 1394b mode is used, see FDC1394bMode_t (int32, read/write)*/
+    int FDC_1394b;                         /** The camera is in 1394b mode (int32, read)*/
+    int FDC_link_speed;                    /** Fastest speed both the camera and the host support in Mb/s (int32, read)*/
+    int FDC_iso_speed;                     /** Speed the camera sends at in Mb/s (int32, read)*/
+    int FDC_max_mbytes;                    /** Most image data the camera can send at that speed in MB/s (float64, read)*/
+    int FDC_reactor;                       /** The frames are grabbed by the shared grab reactor (int32, read)*/
+    int FDC_grab_priority;                 /** EPICS priority of the grab thread and strip workers, 0-99 (int32, read/write)*/
+    int FDC_grab_cpus;                     /** CPUs the grab thread and strip workers may run on, "" for any (octet, read/write)*/
+    int FDC_grab_cpu;                      /** CPU the grab thread last ran on, -1 if not known (int32, read)*/
+    int FDC_grab_node;                     /** NUMA node of that CPU, -1 if not known (int32, read)*/
+    int FDC_numa_buffers;                  /** Keep the free NDArrays on the node of a pinned grab thread: 0=no, 1=yes (int32, read/write)*/
+    int FDC_wake_latency;                  /** Mean time the grab thread took to run after a frame arrived in seconds (float64, read)*/
+    int FDC_wake_latency_max;              /** Longest such time since acquisition was started in seconds (float64, read)*/
+    int FDC_convert_threads;               /** Most threads converting a large frame, 0 for one per core, 1 for the grab thread alone (int32, read/write)*/
+    int FDC_convert_time;                  /** Time the last frame took to copy or convert in seconds (float64, read)*/
+    int FDC_demosaic;                      /** Demosaic raw Bayer frames to RGB: 0=off, 1=bilinear, 2=edge-aware (int32, read/write)*/
+    int FDC_bayer_pattern;                 /** Color filter of raw frames: 0=as reported, 1=RGGB, 2=GBRG, 3=GRBG, 4=BGGR (int32, read/write)*/
+    int FDC_color_filter;                  /** Color filter the camera reports: 0=none, 1=RGGB, 2=GBRG, 3=GRBG, 4=BGGR (int32, read)*/
+    int FDC_data_bits;                     /** Significant bits of 16-bit samples: 0=as reported, 1-16 (int32, read/write)*/
+    int FDC_data_depth;                    /** Significant bits of the samples of the last frame (int32, read)*/
+    int FDC_sent_align;                    /** Where the camera sends the significant bits: 0=high bits, 1=low bits (int32, read/write)*/
+    int FDC_sample_align;                  /** Where they are published: 0=as sent, 1=low bits, 2=high bits (int32, read/write)*/
+    int FDC_unused_bits;                   /** Samples sent in the low bits beyond the data depth: 0=masked, 1=clamped (int32, read/write)*/
+    #define LAST_FDC_PARAM FDC_unused_bits
 
 private:
     /* Local methods to this class */
+    asynStatus initCamera();
+    asynStatus openCamera(unsigned long long guid, int *pBus);
+    asynStatus queueWrite(asynUser *pasynUser, int isFloat, epicsInt32 ival, epicsFloat64 dval);
+    void applyPendingWrites();
+    int needsCamera(int function);
     int grabImage();
+    NDArray *allocArray(int ndims, size_t *dims, NDDataType_t dataType);
+    void updatePoolStats();
+    int publishFrame();
+    void updatePublishRate(double callbackTime);
+    void countCapturedFrame(epicsTimeStamp *pFrameTime);
+    asynStatus startRecording();
+    void stopRecording();
+    void recordFrame(int format, int mode, FDCColorCode colorCode, int depth, int sizeX, int sizeY,
+                     int droppedFrames, epicsTimeStamp *pFrameTime);
+    int grabStep(int blocking);
     asynStatus startCapture();
+    asynStatus startStream();
+    asynStatus allocateBandwidth();
+    asynStatus negotiateSpeed();
+    void updateBusUsage();
+    void recoverStream();
+    void streamRecovered(epicsTimeStamp *pFrameTime);
+    void loseCamera();
+    asynStatus reconnectCamera();
+    int lostStep(int blocking);
+    void startReconnect();
+    void saveShadow();
+    asynStatus restoreShadow();
     asynStatus stopCapture();
+    asynStatus pauseCapture(int *paused);
+    asynStatus resumeCapture(int paused);
+    asynStatus restartStream();
 
     /* camera feature control functions */
     asynStatus setFeatureValue(int feature, epicsInt32 value);
     asynStatus setFeatureAbsValue(int feature, epicsFloat64 value);
     asynStatus setFeatureMode(int feature, epicsInt32 value);
-    C1394CameraControl* checkFeature(int feature, char **featureName);
+    FDCCameraControl* checkFeature(int feature, char **featureName);
     asynStatus setVideoFormat(epicsInt32 format);
     asynStatus setVideoMode(epicsInt32 mode);
     asynStatus setFrameRate(epicsInt32 rate);
     asynStatus setFormat7Params();
+    asynStatus setFormat7Position();
+    void updateFormat7Position(epicsTimeStamp *pFrameTime);
+    int updateBacklog(int policy, epicsTimeStamp *pWaitStart, epicsTimeStamp *pFrameTime, int droppedFrames);
+    double updateWakeLatency(epicsTimeStamp *pWaitStart, epicsTimeStamp *pFrameTime, int droppedFrames);
+    void applySchedule();
+    void updatePlacement();
+    double getFrameInterval();
+    double getExpectedInterval();
+    unsigned long getFrameBytes();
+    int dmaBufferCount(double interval);
+    asynStatus loadCapabilities(int forceRefresh);
+    int validateCapabilities(FDCCapabilities *pCached);
+    void getVideoCapabilities(FDCCapabilities *pCaps);
+    asynStatus probeFeatures();
+    void setFormat7ModeString(int mode, FDCFormat7Caps *pDesc);
     asynStatus formatFormat7Modes();
     asynStatus formatValidModes();
     asynStatus getAllFeatures();
@@ -167,10 +494,68 @@ private:
 
     /* Data */
     NDArray *pRaw;
-    C1394Camera *pCamera;
-    C1394CameraControlSize *pCameraControlSize;
-    C1394CameraControl **pCameraControl;
+    FDCCamera *pCamera;
+    unsigned long long guid;    /**< GUID of the open camera */
+    FDCCameraControlSize *pCameraControlSize;
+    FDCCameraControl **pCameraControl;
     epicsEventId startEventId;
+    epicsEventId pausedEventId;
+    epicsEventId resumeEventId;
+    int reconfigPending;        /**< Set by the port thread to ask the grab thread to stop the stream */
+    int capturePaused;          /**< Set by the grab thread while the stream is stopped for a reconfiguration */
+    int gapPending;             /**< The next frame is the first one after a reconfiguration */
+    epicsTimeStamp lastFrameTime;
+    size_t lastArrayBytes;
+    int roiMinX, roiMinY;       /**< Format 7 origin of the frames currently being delivered */
+    int pendingMinX, pendingMinY;
+    int positionPending;        /**< A new origin has been requested but not yet written to the camera */
+    int positionInFlight;       /**< A new origin has been written but frames in the pipeline still have the old one */
+    int positionFrames;         /**< Frames received since the last position command */
+    epicsTimeStamp positionApplyTime;
+    FDCCapabilities caps;       /**< Static capabilities of the camera, probed or from the cache file */
+    int capsValid;
+    char *camid;
+    int initState;              /**< FDCInitState_t, writes that need the camera are queued until FDCInitReady */
+    FDCPendingWrite pendingWrites[MAX_PENDING_WRITES];
+    int numPendingWrites;
+    FDCRecordFile *pRecord;     /**< Recording the raw frames are written to, NULL when not recording */
+    int msTimeout;              /**< Frame timeout the stream was started with */
+    int acquireFailed;          /**< The last grab failed because no frame was received from the camera */
+    int wdFailures;             /**< Consecutive failed grabs, the watchdog escalates with this */
+    FDCShadow shadow;           /**< Settings of a lost camera, restored when it is back */
+    int cameraLost;             /**< The camera has left the bus and has not been opened again */
+    int reconnectRunning;       /**< A thread of its own looks for the lost camera, see lostStep() */
+    epicsTimeStamp lostTime;    /**< When the camera was lost */
+    FDCFeatureShadow *pFeatureShadow;
+    double streamInterval;      /**< Expected time between frames of the running stream */
+    epicsTimeStamp backlogAnchor; /**< Arrival of the last frame found with an empty DMA ring */
+    int backlogFrames;          /**< Frames taken from the ring since backlogAnchor */
+    int backlogValid;
+    int acqOverruns;            /**< Frames lost to ring overflow during the current acquisition */
+    int dmaGrowth;              /**< Buffers added to the automatic ring depth because of overflows */
+    int publishPhase;           /**< Frames since the last published one */
+    int publishWindow;          /**< Frames published in the current control window */
+    int publishSlowInWindow;    /**< Slow callbacks in the current control window */
+    int publishHeldInWindow;    /**< Largest number of arrays held by plugins in the current control window */
+    int publishPoolMisses;      /**< Pool drops, waits and reclaims when the control window started */
+    int publishCalmWindows;     /**< Consecutive control windows without pressure */
+    epicsTimeStamp rateStart;   /**< Start of the current rate measurement */
+    int rateCaptured;           /**< Frames received since rateStart */
+    int ratePublished;          /**< Frames published since rateStart */
+    int isoSpeed;               /**< Speed the camera sends at in Mb/s, see negotiateSpeed() */
+    FDCReactorCamera *pReactorCamera;   /**< The camera in the grab reactor, NULL if it has its own thread */
+    int reactorTimedOut;        /**< The reactor runs the grab step because no frame arrived in time */
+    int grabIdle;               /**< The grab step has seen acquisition off and not started again */
+    int schedPending;           /**< FDC_GRAB_PRIORITY or FDC_GRAB_CPUS changed, see applySchedule() */
+    int grabPriority;           /**< Priority of the grab thread and strip workers, see applySchedule() */
+    unsigned long long grabMask; /**< CPUs the grab thread is restricted to, 0 for any */
+    int bufferNode;             /**< NUMA node the free NDArrays were allocated on, -1 if not known */
+    epicsTimeStamp wakeAnchor;  /**< Arrival of the frame the wake-up latency is measured from */
+    int wakeFrames;             /**< Frames since wakeAnchor */
+    int wakeValid;
+    int wakeCount;              /**< Frames measured in the current rate period */
+    double wakeSum, wakeMin, wakeMax; /**< Their offsets from the frame schedule */
+    FDCStripJob *pStripJob;     /**< Converts the frames in strips, see firewireWinDCAMStrips.h */
 };
 /* end of FirewireWinDCAM class description */
 
@@ -185,7 +570,9 @@ private:
  * \param[in] camid The camera ID or serial number in a hexadecimal string. Lower case and
  *            upper case letters can be used. This is used to identify a specific camera
  *            on the bus. For instance: "0x00b09d01007139d0".  If this parameter is empty ("")
- *            then the first camera found on the Firewire bus will be used.
+ *            then the first camera found on the Firewire bus will be used. A string of 16
+ *            digits is read as hexadecimal; other strings without "0x" and without any of the
+ *            letters a-f are read as decimal numbers.
  * \param[in] maxBuffers Maxiumum number of NDArray objects (image buffers) this driver is allowed to allocate.
  *            This driver requires 2 buffers, and each queue element in a plugin can require one buffer
  *            which will all need to be added up in this parameter. Use -1 for unlimited.
@@ -193,10 +580,120 @@ private:
  *            and maxBuffers is, say 14. maxMemory = 1024x768x14 = 11010048 bytes (~11MB). Use -1 for unlimited.
  * \param[in] priority The EPICS thread priority for this driver.  0=use asyn default.
  * \param[in] stackSize The size of the stack for the EPICS port thread. 0=use asyn default.
+ * \param[in] dmaBuffers Number of DMA buffers the frames are received into. 0=size the ring
+ *            automatically from the frame size, frame rate and FDC_STALL_TOLERANCE.
+ */
+extern "C" int WinFDC_Config(const char *portName, const char* camid, int maxBuffers, size_t maxMemory, int priority, int stackSize,
+                             int dmaBuffers)
+{
+    new FirewireWinDCAM( portName, camid, maxBuffers, maxMemory, priority, stackSize, dmaBuffers);
+    return asynSuccess;
+}
+
+/** Scans the Firewire bus again and prints the cameras found.
+ *
+ * The cameras are normally found by a scan shared by all the driver instances, done when the
+ * first camera is initialized and again when a camera is not found. This forces a new scan,
+ * for instance to see a camera that has just been plugged in.
+ */
+extern "C" int WinFDC_BusScan(void)
+{
+    fdcEnumRescan();
+    fdcEnumReport(stdout);
+    return asynSuccess;
+}
+
+/** Adds a simulated camera.
+ *
+ * Simulated cameras are found by the bus scan like real ones, so this must be called before
+ * WinFDC_Config() for the camera. They need no Firewire hardware and are the only cameras
+ * available when the driver is built for Linux.
+ * \param[in] camid The camera GUID, in the same format as for WinFDC_Config(). If empty ("")
+ *            the GUIDs 0x0000fdc000000001, 0x0000fdc000000002, ... are used in turn.
+ * \param[in] maxSizeX Width of the sensor; 0 for 1280.
+ * \param[in] maxSizeY Height of the sensor; 0 for 960.
+ * \param[in] frameRate Overrides the frame rate of the selected mode if > 0. If < 0 frames are
+ *            delivered as fast as they are read. 0 uses the rate of the selected mode.
+ * \param[in] bus The bus the isochronous bandwidth of the camera is counted on; -1 for none.
+ * \param[in] speed The link speed in Mb/s; 0 for 400. Above 400 the camera has 1394b mode.
+ * \param[in] dataDepth Significant bits of the 16-bit samples, the data depth the camera reports;
+ *            0 for 16.
+ * \param[in] sentAlign Where the camera sends the significant bits, as FDC_SENT_ALIGN: 0 in the
+ *            high bits, 1 in the low bits.
+ */
+extern "C" int WinFDC_SimCamera(const char *camid, int maxSizeX, int maxSizeY, double frameRate, int bus,
+                                int speed, int dataDepth, int sentAlign)
+{
+    if (fdcSimAddCamera(camid, maxSizeX, maxSizeY, frameRate, bus, speed, dataDepth, sentAlign) != 0)
+        return asynError;
+    return asynSuccess;
+}
+
+/** Injects faults into the calls made to a camera, to test the recovery and the frame accounting.
+ *
+ * Must be called before WinFDC_Config() for the camera. Calling it again replaces the schedule
+ * and restarts it; an empty schedule stops the injection. The number of faults injected is
+ * reported in FAULTS_INJECTED_RBV and the details by dbior with details > 1.
+ * \param[in] camid The camera GUID, in the same format as for WinFDC_Config(). "" is not allowed.
+ * \param[in] schedule The faults to inject, for instance "acqerr@100+100;drop=2@1%;linkloss=3@5000".
+ *            See firewireWinDCAMFault.h for the syntax.
+ * \param[in] seed The seed of the random generator used by the schedule.
+ */
+extern "C" int WinFDC_FaultInject(const char *camid, const char *schedule, int seed)
+{
+    if (fdcFaultConfigure(camid, schedule, (unsigned int)seed) != 0) return asynError;
+    return asynSuccess;
+}
+
+/** Adds a camera that plays back a recording made with the REC_FILE and REC_ENABLE records.
+ *
+ * Replay cameras are found by the bus scan like real ones, so this must be called before
+ * WinFDC_Config() for the camera. The camera offers the formats, modes, rates and color codes
+ * found in the recording, and every start of acquisition plays it from the beginning.
+ * \param[in] fileName The recording.
+ * \param[in] camid The camera GUID, in the same format as for WinFDC_Config(). If empty ("")
+ *            the GUID of the camera the recording was made with.
+ * \param[in] speed 1 to deliver the frames at the times they were recorded, 2 twice as fast and
+ *            so on. 0 delivers the frames as fast as they are read.
+ * \param[in] loop If non-zero the recording is played again from the start when it ends,
+ *            otherwise the camera stops sending frames.
+ */
+extern "C" int WinFDC_ReplayCamera(const char *fileName, const char *camid, double speed, int loop)
+{
+    if (fdcReplayAddCamera(fileName, camid, speed, loop) != 0) return asynError;
+    return asynSuccess;
+}
+
+/** Starts the grab reactor, which grabs the frames of all the cameras configured afterwards.
+ *
+ * Instead of a thread per camera blocking in AcquireImageEx(), one thread waits for the frame
+ * events of all the cameras and a pool of workers grabs, converts and publishes the frames of the
+ * cameras that have one ready. The frames of a camera are still published in order. Must be
+ * called before WinFDC_Config() for the cameras that are to use it. A camera that has left the bus
+ * keeps a worker busy while it is waited for, so use at least two workers with several cameras.
+ * \param[in] workers The number of worker threads; 0 for one per CPU core.
+ */
+extern "C" int WinFDC_GrabReactor(int workers)
+{
+    if (fdcReactorConfigure(workers) != 0) return asynError;
+    return asynSuccess;
+}
+
+/** Configures the capability cache used by all cameras created afterwards.
+ *
+ * The static capabilities of a camera (formats, modes, rates, Format 7 mode descriptors and
+ * feature capabilities) are saved in a file named after the camera GUID in this directory.
+ * On the next IOC start they are loaded from the file instead of probing the camera, which
+ * takes several seconds per camera. A file is only used if the GUID, the IIDC version and the
+ * supported formats, modes and rates reported by the camera match.
+ * \param[in] directory Directory for the cache files. NULL or "" disables the cache.
+ * \param[in] forceRefresh If non-zero the cameras are always probed and the cache files rewritten.
  */
-extern "C" int WinFDC_Config(const char *portName, const char* camid, int maxBuffers, size_t maxMemory, int priority, int stackSize)
+extern "C" int WinFDC_CapabilityCache(const char *directory, int forceRefresh)
 {
-    new FirewireWinDCAM( portName, camid, maxBuffers, maxMemory, priority, stackSize);
+    free(capCacheDirectory);
+    capCacheDirectory = (directory && (strlen(directory) > 0)) ? epicsStrDup(directory) : NULL;
+    capCacheForceRefresh = forceRefresh;
     return asynSuccess;
 }
 
@@ -219,6 +716,7 @@ static char *errMsg[] = {
     "Param out of range",       //-15
     "Frame timeout",            //-16
 };
+static int numErrMsg = sizeof(errMsg) / sizeof(errMsg[0]);
 
 static char *videoFormatStrings[MAX_1394_VIDEO_FORMATS] = {
     "VGA",
@@ -253,7 +751,7 @@ static char *frameRateStrings[MAX_1394_FRAME_RATES] = {
     "240"
 };
 
-static char *colorCodeStrings[COLOR_CODE_MAX] = {
+static char *colorCodeStrings[FDC_COLOR_CODE_MAX] = {
     "Mono8",
     "YUV411",
     "YUV422",
@@ -269,29 +767,29 @@ static char *colorCodeStrings[COLOR_CODE_MAX] = {
 
 /* This array converts from the 0-21 index used in the asyn addr field for features to the enum values
  * used by the CMU driver, which are not sequential */
-static CAMERA_FEATURE featureIndex[] = {
-    FEATURE_BRIGHTNESS,
-    FEATURE_AUTO_EXPOSURE,
-    FEATURE_SHARPNESS,
-    FEATURE_WHITE_BALANCE,
-    FEATURE_HUE,
-    FEATURE_SATURATION,
-    FEATURE_GAMMA,
-    FEATURE_SHUTTER,
-    FEATURE_GAIN,
-    FEATURE_IRIS,
-    FEATURE_FOCUS,
-    FEATURE_TEMPERATURE,
-    FEATURE_TRIGGER_MODE,
-    FEATURE_TRIGGER_DELAY,
-    FEATURE_WHITE_SHADING,
-    FEATURE_FRAME_RATE,
-    FEATURE_ZOOM,
-    FEATURE_PAN,
-    FEATURE_TILT,
-    FEATURE_OPTICAL_FILTER,
-    FEATURE_CAPTURE_SIZE,
-    FEATURE_CAPTURE_QUALITY
+static FDCFeature featureIndex[] = {
+    FDC_FEATURE_BRIGHTNESS,
+    FDC_FEATURE_AUTO_EXPOSURE,
+    FDC_FEATURE_SHARPNESS,
+    FDC_FEATURE_WHITE_BALANCE,
+    FDC_FEATURE_HUE,
+    FDC_FEATURE_SATURATION,
+    FDC_FEATURE_GAMMA,
+    FDC_FEATURE_SHUTTER,
+    FDC_FEATURE_GAIN,
+    FDC_FEATURE_IRIS,
+    FDC_FEATURE_FOCUS,
+    FDC_FEATURE_TEMPERATURE,
+    FDC_FEATURE_TRIGGER_MODE,
+    FDC_FEATURE_TRIGGER_DELAY,
+    FDC_FEATURE_WHITE_SHADING,
+    FDC_FEATURE_FRAME_RATE,
+    FDC_FEATURE_ZOOM,
+    FDC_FEATURE_PAN,
+    FDC_FEATURE_TILT,
+    FDC_FEATURE_OPTICAL_FILTER,
+    FDC_FEATURE_CAPTURE_SIZE,
+    FDC_FEATURE_CAPTURE_QUALITY
 };
 static int num1394Features = sizeof(featureIndex) / sizeof(featureIndex[0]);
 
@@ -302,15 +800,32 @@ static void imageGrabTaskC(void *drvPvt)
     pPvt->imageGrabTask();
 }
 
+static void reactorServiceC(void *drvPvt, int timedOut, FDCReactorArm *pArm)
+{
+    FirewireWinDCAM *pPvt = (FirewireWinDCAM *)drvPvt;
+
+    pPvt->reactorService(timedOut, pArm);
+}
+
+static void reconnectTaskC(void *drvPvt)
+{
+    FirewireWinDCAM *pPvt = (FirewireWinDCAM *)drvPvt;
+
+    pPvt->reconnectTask();
+}
+
 /** Constructor for the FirewireWinDCAM class
- * Initialises the camera object by setting all the default parameters and initializing
- * the camera hardware with it. This function also reads out the current settings of the
- * camera and prints out a selection of parameters to the shell.
+ * Creates the parameters and starts the image grabbing thread, which finds, opens and probes the
+ * camera in the background (see initCamera()) so that several cameras can be initialized in
+ * parallel and iocInit does not wait for them. Writes received before the camera is ready are
+ * queued and applied once it is.
  * \param[in] portName Asyn port name to assign to the camera driver.
  * \param[in] camid The camera ID or serial number in a hexadecimal string. Lower case and
  *            upper case letters can be used. This is used to identify a specific camera
  *            on the bus. For instance: "0x00b09d01007139d0".  If this parameter is empty ("")
- *            then the first camera found on the Firewire bus will be used.
+ *            then the first camera found on the Firewire bus will be used. A string of 16
+ *            digits is read as hexadecimal; other strings without "0x" and without any of the
+ *            letters a-f are read as decimal numbers.
  * \param[in] maxBuffers Maxiumum number of NDArray objects (image buffers) this driver is allowed to allocate.
  *            This driver requires 2 buffers, and each queue element in a plugin can require one buffer
  *            which will all need to be added up in this parameter. Use -1 for unlimited.
@@ -318,68 +833,31 @@ static void imageGrabTaskC(void *drvPvt)
  *            and maxBuffers is, say 14. maxMemory = 1024x768x14 = 11010048 bytes (~11MB). Use -1 for unlimited.
  * \param[in] priority The EPICS thread priority for this asyn port driver.  0=use asyn default.
  * \param[in] stackSize The size of the stack for the asyn port thread. 0=use asyn default.
+ * \param[in] dmaBuffers Number of DMA buffers, 0=automatic. This is the initial value of FDC_DMA_DEPTH.
  */
 FirewireWinDCAM::FirewireWinDCAM(    const char *portName, const char* camid, 
-                            int maxBuffers, size_t maxMemory, int priority, int stackSize )
+                            int maxBuffers, size_t maxMemory, int priority, int stackSize, int dmaBuffers )
     : ADDriver(portName, num1394Features, NUM_FDC_PARAMS, maxBuffers, maxMemory, 0, 0,
                ASYN_CANBLOCK | ASYN_MULTIDEVICE, 1, priority, stackSize),
-        pRaw(NULL)
+        pRaw(NULL), pCamera(NULL), guid(0), pCameraControlSize(NULL), pCameraControl(NULL),
+        reconfigPending(0), capturePaused(0), gapPending(0), lastArrayBytes(0),
+        roiMinX(0), roiMinY(0), positionPending(0), positionInFlight(0), positionFrames(0), capsValid(0),
+        initState(FDCInitDiscovering), numPendingWrites(0), pRecord(NULL),
+        msTimeout(0), acquireFailed(0), wdFailures(0), cameraLost(0), reconnectRunning(0), pFeatureShadow(NULL),
+        streamInterval(0.0), backlogFrames(0), backlogValid(0), acqOverruns(0), dmaGrowth(0),
+        publishPhase(0), publishWindow(0), publishSlowInWindow(0), publishHeldInWindow(0),
+        publishPoolMisses(0), publishCalmWindows(0), rateCaptured(0), ratePublished(0),
+        isoSpeed(FDC_ISO_LEGACY_SPEED), pReactorCamera(NULL), reactorTimedOut(0), grabIdle(1),
+        schedPending(1), grabPriority(epicsThreadPriorityMedium), grabMask(0), bufferNode(-1), wakeFrames(0), wakeValid(0), wakeCount(0),
+        wakeSum(0.0), wakeMin(0.0), wakeMax(0.0), pStripJob(NULL)
 {
     const char *functionName = "FirewireWinDCAM";
-    char vendorName[256], cameraName[256];
-    LARGE_INTEGER uniqueId;
-    unsigned long long int camUID = 0;
-    unsigned long version;
-    int err;
-    int numCameras;
-    int selectedCamera = -1;
-    int i, status, ret;
-    char chMode = 'A';
-
-    /* parse the string of hex-numbers that is the cameras unique ID
-     * If this string is not specified then we just use the first camera found */
-    if (camid && (strlen(camid) > 0)) {
-        ret = sscanf(camid, "%lld", &camUID);
-    } else {
-        selectedCamera = 0;
-    }
-    this->pCamera = new C1394Camera();
-    numCameras = this->pCamera->RefreshCameraList();
-    // Print out information about all the cameras found
-    printf("%s::%s: %d cameras found\n", driverName, functionName, numCameras);
-    if (numCameras < 1) return;
-    for (i=0; i<numCameras; i++) {
-        printf("  camera %d\n", i);
-        err = this->pCamera->SelectCamera(i);
-        status = PERR(err);
-        this->pCamera->GetCameraVendor(vendorName, sizeof(vendorName));
-        this->pCamera->GetCameraName(cameraName, sizeof(cameraName));
-        this->pCamera->GetCameraUniqueID(&uniqueId);
-        if (uniqueId.QuadPart == camUID) selectedCamera=i;
-        version = this->pCamera->GetVersion();
-        printf("Vendor name: %s\n", vendorName);
-        printf("Camera name: %s\n", cameraName);
-        printf("UniqueId: %lld (0x%llX)\n", uniqueId.QuadPart, uniqueId.QuadPart);
-        printf("Version: 0x%lX\n", version);
-    }
-            
-    /* If we didn't find the camera with the specific ID we return... */
-    if (selectedCamera < 0)
-    {
-        fprintf(stderr,"### ERROR ### Did not find camera with GUID: 0x%16.16llX\n", camUID);
-        return;
-    } else {
-        printf("Found requested camera, initializing ...\n ");
-        err = this->pCamera->SelectCamera(selectedCamera);
-        status = PERR(err);
-        err = this->pCamera->InitCamera(TRUE);
-        status = PERR(err);
-    }
-    this->pCameraControlSize = this->pCamera->GetCameraControlSize();
-    this->pCameraControl = (C1394CameraControl **)malloc(num1394Features * sizeof(pCameraControl[0]));
-    for (i=0; i<num1394Features; i++) {
-        this->pCameraControl[i] = new C1394CameraControl(this->pCamera, featureIndex[i]);
-    }
+    int status;
+
+    memset(&this->caps, 0, sizeof(this->caps));
+    memset(&this->shadow, 0, sizeof(this->shadow));
+    this->pFeatureShadow = (FDCFeatureShadow *)calloc(num1394Features, sizeof(FDCFeatureShadow));
+    this->camid = epicsStrDup(camid ? camid : "");
 
     createParam(FDC_feat_valString,             asynParamInt32,   &FDC_feat_val);
     createParam(FDC_feat_val_maxString,         asynParamInt32,   &FDC_feat_val_max);
@@ -408,37 +886,203 @@ FirewireWinDCAM::FirewireWinDCAM(    const char *portName, const char* camid,
     createParam(FDC_current_colorcodeString,    asynParamOctet,   &FDC_current_colorcode);
     createParam(FDC_readout_timeString,       asynParamFloat64,   &FDC_readout_time);
     createParam(FDC_dropped_framesString,       asynParamInt32,   &FDC_dropped_frames);
+    createParam(FDC_reconfig_gapString,       asynParamFloat64,   &FDC_reconfig_gap);
+    createParam(FDC_roi_move_latencyString,     asynParamInt32,   &FDC_roi_move_latency);
+    createParam(FDC_caps_sourceString,          asynParamInt32,   &FDC_caps_source);
+    createParam(FDC_caps_refreshString,         asynParamInt32,   &FDC_caps_refresh);
+    createParam(FDC_caps_timeString,          asynParamFloat64,   &FDC_caps_time);
+    createParam(FDC_init_stateString,           asynParamInt32,   &FDC_init_state);
+    createParam(FDC_init_enum_timeString,     asynParamFloat64,   &FDC_init_enum_time);
+    createParam(FDC_init_open_timeString,     asynParamFloat64,   &FDC_init_open_time);
+    createParam(FDC_init_probe_timeString,    asynParamFloat64,   &FDC_init_probe_time);
+    createParam(FDC_bus_camerasString,          asynParamInt32,   &FDC_bus_cameras);
+    createParam(FDC_bus_scan_timeString,      asynParamFloat64,   &FDC_bus_scan_time);
+    createParam(FDC_faults_injectedString,      asynParamInt32,   &FDC_faults_injected);
+    createParam(FDC_rec_fileString,             asynParamOctet,   &FDC_rec_file);
+    createParam(FDC_rec_enableString,           asynParamInt32,   &FDC_rec_enable);
+    createParam(FDC_rec_framesString,           asynParamInt32,   &FDC_rec_frames);
+    createParam(FDC_wd_enableString,            asynParamInt32,   &FDC_wd_enable);
+    createParam(FDC_wd_timeoutString,         asynParamFloat64,   &FDC_wd_timeout);
+    createParam(FDC_wd_retriesString,           asynParamInt32,   &FDC_wd_retries);
+    createParam(FDC_wd_restartsString,          asynParamInt32,   &FDC_wd_restarts);
+    createParam(FDC_wd_reinitsString,           asynParamInt32,   &FDC_wd_reinits);
+    createParam(FDC_wd_downtimeString,        asynParamFloat64,   &FDC_wd_downtime);
+    createParam(FDC_wd_last_downtimeString,   asynParamFloat64,   &FDC_wd_last_downtime);
+    createParam(FDC_wd_reconnectsString,        asynParamInt32,   &FDC_wd_reconnects);
+    createParam(FDC_wd_reconnect_timeString,  asynParamFloat64,   &FDC_wd_reconnect_time);
+    createParam(FDC_drain_policyString,         asynParamInt32,   &FDC_drain_policy);
+    createParam(FDC_stall_toleranceString,    asynParamFloat64,   &FDC_stall_tolerance);
+    createParam(FDC_dma_buffersString,          asynParamInt32,   &FDC_dma_buffers);
+    createParam(FDC_backlogString,              asynParamInt32,   &FDC_backlog);
+    createParam(FDC_backlog_maxString,          asynParamInt32,   &FDC_backlog_max);
+    createParam(FDC_dropped_staleString,        asynParamInt32,   &FDC_dropped_stale);
+    createParam(FDC_dropped_overrunString,      asynParamInt32,   &FDC_dropped_overrun);
+    createParam(FDC_dma_depthString,            asynParamInt32,   &FDC_dma_depth);
+    createParam(FDC_dma_memoryString,         asynParamFloat64,   &FDC_dma_memory);
+    createParam(FDC_dma_peakString,           asynParamFloat64,   &FDC_dma_peak);
+    createParam(FDC_pool_policyString,          asynParamInt32,   &FDC_pool_policy);
+    createParam(FDC_pool_timeoutString,       asynParamFloat64,   &FDC_pool_timeout);
+    createParam(FDC_pool_dropsString,           asynParamInt32,   &FDC_pool_drops);
+    createParam(FDC_pool_waitsString,           asynParamInt32,   &FDC_pool_waits);
+    createParam(FDC_pool_reclaimsString,        asynParamInt32,   &FDC_pool_reclaims);
+    createParam(FDC_pool_buffersString,         asynParamInt32,   &FDC_pool_buffers);
+    createParam(FDC_pool_freeString,            asynParamInt32,   &FDC_pool_free);
+    createParam(FDC_pool_memoryString,        asynParamFloat64,   &FDC_pool_memory);
+    createParam(FDC_pool_memory_useString,    asynParamFloat64,   &FDC_pool_memory_use);
+    createParam(FDC_publish_autoString,         asynParamInt32,   &FDC_publish_auto);
+    createParam(FDC_publish_decimationString,   asynParamInt32,   &FDC_publish_decimation);
+    createParam(FDC_publish_max_decimString,    asynParamInt32,   &FDC_publish_max_decim);
+    createParam(FDC_publish_held_maxString,     asynParamInt32,   &FDC_publish_held_max);
+    createParam(FDC_publish_heldString,         asynParamInt32,   &FDC_publish_held);
+    createParam(FDC_publish_slowString,         asynParamInt32,   &FDC_publish_slow);
+    createParam(FDC_publish_skippedString,      asynParamInt32,   &FDC_publish_skipped);
+    createParam(FDC_publish_rateString,       asynParamFloat64,   &FDC_publish_rate);
+    createParam(FDC_frames_capturedString,      asynParamInt32,   &FDC_frames_captured);
+    createParam(FDC_capture_rateString,       asynParamFloat64,   &FDC_capture_rate);
+    createParam(FDC_packet_modeString,          asynParamInt32,   &FDC_packet_mode);
+    createParam(FDC_packet_sizeString,          asynParamInt32,   &FDC_packet_size);
+    createParam(FDC_packets_per_frameString,    asynParamInt32,   &FDC_packets_per_frame);
+    createParam(FDC_packet_limitedString,       asynParamInt32,   &FDC_packet_limited);
+    createParam(FDC_predicted_fpsString,      asynParamFloat64,   &FDC_predicted_fps);
+    createParam(FDC_iso_policyString,           asynParamInt32,   &FDC_iso_policy);
+    createParam(FDC_iso_busString,              asynParamInt32,   &FDC_iso_bus);
+    createParam(FDC_iso_unitsString,            asynParamInt32,   &FDC_iso_units);
+    createParam(FDC_iso_shrunkString,           asynParamInt32,   &FDC_iso_shrunk);
+    createParam(FDC_iso_bus_useString,        asynParamFloat64,   &FDC_iso_bus_use);
+    createParam(FDC_iso_bus_camerasString,      asynParamInt32,   &FDC_iso_bus_cameras);
+    createParam(FDC_1394b_modeString,           asynParamInt32,   &FDC_1394b_mode);
+    createParam(FDC_1394bString,                asynParamInt32,   &FDC_1394b);
+    createParam(FDC_link_speedString,           asynParamInt32,   &FDC_link_speed);
+    createParam(FDC_iso_speedString,            asynParamInt32,   &FDC_iso_speed);
+    createParam(FDC_max_mbytesString,         asynParamFloat64,   &FDC_max_mbytes);
+    createParam(FDC_reactorString,              asynParamInt32,   &FDC_reactor);
+    createParam(FDC_grab_priorityString,        asynParamInt32,   &FDC_grab_priority);
+    createParam(FDC_grab_cpusString,            asynParamOctet,   &FDC_grab_cpus);
+    createParam(FDC_grab_cpuString,             asynParamInt32,   &FDC_grab_cpu);
+    createParam(FDC_grab_nodeString,            asynParamInt32,   &FDC_grab_node);
+    createParam(FDC_numa_buffersString,         asynParamInt32,   &FDC_numa_buffers);
+    createParam(FDC_wake_latencyString,         asynParamFloat64, &FDC_wake_latency);
+    createParam(FDC_wake_latency_maxString,     asynParamFloat64, &FDC_wake_latency_max);
+    createParam(FDC_convert_threadsString,      asynParamInt32,   &FDC_convert_threads);
+    createParam(FDC_convert_timeString,         asynParamFloat64, &FDC_convert_time);
+    createParam(FDC_demosaicString,             asynParamInt32,   &FDC_demosaic);
+    createParam(FDC_bayer_patternString,        asynParamInt32,   &FDC_bayer_pattern);
+    createParam(FDC_color_filterString,         asynParamInt32,   &FDC_color_filter);
+    createParam(FDC_data_bitsString,            asynParamInt32,   &FDC_data_bits);
+    createParam(FDC_data_depthString,           asynParamInt32,   &FDC_data_depth);
+    createParam(FDC_sent_alignString,           asynParamInt32,   &FDC_sent_align);
+    createParam(FDC_sample_alignString,         asynParamInt32,   &FDC_sample_align);
+    createParam(FDC_unused_bitsString,          asynParamInt32,   &FDC_unused_bits);
 
-    this->pCamera->GetCameraVendor(vendorName, sizeof(vendorName));
-    this->pCamera->GetCameraName(cameraName, sizeof(cameraName));
-    status =  setStringParam (ADManufacturer, vendorName);
-    status |= setStringParam (ADModel, cameraName);
-
-    // We would like to get the camera chip size, but there is really no way to do this.
-    // In Format 7 one can call 
-    // this->pCameraControlSize->GetSizeLimits(&maxSizeX, &maxSizeY);
-    // but even that just returns the largest size for that video mode, not for the entire chip. */
-    
     /* Create the start and stop event that will be used to signal our
      * image grabbing thread when to start/stop     */
-    printf("Creating EPICS events...                 ");
     this->startEventId = epicsEventCreate(epicsEventEmpty);
-    printf("OK\n");
+    this->pausedEventId = epicsEventCreate(epicsEventEmpty);
+    this->resumeEventId = epicsEventCreate(epicsEventEmpty);
 
-    status |= setIntegerParam(NDDataType, NDUInt8);
+    status =  setIntegerParam(NDDataType, NDUInt8);
     status |= setIntegerParam(ADImageMode, ADImageContinuous);
     status |= setIntegerParam(ADNumImages, 100);
-    printf("Creating Format 7 mode strings...                 ");
-    status |= this->formatFormat7Modes();
-    status |= this->formatValidModes();
-    status |= this->getAllFeatures();
-    if (status)
-    {
-         fprintf(stderr, "ERROR %s: unable to set camera parameters\n", functionName);
-    } else printf("OK\n");
+    status |= setIntegerParam(ADStatus, ADStatusInitializing);
+    status |= setStringParam (ADStatusMessage, "Initializing camera");
+    status |= setDoubleParam(FDC_reconfig_gap, 0.0);
+    status |= setIntegerParam(FDC_roi_move_latency, 0);
+    status |= setIntegerParam(FDC_init_state, FDCInitDiscovering);
+    status |= setIntegerParam(FDC_faults_injected, 0);
+    status |= setStringParam (FDC_rec_file, "");
+    status |= setIntegerParam(FDC_rec_enable, 0);
+    status |= setIntegerParam(FDC_rec_frames, 0);
+    status |= setIntegerParam(FDC_wd_enable, 1);
+    status |= setDoubleParam(FDC_wd_timeout, 0.0);
+    status |= setIntegerParam(FDC_wd_retries, 0);
+    status |= setIntegerParam(FDC_wd_restarts, 0);
+    status |= setIntegerParam(FDC_wd_reinits, 0);
+    status |= setDoubleParam(FDC_wd_downtime, 0.0);
+    status |= setDoubleParam(FDC_wd_last_downtime, 0.0);
+    status |= setIntegerParam(FDC_wd_reconnects, 0);
+    status |= setDoubleParam(FDC_wd_reconnect_time, 0.0);
+    status |= setIntegerParam(FDC_drain_policy, FDCDrainLatest);
+    status |= setDoubleParam(FDC_stall_tolerance, 1.0);
+    status |= setIntegerParam(FDC_dma_buffers, 0);
+    status |= setIntegerParam(FDC_backlog, 0);
+    status |= setIntegerParam(FDC_backlog_max, 0);
+    status |= setIntegerParam(FDC_dropped_frames, 0);
+    status |= setIntegerParam(FDC_dropped_stale, 0);
+    status |= setIntegerParam(FDC_dropped_overrun, 0);
+    status |= setIntegerParam(FDC_dma_depth, (dmaBuffers > 0) ? dmaBuffers : 0);
+    status |= setDoubleParam(FDC_dma_memory, DEFAULT_DMA_MEMORY);
+    status |= setDoubleParam(FDC_dma_peak, 0.0);
+    status |= setIntegerParam(FDC_pool_policy, FDCPoolDrop);
+    status |= setDoubleParam(FDC_pool_timeout, 0.1);
+    status |= setIntegerParam(FDC_pool_drops, 0);
+    status |= setIntegerParam(FDC_pool_waits, 0);
+    status |= setIntegerParam(FDC_pool_reclaims, 0);
+    status |= setIntegerParam(FDC_pool_buffers, 0);
+    status |= setIntegerParam(FDC_pool_free, 0);
+    status |= setDoubleParam(FDC_pool_memory, 0.0);
+    status |= setDoubleParam(FDC_pool_memory_use, 0.0);
+    status |= setIntegerParam(FDC_publish_auto, 0);
+    status |= setIntegerParam(FDC_publish_decimation, 1);
+    status |= setIntegerParam(FDC_publish_max_decim, 16);
+    status |= setIntegerParam(FDC_publish_held_max, 4);
+    status |= setIntegerParam(FDC_publish_held, 0);
+    status |= setIntegerParam(FDC_publish_slow, 0);
+    status |= setIntegerParam(FDC_publish_skipped, 0);
+    status |= setDoubleParam(FDC_publish_rate, 0.0);
+    status |= setIntegerParam(FDC_frames_captured, 0);
+    status |= setDoubleParam(FDC_capture_rate, 0.0);
+    status |= setIntegerParam(FDC_packet_mode, FDCPacketPlanned);
+    status |= setIntegerParam(FDC_packet_size, 0);
+    status |= setIntegerParam(FDC_packets_per_frame, 0);
+    status |= setIntegerParam(FDC_packet_limited, 0);
+    status |= setDoubleParam(FDC_predicted_fps, 0.0);
+    status |= setIntegerParam(FDC_iso_policy, FDCIsoShrink);
+    status |= setIntegerParam(FDC_iso_bus, 0);
+    status |= setIntegerParam(FDC_iso_units, 0);
+    status |= setIntegerParam(FDC_iso_shrunk, 0);
+    status |= setDoubleParam(FDC_iso_bus_use, 0.0);
+    status |= setIntegerParam(FDC_iso_bus_cameras, 0);
+    status |= setIntegerParam(FDC_1394b_mode, FDC1394bAuto);
+    status |= setIntegerParam(FDC_1394b, 0);
+    status |= setIntegerParam(FDC_link_speed, 0);
+    status |= setIntegerParam(FDC_iso_speed, 0);
+    status |= setDoubleParam(FDC_max_mbytes, 0.0);
+    status |= setIntegerParam(FDC_grab_priority, epicsThreadPriorityMedium);
+    status |= setStringParam (FDC_grab_cpus, "");
+    status |= setIntegerParam(FDC_grab_cpu, -1);
+    status |= setIntegerParam(FDC_grab_node, -1);
+    status |= setIntegerParam(FDC_numa_buffers, 1);
+    status |= setDoubleParam(FDC_wake_latency, 0.0);
+    status |= setDoubleParam(FDC_wake_latency_max, 0.0);
+    status |= setIntegerParam(FDC_convert_threads, 0);
+    status |= setDoubleParam(FDC_convert_time, 0.0);
+    status |= setIntegerParam(FDC_demosaic, FDCDemosaicOff);
+    status |= setIntegerParam(FDC_bayer_pattern, 0);
+    status |= setIntegerParam(FDC_color_filter, 0);
+    status |= setIntegerParam(FDC_data_bits, 0);
+    status |= setIntegerParam(FDC_data_depth, 0);
+    status |= setIntegerParam(FDC_sent_align, 0);
+    status |= setIntegerParam(FDC_sample_align, FDCAlignAsSent);
+    status |= setIntegerParam(FDC_unused_bits, 0);
+    status |= setDoubleParam(FDC_init_enum_time, 0.0);
+    status |= setDoubleParam(FDC_init_open_time, 0.0);
+    status |= setDoubleParam(FDC_init_probe_time, 0.0);
+    callParamCallbacks();
 
-    /* Start up acquisition thread */
-    printf("Starting up image grabbing task...     ");
+    /* Without a strip job the frames are converted by the grab thread alone */
+    this->pStripJob = fdcStripJobCreate();
+    if (!this->pStripJob) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s unable to create the strip job, frames are converted by one thread\n",
+            driverName, functionName);
+    }
+
+    /* With the grab reactor the thread only initializes the camera, the reactor grabs the frames */
+    this->pReactorCamera = fdcReactorAdd(portName, reactorServiceC, this);
+    setIntegerParam(FDC_reactor, this->pReactorCamera ? 1 : 0);
+    callParamCallbacks();
+
+    /* Start up acquisition thread. It initializes the camera before it waits for acquire. */
     status = (epicsThreadCreate("imageGrabTask",
             epicsThreadPriorityMedium,
             epicsThreadGetStackSize(epicsThreadStackMedium),
@@ -448,131 +1092,497 @@ FirewireWinDCAM::FirewireWinDCAM(    const char *portName, const char* camid,
         printf("%s:%s epicsThreadCreate failure for image task\n",
                 driverName, functionName);
         return;
-    } else printf("OK\n");
-    printf("Configuration complete!\n");
+    }
     return;
 }
 
+/** Finds, opens and probes the camera.
+ * Called from the image grabbing thread before it enters its acquisition loop; the state and
+ * the time spent in each phase are reported in FDC_INIT_STATE and FDC_INIT_*_TIME.
+ * The lock is only held while the parameter library is updated, so the port thread can queue
+ * writes while the bus is enumerated and the camera opened. Enumeration itself is serialized
+ * between cameras, opening and probing run in parallel.
+ * \return asynSuccess when the camera is ready, asynError if it could not be found or opened.
+ */
+asynStatus FirewireWinDCAM::initCamera()
+{
+    const char *functionName = "initCamera";
+    char vendorName[256], cameraName[256];
+    unsigned long long uniqueId;
+    unsigned long long int camUID = 0;
+    int err;
+    int numCameras;
+    unsigned long generation;
+    double scanTime;
+    int i, status, bus = 0;
+    epicsTimeStamp t0, t1;
+    double enumTime, openTime, probeTime;
+
+    epicsTimeGetCurrent(&t0);
+    /* parse the cameras unique ID. If this string is not specified then we just use the first camera found */
+    status = fdcParseGuid(this->camid, &camUID) ? asynError : asynSuccess;
+    if (status) {
+        fprintf(stderr,"### ERROR ### [%s] Invalid camera ID: \"%s\"\n", this->portName, this->camid);
+    } else {
+        status = this->openCamera(camUID, &bus);
+    }
+    fdcEnumGetStats(&numCameras, &scanTime, &generation);
+    epicsTimeGetCurrent(&t1);
+    this->lock();
+    enumTime = epicsTimeDiffInSeconds(&t1, &t0);
+    setDoubleParam(FDC_init_enum_time, enumTime);
+    setIntegerParam(FDC_bus_cameras, numCameras);
+    setDoubleParam(FDC_bus_scan_time, scanTime);
+    if (status) goto failed;
+    /* The bus found by the scan is the default, a write to FDC_ISO_BUS queued meanwhile overrides it */
+    setIntegerParam(FDC_iso_bus, bus);
+
+    /* Open the camera */
+    this->initState = FDCInitOpening;
+    setIntegerParam(FDC_init_state, FDCInitOpening);
+    callParamCallbacks();
+    this->unlock();
+    t0 = t1;
+    err = this->pCamera->InitCamera(1);
+    status = PERR(err);
+    /* The camera can not be asked for anything if it could not be initialized */
+    if (status) {
+        this->lock();
+        goto failed;
+    }
+    this->pCameraControlSize = this->pCamera->GetCameraControlSize();
+    this->pCameraControl = (FDCCameraControl **)malloc(num1394Features * sizeof(pCameraControl[0]));
+    for (i=0; i<num1394Features; i++) {
+        this->pCameraControl[i] = this->pCamera->GetCameraControl(featureIndex[i]);
+    }
+    this->pCamera->GetCameraVendor(vendorName, sizeof(vendorName));
+    this->pCamera->GetCameraName(cameraName, sizeof(cameraName));
+    this->pCamera->GetCameraUniqueID(&uniqueId);
+    epicsTimeGetCurrent(&t1);
+    this->lock();
+    openTime = epicsTimeDiffInSeconds(&t1, &t0);
+    setDoubleParam(FDC_init_open_time, openTime);
+    setStringParam (ADManufacturer, vendorName);
+    setStringParam (ADModel, cameraName);
+
+    // We would like to get the camera chip size, but there is really no way to do this.
+    // In Format 7 one can call 
+    // this->pCameraControlSize->GetSizeLimits(&maxSizeX, &maxSizeY);
+    // but even that just returns the largest size for that video mode, not for the entire chip. */
+
+    /* Read the capabilities and current settings. This updates many parameters so the lock is
+     * held, writes from the port thread are queued because the camera is not ready yet. */
+    this->initState = FDCInitProbing;
+    setIntegerParam(FDC_init_state, FDCInitProbing);
+    callParamCallbacks();
+    t0 = t1;
+    /* The Format 7 packet sizes the camera offers depend on the speed, so this comes first */
+    if (this->negotiateSpeed()) {
+        fprintf(stderr, "ERROR %s::%s [%s]: unable to set the 1394b mode, using S%d\n",
+            driverName, functionName, this->portName, this->isoSpeed);
+    }
+    status  = this->loadCapabilities(capCacheForceRefresh);
+    status |= this->formatValidModes();
+    status |= this->getAllFeatures();
+    if (status) {
+         fprintf(stderr, "ERROR %s::%s [%s]: unable to set camera parameters\n", 
+            driverName, functionName, this->portName);
+    }
+    epicsTimeGetCurrent(&t1);
+    probeTime = epicsTimeDiffInSeconds(&t1, &t0);
+    setDoubleParam(FDC_init_probe_time, probeTime);
+
+    this->initState = FDCInitReady;
+    setIntegerParam(FDC_init_state, FDCInitReady);
+    setIntegerParam(ADStatus, ADStatusIdle);
+    setStringParam (ADStatusMessage, "");
+    printf("%s::%s [%s]: %s %s (0x%16.16llX) ready, enumerate %.3f s, open %.3f s, probe %.3f s\n",
+        driverName, functionName, this->portName, vendorName, cameraName, uniqueId,
+        enumTime, openTime, probeTime);
+    this->applyPendingWrites();
+    callParamCallbacks();
+    this->unlock();
+    return asynSuccess;
+
+    failed:
+    this->initState = FDCInitFailed;
+    setIntegerParam(FDC_init_state, FDCInitFailed);
+    setIntegerParam(ADStatus, ADStatusError);
+    setStringParam (ADStatusMessage, "Camera not found or could not be opened");
+    /* Writes queued so far can not be applied */
+    this->numPendingWrites = 0;
+    callParamCallbacks();
+    this->unlock();
+    return asynError;
+}
+
+/** Opens the camera with a given GUID into pCamera.
+ * The camera is looked up in the shared enumeration index. If the camera opened turns out to
+ * have a different GUID the nodes have been renumbered by a bus reset since the last scan, so the
+ * index is invalidated and the lookup done once more. Called without the lock, so it does not
+ * touch the parameter library.
+ * \param[in] guid The camera GUID, 0 for the first camera found.
+ * \param[out] pBus The bus the camera was found on.
+ */
+asynStatus FirewireWinDCAM::openCamera(unsigned long long guid, int *pBus)
+{
+    const char *functionName = "openCamera";
+    FDCCameraInfo info;
+    unsigned long long uniqueId;
+    int retry;
+
+    for (retry=0; retry<2; retry++) {
+        if (fdcEnumFind(guid, &info)) {
+            /* Show how the camera ID was read, a mistyped ID matches no camera */
+            fprintf(stderr,"### ERROR ### [%s] Did not find camera \"%s\", read as GUID 0x%16.16llX\n", 
+                this->portName, this->camid, guid);
+            return asynError;
+        }
+        this->pCamera = info.pBackend->open(&info);
+        if (this->pCamera) {
+            this->pCamera->GetCameraUniqueID(&uniqueId);
+            if (uniqueId == info.guid) {
+                this->guid = info.guid;
+                *pBus = info.bus;
+                this->pCamera = fdcFaultWrap(info.guid, this->pCamera);
+                asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                    "%s::%s [%s]: opened %s camera 0x%16.16llX on node %d\n",
+                    driverName, functionName, this->portName, info.pBackend->name, info.guid, info.node);
+                return asynSuccess;
+            }
+            delete this->pCamera;
+            this->pCamera = NULL;
+        }
+        fdcEnumInvalidate();
+    }
+    fprintf(stderr,"### ERROR ### [%s] Camera with GUID 0x%16.16llX not found on node %d\n", 
+        this->portName, info.guid, info.node);
+    return asynError;
+}
+
+/** Queues a write received before the camera is ready.
+ * A later write to the same record replaces the queued value, so the queue holds at most one
+ * entry per record and the writes are applied in the order the records were first written.
+ * The value is also set in the parameter library so the readbacks follow the request.
+ * \param[in] pasynUser The asynUser of the record; its reason and address do not change.
+ * \param[in] isFloat 1 for a writeFloat64, 0 for a writeInt32.
+ * \param[in] ival The value of a writeInt32.
+ * \param[in] dval The value of a writeFloat64.
+ */
+asynStatus FirewireWinDCAM::queueWrite(asynUser *pasynUser, int isFloat, epicsInt32 ival, epicsFloat64 dval)
+{
+    const char *functionName = "queueWrite";
+    int i, addr;
+
+    if (this->initState == FDCInitFailed) {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, 
+            "%s::%s ERROR [%s]: camera initialization failed, write rejected\n",
+            driverName, functionName, this->portName);
+        return asynError;
+    }
+    for (i=0; i<this->numPendingWrites; i++) {
+        if (this->pendingWrites[i].pasynUser == pasynUser) break;
+    }
+    if (i == MAX_PENDING_WRITES) {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, 
+            "%s::%s ERROR [%s]: too many writes before the camera is ready, write rejected\n",
+            driverName, functionName, this->portName);
+        return asynError;
+    }
+    if (i == this->numPendingWrites) this->numPendingWrites++;
+    this->pendingWrites[i].pasynUser = pasynUser;
+    this->pendingWrites[i].isFloat = isFloat;
+    this->pendingWrites[i].ival = ival;
+    this->pendingWrites[i].dval = dval;
+
+    pasynManager->getAddr(pasynUser, &addr);
+    if (addr < 0) addr=0;
+    if (isFloat) setDoubleParam(addr, pasynUser->reason, dval);
+    else         setIntegerParam(addr, pasynUser->reason, ival);
+    callParamCallbacks(addr, addr);
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, 
+        "%s::%s [%s]: function=%d queued until the camera is ready\n",
+        driverName, functionName, this->portName, pasynUser->reason);
+    /* A lost camera that is no longer looked for is looked for again, see lostStep() */
+    if (this->cameraLost) {
+        if (this->pReactorCamera) this->startReconnect();
+        else epicsEventSignal(this->startEventId);
+    }
+    return asynSuccess;
+}
+
+/** Applies the writes queued while the camera was initializing. Called with the lock held. */
+void FirewireWinDCAM::applyPendingWrites()
+{
+    int i, acquire;
+    int numWrites = this->numPendingWrites;
+
+    this->numPendingWrites = 0;
+    for (i=0; i<numWrites; i++) {
+        if (this->pendingWrites[i].isFloat)
+            this->writeFloat64(this->pendingWrites[i].pasynUser, this->pendingWrites[i].dval);
+        else
+            this->writeInt32(this->pendingWrites[i].pasynUser, this->pendingWrites[i].ival);
+    }
+    /* If acquisition was started the grab loop will see ADAcquire=1 directly, so the start
+     * event must not be left signalled for the next time it waits */
+    getIntegerParam(ADAcquire, &acquire);
+    if (acquire) {
+        epicsEventTryWait(this->startEventId);
+        setIntegerParam(ADNumImagesCounter, 0);
+    }
+}
+
+/** Returns 1 if a parameter needs the camera, so a write to it must be queued until the camera is ready */
+int FirewireWinDCAM::needsCamera(int function)
+{
+    return ((function >= FIRST_FDC_PARAM) ||
+            (function == ADAcquire)       ||
+            (function == ADAcquireTime)   ||
+            (function == ADAcquirePeriod) ||
+            (function == ADMinX)  || (function == ADMinY) ||
+            (function == ADSizeX) || (function == ADSizeY));
+}
+
 
 /** Task to grab images off the camera and send them up to areaDetector
  *
+ * When the grab reactor is configured this thread only initializes the camera; from then on the
+ * grab steps are run by the reactor workers, see reactorService().
  */
 void FirewireWinDCAM::imageGrabTask()
+{
+    /* Find and open the camera. If that fails there is nothing for this thread to do. */
+    if (this->initCamera() != asynSuccess) return;
+
+    if (this->pReactorCamera) {
+        fdcReactorWake(this->pReactorCamera);
+        return;
+    }
+    this->lock();
+    while (1) /* ... round and round and round we go ... */
+    {
+        this->grabStep(1);
+    }
+}
+
+/** Runs one grab step of the camera for the grab reactor, in one of its worker threads.
+ * \param[in] timedOut No frame arrived within the frame timeout; AcquireImageEx() is not called.
+ * \param[out] pArm How the reactor waits for the camera next.
+ */
+void FirewireWinDCAM::reactorService(int timedOut, FDCReactorArm *pArm)
+{
+    this->lock();
+    this->reactorTimedOut = timedOut;
+    pArm->park = this->grabStep(0);
+    this->reactorTimedOut = 0;
+    pArm->pCamera = this->pCamera;
+    pArm->timeout = this->msTimeout / 1000.;
+    this->unlock();
+}
+
+/** One pass of the acquisition loop: waits for and publishes one frame, or handles a start, a stop,
+ * a reconfiguration or a failure. Called with the driver locked.
+ * \param[in] blocking 1 in the thread of the camera, which waits here for acquisition to start and
+ *            for a reconfiguration to finish. 0 in the grab reactor, where the step returns instead and
+ *            the camera is serviced again after fdcReactorWake().
+ * \return 1 if the camera waits for fdcReactorWake(), 0 if it waits for its next frame.
+ */
+int FirewireWinDCAM::grabStep(int blocking)
 {
     int status = asynSuccess;
     int imageCounter;
     int numImages, numImagesCounter;
     int imageMode;
     int arrayCallbacks;
-    epicsTimeStamp startTime;
+    epicsTimeStamp startTime, frameTime;
+    epicsTimeStamp callbackStart, callbackEnd;
     int acquire;
-    const char *functionName = "imageGrabTask";
-
-    printf("FirewireWinDCAM::imageGrabTask: Got the image grabbing thread started!\n");
-
-    this->lock();
+    int wdEnable;
+    const char *functionName = "grabStep";
 
-    while (1) /* ... round and round and round we go ... */
-    {
-        /* Is acquisition active? */
-        getIntegerParam(ADAcquire, &acquire);
+    /* Move the grab thread as configured before it waits for anything. A reactor worker may
+     * have run the grab step of another camera since, and is moved back. */
+    if (this->schedPending) this->applySchedule();
+    else if (this->pReactorCamera) fdcSchedApply(this->grabPriority, this->grabMask);
 
-        /* If we are not acquiring then wait for a semaphore that is given when acquisition is started */
-        if (!acquire)
-        {
-            setIntegerParam(ADStatus, ADStatusIdle);
-            callParamCallbacks();
+    /* A camera that has left the bus is looked for until it is back */
+    if (this->cameraLost) return this->lostStep(blocking);
 
-            /* Wait for a signal that tells this thread that the transmission
-             * has started and we can start asking for image buffers...     */
-            asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
-                "%s::%s [%s]: waiting for acquire to start\n", 
-                driverName, functionName, this->portName);
-            /* Release the lock while we wait for an event that says acquire has started, then lock again */
-            this->unlock();
-            status = epicsEventWait(this->startEventId);
-            this->lock();
-            asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
-                "%s::%s [%s]: started!\n", 
-                driverName, functionName, this->portName);
-            setIntegerParam(ADNumImagesCounter, 0);
-            setIntegerParam(ADAcquire, 1);
-        }
+    /* Is acquisition active? */
+    getIntegerParam(ADAcquire, &acquire);
 
-        /* Get the current time */
-        epicsTimeGetCurrent(&startTime);
-        /* We are now waiting for an image  */
-        setIntegerParam(ADStatus, ADStatusWaiting);
-        /* Call the callbacks to update any changes */
+    /* If we are not acquiring then wait for a semaphore that is given when acquisition is started */
+    if (!acquire)
+    {
+        this->updatePoolStats();
+        this->updateBusUsage();
+        setIntegerParam(ADStatus, ADStatusIdle);
         callParamCallbacks();
 
-        status = this->grabImage();        /* #### GET THE IMAGE FROM CAMERA HERE! ##### */
-        if (status == asynError)         /* check for error */
-        {
-            /* remember to release the NDArray back to the pool now
-             * that we are not using it (we didn't get an image...) */
-            if(this->pRaw) this->pRaw->release();
-            /* We abort if we had some problem with grabbing an image...
-             * This is perhaps not always the desired behaviour but it'll do for now. */
-            setIntegerParam(ADStatus, ADStatusAborting);
-            setIntegerParam(ADAcquire, 0);
-            continue;
-        }
+        /* In the reactor the camera is parked until startCapture() wakes it */
+        this->grabIdle = 1;
+        if (!blocking) return 1;
 
-        /* Set a bit of image/frame statistics... */
-        getIntegerParam(NDArrayCounter, &imageCounter);
-        getIntegerParam(ADNumImages, &numImages);
-        getIntegerParam(ADNumImagesCounter, &numImagesCounter);
-        getIntegerParam(ADImageMode, &imageMode);
-        getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
-        imageCounter++;
-        numImagesCounter++;
-        setIntegerParam(NDArrayCounter, imageCounter);
-        setIntegerParam(ADNumImagesCounter, numImagesCounter);
-        /* Put the frame number into the buffer */
-        this->pRaw->uniqueId = imageCounter;
-        /* Set a timestamp in the buffer */
-        this->pRaw->timeStamp = startTime.secPastEpoch + startTime.nsec / 1.e9;
-        updateTimeStamp(&this->pRaw->epicsTS);
+        /* Wait for a signal that tells this thread that the transmission
+         * has started and we can start asking for image buffers...     */
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+            "%s::%s [%s]: waiting for acquire to start\n", 
+            driverName, functionName, this->portName);
+        /* Release the lock while we wait for an event that says acquire has started, then lock again */
+        this->unlock();
+        status = epicsEventWait(this->startEventId);
+        this->lock();
+    }
+    if (this->grabIdle)
+    {
+        this->grabIdle = 0;
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+            "%s::%s [%s]: started!\n", 
+            driverName, functionName, this->portName);
+        setIntegerParam(ADNumImagesCounter, 0);
+        setIntegerParam(ADAcquire, 1);
+        epicsTimeGetCurrent(&this->lastFrameTime);
+        this->wdFailures = 0;
+        setIntegerParam(FDC_backlog_max, 0);
+        setDoubleParam(FDC_dma_peak, 0.0);
+        setIntegerParam(FDC_frames_captured, 0);
+        setIntegerParam(FDC_publish_skipped, 0);
+        setIntegerParam(FDC_publish_slow, 0);
+        setDoubleParam(FDC_wake_latency_max, 0.0);
+        this->publishPhase = 0;
+        this->publishWindow = 0;
+        this->publishSlowInWindow = 0;
+        this->publishHeldInWindow = 0;
+        this->publishCalmWindows = 0;
+        this->rateStart = this->lastFrameTime;
+        this->rateCaptured = 0;
+        this->ratePublished = 0;
+    }
 
-        /* Get any attributes that have been defined for this driver */        
-        this->getAttributes(this->pRaw->pAttributeList);
+    /* If the port thread wants to reconfigure the camera while we are acquiring then
+     * stop the stream, hand over to the port thread and wait until it has restarted the stream */
+    if (this->reconfigPending)
+    {
+        this->reconfigPending = 0;
+        this->stopCapture();
+        this->capturePaused = 1;
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+            "%s::%s [%s]: stream stopped for reconfiguration\n", 
+            driverName, functionName, this->portName);
+        epicsEventSignal(this->pausedEventId);
+        /* In the reactor resumeCapture() clears capturePaused and wakes the camera */
+        if (!blocking) return 1;
+        this->unlock();
+        epicsEventWait(this->resumeEventId);
+        this->lock();
+        this->capturePaused = 0;
+        /* Acquisition may have been turned off if the stream could not be restarted */
+        return 0;
+    }
 
-        /* Call the callbacks to update any changes */
-        callParamCallbacks();
+    /* Get the current time */
+    epicsTimeGetCurrent(&startTime);
+    /* We are now waiting for an image  */
+    setIntegerParam(ADStatus, ADStatusWaiting);
+    /* Call the callbacks to update any changes */
+    callParamCallbacks();
 
-        if (arrayCallbacks)
-        {
-            /* Call the NDArray callback */
-            doCallbacksGenericPointer(this->pRaw, NDArrayData, 0);
-        }
-        /* Release the NDArray buffer now that we are done with it.
-         * After the callback just above we don't need it anymore */
-        this->pRaw->release();
+    status = this->grabImage();        /* #### GET THE IMAGE FROM CAMERA HERE! ##### */
+    setIntegerParam(FDC_faults_injected, (int)fdcFaultCount(this->guid));
+    if (status == asynError)         /* check for error */
+    {
+        /* remember to release the NDArray back to the pool now
+         * that we are not using it (we didn't get an image...) */
+        if(this->pRaw) this->pRaw->release();
         this->pRaw = NULL;
-
-        /* See if acquisition is done if we are in single or multiple mode */
-        if ((imageMode == ADImageSingle) || ((imageMode == ADImageMultiple) && (numImagesCounter >= numImages)))
-        {
-            /* command the camera to stop acquiring.. */
-            setIntegerParam(ADAcquire, 0);
-        }
+        /* If no frame arrived the watchdog tries to get the stream going again. Other errors,
+         * and any error with the watchdog disabled, abort the acquisition. */
+        getIntegerParam(FDC_wd_enable, &wdEnable);
         getIntegerParam(ADAcquire, &acquire);
-        if (!acquire)
-        {
-            /* Acquisition has been turned off.  This could be because it was done by setting ADAcquire=0 from CA, or
-             * because the requested number of frames is done, or because of an error.  Stop capture. */
-            status = this->stopCapture();
-            if (status == asynError)
-            {
-                asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
-                    "%s::%s [%s] Stopping transmission failed...\n",
-                    driverName, functionName, this->portName);
-            }
+        if (this->acquireFailed && acquire && wdEnable) {
+            this->recoverStream();
+            if (this->cameraLost) return this->lostStep(blocking);
+            /* Acquisition may have been stopped while the camera was being re-initialized */
+            getIntegerParam(ADAcquire, &acquire);
+            if (!acquire) this->stopCapture();
             callParamCallbacks();
+            return 0;
         }
-    }/* back to the top... */
-    return;
+        if (acquire) setIntegerParam(ADStatus, ADStatusAborting);
+        setIntegerParam(ADAcquire, 0);
+        this->stopCapture();
+        return 0;
+    }
+
+    epicsTimeGetCurrent(&frameTime);
+    if (this->wdFailures > 0) this->streamRecovered(&frameTime);
+    /* If this is the first frame after a reconfiguration report how long the stream was interrupted */
+    if (this->gapPending) {
+        setDoubleParam(FDC_reconfig_gap, epicsTimeDiffInSeconds(&frameTime, &this->lastFrameTime));
+        this->gapPending = 0;
+    }
+    this->lastFrameTime = frameTime;
+    this->countCapturedFrame(&frameTime);
+    /* The frame was not published because of the decimation, or because there was no NDArray for it */
+    if (!this->pRaw) return 0;
+
+    /* Set a bit of image/frame statistics... */
+    getIntegerParam(NDArrayCounter, &imageCounter);
+    getIntegerParam(ADNumImages, &numImages);
+    getIntegerParam(ADNumImagesCounter, &numImagesCounter);
+    getIntegerParam(ADImageMode, &imageMode);
+    getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
+    imageCounter++;
+    numImagesCounter++;
+    setIntegerParam(NDArrayCounter, imageCounter);
+    setIntegerParam(ADNumImagesCounter, numImagesCounter);
+    /* Put the frame number into the buffer */
+    this->pRaw->uniqueId = imageCounter;
+    /* Set a timestamp in the buffer */
+    this->pRaw->timeStamp = startTime.secPastEpoch + startTime.nsec / 1.e9;
+    updateTimeStamp(&this->pRaw->epicsTS);
+
+    /* Get any attributes that have been defined for this driver */        
+    this->getAttributes(this->pRaw->pAttributeList);
+
+    /* Call the callbacks to update any changes */
+    callParamCallbacks();
+
+    epicsTimeGetCurrent(&callbackStart);
+    if (arrayCallbacks)
+    {
+        /* Call the NDArray callback */
+        doCallbacksGenericPointer(this->pRaw, NDArrayData, 0);
+    }
+    /* Release the NDArray buffer now that we are done with it.
+     * After the callback just above we don't need it anymore */
+    this->pRaw->release();
+    this->pRaw = NULL;
+    epicsTimeGetCurrent(&callbackEnd);
+    this->updatePublishRate(epicsTimeDiffInSeconds(&callbackEnd, &callbackStart));
+
+    /* See if acquisition is done if we are in single or multiple mode */
+    if ((imageMode == ADImageSingle) || ((imageMode == ADImageMultiple) && (numImagesCounter >= numImages)))
+    {
+        /* command the camera to stop acquiring.. */
+        setIntegerParam(ADAcquire, 0);
+    }
+    getIntegerParam(ADAcquire, &acquire);
+    if (!acquire)
+    {
+        /* Acquisition has been turned off.  This could be because it was done by setting ADAcquire=0 from CA, or
+         * because the requested number of frames is done, or because of an error.  Stop capture. */
+        status = this->stopCapture();
+        if (status == asynError)
+        {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s::%s [%s] Stopping transmission failed...\n",
+                driverName, functionName, this->portName);
+        }
+        callParamCallbacks();
+    }
+    return 0;
 }
 
 /** Grabs one image off the dc1394 queue, notifies areaDetector about it and
@@ -584,73 +1594,108 @@ int FirewireWinDCAM::grabImage()
     int status = asynSuccess;
     NDDataType_t dataType;
     size_t dims[3];
+    size_t arrayBytes;
     int err;
     unsigned long lsizeX, lsizeY;
     unsigned short sizeX, sizeY;
-    unsigned long dataLength;
+    FDCSegment segments[FDC_MAX_SEGMENTS];
+    int numSegments;
     unsigned short depth;
     int format, mode;
     int bytesPerColor;
     int numColors;
     int ndims;
     int droppedFrames, newDroppedFrames;
-    NDColorMode_t colorMode;
-    COLOR_CODE colorCode;
-    unsigned char * pTmpData;
+    int policy;
+    NDColorMode_t colorMode, paramColorMode;
+    FDCColorCode colorCode;
+    FDCColorFilter filter = FDC_COLOR_FILTER_NONE;
+    int demosaic, pattern;
+    int bits, sentAlign, sampleAlign, clamp;
+    FDCSampleFormat sampleFormat, *pFormat = NULL;
     int unsupportedFormat = 0;
+    int roiMinX, roiMinY;
+    epicsTimeStamp waitStart, frameTime, convertStart, convertEnd;
+    unsigned long cycleTime;
+    double cycleSeconds, wakeDelay;
+    int packets, bus, backlog;
+    int threads;
     const char* functionName = "grabImage";
 
+    /* The latest-only policy lets the driver discard all but the newest queued frame */
+    getIntegerParam(FDC_drain_policy, &policy);
     /* unlock the driver while we wait for a new image to be ready */
     this->unlock();
-    err = this->pCamera->AcquireImageEx(TRUE, &newDroppedFrames);
+    epicsTimeGetCurrent(&waitStart);
+    /* The grab reactor has already waited the frame timeout for this camera */
+    if (this->reactorTimedOut) err = FDC_CAM_ERROR_FRAME_TIMEOUT;
+    else err = this->pCamera->AcquireImageEx(policy != FDCDrainLossless, &newDroppedFrames);
     this->lock();
     status = PERR(err);
+    this->acquireFailed = (status != asynSuccess);
     if (status) return status;   /* if we didn't get an image properly... */
 
+    /* Work out the ROI origin of this frame and apply any pending position change before the next one */
+    epicsTimeGetCurrent(&frameTime);
+    this->updateFormat7Position(&frameTime);
+    backlog = this->updateBacklog(policy, &waitStart, &frameTime, newDroppedFrames);
+    wakeDelay = this->updateWakeLatency(&waitStart, &frameTime, newDroppedFrames);
+
     getIntegerParam(FDC_dropped_frames, &droppedFrames);
     droppedFrames += newDroppedFrames;
     setIntegerParam(FDC_dropped_frames, droppedFrames);
+    /* Frames skipped to get to the newest are the price of the latest-only policy, in lossless
+     * mode frames are only lost when the ring overflows */
+    if (policy == FDCDrainLossless) {
+        getIntegerParam(FDC_dropped_overrun, &droppedFrames);
+        setIntegerParam(FDC_dropped_overrun, droppedFrames + newDroppedFrames);
+        this->acqOverruns += newDroppedFrames;
+    } else {
+        getIntegerParam(FDC_dropped_stale, &droppedFrames);
+        setIntegerParam(FDC_dropped_stale, droppedFrames + newDroppedFrames);
+    }
     
     /* Get the current video format */
     format = this->pCamera->GetVideoFormat();
 
     /* Get the size of the frame */
+    mode = this->pCamera->GetVideoMode();
     if (format == 7) {
         this->pCameraControlSize->GetSize(&sizeX, &sizeY);
         this->pCameraControlSize->GetDataDepth(&depth);
         this->pCameraControlSize->GetColorCode(&colorCode);
         switch (colorCode) {
-            case COLOR_CODE_Y8:
-            case COLOR_CODE_RAW8:
+            case FDC_COLOR_CODE_Y8:
+            case FDC_COLOR_CODE_RAW8:
                 numColors = 1;
                 bytesPerColor = 1;
                 dataType = NDUInt8;
                 break;
-            case COLOR_CODE_Y16:
-            case COLOR_CODE_RAW16:
+            case FDC_COLOR_CODE_Y16:
+            case FDC_COLOR_CODE_RAW16:
                 numColors = 1;
                 bytesPerColor = 2;
                 dataType = NDUInt16;
                 break;
-            case COLOR_CODE_Y16_SIGNED:
+            case FDC_COLOR_CODE_Y16_SIGNED:
                 numColors = 1;
                 bytesPerColor = 2;
                 dataType = NDInt16;
                 break;
-            case COLOR_CODE_YUV411:
-            case COLOR_CODE_YUV422:
-            case COLOR_CODE_YUV444:
-            case COLOR_CODE_RGB8:
+            case FDC_COLOR_CODE_YUV411:
+            case FDC_COLOR_CODE_YUV422:
+            case FDC_COLOR_CODE_YUV444:
+            case FDC_COLOR_CODE_RGB8:
                 numColors = 3;
                 bytesPerColor = 1;
                 dataType = NDUInt8;
                 break;
-            case COLOR_CODE_RGB16:
+            case FDC_COLOR_CODE_RGB16:
                 numColors = 3;
                 bytesPerColor = 2;
                 dataType = NDUInt8;
                 break;
-            case COLOR_CODE_RGB16_SIGNED:
+            case FDC_COLOR_CODE_RGB16_SIGNED:
                 numColors = 3;
                 bytesPerColor = 2;
                 dataType = NDInt8;
@@ -664,7 +1709,7 @@ int FirewireWinDCAM::grabImage()
         sizeX = (unsigned short)lsizeX;
         sizeY = (unsigned short)lsizeY;
         this->pCamera->GetVideoDataDepth(&depth);
-        mode = this->pCamera->GetVideoMode();
+        fdcColorCodeForMode(format, mode, &colorCode);
         switch (format) {
             case 0:
                 switch (mode) {
@@ -737,19 +1782,54 @@ int FirewireWinDCAM::grabImage()
             driverName, functionName, format, mode);
         return(asynError);
     }
+
+    if (this->pRecord) this->recordFrame(format, mode, colorCode, depth, sizeX, sizeY, newDroppedFrames, &frameTime);
     
     setIntegerParam(NDArraySizeX, sizeX);
     setIntegerParam(NDArraySizeY, sizeY);
     setIntegerParam(NDDataType, dataType);
+
+    /* Raw frames have the color filter the camera reports, unless FDC_BAYER_PATTERN sets one */
+    if ((format == 7) && ((colorCode == FDC_COLOR_CODE_RAW8) || (colorCode == FDC_COLOR_CODE_RAW16)))
+        this->pCameraControlSize->GetColorFilter(&filter);
+    setIntegerParam(FDC_color_filter, filter + 1);
+    getIntegerParam(FDC_bayer_pattern, &pattern);
+    if ((pattern > 0) && (pattern <= FDC_COLOR_FILTER_MAX)) filter = (FDCColorFilter)(pattern - 1);
+
+    /* Raw frames, and mono frames whose color mode is set to Bayer, are demosaiced if asked to */
+    getIntegerParam(NDColorMode, (int *)&paramColorMode);
+    getIntegerParam(FDC_demosaic, &demosaic);
+    if ((numColors != 1) || (dataType == NDInt16) || (filter == FDC_COLOR_FILTER_NONE) ||
+        ((colorCode != FDC_COLOR_CODE_RAW8) && (colorCode != FDC_COLOR_CODE_RAW16) &&
+         (paramColorMode != NDColorModeBayer)) ||
+        (sizeX < FDC_BAYER_MIN_SIZE) || (sizeY < FDC_BAYER_MIN_SIZE)) demosaic = FDCDemosaicOff;
+    if (demosaic != FDCDemosaicOff) numColors = 3;
+
+    /* The significant bits of unsigned 16-bit samples are moved and the others cleared by the
+     * pass that swaps their bytes. Other samples are published with all their bits. */
+    if ((bytesPerColor == 2) && (dataType == NDUInt16)) {
+        getIntegerParam(FDC_data_bits, &bits);
+        if ((bits <= 0) || (bits > 16)) bits = depth;
+        if ((bits <= 0) || (bits > 16)) bits = 16;
+        getIntegerParam(FDC_sent_align, &sentAlign);
+        getIntegerParam(FDC_sample_align, &sampleAlign);
+        getIntegerParam(FDC_unused_bits, &clamp);
+        if (fdcSampleFormat(bits, sentAlign == 0, (FDCSampleAlign)sampleAlign, clamp, &sampleFormat))
+            pFormat = &sampleFormat;
+    } else {
+        bits = ((dataType == NDInt16) || (dataType == NDUInt16)) ? 16 : 8;
+    }
+    setIntegerParam(FDC_data_depth, bits);
+
     if (numColors == 3) {
         colorMode = NDColorModeRGB1;
     } else {
         /* If the color mode is currently set to Bayer leave it alone */
-        getIntegerParam(NDColorMode, (int *)&colorMode);
-        if (colorMode != NDColorModeBayer) colorMode = NDColorModeMono;
+        colorMode = (paramColorMode == NDColorModeBayer) ? NDColorModeBayer : NDColorModeMono;
     }
     
-    setIntegerParam(NDColorMode, colorMode);
+    /* A Bayer color mode set for a mono mode stays set while its frames are demosaiced */
+    if ((demosaic == FDCDemosaicOff) || (paramColorMode != NDColorModeBayer)) setIntegerParam(NDColorMode, colorMode);
     if (numColors == 1) {
         ndims = 2;
         dims[0] = sizeX;
@@ -760,38 +1840,55 @@ int FirewireWinDCAM::grabImage()
         dims[1] = sizeX;
         dims[2] = sizeY;
     }
+
+    /* Buffers in the free list are reused as long as the geometry does not grow.  If it does grow
+     * the old buffers are too small, so release them rather than let them count against maxMemory */
+    arrayBytes = (size_t)sizeX * sizeY * numColors * bytesPerColor;
+    if ((this->lastArrayBytes > 0) && (arrayBytes > this->lastArrayBytes)) {
+        this->pNDArrayPool->emptyFreeList();
+    }
+    this->lastArrayBytes = arrayBytes;
+
+    /* Every frame is counted and recorded, but only the ones that are published are converted */
+    if (!this->publishFrame()) return asynSuccess;
    
-    this->pRaw = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
-    if (!this->pRaw) {
-        /* If we didn't get a valid buffer from the NDArrayPool we must abort
-         * the acquisition as we have nowhere to dump the data...       */
-        setIntegerParam(ADStatus, ADStatusAborting);
-        callParamCallbacks();
+    /* If the pool has no array for the frame it is dropped, pRaw stays NULL and acquisition goes on */
+    this->pRaw = this->allocArray(ndims, dims, dataType);
+    if (!this->pRaw) return asynSuccess;
+
+
+    /* Copy or convert the frame straight from the buffers it was received into, which need not be
+     * contiguous, so it is not first flattened into one buffer */
+    numSegments = this->pCamera->GetRawSegments(segments, FDC_MAX_SEGMENTS);
+    if (numSegments == 0) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
-            "%s::%s [%s] ERROR: Serious problem: not enough buffers left! Aborting acquisition!\n",
-            driverName, functionName, this->portName);
-        setIntegerParam(ADAcquire, 0);
-        return(asynError);
+            "%s:%s: no frame data\n",
+            driverName, functionName);
+        return asynError;
     }
-
-
-    /* tell our driver where to find the image buffer with this latest image */
+    /* Large frames are converted in strips by several threads, see firewireWinDCAMStrips.h */
+    getIntegerParam(FDC_convert_threads, &threads);
+    epicsTimeGetCurrent(&convertStart);
     switch (colorMode) {
         case NDColorModeMono:
         case NDColorModeBayer:
-            pTmpData = this->pCamera->GetRawData(&dataLength);
-            if ((int)dataLength > this->pRaw->dataSize) dataLength = this->pRaw->dataSize;
-            /* The Firewire byte order is big-endian.  If this is 16-bit data and we are on a little-endian
-             * machine we need to swap bytes */
-            if ((bytesPerColor == 1) || (EPICS_BYTE_ORDER == EPICS_ENDIAN_BIG)) {
-                memcpy((unsigned char*)this->pRaw->pData, pTmpData, dataLength);
-            } else {
-                swab((char *)pTmpData, (char *)this->pRaw->pData, dataLength);
-            }
+            fdcCopyMonoStrips(this->pStripJob, threads, segments, numSegments, (unsigned char *)this->pRaw->pData,
+                              this->pRaw->dataSize, bytesPerColor, pFormat);
             break;
         case NDColorModeRGB1:
-            err = this->pCamera->getRGB((unsigned char*)this->pRaw->pData, this->pRaw->dataSize);
-            status = PERR(err);
+            if (demosaic != FDCDemosaicOff) {
+                if (fdcDemosaicStrips(this->pStripJob, threads, (FDCDemosaic)demosaic, filter, segments, numSegments,
+                                      (unsigned char *)this->pRaw->pData, sizeX, sizeY, bytesPerColor, pFormat) < 0) {
+                    /* The frame is not complete, it is not published */
+                    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                        "%s:%s: unable to demosaic the frame\n",
+                        driverName, functionName);
+                    return asynError;
+                }
+            } else {
+                fdcConvertToRGB8Strips(this->pStripJob, threads, colorCode, segments, numSegments,
+                                       (unsigned char *)this->pRaw->pData, sizeX, sizeY);
+            }
             break;
         default:
             asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
@@ -799,6 +1896,8 @@ int FirewireWinDCAM::grabImage()
                 driverName, functionName, colorMode);
             break;
     }
+    epicsTimeGetCurrent(&convertEnd);
+    setDoubleParam(FDC_convert_time, epicsTimeDiffInSeconds(&convertEnd, &convertStart));
     
     asynPrintIO(this->pasynUserSelf, ASYN_TRACEIO_DRIVER, 
         (const char*)this->pRaw->pData, this->pRaw->dataSize,
@@ -810,10 +1909,388 @@ int FirewireWinDCAM::grabImage()
     callParamCallbacks();
 
     this->pRaw->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &colorMode);
+    roiMinX = (format == 7) ? this->roiMinX : 0;
+    roiMinY = (format == 7) ? this->roiMinY : 0;
+    this->pRaw->pAttributeList->add("ROIMinX", "ROI origin X the frame was captured with", NDAttrInt32, &roiMinX);
+    this->pRaw->pAttributeList->add("ROIMinY", "ROI origin Y the frame was captured with", NDAttrInt32, &roiMinY);
+    this->pRaw->pAttributeList->add("BitDepth", "Significant bits of the samples", NDAttrInt32, &bits);
+    /* For the plugins that demosaic Bayer frames, with the values of NDBayerPattern_t */
+    if ((colorMode == NDColorModeBayer) && (filter != FDC_COLOR_FILTER_NONE)) {
+        pattern = filter;
+        this->pRaw->pAttributeList->add("BayerPattern", "Bayer color filter of the frame", NDAttrInt32, &pattern);
+    }
+
+    /* The time the frame started to be sent on the cycle timer of the bus, which the cameras of a
+     * bus share. A Format 7 frame takes one cycle per packet, the fixed modes spread a frame over
+     * the frame interval. The timer is read when AcquireImageEx() returns the frame, which is when
+     * it arrived only if no frames were waiting before it in the ring and the frame was taken
+     * without a late wake-up; otherwise the time would be late by up to several frame intervals, so
+     * the frame goes without it and is matched on its host time stamp. */
+    if ((newDroppedFrames == 0) && (backlog == 0) && (wakeDelay <= this->streamInterval / 2.) &&
+        (this->pCamera->GetFrameCycleTime(&cycleTime) == FDC_CAM_SUCCESS)) {
+        getIntegerParam(FDC_packets_per_frame, &packets);
+        cycleSeconds = fdcIsoCycleTimeSeconds(cycleTime) -
+            (((format == 7) && (packets > 0)) ? (double)packets / FDC_ISO_CYCLES_PER_SECOND : this->streamInterval);
+        if (cycleSeconds < 0.) cycleSeconds += FDC_ISO_CYCLE_TIMER_PERIOD;
+        getIntegerParam(FDC_iso_bus, &bus);
+        this->pRaw->pAttributeList->add("CycleTime", "Bus cycle time the frame started to be sent at", NDAttrFloat64, &cycleSeconds);
+        this->pRaw->pAttributeList->add("Bus", "Bus whose cycle timer CycleTime is read from", NDAttrInt32, &bus);
+    }
 
     return (status);
 }
 
+/** Allocates the NDArray for a frame, applying FDC_POOL_POLICY if the pool is exhausted.
+ * Called from the image grabbing thread with the driver locked; the wait policy releases the lock
+ * while it waits for plugins to release arrays. The frame is still held in the DMA ring meanwhile,
+ * and is converted with the settings read before the wait. The wait is kept shorter than the frame
+ * timeout, which pauseCapture() waits for the grab thread, and it ends when a reconfiguration
+ * or the end of acquisition is asked for, so a full pool does not hold these up.
+ * \return The array, NULL if the frame must be dropped.
+ */
+NDArray *FirewireWinDCAM::allocArray(int ndims, size_t *dims, NDDataType_t dataType)
+{
+    NDArray *pArray;
+    int policy, count, acquire = 1;
+    double timeout, waited = 0.;
+    const char *functionName = "allocArray";
+
+    pArray = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
+    getIntegerParam(FDC_pool_policy, &policy);
+    if (!pArray && (policy == FDCPoolWait)) {
+        getDoubleParam(FDC_pool_timeout, &timeout);
+        if (timeout > this->msTimeout / 1000.) timeout = this->msTimeout / 1000.;
+        while (!pArray && (waited < timeout) && acquire && !this->reconfigPending) {
+            this->unlock();
+            epicsThreadSleep(POOL_WAIT_POLL);
+            waited += POOL_WAIT_POLL;
+            pArray = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
+            this->lock();
+            getIntegerParam(ADAcquire, &acquire);
+        }
+        if (pArray) {
+            getIntegerParam(FDC_pool_waits, &count);
+            setIntegerParam(FDC_pool_waits, count + 1);
+        }
+    } else if (!pArray && (policy == FDCPoolFreeMemory)) {
+        /* The pool already reuses the arrays in its free list. When they are too small for this
+         * frame their memory may still be what keeps it under maxMemory, so it is freed. This does
+         * not help when maxBuffers arrays are held by the plugins. */
+        this->pNDArrayPool->emptyFreeList();
+        pArray = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
+        if (pArray) {
+            getIntegerParam(FDC_pool_reclaims, &count);
+            setIntegerParam(FDC_pool_reclaims, count + 1);
+        }
+    }
+    if (!pArray) {
+        getIntegerParam(FDC_pool_drops, &count);
+        setIntegerParam(FDC_pool_drops, count + 1);
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
+            "%s::%s [%s]: no NDArray left in the pool, frame dropped\n",
+            driverName, functionName, this->portName);
+    }
+    this->updatePoolStats();
+    return pArray;
+}
+
+/** Publishes how much of the NDArrayPool is in use, to help choose maxBuffers and maxMemory */
+void FirewireWinDCAM::updatePoolStats()
+{
+    size_t memory = this->pNDArrayPool->getMemorySize();
+    size_t maxMemory = this->pNDArrayPool->getMaxMemory();
+
+    setIntegerParam(FDC_pool_buffers, this->pNDArrayPool->getNumBuffers());
+    setIntegerParam(FDC_pool_free, this->pNDArrayPool->getNumFree());
+    setDoubleParam(FDC_pool_memory, memory / 1048576.);
+    setDoubleParam(FDC_pool_memory_use, (maxMemory > 0) ? 100. * memory / maxMemory : 0.);
+}
+
+/** Decides whether the frame just received is passed to the plugins, one frame in
+ * FDC_PUBLISH_DECIMATION is. Called from the image grabbing thread with the driver locked.
+ * \return 1 if the frame is published, 0 if it is skipped.
+ */
+int FirewireWinDCAM::publishFrame()
+{
+    int decimation, skipped;
+    int publish;
+
+    getIntegerParam(FDC_publish_decimation, &decimation);
+    if (decimation < 1) decimation = 1;
+    publish = (this->publishPhase == 0);
+    this->publishPhase = (this->publishPhase + 1) % decimation;
+    if (!publish) {
+        getIntegerParam(FDC_publish_skipped, &skipped);
+        setIntegerParam(FDC_publish_skipped, skipped + 1);
+    }
+    return publish;
+}
+
+/** Counts a frame received from the camera and updates the capture and publish rates.
+ * Called for every frame, published or not, from the image grabbing thread with the driver locked.
+ */
+void FirewireWinDCAM::countCapturedFrame(epicsTimeStamp *pFrameTime)
+{
+    int captured;
+    double elapsed, latencyMax;
+
+    getIntegerParam(FDC_frames_captured, &captured);
+    setIntegerParam(FDC_frames_captured, captured + 1);
+    this->rateCaptured++;
+    if (this->pRaw) this->ratePublished++;
+    elapsed = epicsTimeDiffInSeconds(pFrameTime, &this->rateStart);
+    if (elapsed >= PUBLISH_RATE_PERIOD) {
+        setDoubleParam(FDC_capture_rate, this->rateCaptured / elapsed);
+        setDoubleParam(FDC_publish_rate, this->ratePublished / elapsed);
+        /* Other cameras on the bus start and stop */
+        this->updateBusUsage();
+        /* The latency is measured from the frame that was taken soonest after it arrived */
+        if (this->wakeCount > 1) {
+            setDoubleParam(FDC_wake_latency, this->wakeSum / this->wakeCount - this->wakeMin);
+            getDoubleParam(FDC_wake_latency_max, &latencyMax);
+            setDoubleParam(FDC_wake_latency_max, MAX(latencyMax, this->wakeMax - this->wakeMin));
+        }
+        /* Start from a new frame each period, so the drift between the camera and host clocks does not add up */
+        this->wakeValid = 0;
+        this->updatePlacement();
+        this->rateStart = *pFrameTime;
+        this->rateCaptured = 0;
+        this->ratePublished = 0;
+    }
+}
+
+/** Measures how long the grab thread takes to run after a frame has arrived.
+ * The arrival times are not known, but the frames of a stream arrive one interval apart, so the
+ * time at which each frame is taken, less the time it is due by that schedule, is the latency
+ * plus a constant. Over each rate period the frame taken soonest is taken as on time, and
+ * FDC_WAKE_LATENCY and FDC_WAKE_LATENCY_MAX are the mean and largest delay from there. Frames
+ * that were already waiting when the thread asked for them are left out, they measure the
+ * backlog instead; the grab reactor waits for the frames itself, so there every frame counts.
+ * Called for every frame from the image grabbing thread with the driver locked.
+ * \return The delay of this frame from the soonest one of the period, 0 if it was not measured.
+ */
+double FirewireWinDCAM::updateWakeLatency(epicsTimeStamp *pWaitStart, epicsTimeStamp *pFrameTime,
+                                          int droppedFrames)
+{
+    double interval = this->streamInterval;
+    double offset;
+
+    if (interval <= 0.) return 0.;
+    if (!this->wakeValid) {
+        this->wakeAnchor = *pFrameTime;
+        this->wakeFrames = 0;
+        this->wakeCount = 0;
+        this->wakeSum = 0.;
+        this->wakeValid = 1;
+        return 0.;
+    }
+    this->wakeFrames += 1 + droppedFrames;
+    if (!this->pReactorCamera && (epicsTimeDiffInSeconds(pFrameTime, pWaitStart) < interval / 2.)) return 0.;
+    offset = epicsTimeDiffInSeconds(pFrameTime, &this->wakeAnchor) - this->wakeFrames * interval;
+    if ((this->wakeCount == 0) || (offset < this->wakeMin)) this->wakeMin = offset;
+    if ((this->wakeCount == 0) || (offset > this->wakeMax)) this->wakeMax = offset;
+    this->wakeSum += offset;
+    this->wakeCount++;
+    return offset - this->wakeMin;
+}
+
+/** Reads FDC_GRAB_PRIORITY and FDC_GRAB_CPUS and applies them to the thread that calls it, the
+ * grab thread, and to the strip workers that help convert the frames. With the grab reactor the
+ * thread is the reactor worker running the grab step; the workers are shared by the cameras, so
+ * each one is given the placement of the camera again when it next runs a grab step for it, see
+ * grabStep(). Called from the image grabbing thread with the driver locked.
+ */
+void FirewireWinDCAM::applySchedule()
+{
+    char cpus[256];
+    unsigned long long mask;
+    int priority;
+    const char *functionName = "applySchedule";
+
+    this->schedPending = 0;
+    getIntegerParam(FDC_grab_priority, &priority);
+    priority = MAX(MIN(priority, (int)epicsThreadPriorityMax), (int)epicsThreadPriorityMin);
+    getStringParam(FDC_grab_cpus, sizeof(cpus), cpus);
+    if (fdcSchedParseCpus(cpus, &mask)) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s [%s]: invalid CPU set \"%s\", use a list such as 0-3,8 or a mask such as 0x10f\n",
+            driverName, functionName, this->portName, cpus);
+        mask = this->grabMask;
+    }
+    this->grabPriority = priority;
+    this->grabMask = mask;
+    if (this->pStripJob) fdcStripJobSchedule(this->pStripJob, priority, mask);
+    if (fdcSchedApply(priority, mask)) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s [%s]: unable to restrict the grab thread to CPUs \"%s\"\n",
+            driverName, functionName, this->portName, cpus);
+    } else {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+            "%s::%s [%s]: grab thread priority %d, CPUs \"%s\"\n",
+            driverName, functionName, this->portName, priority, cpus);
+    }
+    this->updatePlacement();
+}
+
+/** Reports the CPU and NUMA node the grab thread runs on. With FDC_NUMA_BUFFERS, when a pinned
+ * grab thread is on another node than the free NDArrays were allocated on, they are freed so the
+ * thread allocates new ones, which the OS places on its own node when it first writes to them.
+ * Called from the image grabbing thread with the driver locked.
+ */
+void FirewireWinDCAM::updatePlacement()
+{
+    int cpu, node, local;
+
+    cpu = fdcSchedCurrentCpu();
+    node = fdcSchedCpuNode(cpu);
+    setIntegerParam(FDC_grab_cpu, cpu);
+    setIntegerParam(FDC_grab_node, node);
+    getIntegerParam(FDC_numa_buffers, &local);
+    if (local && this->grabMask && (node >= 0) && (node != this->bufferNode)) {
+        this->pNDArrayPool->emptyFreeList();
+        this->bufferNode = node;
+    }
+}
+
+/** Watches how the plugins keep up with the published frames and, with FDC_PUBLISH_AUTO, adjusts
+ * the publish decimation. Called after each published frame has been passed to the plugins and
+ * released, from the image grabbing thread with the driver locked.
+ * The plugins are falling behind if they hold more than FDC_PUBLISH_HELD_MAX of the published
+ * arrays, which is what their queues hold, if callbacks take longer than the time between
+ * published frames, or if the pool ran out of arrays. The decimation is then doubled, up to
+ * FDC_PUBLISH_MAX_DECIM; it is lowered by one again after PUBLISH_RECOVER_WINDOWS windows of
+ * PUBLISH_WINDOW published frames without any of these.
+ * \param[in] callbackTime Time spent in the NDArray callbacks for this frame in seconds.
+ */
+void FirewireWinDCAM::updatePublishRate(double callbackTime)
+{
+    int held, heldMax, slow;
+    int autoDecimation, decimation, maxDecimation;
+    int drops, waits, reclaims, poolMisses;
+    int pressure;
+    const char *functionName = "updatePublishRate";
+
+    getIntegerParam(FDC_publish_decimation, &decimation);
+    if (decimation < 1) decimation = 1;
+    held = (int)this->pNDArrayPool->getNumBuffers() - (int)this->pNDArrayPool->getNumFree();
+    setIntegerParam(FDC_publish_held, held);
+    if (held > this->publishHeldInWindow) this->publishHeldInWindow = held;
+    if ((this->streamInterval > 0.) &&
+        (callbackTime > PUBLISH_SLOW_FRACTION * this->streamInterval * decimation)) {
+        this->publishSlowInWindow++;
+        getIntegerParam(FDC_publish_slow, &slow);
+        setIntegerParam(FDC_publish_slow, slow + 1);
+    }
+    if (++this->publishWindow < PUBLISH_WINDOW) return;
+
+    getIntegerParam(FDC_pool_drops, &drops);
+    getIntegerParam(FDC_pool_waits, &waits);
+    getIntegerParam(FDC_pool_reclaims, &reclaims);
+    poolMisses = drops + waits + reclaims;
+    getIntegerParam(FDC_publish_auto, &autoDecimation);
+    getIntegerParam(FDC_publish_max_decim, &maxDecimation);
+    getIntegerParam(FDC_publish_held_max, &heldMax);
+    if (autoDecimation) {
+        pressure = (this->publishHeldInWindow > heldMax) ||
+                   (this->publishSlowInWindow > PUBLISH_WINDOW / 4) ||
+                   (poolMisses > this->publishPoolMisses);
+        if (pressure) {
+            this->publishCalmWindows = 0;
+            if (decimation < maxDecimation) {
+                decimation = MIN(2 * decimation, maxDecimation);
+                asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                    "%s::%s [%s]: plugins falling behind, publishing 1 frame in %d\n",
+                    driverName, functionName, this->portName, decimation);
+            }
+        } else if ((this->publishHeldInWindow > heldMax / 2) || (this->publishSlowInWindow > 0)) {
+            /* Not falling behind, but not enough headroom to publish more either */
+            this->publishCalmWindows = 0;
+        } else if (++this->publishCalmWindows >= PUBLISH_RECOVER_WINDOWS) {
+            this->publishCalmWindows = 0;
+            if (decimation > 1) {
+                decimation--;
+                asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                    "%s::%s [%s]: plugins keeping up, publishing 1 frame in %d\n",
+                    driverName, functionName, this->portName, decimation);
+            }
+        }
+        setIntegerParam(FDC_publish_decimation, decimation);
+    }
+    this->publishPoolMisses = poolMisses;
+    this->publishWindow = 0;
+    this->publishSlowInWindow = 0;
+    this->publishHeldInWindow = 0;
+}
+
+/** Starts recording the raw frames to the file in FDC_rec_file, replacing it if it exists.
+ * The frames are written as they arrive, before conversion, so the recording can be played back
+ * with WinFDC_ReplayCamera(). */
+asynStatus FirewireWinDCAM::startRecording()
+{
+    FDCRecordInfo info;
+    char fileName[256];
+    const char *functionName = "startRecording";
+
+    getStringParam(FDC_rec_file, sizeof(fileName), fileName);
+    memset(&info, 0, sizeof(info));
+    info.guid = this->guid;
+    this->pCamera->GetCameraVendor(info.vendor, sizeof(info.vendor));
+    this->pCamera->GetCameraName(info.model, sizeof(info.model));
+    this->pRecord = (strlen(fileName) > 0) ? fdcRecordCreate(fileName, &info) : NULL;
+    if (!this->pRecord) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s [%s] ERROR: cannot create recording \"%s\"\n",
+            driverName, functionName, this->portName, fileName);
+        setIntegerParam(FDC_rec_enable, 0);
+        return asynError;
+    }
+    setIntegerParam(FDC_rec_frames, 0);
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+        "%s::%s [%s]: recording to %s\n",
+        driverName, functionName, this->portName, fileName);
+    return asynSuccess;
+}
+
+void FirewireWinDCAM::stopRecording()
+{
+    fdcRecordClose(this->pRecord);
+    this->pRecord = NULL;
+    setIntegerParam(FDC_rec_enable, 0);
+}
+
+/** Appends the frame just acquired to the recording. A write error stops the recording. */
+void FirewireWinDCAM::recordFrame(int format, int mode, FDCColorCode colorCode, int depth, int sizeX, int sizeY,
+                                  int droppedFrames, epicsTimeStamp *pFrameTime)
+{
+    FDCRecordFrame frame;
+    FDCColorFilter filter = FDC_COLOR_FILTER_NONE;
+    unsigned char *pData;
+    const char *functionName = "recordFrame";
+
+    frame.arrivalTime = *pFrameTime;
+    frame.format = format;
+    frame.mode = mode;
+    frame.rate = (format == 7) ? 0 : this->pCamera->GetVideoFrameRate();
+    frame.colorCode = colorCode;
+    frame.depth = depth;
+    frame.sizeX = sizeX;
+    frame.sizeY = sizeY;
+    frame.left = (format == 7) ? this->roiMinX : 0;
+    frame.top = (format == 7) ? this->roiMinY : 0;
+    if (format == 7) this->pCameraControlSize->GetColorFilter(&filter);
+    frame.colorFilter = filter;
+    frame.droppedFrames = droppedFrames;
+    pData = this->pCamera->GetRawData(&frame.dataLength);
+    if (fdcRecordWrite(this->pRecord, &frame, pData)) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s [%s] ERROR: write to recording failed, recording stopped\n",
+            driverName, functionName, this->portName);
+        this->stopRecording();
+        return;
+    }
+    setIntegerParam(FDC_rec_frames, (int)fdcRecordFrames(this->pRecord));
+}
+
 
 /** Sets an int32 parameter.
   * \param[in] pasynUser asynUser structure that contains the function code in pasynUser->reason. 
@@ -827,8 +2304,13 @@ asynStatus FirewireWinDCAM::writeInt32( asynUser *pasynUser, epicsInt32 value)
     int function = pasynUser->reason;
     int adstatus;
     int addr, feature, tmpVal;
+    int paused = 0;
     const char* functionName = "writeInt32";
 
+    /* Until the camera is ready the writes that need it are queued */
+    if ((this->initState != FDCInitReady) && this->needsCamera(function))
+        return this->queueWrite(pasynUser, 0, value, 0.0);
+
     pasynManager->getAddr(pasynUser, &addr);
     feature = addr;
     if (addr < 0) addr=0;
@@ -846,10 +2328,17 @@ asynStatus FirewireWinDCAM::writeInt32( asynUser *pasynUser, epicsInt32 value)
         {
             /* Nothing to do when acquire is turned off, just setting ADAcquire=0 above is enough */
         }
+    } else if ( (function == ADMinX)  ||
+                (function == ADMinY)) {
+        /* Moving the ROI does not change the packet or frame size so it can be done without
+         * stopping the stream */
+        getIntegerParam(ADAcquire, &tmpVal);
+        if (tmpVal && (this->pCamera->GetVideoFormat() == 7))
+            status = this->setFormat7Position();
+        else
+            status = this->setFormat7Params();
     } else if ( (function == ADSizeX) ||
                 (function == ADSizeY) ||
-                (function == ADMinX)  ||
-                (function == ADMinY)  ||
                 (function == FDC_colorcode)) {
         status = this->setFormat7Params();
     } else if (function == FDC_feat_val) {
@@ -872,6 +2361,64 @@ asynStatus FirewireWinDCAM::writeInt32( asynUser *pasynUser, epicsInt32 value)
         status = this->setVideoMode(value);
     } else if (function == FDC_framerate) {
         status = this->setFrameRate(value);
+    } else if (function == FDC_caps_refresh) {
+        /* Probing switches the camera through all the Format 7 modes */
+        getIntegerParam(ADAcquire, &tmpVal);
+        if (tmpVal) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s::%s ERROR [%s]: must stop acquisition before probing camera capabilities\n",
+                driverName, functionName, this->portName);
+            status = asynError;
+        } else if (value) {
+            status = this->loadCapabilities(1);
+            this->formatValidModes();
+            this->getAllFeatures();
+        }
+        setIntegerParam(FDC_caps_refresh, 0);
+    } else if (function == FDC_rec_enable) {
+        if (value && !this->pRecord) status = this->startRecording();
+        else if (!value) this->stopRecording();
+    } else if (function == FDC_dropped_frames) {
+        /* Resetting the dropped frame count also resets the counts of each kind and the pool counts */
+        setIntegerParam(FDC_dropped_stale, 0);
+        setIntegerParam(FDC_dropped_overrun, 0);
+        setIntegerParam(FDC_pool_drops, 0);
+        setIntegerParam(FDC_pool_waits, 0);
+        setIntegerParam(FDC_pool_reclaims, 0);
+    } else if (function == FDC_drain_policy) {
+        /* The DMA ring is sized for the policy */
+        status = this->restartStream();
+    } else if (function == FDC_dma_depth) {
+        if (value < 0) setIntegerParam(FDC_dma_depth, 0);
+        this->dmaGrowth = 0;
+        status = this->restartStream();
+    } else if ((function == FDC_iso_policy) || (function == FDC_iso_bus)) {
+        /* The bandwidth is reserved when the stream starts */
+        status = this->restartStream();
+        this->updateBusUsage();
+    } else if (function == FDC_1394b_mode) {
+        /* The mode can only change with the stream stopped. The packet size is planned again for
+         * the new speed while it is. */
+        status = this->pauseCapture(&paused);
+        if (status == asynSuccess) {
+            status = this->negotiateSpeed();
+            if (this->setFormat7Params()) status = asynError;
+            if (this->resumeCapture(paused)) status = asynError;
+        }
+    } else if (function == FDC_packet_mode) {
+        status = this->setFormat7Params();
+    } else if (function == FDC_publish_decimation) {
+        if (value < 1) setIntegerParam(FDC_publish_decimation, 1);
+        this->publishPhase = 0;
+    } else if (function == FDC_publish_max_decim) {
+        if (value < 1) setIntegerParam(FDC_publish_max_decim, 1);
+    } else if (function == FDC_publish_held_max) {
+        if (value < 0) setIntegerParam(FDC_publish_held_max, 0);
+    } else if (function == FDC_convert_threads) {
+        if (value < 0) setIntegerParam(FDC_convert_threads, 0);
+    } else if ((function == FDC_grab_priority) || (function == FDC_numa_buffers)) {
+        /* The grab thread applies it to itself */
+        this->schedPending = 1;
     } else {
         /* If this parameter belongs to a base class call its method */
         if (function < FIRST_FDC_PARAM) status = ADDriver::writeInt32(pasynUser, value);
@@ -898,9 +2445,13 @@ asynStatus FirewireWinDCAM::writeFloat64( asynUser *pasynUser, epicsFloat64 valu
 {
     asynStatus status = asynSuccess;
     int function = pasynUser->reason;
-    int addr, feature, tmpVal;
+    int addr, feature, tmpVal, depth;
     const char* functionName = "writeFloat64";
     
+    /* Until the camera is ready the writes that need it are queued */
+    if ((this->initState != FDCInitReady) && this->needsCamera(function))
+        return this->queueWrite(pasynUser, 1, 0, value);
+
     pasynManager->getAddr(pasynUser, &addr);
     feature = addr;
     if (addr < 0) addr=0;
@@ -909,7 +2460,7 @@ asynStatus FirewireWinDCAM::writeFloat64( asynUser *pasynUser, epicsFloat64 valu
     status = setDoubleParam(addr, function, value);
 
     if ((function == FDC_feat_val_abs) || (function == ADAcquireTime)) {
-        if (function == ADAcquireTime) feature = FEATURE_SHUTTER;
+        if (function == ADAcquireTime) feature = FDC_FEATURE_SHUTTER;
         /* First check if the camera is set for manual control... */
         getIntegerParam(feature, FDC_feat_mode, &tmpVal);
         /* if it is not set to 'manual' (0) then we do set it to manual */
@@ -918,6 +2469,15 @@ asynStatus FirewireWinDCAM::writeFloat64( asynUser *pasynUser, epicsFloat64 valu
         status = this->setFeatureAbsValue(feature, value);
         /* update all feature values to check if any settings have changed */
         status = this->getAllFeatures();
+    } else if (function == ADAcquirePeriod) {
+        /* In Format 7 the packet size is planned for the acquire period */
+        getIntegerParam(FDC_packet_mode, &tmpVal);
+        if (tmpVal == FDCPacketPlanned) status = this->setFormat7Params();
+    } else if ((function == FDC_stall_tolerance) || (function == FDC_dma_memory)) {
+        /* In lossless mode an automatic DMA ring is sized for the stall tolerance and memory budget */
+        getIntegerParam(FDC_drain_policy, &tmpVal);
+        getIntegerParam(FDC_dma_depth, &depth);
+        if ((tmpVal == FDCDrainLossless) && (depth == 0)) status = this->restartStream();
     } else {
         /* If this parameter belongs to a base class call its method */
         if (function < FIRST_FDC_PARAM) status = ADDriver::writeFloat64(pasynUser, value);
@@ -930,6 +2490,23 @@ asynStatus FirewireWinDCAM::writeFloat64( asynUser *pasynUser, epicsFloat64 valu
     return status;
 }
 
+/** Sets a string parameter.
+  * \param[in] pasynUser asynUser structure that contains the function code in pasynUser->reason.
+  * \param[in] value The string to write.
+  * \param[in] nChars The number of characters in value.
+  * \param[out] nActual The number of characters written.
+  *
+  * FDC_grab_cpus is applied by the grab thread itself, the next time it runs. */
+asynStatus FirewireWinDCAM::writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual)
+{
+    asynStatus status;
+    int function = pasynUser->reason;
+
+    status = ADDriver::writeOctet(pasynUser, value, nChars, nActual);
+    if (function == FDC_grab_cpus) this->schedPending = 1;
+    return status;
+}
+
 /** Check if a requested feature is valid
  *
  * Checks for:
@@ -946,11 +2523,11 @@ asynStatus FirewireWinDCAM::writeFloat64( asynUser *pasynUser, epicsFloat64 valu
  *              name. For debugging/printing purposes only.
  * asyn status
  */
-C1394CameraControl* FirewireWinDCAM::checkFeature(int feature, char **featureName)
+FDCCameraControl* FirewireWinDCAM::checkFeature(int feature, char **featureName)
 {
     asynStatus status = asynSuccess;
     const char* functionName = "checkFeature";
-    C1394CameraControl *pFeature=NULL;
+    FDCCameraControl *pFeature=NULL;
 
     if (feature < 0 || feature >= num1394Features)
     {
@@ -985,7 +2562,7 @@ asynStatus FirewireWinDCAM::setFeatureMode(int feature, epicsInt32 value)
     const char *functionName = "setFeatureMode";
     char *featureName;
     int err;
-    C1394CameraControl *pFeature;
+    FDCCameraControl *pFeature;
     
     /* First check if the feature is valid for this camera */
     pFeature = this->checkFeature(feature, &featureName);
@@ -1011,7 +2588,7 @@ asynStatus FirewireWinDCAM::setFeatureValue(int feature, epicsInt32 value)
     int err;
     unsigned short min, max, lo, hi;
     const char *functionName = "setFeatureValue";
-    C1394CameraControl *pFeature;
+    FDCCameraControl *pFeature;
     char *featureName;
 
     /* First check if the feature is valid for this camera */
@@ -1019,7 +2596,7 @@ asynStatus FirewireWinDCAM::setFeatureValue(int feature, epicsInt32 value)
     if (!pFeature) return status;
 
     /* Disable absolute mode control for this feature */
-    err = pFeature->SetAbsControl(FALSE);
+    err = pFeature->SetAbsControl(0);
     status = PERR(err);
     if(status == asynError) return status;
 
@@ -1045,6 +2622,7 @@ asynStatus FirewireWinDCAM::setFeatureValue(int feature, epicsInt32 value)
 
     err = pFeature->SetValue(lo, hi);
     status = PERR(err);
+    if (status == asynSuccess) this->pFeatureShadow[feature].absolute = 0;
     asynPrint(pasynUserSelf, ASYN_TRACEIO_DRIVER, 
         "%s::%s set value=%d, status=%d\n",
         driverName, functionName, value, status);
@@ -1058,7 +2636,7 @@ asynStatus FirewireWinDCAM::setFeatureAbsValue(int feature, epicsFloat64 value)
     int err;
     float min, max;
     const char *functionName = "setFeatureAbsValue";
-    C1394CameraControl *pFeature;
+    FDCCameraControl *pFeature;
     char *featureName;
 
     /* First check if the feature is valid for this camera */
@@ -1084,13 +2662,14 @@ asynStatus FirewireWinDCAM::setFeatureAbsValue(int feature, epicsFloat64 value)
     }
 
     /* Enable absolute mode control for this feature */
-    err = pFeature->SetAbsControl(TRUE);
+    err = pFeature->SetAbsControl(1);
     status = PERR(err);
     if(status == asynError) return status;
 
     /* Finally set the feature value in the camera */
     err = pFeature->SetValueAbsolute((float)value);
     status = PERR(err);
+    if (status == asynSuccess) this->pFeatureShadow[feature].absolute = 1;
 
     asynPrint(pasynUserSelf, ASYN_TRACEIO_DRIVER, 
         "%s::%s set value to cam: %f, status=%d\n",
@@ -1104,17 +2683,9 @@ asynStatus FirewireWinDCAM::setVideoFormat(epicsInt32 format)
 {
     asynStatus status = asynSuccess;
     int err;
-    int wasAcquiring;
+    int paused = 0;
     const char* functionName = "setVideoFormat";
 
-    getIntegerParam(ADAcquire, &wasAcquiring);
-    if (wasAcquiring) {
-        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
-            "%s::%s ERROR [%s]: must stop acquisition before changing format\n",
-            driverName, functionName, this->portName);
-       return(asynError);
-    }
-    
     if (!this->pCamera->HasVideoFormat(format)) {
          asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
             "%s::%s ERROR [%s]: camera does not support format %d\n",
@@ -1122,6 +2693,10 @@ asynStatus FirewireWinDCAM::setVideoFormat(epicsInt32 format)
         return(asynError);
     }
 
+    /* If we are acquiring the stream is stopped while the format is changed */
+    status = this->pauseCapture(&paused);
+    if (status == asynError) return status;
+
     /* attempt to write the format to camera */
     asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
         "%s::%s [%s]: setting video format:%d\n",
@@ -1134,6 +2709,8 @@ asynStatus FirewireWinDCAM::setVideoFormat(epicsInt32 format)
     if (format == 7) this->setFormat7Params();
 
     done:
+    /* Restart the stream before reading back the camera settings to keep the gap short */
+    if (this->resumeCapture(paused)) status = asynError;
     /* When the format changes the supported values of video mode and frame rate change */
     this->formatValidModes();
     /* When the format changes the available features can also change */
@@ -1146,17 +2723,10 @@ asynStatus FirewireWinDCAM::setVideoMode(epicsInt32 mode)
 {
     asynStatus status = asynSuccess;
     int err;
-    int wasAcquiring;
+    int paused = 0;
     int format;
     const char* functionName = "setVideoMode";
 
-    getIntegerParam(ADAcquire, &wasAcquiring);
-    if (wasAcquiring) {
-        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
-            "%s::%s ERROR [%s]: must stop acquisition before changing video mode\n",
-            driverName, functionName, this->portName);
-       return(asynError);
-    }
     /* Get the current video format */
     format = this->pCamera->GetVideoFormat();
     if (!this->pCamera->HasVideoMode(format, mode)) {
@@ -1167,6 +2737,10 @@ asynStatus FirewireWinDCAM::setVideoMode(epicsInt32 mode)
        goto done;
     }
 
+    /* If we are acquiring the stream is stopped while the mode is changed */
+    status = this->pauseCapture(&paused);
+    if (status == asynError) return status;
+
     /* attempt to write the mode to camera */
     asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
         "%s::%s [%s]: setting video mode:%d\n",
@@ -1178,6 +2752,8 @@ asynStatus FirewireWinDCAM::setVideoMode(epicsInt32 mode)
     /* If the new format is format 7 then set the parameters */
     if (format == 7) this->setFormat7Params();
 
+    /* Restart the stream before reading back the camera settings to keep the gap short */
+    if (this->resumeCapture(paused)) status = asynError;
     /* When the mode changes the supported values of frame rate change */
     this->formatValidModes();
     /* When the mode changes the available features can also change */
@@ -1191,18 +2767,10 @@ asynStatus FirewireWinDCAM::setFrameRate(epicsInt32 rate)
     asynStatus status = asynSuccess;
     unsigned int newframerate = 0;
     int err;
-    int wasAcquiring;
+    int paused = 0;
     int format, mode;
     const char* functionName = "setFrameRate";
 
-    getIntegerParam(ADAcquire, &wasAcquiring);
-    if (wasAcquiring) {
-        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
-            "%s::%s ERROR [%s]: must stop acquisition before changing frame rate\n",
-            driverName, functionName, this->portName);
-       return(asynError);
-    }
-
     /* Get the current video format and mode */
     format = this->pCamera->GetVideoFormat();
     mode = this->pCamera->GetVideoMode();
@@ -1213,6 +2781,10 @@ asynStatus FirewireWinDCAM::setFrameRate(epicsInt32 rate)
         goto done;
     }
 
+    /* If we are acquiring the stream is stopped while the frame rate is changed */
+    status = this->pauseCapture(&paused);
+    if (status == asynError) return status;
+
     /* attempt to write the framerate to camera */
     asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
         "%s::%s [%s]: setting framerate:%d\n",
@@ -1222,6 +2794,8 @@ asynStatus FirewireWinDCAM::setFrameRate(epicsInt32 rate)
     if (status == asynError) goto done;
 
     done:
+    /* Restart the stream before reading back the camera settings to keep the gap short */
+    if (this->resumeCapture(paused)) status = asynError;
     /* When the mode changes the supported values of frame rate change */
     this->formatValidModes();
     /* When the mode changes the available features can also change */
@@ -1234,29 +2808,29 @@ asynStatus FirewireWinDCAM::setFormat7Params()
 {
     asynStatus status = asynSuccess;
     int err;
-    int wasAcquiring;
+    int paused = 0;
     int format;
     int sizeX, sizeY, minX, minY;
-    COLOR_CODE colorCode;
+    FDCColorCode colorCode;
     unsigned short width, height, left, top;
     unsigned short hsMax, vsMax, hsUnit, vsUnit;
     unsigned short hpMax, vpMax, hpUnit, vpUnit;
     unsigned short bppMin, bppMax, bppCur, bppRec, bppAct;
+    unsigned long packetsPerFrame;
+    int packetMode;
+    double period;
+    FDCPacketPlan plan;
     char str[40];
     const char* functionName = "setFormat7Params";
 
-    getIntegerParam(ADAcquire, &wasAcquiring);
-    if (wasAcquiring) {
-        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
-            "%s::%s ERROR [%s]: must stop acquisition before changing format 7 params\n",
-            driverName, functionName, this->portName);
-       return(asynError);
-    }
-
     /* Get the current video format */
     format = this->pCamera->GetVideoFormat();
     /* If not format 7 then silently exit */
     if (format != 7) goto done;
+
+    /* If we are acquiring the stream is stopped while the format 7 parameters are changed */
+    status = this->pauseCapture(&paused);
+    if (status == asynError) return status;
     
     getIntegerParam(ADSizeX, &sizeX);
     getIntegerParam(ADSizeY, &sizeY);
@@ -1313,33 +2887,281 @@ asynStatus FirewireWinDCAM::setFormat7Params()
     if (status == asynError) goto done;
     this->pCameraControlSize->GetBytesPerPacketRange(&bppMin, &bppMax);
     this->pCameraControlSize->GetBytesPerPacket(&bppCur, &bppRec);
-    bppAct = bppRec;
+    /* The packet size sets the share of the bus the camera takes and the fastest frame rate. The
+     * planner takes the smallest size that sends a frame within the acquire period, so cameras
+     * sharing the bus are left as much bandwidth as possible, or the largest one if the period is 0 */
+    getIntegerParam(FDC_packet_mode, &packetMode);
+    getDoubleParam(ADAcquirePeriod, &period);
+    fdcPlanBytesPerPacket(this->getFrameBytes(), bppMin, bppMax, this->isoSpeed, period, &plan);
+    bppAct = (packetMode == FDCPacketPlanned) ? plan.bytesPerPacket : bppRec;
+    setIntegerParam(FDC_packet_limited, (packetMode == FDCPacketPlanned) && !plan.periodMet);
     asynPrint(pasynUserSelf, ASYN_TRACEIO_DRIVER,
-        "%s:%s bytes per packet: min=%d, max=%d, current=%d, recommended=%d, actually setting=%d\n", 
-        driverName, functionName, bppMin, bppMax, bppCur, bppRec, bppAct);
+        "%s:%s bytes per packet: min=%d, max=%d, current=%d, recommended=%d, planned=%d, actually setting=%d\n", 
+        driverName, functionName, bppMin, bppMax, bppCur, bppRec, plan.bytesPerPacket, bppAct);
 
     err = this->pCameraControlSize->SetBytesPerPacket(bppAct);
       status = PERR(err );
     if (status == asynError) goto done;
 
     done:
+    if (this->resumeCapture(paused)) status = asynError;
     /* Read back the actual values */
     this->pCameraControlSize->GetPos(&left, &top);
     setIntegerParam(ADMinX, left);
     setIntegerParam(ADMinY, top);
+    this->roiMinX = left;
+    this->roiMinY = top;
+    this->positionPending = 0;
+    this->positionInFlight = 0;
     this->pCameraControlSize->GetSize(&width, &height);
     setIntegerParam(ADSizeX, width);
     setIntegerParam(ADSizeY, height);
-    this->pCameraControlSize->GetColorCode((COLOR_CODE *)&colorCode);
+    this->pCameraControlSize->GetColorCode((FDCColorCode *)&colorCode);
     setIntegerParam(FDC_colorcode, colorCode);
     sprintf(str, "%s", colorCodeStrings[colorCode]);
     setStringParam(FDC_current_colorcode, str);
+    if (format == 7) {
+        this->pCameraControlSize->GetBytesPerPacket(&bppCur);
+        this->pCameraControlSize->GetPacketsPerFrame(&packetsPerFrame);
+        setIntegerParam(FDC_packet_size, bppCur);
+        setIntegerParam(FDC_packets_per_frame, (int)packetsPerFrame);
+        period = this->getExpectedInterval();
+        setDoubleParam(FDC_predicted_fps, (period > 0.) ? 1. / period : 0.);
+    }
     callParamCallbacks();
 
     return status;
 }
 
 
+/** Requests a new Format 7 ROI position while the stream is running.
+ * The position is checked against the position limits and units of the current mode and stored.
+ * The image grabbing thread writes it to the camera between two frames, see updateFormat7Position().
+ */
+asynStatus FirewireWinDCAM::setFormat7Position()
+{
+    int minX, minY;
+    unsigned short width, height;
+    unsigned short hsMax, vsMax;
+    unsigned short hpMax, vpMax, hpUnit, vpUnit;
+    const char* functionName = "setFormat7Position";
+
+    getIntegerParam(ADMinX, &minX);
+    getIntegerParam(ADMinY, &minY);
+
+    this->pCameraControlSize->GetSizeLimits(&hsMax, &vsMax);
+    this->pCameraControlSize->GetSize(&width, &height);
+    this->pCameraControlSize->GetPosLimits(&hpMax, &vpMax);
+    this->pCameraControlSize->GetPosUnits(&hpUnit, &vpUnit);
+
+    /* The position limits are defined as the difference from the max size values, 
+     * and the ROI must also stay on the chip with the current size */
+    hpMax = hsMax - hpMax;
+    vpMax = vsMax - vpMax;
+    if (hpMax > hsMax - width)  hpMax = hsMax - width;
+    if (vpMax > vsMax - height) vpMax = vsMax - height;
+
+    if (hpUnit && (minX % hpUnit)) minX = (minX/hpUnit) * hpUnit;
+    if (vpUnit && (minY % vpUnit)) minY = (minY/vpUnit) * vpUnit;
+    if (minX < 0) minX = 0;
+    if (minX > hpMax)  minX = hpMax;
+    if (minY < 0) minY = 0;
+    if (minY > vpMax)  minY = vpMax;
+
+    asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
+        "%s::%s [%s]: requesting format 7 position minX=%d, minY=%d\n",
+        driverName, functionName, this->portName, minX, minY);
+    this->pendingMinX = minX;
+    this->pendingMinY = minY;
+    this->positionPending = 1;
+    this->positionFrames = 0;
+    setIntegerParam(ADMinX, minX);
+    setIntegerParam(ADMinY, minY);
+    return asynSuccess;
+}
+
+/** Keeps track of the Format 7 ROI position while streaming.
+ * Called by the image grabbing thread with the driver locked, each time a frame has been received.
+ * A position written to the camera only affects frames whose exposure starts afterwards, so frames
+ * that arrive less than one frame interval after the position was written are still tagged with 
+ * the old origin. A pending position is written to the camera after the frame has been tagged.
+ * \param[in] pFrameTime The time the frame was received.
+ */
+void FirewireWinDCAM::updateFormat7Position(epicsTimeStamp *pFrameTime)
+{
+    int err;
+    unsigned short left, top;
+    const char* functionName = "updateFormat7Position";
+
+    if (!this->positionPending && !this->positionInFlight) return;
+    this->positionFrames++;
+
+    if (this->positionInFlight && 
+        (epicsTimeDiffInSeconds(pFrameTime, &this->positionApplyTime) >= this->getFrameInterval())) {
+        this->positionInFlight = 0;
+        this->pCameraControlSize->GetPos(&left, &top);
+        this->roiMinX = left;
+        this->roiMinY = top;
+        setIntegerParam(FDC_roi_move_latency, this->positionFrames);
+    }
+
+    if (this->positionPending) {
+        this->positionPending = 0;
+        err = this->pCameraControlSize->SetPos(this->pendingMinX, this->pendingMinY);
+        if (PERR(err)) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s::%s ERROR [%s]: unable to move ROI to minX=%d, minY=%d while streaming\n",
+                driverName, functionName, this->portName, this->pendingMinX, this->pendingMinY);
+            setIntegerParam(ADMinX, this->roiMinX);
+            setIntegerParam(ADMinY, this->roiMinY);
+            return;
+        }
+        epicsTimeGetCurrent(&this->positionApplyTime);
+        this->positionInFlight = 1;
+    }
+}
+
+/** Returns the time between frames in seconds for the current video settings */
+double FirewireWinDCAM::getFrameInterval()
+{
+    int format, rate;
+    float interval = 0.;
+    unsigned short bytesPerPacket = 0;
+    double period;
+
+    format = this->pCamera->GetVideoFormat();
+    if (format == 7) {
+        /* The frame interval register is optional, 0 means it is not implemented. Without it the
+         * frame takes one bus cycle per packet. */
+        this->pCameraControlSize->GetFrameInterval(&interval);
+        if (interval > 0.) return interval;
+        this->pCameraControlSize->GetBytesPerPacket(&bytesPerPacket);
+        if (bytesPerPacket > 0) return fdcPacketFrameInterval(this->getFrameBytes(), bytesPerPacket);
+    } else {
+        rate = this->pCamera->GetVideoFrameRate();
+        /* The fixed frame rates start at 1.875 fps and double for each step */
+        if ((rate >= 0) && (rate < MAX_1394_FRAME_RATES)) return 1. / (1.875 * (1 << rate));
+    }
+    /* Fall back to the acquire period set by the user */
+    getDoubleParam(ADAcquirePeriod, &period);
+    return period;
+}
+
+/** Returns the time between frames in seconds expected from the video settings, or from the
+ * exposure plus readout time if that is longer */
+double FirewireWinDCAM::getExpectedInterval()
+{
+    double acquireTime;
+    double readoutTime;
+
+    getDoubleParam(ADAcquireTime, &acquireTime);
+    getDoubleParam(FDC_readout_time, &readoutTime);
+    return MAX(this->getFrameInterval(), acquireTime + readoutTime);
+}
+
+/** Returns the size in bytes of a frame with the current video settings, 0 if it is not known */
+unsigned long FirewireWinDCAM::getFrameBytes()
+{
+    int format;
+    unsigned short sizeX, sizeY;
+    unsigned long lsizeX, lsizeY;
+    FDCColorCode colorCode;
+
+    format = this->pCamera->GetVideoFormat();
+    if (format == 7) {
+        this->pCameraControlSize->GetSize(&sizeX, &sizeY);
+        this->pCameraControlSize->GetColorCode(&colorCode);
+        return fdcFrameBytes(colorCode, sizeX, sizeY);
+    }
+    if (fdcColorCodeForMode(format, this->pCamera->GetVideoMode(), &colorCode)) return 0;
+    this->pCamera->GetVideoFrameDimensions(&lsizeX, &lsizeY);
+    return fdcFrameBytes(colorCode, lsizeX, lsizeY);
+}
+
+/** Returns the number of DMA buffers to start the stream with.
+ * A depth set in FDC_DMA_DEPTH is used as it is. In automatic mode the latest-only policy gets a
+ * short ring, as only the newest frame is ever used. In lossless mode the ring holds the frames that
+ * arrive while the grab thread is stalled for FDC_STALL_TOLERANCE, plus two for the frames being
+ * filled and read, plus the buffers added after acquisitions that lost frames to overflows. In both
+ * modes it is limited to MAX_DMA_BUFFERS and to FDC_DMA_MEMORY megabytes of frames.
+ * \param[in] interval The expected time between frames in seconds.
+ */
+int FirewireWinDCAM::dmaBufferCount(double interval)
+{
+    int policy, depth;
+    int nBuffers = MAX_1394_BUFFERS;
+    int maxBuffers = MAX_DMA_BUFFERS;
+    double tolerance, budget;
+    unsigned long frameBytes;
+    const char *functionName = "dmaBufferCount";
+
+    getIntegerParam(FDC_dma_depth, &depth);
+    if (depth > 0) {
+        if (depth < MIN_DMA_BUFFERS) return MIN_DMA_BUFFERS;
+        return (depth > MAX_DMA_BUFFERS) ? MAX_DMA_BUFFERS : depth;
+    }
+    getDoubleParam(FDC_dma_memory, &budget);
+    frameBytes = this->getFrameBytes();
+    if ((frameBytes > 0) && (budget > 0.) && (budget * 1024. * 1024. / frameBytes < maxBuffers))
+        maxBuffers = MAX((int)(budget * 1024. * 1024. / frameBytes), MIN_DMA_BUFFERS);
+    getIntegerParam(FDC_drain_policy, &policy);
+    if (policy != FDCDrainLossless) return MIN(nBuffers, maxBuffers);
+    getDoubleParam(FDC_stall_tolerance, &tolerance);
+    if ((interval > 0.) && (tolerance > 0.)) {
+        if (tolerance / interval < MAX_DMA_BUFFERS) nBuffers = (int)(tolerance / interval + 0.999) + 2;
+        else nBuffers = MAX_DMA_BUFFERS + 1;
+    }
+    nBuffers = MAX(nBuffers, MAX_1394_BUFFERS) + this->dmaGrowth;
+    if (nBuffers > maxBuffers) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+            "%s::%s [%s]: %d DMA buffers needed for a stall of %.3f s, limited to %d\n",
+            driverName, functionName, this->portName, nBuffers, tolerance, maxBuffers);
+        nBuffers = maxBuffers;
+    }
+    return nBuffers;
+}
+
+/** Estimates the number of frames still waiting in the DMA ring after the one just taken.
+ * The backends do not report how full the ring is, so the backlog is worked out from the arrival
+ * times: when AcquireImageEx() had to wait for a frame the ring was empty, and since then frames have
+ * arrived once per frame interval while the grab thread has taken backlogFrames of them, counting the
+ * dropped ones. With the latest-only policy nothing is left behind after a grab.
+ * \param[in] policy The FDCDrainPolicy_t the frame was taken with.
+ * \param[in] pWaitStart When AcquireImageEx() was called.
+ * \param[in] pFrameTime When it returned the frame.
+ * \param[in] droppedFrames Frames dropped before this one.
+ * \return The estimated backlog.
+ */
+int FirewireWinDCAM::updateBacklog(int policy, epicsTimeStamp *pWaitStart, epicsTimeStamp *pFrameTime,
+                                    int droppedFrames)
+{
+    double interval = this->streamInterval;
+    int backlog = 0;
+    int backlogMax, nBuffers;
+
+    if ((policy == FDCDrainLossless) && (interval > 0.) && this->backlogValid &&
+        (epicsTimeDiffInSeconds(pFrameTime, pWaitStart) < interval / 2.)) {
+        this->backlogFrames += 1 + droppedFrames;
+        backlog = (int)(epicsTimeDiffInSeconds(pFrameTime, &this->backlogAnchor) / interval + 0.5) -
+                  this->backlogFrames;
+    }
+    /* Start counting again from an empty ring, or if the frames come slower than expected */
+    if (backlog <= 0) {
+        backlog = 0;
+        this->backlogAnchor = *pFrameTime;
+        this->backlogFrames = 0;
+        this->backlogValid = 1;
+    }
+    setIntegerParam(FDC_backlog, backlog);
+    getIntegerParam(FDC_backlog_max, &backlogMax);
+    backlogMax = MAX(backlog, backlogMax);
+    setIntegerParam(FDC_backlog_max, backlogMax);
+    /* The ring holds the waiting frames and the one just taken */
+    getIntegerParam(FDC_dma_buffers, &nBuffers);
+    if (nBuffers > 0) setDoubleParam(FDC_dma_peak, MIN(100. * (backlogMax + 1) / nBuffers, 100.));
+    return backlog;
+}
+
 
 asynStatus FirewireWinDCAM::formatValidModes()
 {
@@ -1407,8 +3229,8 @@ asynStatus FirewireWinDCAM::formatValidModes()
     setStringParam(FDC_current_framerate, str);
     
     /* Format all valid format 7 color modes */
-    for (colorCode=0; colorCode<COLOR_CODE_MAX; colorCode++) {
-        if (this->pCameraControlSize->HasColorCode((COLOR_CODE)colorCode)) {
+    for (colorCode=0; colorCode<FDC_COLOR_CODE_MAX; colorCode++) {
+        if (this->pCameraControlSize->HasColorCode((FDCColorCode)colorCode)) {
             sprintf(str, "%d %s", colorCode, colorCodeStrings[colorCode]);
             setIntegerParam(colorCode, FDC_has_colorcode, 1);
         } else {
@@ -1419,14 +3241,14 @@ asynStatus FirewireWinDCAM::formatValidModes()
     }
 
     /* Get the current color code */
-    this->pCameraControlSize->GetColorCode((COLOR_CODE *)&colorCode);
+    this->pCameraControlSize->GetColorCode((FDCColorCode *)&colorCode);
     setIntegerParam(FDC_colorcode, colorCode);
     sprintf(str, "%s", colorCodeStrings[colorCode]);
     setStringParam(FDC_current_colorcode, str);
     
     maxAddr = MAX(MAX_1394_VIDEO_FORMATS, MAX_1394_VIDEO_MODES);
     maxAddr = MAX(maxAddr, MAX_1394_FRAME_RATES);
-    maxAddr = MAX(maxAddr, COLOR_CODE_MAX);
+    maxAddr = MAX(maxAddr, FDC_COLOR_CODE_MAX);
     /* This assumes that the number of formats, modes and rates are all the same */
     for (addr=0; addr<maxAddr; addr++) callParamCallbacks(addr, addr);
 
@@ -1438,10 +3260,9 @@ asynStatus FirewireWinDCAM::formatFormat7Modes()
     int format=7, mode;
     int oldFormat, oldMode, oldRate;
     int err;
+    int colorCode;
     asynStatus status = asynSuccess;
-    unsigned short hsMax, vsMax, hsUnit, vsUnit;
-    unsigned short hpUnit, vpUnit;
-    char str[100];
+    FDCFormat7Caps *pDesc;
     const char* functionName="formatFormat7Modes";
  
     /* This function changes the camera to each valid Format 7 mode and
@@ -1469,15 +3290,20 @@ asynStatus FirewireWinDCAM::formatFormat7Modes()
         err = this->pCamera->SetVideoMode(mode);
         status = PERR(err);
         if (status == asynError) goto done;
+        pDesc = &this->caps.format7[mode];
         /* Get the size limits */
-        this->pCameraControlSize->GetSizeLimits(&hsMax, &vsMax);
+        this->pCameraControlSize->GetSizeLimits(&pDesc->hsMax, &pDesc->vsMax);
         /* Get the size units (minimum increment) */
-        this->pCameraControlSize->GetSizeUnits(&hsUnit, &vsUnit);
+        this->pCameraControlSize->GetSizeUnits(&pDesc->hsUnit, &pDesc->vsUnit);
         /* Get the position units (minimum increment) */
-        this->pCameraControlSize->GetPosUnits(&hpUnit, &vpUnit);
-        sprintf(str, "%dx%d (%d,%d)(%d,%d)",
-            hsMax, vsMax, hsUnit, vsUnit, hpUnit, vpUnit);
-        videoModeStrings[format][mode] = epicsStrDup(str);
+        this->pCameraControlSize->GetPosUnits(&pDesc->hpUnit, &pDesc->vpUnit);
+        /* Get the color codes this mode supports */
+        pDesc->colorCodes = 0;
+        for (colorCode=0; colorCode<FDC_COLOR_CODE_MAX; colorCode++) {
+            if (this->pCameraControlSize->HasColorCode((FDCColorCode)colorCode)) 
+                pDesc->colorCodes |= 1 << colorCode;
+        }
+        this->setFormat7ModeString(mode, pDesc);
     }
     if (oldFormat != -1) {
         err = this->pCamera->SetVideoFormat(oldFormat);
@@ -1499,6 +3325,154 @@ asynStatus FirewireWinDCAM::formatFormat7Modes()
     return status;
 }
 
+/** Writes the informative string for a Format 7 mode from its descriptor */
+void FirewireWinDCAM::setFormat7ModeString(int mode, FDCFormat7Caps *pDesc)
+{
+    char str[100];
+
+    sprintf(str, "%dx%d (%d,%d)(%d,%d)",
+        pDesc->hsMax, pDesc->vsMax, pDesc->hsUnit, pDesc->vsUnit, pDesc->hpUnit, pDesc->vpUnit);
+    videoModeStrings[7][mode] = epicsStrDup(str);
+}
+
+/** Reads the supported formats, modes and rates.
+ * These come from registers the library reads in InitCamera(), so this does no bus I/O. */
+void FirewireWinDCAM::getVideoCapabilities(FDCCapabilities *pCaps)
+{
+    int format, mode, rate;
+
+    this->pCamera->GetCameraUniqueID(&pCaps->guid);
+    pCaps->version = this->pCamera->GetVersion();
+    pCaps->formats = 0;
+    for (format=0; format<MAX_1394_VIDEO_FORMATS; format++) {
+        pCaps->modes[format] = 0;
+        if (!this->pCamera->HasVideoFormat(format)) continue;
+        pCaps->formats |= 1 << format;
+        for (mode=0; mode<MAX_1394_VIDEO_MODES; mode++) {
+            pCaps->rates[format][mode] = 0;
+            if (!this->pCamera->HasVideoMode(format, mode)) continue;
+            pCaps->modes[format] |= 1 << mode;
+            for (rate=0; rate<MAX_1394_FRAME_RATES; rate++) {
+                if (this->pCamera->HasVideoFrameRate(format, mode, rate)) 
+                    pCaps->rates[format][mode] |= 1 << rate;
+            }
+        }
+    }
+}
+
+/** Checks that a cache file matches the camera.
+ * The GUID, IIDC version, and the supported formats, modes and rates must match, and if the camera
+ * is in Format 7 the descriptor of the current mode must match. None of this needs to switch modes.
+ * \return 1 if the cache can be used, 0 if not.
+ */
+int FirewireWinDCAM::validateCapabilities(FDCCapabilities *pCached)
+{
+    FDCCapabilities *pLive = &this->caps;
+    FDCFormat7Caps *pDesc;
+    unsigned short hsMax, vsMax, hsUnit, vsUnit;
+    int mode;
+
+    if ((pCached->guid != pLive->guid) || (pCached->version != pLive->version)) return 0;
+    if (pCached->formats != pLive->formats) return 0;
+    if (memcmp(pCached->modes, pLive->modes, sizeof(pLive->modes))) return 0;
+    if (memcmp(pCached->rates, pLive->rates, sizeof(pLive->rates))) return 0;
+    if (pCached->numFeatures != num1394Features) return 0;
+    if (this->pCamera->GetVideoFormat() == 7) {
+        mode = this->pCamera->GetVideoMode();
+        if ((mode < 0) || (mode >= MAX_1394_VIDEO_MODES)) return 0;
+        pDesc = &pCached->format7[mode];
+        this->pCameraControlSize->GetSizeLimits(&hsMax, &vsMax);
+        this->pCameraControlSize->GetSizeUnits(&hsUnit, &vsUnit);
+        if ((hsMax != pDesc->hsMax) || (vsMax != pDesc->vsMax) ||
+            (hsUnit != pDesc->hsUnit) || (vsUnit != pDesc->vsUnit)) return 0;
+    }
+    return 1;
+}
+
+/** Obtains the static capabilities of the camera.
+ * If a capability cache directory has been configured and a valid cache file exists for this camera
+ * the capabilities are loaded from it. Otherwise the camera is probed and the cache file is written.
+ * \param[in] forceRefresh Probe the camera even if a valid cache file exists.
+ */
+asynStatus FirewireWinDCAM::loadCapabilities(int forceRefresh)
+{
+    asynStatus status = asynSuccess;
+    FDCCapabilities cached;
+    char fileName[256];
+    int haveFile = 0;
+    int mode;
+    epicsTimeStamp tStart, tEnd;
+    const char* functionName="loadCapabilities";
+
+    epicsTimeGetCurrent(&tStart);
+    this->getVideoCapabilities(&this->caps);
+    if (capCacheDirectory) {
+        haveFile = (fdcCapCacheFileName(capCacheDirectory, this->caps.guid, fileName, sizeof(fileName)) == 0);
+    }
+
+    if (haveFile && !forceRefresh && 
+        (fdcCapCacheRead(fileName, &cached) == 0) && this->validateCapabilities(&cached)) {
+        this->caps = cached;
+        for (mode=0; mode<MAX_1394_VIDEO_MODES; mode++) {
+            if (this->caps.modes[7] & (1 << mode)) this->setFormat7ModeString(mode, &this->caps.format7[mode]);
+        }
+        this->capsValid = 1;
+        setIntegerParam(FDC_caps_source, 1);
+        asynPrint(pasynUserSelf, ASYN_TRACE_FLOW,
+            "%s:%s [%s] capabilities loaded from %s\n",
+            driverName, functionName, this->portName, fileName);
+    } else {
+        status = this->formatFormat7Modes();
+        if (status == asynSuccess) status = this->probeFeatures();
+        if (status == asynSuccess) {
+            this->capsValid = 1;
+            if (haveFile && fdcCapCacheWrite(fileName, &this->caps)) {
+                asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s [%s] ERROR: unable to write capability cache file %s\n",
+                    driverName, functionName, this->portName, fileName);
+            }
+        }
+        setIntegerParam(FDC_caps_source, 0);
+    }
+    epicsTimeGetCurrent(&tEnd);
+    setDoubleParam(FDC_caps_time, epicsTimeDiffInSeconds(&tEnd, &tStart));
+    return status;
+}
+
+/** Reads the capabilities and ranges of all features from their inquiry registers */
+asynStatus FirewireWinDCAM::probeFeatures()
+{
+    FDCCameraControl *pFeature;
+    FDCFeatureCaps *pCaps;
+    float fmin, fmax;
+    int addr;
+
+    this->caps.numFeatures = num1394Features;
+    for (addr = 0; addr < num1394Features; addr++) {
+        pFeature = this->pCameraControl[addr];
+        pCaps = &this->caps.features[addr];
+        pFeature->Inquire();
+        pCaps->flags = 0;
+        pCaps->min = pCaps->max = 0;
+        pCaps->absMin = pCaps->absMax = 0.;
+        if (!pFeature->HasPresence()) continue;
+        pCaps->flags |= FDC_CAP_FEAT_PRESENT;
+        if (pFeature->HasAbsControl())  pCaps->flags |= FDC_CAP_FEAT_ABS;
+        if (pFeature->HasAutoMode())    pCaps->flags |= FDC_CAP_FEAT_AUTO;
+        if (pFeature->HasManualMode())  pCaps->flags |= FDC_CAP_FEAT_MANUAL;
+        if (pFeature->HasOnOff())       pCaps->flags |= FDC_CAP_FEAT_ONOFF;
+        if (pFeature->HasOnePush())     pCaps->flags |= FDC_CAP_FEAT_ONEPUSH;
+        if (pFeature->HasReadout())     pCaps->flags |= FDC_CAP_FEAT_READOUT;
+        pFeature->GetRange(&pCaps->min, &pCaps->max);
+        if (pCaps->flags & FDC_CAP_FEAT_ABS) {
+            pFeature->GetRangeAbsolute(&fmin, &fmax);
+            pCaps->absMin = fmin;
+            pCaps->absMax = fmax;
+        }
+    }
+    return asynSuccess;
+}
+
 /** Read all the feature settings and values from the camera.
  * This function will collect all the current values and settings from the camera,
  * and set the appropriate integer/double parameters in the param lib. If a certain feature
@@ -1511,7 +3485,7 @@ asynStatus FirewireWinDCAM::formatFormat7Modes()
 asynStatus FirewireWinDCAM::getAllFeatures()
 {
     asynStatus status = asynSuccess;
-    C1394CameraControl *pFeature;
+    FDCCameraControl *pFeature;
     int tmp, addr, value;
     unsigned short min, max, lo, hi;
     float fmin, fmax, fvalue;
@@ -1525,6 +3499,22 @@ asynStatus FirewireWinDCAM::getAllFeatures()
             "%s:%s: checking feature %d\n",
             driverName, functionName, addr);
 
+        /* Features the camera does not have need no bus I/O */
+        if (this->capsValid && !(this->caps.features[addr].flags & FDC_CAP_FEAT_PRESENT)) {
+            tmp = -1;
+            dtmp = -1.0;
+            setIntegerParam(addr, FDC_feat_available, 0);
+            setIntegerParam(addr, FDC_feat_val, tmp);
+            setIntegerParam(addr, FDC_feat_val_min, tmp);
+            setIntegerParam(addr, FDC_feat_val_max, tmp);
+            setIntegerParam(addr, FDC_feat_mode, tmp);
+            setIntegerParam(addr, FDC_feat_absolute, 0);
+            setDoubleParam(addr, FDC_feat_val_abs, dtmp);
+            setDoubleParam(addr, FDC_feat_val_abs_max, dtmp);
+            setDoubleParam(addr, FDC_feat_val_abs_min, dtmp);
+            continue;
+        }
+
         /* The Inquire function reads values from the camera into registers */
         pFeature->Inquire();
         /* The Status function reads status and absolute values from the camera into registers */
@@ -1540,7 +3530,7 @@ asynStatus FirewireWinDCAM::getAllFeatures()
             setIntegerParam(addr, FDC_feat_val, value);
             setIntegerParam(addr, FDC_feat_val_min, min);
             /* The max for white balance needs special treatment */
-            if (featureIndex[addr] == FEATURE_WHITE_BALANCE) 
+            if (featureIndex[addr] == FDC_FEATURE_WHITE_BALANCE) 
                 setIntegerParam(addr, FDC_feat_val_max, (((int)max)<<12) + max);
             else
                 setIntegerParam(addr, FDC_feat_val_max, max);
@@ -1576,13 +3566,13 @@ asynStatus FirewireWinDCAM::getAllFeatures()
 
     /* Finally map a few of the AreaDetector parameters on to the camera 'features' */
     for (addr=0; addr<num1394Features; addr++) {
-        if (featureIndex[addr] == FEATURE_SHUTTER) break;
+        if (featureIndex[addr] == FDC_FEATURE_SHUTTER) break;
     }
     getDoubleParam(addr, FDC_feat_val_abs, &dtmp);
     setDoubleParam(ADAcquireTime, dtmp);
 
     for (addr=0; addr<num1394Features; addr++) {
-        if (featureIndex[addr] == FEATURE_GAIN) break;
+        if (featureIndex[addr] == FDC_FEATURE_GAIN) break;
     }
     getDoubleParam(addr, FDC_feat_val_abs, &dtmp);
     setDoubleParam(ADGain, dtmp);
@@ -1597,23 +3587,23 @@ asynStatus FirewireWinDCAM::getAllFeatures()
 asynStatus FirewireWinDCAM::startCapture()
 {
     asynStatus status = asynSuccess;
-    int err;
-    int msTimeout;
-    double acquireTime;
-    double readoutTime;
+    int depth, policy, nBuffers;
     const char* functionName = "startCapture";
 
-    getDoubleParam(ADAcquireTime, &acquireTime);
-    getDoubleParam(FDC_readout_time, &readoutTime);
-    /* The timeout for waiting for a frame will be the exposure time plus readout time */
-    msTimeout = 1000 * (int)(acquireTime + readoutTime);
-    asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
-        "%s::%s [%s] Starting firewire transmission, timeout (ms)=%d\n",
-        driverName, functionName, this->portName, msTimeout);
-    /* Start the camera transmission... */
-    err = this->pCamera->StartImageAcquisitionEx(MAX_1394_BUFFERS, 
-                                                 msTimeout, ACQ_START_VIDEO_STREAM);
-    status = PERR(err);
+    /* An automatically sized ring that overflowed during the last acquisition is doubled */
+    getIntegerParam(FDC_dma_depth, &depth);
+    getIntegerParam(FDC_drain_policy, &policy);
+    getIntegerParam(FDC_dma_buffers, &nBuffers);
+    if ((this->acqOverruns > 0) && (depth == 0) && (policy == FDCDrainLossless) &&
+        (nBuffers + this->dmaGrowth < MAX_DMA_BUFFERS)) {
+        this->dmaGrowth += nBuffers;
+        asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
+            "%s::%s [%s] %d frames lost to DMA ring overflows, adding %d buffers\n",
+            driverName, functionName, this->portName, this->acqOverruns, nBuffers);
+    }
+    this->acqOverruns = 0;
+
+    status = this->startStream();
     if (status == asynError)
     {
         asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
@@ -1626,10 +3616,473 @@ asynStatus FirewireWinDCAM::startCapture()
 
     /* Signal the image grabbing thread that the acquisition/transmission has
      * started and it can start dequeueing images from the driver buffer */
-    epicsEventSignal(this->startEventId);
+    if (this->pReactorCamera) fdcReactorWake(this->pReactorCamera);
+    else epicsEventSignal(this->startEventId);
+    return status;
+}
+
+/** Starts the isochronous transmission from the camera into the DMA buffers.
+ * Used both when acquisition is started and when the stream is restarted after a reconfiguration.
+ */
+asynStatus FirewireWinDCAM::startStream()
+{
+    asynStatus status = asynSuccess;
+    int err;
+    double expected;
+    int nBuffers;
+    const char* functionName = "startStream";
+
+    /* Reserve the share of the bus the camera takes before it starts sending; this may reduce the
+     * Format 7 packet size and so the frame rate */
+    status = this->allocateBandwidth();
+    if (status) return status;
+    expected = this->getExpectedInterval();
+    setDoubleParam(FDC_predicted_fps, (expected > 0.) ? 1. / expected : 0.);
+    /* The timeout for waiting for a frame is a few times the expected time between frames, which is
+     * the frame interval of the video mode or the exposure plus readout time if that is longer */
+    this->msTimeout = (int)(1000. * (WATCHDOG_TIMEOUT_FACTOR * expected + WATCHDOG_TIMEOUT_MARGIN));
+    setDoubleParam(FDC_wd_timeout, this->msTimeout / 1000.);
+    /* The DMA ring depth depends on the drain policy */
+    nBuffers = this->dmaBufferCount(expected);
+    setIntegerParam(FDC_dma_buffers, nBuffers);
+    this->streamInterval = expected;
+    this->backlogValid = 0;
+    this->wakeValid = 0;
+    setIntegerParam(FDC_backlog, 0);
+    asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
+        "%s::%s [%s] Starting firewire transmission, timeout (ms)=%d, DMA buffers=%d\n",
+        driverName, functionName, this->portName, this->msTimeout, nBuffers);
+    /* Start the camera transmission... */
+    err = this->pCamera->StartImageAcquisitionEx(nBuffers, 
+                                                 this->msTimeout, FDC_ACQ_START_VIDEO_STREAM);
+    status = PERR(err);
+    if (status) {
+        fdcIsoRelease(this->guid);
+        this->updateBusUsage();
+    }
+    return status;
+}
+
+/** Reserves the isochronous bandwidth of the camera on its bus with the bandwidth manager shared by
+ * all the driver instances, see firewireWinDCAMIso.h. Called before the stream is started.
+ * If the camera does not fit in what the other cameras on the bus leave, FDC_ISO_POLICY decides:
+ * the stream is refused, or in Format 7 the packet size is reduced to what is left.
+ * \return asynSuccess if the bandwidth is reserved, asynError if the stream must not be started.
+ */
+asynStatus FirewireWinDCAM::allocateBandwidth()
+{
+    int policy, bus, speed, format;
+    unsigned short bpp, bppMin, bppMax, fitBpp;
+    unsigned long units, available, packetsPerFrame;
+    double interval;
+    const char *functionName = "allocateBandwidth";
+
+    getIntegerParam(FDC_iso_policy, &policy);
+    getIntegerParam(FDC_iso_bus, &bus);
+    setIntegerParam(FDC_iso_shrunk, 0);
+    if (policy == FDCIsoOff) {
+        fdcIsoRelease(this->guid);
+        setIntegerParam(FDC_iso_units, 0);
+        this->updateBusUsage();
+        return asynSuccess;
+    }
+    speed = this->isoSpeed;
+    format = this->pCamera->GetVideoFormat();
+    if (format == 7) {
+        this->pCameraControlSize->GetBytesPerPacket(&bpp);
+    } else {
+        /* The fixed modes send a frame evenly over the cycles of one frame interval */
+        interval = this->getFrameInterval();
+        bpp = (interval > 0.) ?
+            (unsigned short)(this->getFrameBytes() / (interval * FDC_ISO_CYCLES_PER_SECOND) + 0.999) : 0;
+    }
+    units = fdcIsoPacketUnits(bpp, speed);
+    if (fdcIsoAllocate(bus, this->guid, units, &available) == 0) goto done;
+
+    if ((policy == FDCIsoShrink) && (format == 7)) {
+        this->pCameraControlSize->GetBytesPerPacketRange(&bppMin, &bppMax);
+        fitBpp = fdcIsoFitBytesPerPacket(available, speed, bppMin);
+        if ((fitBpp >= bppMin) && (this->pCameraControlSize->SetBytesPerPacket(fitBpp) == FDC_CAM_SUCCESS)) {
+            units = fdcIsoPacketUnits(fitBpp, speed);
+            if (fdcIsoAllocate(bus, this->guid, units, &available) == 0) {
+                asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s::%s [%s]: bus %d has %lu bandwidth units left, packet size reduced from %u to %u bytes\n",
+                    driverName, functionName, this->portName, bus, available, bpp, fitBpp);
+                setIntegerParam(FDC_iso_shrunk, 1);
+                this->pCameraControlSize->GetPacketsPerFrame(&packetsPerFrame);
+                setIntegerParam(FDC_packet_size, fitBpp);
+                setIntegerParam(FDC_packets_per_frame, (int)packetsPerFrame);
+                goto done;
+            }
+        }
+    }
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+        "%s::%s [%s]: not enough bandwidth on bus %d, %lu units needed, %lu left\n",
+        driverName, functionName, this->portName, bus, units, available);
+    setStringParam(ADStatusMessage, "Not enough bus bandwidth");
+    setIntegerParam(FDC_iso_units, 0);
+    this->updateBusUsage();
+    return asynError;
+
+    done:
+    setIntegerParam(FDC_iso_units, (int)units);
+    this->updateBusUsage();
+    return asynSuccess;
+}
+
+/** Chooses the speed the camera sends at.
+ * The link speed is the fastest both the camera and the host adapter support. IIDC cameras only
+ * send faster than S400 in 1394b mode, so with FDC_1394B_MODE=Auto the mode is turned on when the
+ * camera has it and the link is faster than S400, and with Legacy it is turned off. The speed is
+ * used to plan the Format 7 packet size and to reserve the bus bandwidth.
+ * Called with the stream stopped: when the camera is opened, after it was reset and when
+ * FDC_1394B_MODE is written.
+ * \return asynError if the mode could not be changed; the speed of the mode the camera is in is used.
+ */
+asynStatus FirewireWinDCAM::negotiateSpeed()
+{
+    asynStatus status = asynSuccess;
+    int mode, linkSpeed;
+    bool has1394b, want1394b, on1394b;
+    const char *functionName = "negotiateSpeed";
+
+    getIntegerParam(FDC_1394b_mode, &mode);
+    linkSpeed = this->pCamera->GetMaxSpeed();
+    has1394b = this->pCamera->Has1394b();
+    if (has1394b) {
+        want1394b = (mode == FDC1394bAuto) && (linkSpeed > FDC_ISO_LEGACY_SPEED);
+        if (want1394b != this->pCamera->Status1394b()) status = PERR(this->pCamera->Set1394b(want1394b));
+    }
+    on1394b = has1394b && this->pCamera->Status1394b();
+    this->isoSpeed = fdcIsoSpeed(linkSpeed, on1394b);
+    setIntegerParam(FDC_1394b, on1394b ? 1 : 0);
+    setIntegerParam(FDC_link_speed, linkSpeed);
+    setIntegerParam(FDC_iso_speed, this->isoSpeed);
+    setDoubleParam(FDC_max_mbytes, fdcIsoMaxBytesPerSecond(this->isoSpeed) / 1.e6);
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+        "%s::%s [%s]: link S%d, 1394b %s, sending at S%d\n",
+        driverName, functionName, this->portName, linkSpeed,
+        on1394b ? "on" : (has1394b ? "off" : "not supported"), this->isoSpeed);
     return status;
 }
 
+/** Publishes the bandwidth reserved on the bus of the camera by all the cameras streaming on it */
+void FirewireWinDCAM::updateBusUsage()
+{
+    int bus, cameras;
+    unsigned long units;
+
+    getIntegerParam(FDC_iso_bus, &bus);
+    fdcIsoGetBusUsage(bus, &units, &cameras);
+    setDoubleParam(FDC_iso_bus_use, 100. * units / FDC_ISO_BANDWIDTH_UNITS);
+    setIntegerParam(FDC_iso_bus_cameras, cameras);
+}
+
+/** Tries to get frames flowing again after a grab received no frame.
+ * Called from the image grabbing thread with the driver locked. The action escalates with the
+ * number of consecutive failures: the first WATCHDOG_RETRIES failures are only retried, the next
+ * one restarts the stream, and from then on the camera is re-initialized before the stream is
+ * restarted, until a frame arrives or acquisition is stopped. If the camera cannot be
+ * re-initialized it has left the bus, and it is marked lost by loseCamera() and looked for by the
+ * next grab step, see lostStep().
+ */
+void FirewireWinDCAM::recoverStream()
+{
+    asynStatus status;
+    int count;
+    const char *functionName = "recoverStream";
+
+    this->wdFailures++;
+    if (this->wdFailures <= WATCHDOG_RETRIES) {
+        getIntegerParam(FDC_wd_retries, &count);
+        setIntegerParam(FDC_wd_retries, count + 1);
+        asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
+            "%s::%s [%s]: no frame received, retrying\n",
+            driverName, functionName, this->portName);
+        return;
+    }
+    setIntegerParam(ADStatus, ADStatusWaiting);
+    this->stopCapture();
+    if (this->wdFailures == WATCHDOG_RETRIES + 1) {
+        getIntegerParam(FDC_wd_restarts, &count);
+        setIntegerParam(FDC_wd_restarts, count + 1);
+        setStringParam (ADStatusMessage, "No frames, restarting stream");
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+            "%s::%s [%s]: no frame received, restarting stream\n",
+            driverName, functionName, this->portName);
+        status = this->startStream();
+        if (status == asynSuccess) return;
+    }
+    getIntegerParam(FDC_wd_reinits, &count);
+    setIntegerParam(FDC_wd_reinits, count + 1);
+    setStringParam (ADStatusMessage, "No frames, re-initializing camera");
+    asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+        "%s::%s [%s]: no frame received, re-initializing camera\n",
+        driverName, functionName, this->portName);
+    status = PERR(this->pCamera->InitCamera(0));
+    if (status == asynSuccess) status = this->startStream();
+    if (status != asynSuccess) this->loseCamera();
+}
+
+/** Records the end of a recovery when the first frame after failed grabs has arrived.
+ * \param[in] pFrameTime The arrival time of the frame; the downtime is counted from the last
+ *            frame before the failures.
+ */
+void FirewireWinDCAM::streamRecovered(epicsTimeStamp *pFrameTime)
+{
+    double downtime, total;
+    const char *functionName = "streamRecovered";
+
+    downtime = epicsTimeDiffInSeconds(pFrameTime, &this->lastFrameTime);
+    getDoubleParam(FDC_wd_downtime, &total);
+    setDoubleParam(FDC_wd_downtime, total + downtime);
+    setDoubleParam(FDC_wd_last_downtime, downtime);
+    setStringParam (ADStatusMessage, "");
+    asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
+        "%s::%s [%s]: frames received again after %d failed grabs, %.3f s without frames\n",
+        driverName, functionName, this->portName, this->wdFailures, downtime);
+    this->wdFailures = 0;
+}
+
+/** Gives up a camera that has left the bus.
+ * Called from the grab step with the driver locked, when the camera could not be re-initialized
+ * after failed grabs. This happens on a bus reset, which invalidates the camera handle, and when
+ * the camera is unplugged or loses power. The settings it had are saved in the shadow copy, the
+ * camera is closed, and until it is back the writes that need it are queued as during
+ * initialization. The camera is then looked for by reconnectCamera().
+ */
+void FirewireWinDCAM::loseCamera()
+{
+    const char *functionName = "loseCamera";
+
+    epicsTimeGetCurrent(&this->lostTime);
+    this->saveShadow();
+    this->stopCapture();
+    this->initState = FDCInitDiscovering;
+    setIntegerParam(FDC_init_state, FDCInitDiscovering);
+    asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+        "%s::%s [%s]: camera 0x%16.16llX lost, waiting for it to return\n",
+        driverName, functionName, this->portName, this->guid);
+    /* The setters called to restore the settings must not try to pause the stream */
+    this->capturePaused = 1;
+    delete this->pCamera;
+    this->pCamera = NULL;
+    this->cameraLost = 1;
+}
+
+/** Handles a lost camera in the grab step. Called with the driver locked.
+ * In the thread of the camera the bus is polled by reconnectCamera() here. If acquisition is
+ * stopped before the camera is back the thread waits for acquisition to be started, or for a
+ * write that needs the camera, and then polls again. The workers of the grab reactor are shared
+ * with other cameras and must not wait for one, so in the reactor the camera is parked and the
+ * bus is polled by a thread of its own, which wakes the camera when it is back.
+ * \param[in] blocking 1 in the thread of the camera, 0 in the grab reactor, see grabStep().
+ * \return 1 if the camera waits for fdcReactorWake(), 0 if the grab step is run again.
+ */
+int FirewireWinDCAM::lostStep(int blocking)
+{
+    if (!blocking) {
+        this->startReconnect();
+        return 1;
+    }
+    if (this->reconnectCamera() != asynSuccess) {
+        this->unlock();
+        epicsEventWait(this->startEventId);
+        this->lock();
+    }
+    return 0;
+}
+
+/** Starts the thread that looks for a lost camera in the grab reactor, unless it is already
+ * running. Called with the driver locked. */
+void FirewireWinDCAM::startReconnect()
+{
+    const char *functionName = "startReconnect";
+
+    if (this->reconnectRunning) return;
+    this->reconnectRunning = 1;
+    if (!epicsThreadCreate("FDCReconnect", epicsThreadPriorityMedium,
+                           epicsThreadGetStackSize(epicsThreadStackMedium), reconnectTaskC, this)) {
+        this->reconnectRunning = 0;
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+            "%s::%s [%s]: unable to create the reconnect thread\n",
+            driverName, functionName, this->portName);
+    }
+}
+
+/** Looks for a lost camera of the grab reactor, and wakes the camera if it is back */
+void FirewireWinDCAM::reconnectTask()
+{
+    asynStatus status;
+
+    this->lock();
+    status = this->reconnectCamera();
+    this->reconnectRunning = 0;
+    this->unlock();
+    if (status == asynSuccess) fdcReactorWake(this->pReactorCamera);
+}
+
+/** Looks for a lost camera, opens it again and restores its settings.
+ * Called with the driver locked. The bus is scanned for the same GUID every
+ * WATCHDOG_RECONNECT_POLL seconds with the lock released, for as long as acquisition is on; once
+ * it is stopped the camera is only looked for again when acquisition is started or a write needs
+ * it. When the camera is back it is initialized, the settings it had are restored from the shadow
+ * copy, the queued writes are applied, and the stream is restarted if acquisition is on. FDC_ISO_BUS
+ * is left as it was, it may have been set by the user.
+ * \return asynSuccess when the camera is back, asynError when acquisition was stopped first.
+ */
+asynStatus FirewireWinDCAM::reconnectCamera()
+{
+    FDCCameraInfo info;
+    epicsTimeStamp backTime;
+    asynStatus status;
+    int acquire, numImagesCounter, count, i, bus;
+    double recoverTime;
+    const char *functionName = "reconnectCamera";
+
+    setIntegerParam(ADStatus, ADStatusWaiting);
+    setStringParam (ADStatusMessage, "Camera lost, waiting for it to return");
+    callParamCallbacks();
+
+    /* The lock is released while the bus is scanned, writes meanwhile are queued */
+    while (1) {
+        this->unlock();
+        status = asynError;
+        fdcEnumInvalidate();
+        if (!fdcEnumFind(this->guid, &info) && (this->openCamera(this->guid, &bus) == asynSuccess)) {
+            status = PERR(this->pCamera->InitCamera(1));
+            if (status != asynSuccess) {
+                delete this->pCamera;
+                this->pCamera = NULL;
+            }
+        }
+        this->lock();
+        if (status == asynSuccess) break;
+        getIntegerParam(ADAcquire, &acquire);
+        if (!acquire) {
+            setIntegerParam(ADStatus, ADStatusIdle);
+            setStringParam (ADStatusMessage, "Camera lost, start acquisition to look for it");
+            callParamCallbacks();
+            asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
+                "%s::%s [%s]: acquisition stopped, no longer looking for camera 0x%16.16llX\n",
+                driverName, functionName, this->portName, this->guid);
+            return asynError;
+        }
+        this->unlock();
+        epicsThreadSleep(WATCHDOG_RECONNECT_POLL);
+        this->lock();
+    }
+
+    this->cameraLost = 0;
+    this->pCameraControlSize = this->pCamera->GetCameraControlSize();
+    for (i=0; i<num1394Features; i++) {
+        this->pCameraControl[i] = this->pCamera->GetCameraControl(featureIndex[i]);
+    }
+    /* The reset put the camera back in legacy mode */
+    this->negotiateSpeed();
+    if (this->restoreShadow() != asynSuccess) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+            "%s::%s [%s]: not all settings could be restored\n",
+            driverName, functionName, this->portName);
+    }
+    this->initState = FDCInitReady;
+    setIntegerParam(FDC_init_state, FDCInitReady);
+    /* Writes queued while the camera was lost may have signalled the grab thread to look for it */
+    epicsEventTryWait(this->startEventId);
+    /* Starting acquisition while the camera was lost only set ADAcquire, see writeInt32() */
+    getIntegerParam(ADNumImagesCounter, &numImagesCounter);
+    this->applyPendingWrites();
+    this->capturePaused = 0;
+    getIntegerParam(ADAcquire, &acquire);
+    if (acquire) {
+        setIntegerParam(ADNumImagesCounter, numImagesCounter);
+        status = this->startStream();
+    } else {
+        setIntegerParam(ADStatus, ADStatusIdle);
+    }
+    epicsTimeGetCurrent(&backTime);
+    recoverTime = epicsTimeDiffInSeconds(&backTime, &this->lostTime);
+    getIntegerParam(FDC_wd_reconnects, &count);
+    setIntegerParam(FDC_wd_reconnects, count + 1);
+    setDoubleParam(FDC_wd_reconnect_time, recoverTime);
+    setStringParam (ADStatusMessage, "");
+    callParamCallbacks();
+    asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+        "%s::%s [%s]: camera 0x%16.16llX back after %.3f s\n",
+        driverName, functionName, this->portName, this->guid, recoverTime);
+    if (status != asynSuccess) {
+        /* Do not spin on AcquireImageEx if the stream could not be restarted */
+        this->unlock();
+        epicsThreadSleep(WATCHDOG_RECONNECT_POLL);
+        this->lock();
+    }
+    return asynSuccess;
+}
+
+/** Saves the settings of the camera in the shadow copy.
+ * The parameter library holds the settings last read back from the camera, and the feature
+ * shadow records whether each feature value was last written with absolute control.
+ */
+void FirewireWinDCAM::saveShadow()
+{
+    int addr;
+
+    getIntegerParam(FDC_format, &this->shadow.format);
+    getIntegerParam(FDC_mode, &this->shadow.mode);
+    getIntegerParam(FDC_framerate, &this->shadow.rate);
+    getIntegerParam(FDC_colorcode, &this->shadow.colorCode);
+    getIntegerParam(ADSizeX, &this->shadow.sizeX);
+    getIntegerParam(ADSizeY, &this->shadow.sizeY);
+    getIntegerParam(ADMinX, &this->shadow.minX);
+    getIntegerParam(ADMinY, &this->shadow.minY);
+    for (addr=0; addr<num1394Features; addr++) {
+        FDCFeatureShadow *pShadow = &this->pFeatureShadow[addr];
+        getIntegerParam(addr, FDC_feat_available, &pShadow->available);
+        getIntegerParam(addr, FDC_feat_mode, &pShadow->mode);
+        getIntegerParam(addr, FDC_feat_val, &pShadow->value);
+        getDoubleParam(addr, FDC_feat_val_abs, &pShadow->absValue);
+    }
+}
+
+/** Writes the settings in the shadow copy to the camera and reads them back.
+ * \return asynError if any setting could not be restored.
+ */
+asynStatus FirewireWinDCAM::restoreShadow()
+{
+    asynStatus status = asynSuccess;
+    int addr;
+
+    status = PERR(this->pCamera->SetVideoFormat(this->shadow.format));
+    if (status == asynSuccess) status = PERR(this->pCamera->SetVideoMode(this->shadow.mode));
+    if (this->shadow.format == 7) {
+        /* setFormat7Params() takes the ROI and color code from the parameters */
+        setIntegerParam(ADSizeX, this->shadow.sizeX);
+        setIntegerParam(ADSizeY, this->shadow.sizeY);
+        setIntegerParam(ADMinX, this->shadow.minX);
+        setIntegerParam(ADMinY, this->shadow.minY);
+        setIntegerParam(FDC_colorcode, this->shadow.colorCode);
+        if (this->setFormat7Params()) status = asynError;
+    } else if (status == asynSuccess) {
+        status = PERR(this->pCamera->SetVideoFrameRate(this->shadow.rate));
+    }
+    for (addr=0; addr<num1394Features; addr++) {
+        FDCFeatureShadow *pShadow = &this->pFeatureShadow[addr];
+        if (!pShadow->available) continue;
+        if (pShadow->mode) {
+            if (this->setFeatureMode(addr, 1)) status = asynError;
+            continue;
+        }
+        if (this->setFeatureMode(addr, 0)) status = asynError;
+        if (pShadow->absolute) {
+            if (this->setFeatureAbsValue(addr, pShadow->absValue)) status = asynError;
+        } else {
+            if (this->setFeatureValue(addr, pShadow->value)) status = asynError;
+        }
+    }
+    this->formatValidModes();
+    this->getAllFeatures();
+    return status;
+}
 
 asynStatus FirewireWinDCAM::stopCapture()
 {
@@ -1644,6 +4097,10 @@ asynStatus FirewireWinDCAM::stopCapture()
     /* Stop the actual transmission! */
     err=this->pCamera->StopImageAcquisition();
     status = PERR(err);
+    /* The bandwidth is free for the other cameras on the bus */
+    fdcIsoRelease(this->guid);
+    setIntegerParam(FDC_iso_units, 0);
+    this->updateBusUsage();
     if (status == asynError)
     {
         /* if stopping transmission results in an error (weird situation!) we print a message
@@ -1657,6 +4114,87 @@ asynStatus FirewireWinDCAM::stopCapture()
 }
 
 
+/** Stops the stream for a reconfiguration of the camera while acquisition stays logically on.
+ * This function is called from the port thread with the driver locked. It asks the image grabbing
+ * thread to stop the transmission after the frame it is currently waiting for, and waits until it has
+ * done so. If acquisition is not active, or the stream has already been stopped by a caller further up,
+ * this function does nothing.
+ * \param[out] paused Set to 1 if this call stopped the stream and resumeCapture() must restart it.
+ */
+asynStatus FirewireWinDCAM::pauseCapture(int *paused)
+{
+    int acquire;
+    const char *functionName = "pauseCapture";
+
+    *paused = 0;
+    getIntegerParam(ADAcquire, &acquire);
+    if (!acquire || this->capturePaused) return asynSuccess;
+
+    asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
+        "%s::%s [%s] Stopping stream for reconfiguration\n",
+        driverName, functionName, this->portName);
+    this->reconfigPending = 1;
+    /* In the reactor the camera is waiting for its next frame, have it serviced now */
+    if (this->pReactorCamera) fdcReactorWake(this->pReactorCamera);
+    /* The grab thread needs the lock to see the request, release it while waiting for the next frame */
+    this->unlock();
+    epicsEventWaitWithTimeout(this->pausedEventId, this->msTimeout / 1000. + 1.0);
+    this->lock();
+    if (!this->capturePaused) {
+        this->reconfigPending = 0;
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+            "%s::%s ERROR [%s]: timeout waiting for the stream to stop\n",
+            driverName, functionName, this->portName);
+        return asynError;
+    }
+    *paused = 1;
+    return asynSuccess;
+}
+
+/** Restarts the stream after a reconfiguration and lets the image grabbing thread continue.
+ * If the stream cannot be restarted acquisition is turned off.
+ * \param[in] paused The value returned by the matching pauseCapture() call; nothing is done if 0.
+ */
+asynStatus FirewireWinDCAM::resumeCapture(int paused)
+{
+    asynStatus status = asynSuccess;
+    const char *functionName = "resumeCapture";
+
+    if (!paused) return asynSuccess;
+
+    status = this->startStream();
+    if (status == asynError) {
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
+            "%s::%s ERROR [%s]: restarting transmission after reconfiguration failed, stopping acquisition\n",
+            driverName, functionName, this->portName);
+        setIntegerParam(ADAcquire, 0);
+    } else {
+        this->gapPending = 1;
+    }
+    if (this->pReactorCamera) {
+        /* The grab step parked the camera when it stopped the stream */
+        this->capturePaused = 0;
+        fdcReactorWake(this->pReactorCamera);
+    } else {
+        epicsEventSignal(this->resumeEventId);
+    }
+    return status;
+}
+
+/** Stops and restarts the stream if we are acquiring, to apply settings that are only read when
+ * the stream is started, such as the DMA ring depth.
+ */
+asynStatus FirewireWinDCAM::restartStream()
+{
+    asynStatus status;
+    int paused = 0;
+
+    status = this->pauseCapture(&paused);
+    if (status == asynSuccess) status = this->resumeCapture(paused);
+    return status;
+}
+
+
 /** Parse a dc1394 error code into a user readable string
  * Defaults to printing out using the pasynUser.
  * \param CAM_err The error code, returned from the dc1394 function call. If the error code is OK we just ignore it.
@@ -1664,14 +4202,18 @@ asynStatus FirewireWinDCAM::stopCapture()
  */
 asynStatus FirewireWinDCAM::err(int CAM_err, int errOriginLine)
 {
-    if (CAM_err == CAM_SUCCESS) return asynSuccess; /* if everything is OK we just ignore it */
+    const char *msg;
+
+    if (CAM_err == FDC_CAM_SUCCESS) return asynSuccess; /* if everything is OK we just ignore it */
 
+    /* Codes the table does not cover are only printed as numbers */
+    msg = ((CAM_err < 0) && (-CAM_err < numErrMsg)) ? errMsg[-CAM_err] : "Unknown error";
     if (this->pasynUserSelf == NULL) fprintf(stderr, 
         "### ERROR port=%s line=%d, error=%d (%s)\n", 
-        this->portName, errOriginLine, CAM_err, errMsg[-CAM_err]);
+        this->portName, errOriginLine, CAM_err, msg);
     else asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
         "### ERROR port=%s line=%d, error=%d (%s)\n", 
-        this->portName, errOriginLine, CAM_err, errMsg[-CAM_err]);
+        this->portName, errOriginLine, CAM_err, msg);
     return asynError;
 }
 
@@ -1683,7 +4225,7 @@ asynStatus FirewireWinDCAM::err(int CAM_err, int errOriginLine)
 void FirewireWinDCAM::report(FILE *fp, int details)
 {
     char vendorName[256], cameraName[256];
-    LARGE_INTEGER uniqueId;
+    unsigned long long uniqueId;
     int version;
     int format, mode, rate;
     unsigned long sizeX, sizeY;
@@ -1691,8 +4233,13 @@ void FirewireWinDCAM::report(FILE *fp, int details)
     int value, feature;
     unsigned short min, max, lo, hi;
     float fmin, fmax, fvalue;
-    C1394CameraControl *pFeature;
+    FDCCameraControl *pFeature;
     
+    if (this->initState != FDCInitReady) {
+        fprintf(fp, "Camera %s not ready, initialization state %d\n", this->camid, this->initState);
+        ADDriver::report(fp, details);
+        return;
+    }
     this->pCamera->GetCameraVendor(vendorName, sizeof(vendorName));
     this->pCamera->GetCameraName(cameraName, sizeof(cameraName));
     this->pCamera->GetCameraUniqueID(&uniqueId);
@@ -1700,10 +4247,14 @@ void FirewireWinDCAM::report(FILE *fp, int details)
     version = this->pCamera->GetVersion();
     fprintf(fp, "Vendor name: %s\n", vendorName);
     fprintf(fp, "Camera name: %s\n", cameraName);
-    fprintf(fp, "UniqueId: %lld (0x%llX)\n", uniqueId.QuadPart, uniqueId.QuadPart);
+    fprintf(fp, "UniqueId: %llu (0x%16.16llX)\n", uniqueId, uniqueId);
     fprintf(fp, "Version: 0x%lX\n", version);
     fprintf(fp, "Max size: X=%d, Y=%d\n", maxSizeX, maxSizeY);
     if (details > 1) {
+        fdcEnumReport(fp);
+        fdcFaultReport(fp);
+        fdcIsoReport(fp);
+        fdcReactorReport(fp);
         fprintf(fp, "Supported formats, modes and rates:\n");
         for (format=0; format<=7; format++) {
             if (this->pCamera->HasVideoFormat(format)) {
@@ -1783,23 +4334,110 @@ static const iocshArg configArg2 = {"maxBuffers", iocshArgInt};
 static const iocshArg configArg3 = {"maxMemory", iocshArgInt};
 static const iocshArg configArg4 = {"priority", iocshArgInt};
 static const iocshArg configArg5 = {"stackSize", iocshArgInt};
+static const iocshArg configArg6 = {"dmaBuffers", iocshArgInt};
 static const iocshArg * const configArgs[] = {&configArg0,
                                               &configArg1,
                                               &configArg2,
                                               &configArg3,
                                               &configArg4,
-                                              &configArg5};
-static const iocshFuncDef configFirewireWinDCAM = {"WinFDC_Config", 6, configArgs};
+                                              &configArg5,
+                                              &configArg6};
+static const iocshFuncDef configFirewireWinDCAM = {"WinFDC_Config", 7, configArgs};
 static void configCallFunc(const iocshArgBuf *args)
 {
     WinFDC_Config(args[0].sval, args[1].sval, args[2].ival, 
-                  args[3].ival, args[4].ival, args[5].ival);
+                  args[3].ival, args[4].ival, args[5].ival, args[6].ival);
+}
+
+
+static const iocshArg cacheArg0 = {"directory", iocshArgString};
+static const iocshArg cacheArg1 = {"forceRefresh", iocshArgInt};
+static const iocshArg * const cacheArgs[] = {&cacheArg0,
+                                             &cacheArg1};
+static const iocshFuncDef configCapabilityCache = {"WinFDC_CapabilityCache", 2, cacheArgs};
+static void cacheCallFunc(const iocshArgBuf *args)
+{
+    WinFDC_CapabilityCache(args[0].sval, args[1].ival);
+}
+
+
+static const iocshFuncDef configBusScan = {"WinFDC_BusScan", 0, NULL};
+static void busScanCallFunc(const iocshArgBuf *args)
+{
+    WinFDC_BusScan();
+}
+
+static const iocshArg simArg0 = {"ID", iocshArgString};
+static const iocshArg simArg1 = {"maxSizeX", iocshArgInt};
+static const iocshArg simArg2 = {"maxSizeY", iocshArgInt};
+static const iocshArg simArg3 = {"frameRate", iocshArgDouble};
+static const iocshArg simArg4 = {"bus", iocshArgInt};
+static const iocshArg simArg5 = {"speed", iocshArgInt};
+static const iocshArg simArg6 = {"dataDepth", iocshArgInt};
+static const iocshArg simArg7 = {"sentAlign", iocshArgInt};
+static const iocshArg * const simArgs[] = {&simArg0,
+                                           &simArg1,
+                                           &simArg2,
+                                           &simArg3,
+                                           &simArg4,
+                                           &simArg5,
+                                           &simArg6,
+                                           &simArg7};
+static const iocshFuncDef configSimCamera = {"WinFDC_SimCamera", 8, simArgs};
+static void simCallFunc(const iocshArgBuf *args)
+{
+    WinFDC_SimCamera(args[0].sval, args[1].ival, args[2].ival, args[3].dval, args[4].ival, args[5].ival,
+                     args[6].ival, args[7].ival);
+}
+
+static const iocshArg faultArg0 = {"ID", iocshArgString};
+static const iocshArg faultArg1 = {"schedule", iocshArgString};
+static const iocshArg faultArg2 = {"seed", iocshArgInt};
+static const iocshArg * const faultArgs[] = {&faultArg0,
+                                             &faultArg1,
+                                             &faultArg2};
+static const iocshFuncDef configFaultInject = {"WinFDC_FaultInject", 3, faultArgs};
+static void faultCallFunc(const iocshArgBuf *args)
+{
+    WinFDC_FaultInject(args[0].sval, args[1].sval, args[2].ival);
 }
 
+static const iocshArg replayArg0 = {"fileName", iocshArgString};
+static const iocshArg replayArg1 = {"ID", iocshArgString};
+static const iocshArg replayArg2 = {"speed", iocshArgDouble};
+static const iocshArg replayArg3 = {"loop", iocshArgInt};
+static const iocshArg * const replayArgs[] = {&replayArg0,
+                                              &replayArg1,
+                                              &replayArg2,
+                                              &replayArg3};
+static const iocshFuncDef configReplayCamera = {"WinFDC_ReplayCamera", 4, replayArgs};
+static void replayCallFunc(const iocshArgBuf *args)
+{
+    WinFDC_ReplayCamera(args[0].sval, args[1].sval, args[2].dval, args[3].ival);
+}
+
+static const iocshArg reactorArg0 = {"workers", iocshArgInt};
+static const iocshArg * const reactorArgs[] = {&reactorArg0};
+static const iocshFuncDef configGrabReactor = {"WinFDC_GrabReactor", 1, reactorArgs};
+static void reactorCallFunc(const iocshArgBuf *args)
+{
+    WinFDC_GrabReactor(args[0].ival);
+}
 
 static void firewireWinDCAMRegister(void)
 {
+#ifdef _WIN32
+    fdcCmuRegisterBackend();
+#endif
+    fdcSimRegisterBackend();
+    fdcReplayRegisterBackend();
     iocshRegister(&configFirewireWinDCAM, configCallFunc);
+    iocshRegister(&configCapabilityCache, cacheCallFunc);
+    iocshRegister(&configBusScan, busScanCallFunc);
+    iocshRegister(&configSimCamera, simCallFunc);
+    iocshRegister(&configFaultInject, faultCallFunc);
+    iocshRegister(&configReplayCamera, replayCallFunc);
+    iocshRegister(&configGrabReactor, reactorCallFunc);
 }
 
 extern "C" {
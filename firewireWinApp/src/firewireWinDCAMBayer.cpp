@@ -0,0 +1,438 @@
+/*
+ * firewireWinDCAMBayer.cpp
+ *
+ * Demosaicing of raw Bayer frames. See firewireWinDCAMBayer.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "firewireWinDCAMBayer.h"
+
+/** Rows of the frame above and below a block that are read to demosaic it; the edge-aware method
+ * needs the green of the rows next to the block, which needs two more rows of samples each way */
+#define BAYER_MARGIN 3
+/** Samples of padding left and right of each half line */
+#define BAYER_PAD 1
+
+/** A frame being demosaiced */
+typedef struct {
+    FDCDemosaic method;
+    FDCColorFilter filter;
+    const FDCSegment *pSegments;
+    int numSegments;
+    unsigned char *pDst;
+    unsigned long width;
+    unsigned long height;
+    int bytesPerSample;
+    const FDCSampleFormat *pFormat; /**< The change of 16-bit samples, NULL for none */
+    int failed;                 /**< Set by a strip that had no memory for its lines */
+} BayerFrame;
+
+/** Reads rows of a frame received into several buffers */
+typedef struct {
+    const FDCSegment *pSegments;
+    int numSegments;
+    int index;                  /**< The buffer the last row started in */
+    unsigned long start;        /**< Offset of that buffer in the frame */
+} RowReader;
+
+/** Returns length bytes of the frame from offset on, straight from the buffer that holds them, or
+ * gathered into pScratch if they are split between buffers. Bytes past the end of the data are 0. */
+static const unsigned char *readBytes(RowReader *pReader, unsigned long offset, unsigned long length,
+                                      unsigned char *pScratch)
+{
+    const FDCSegment *pSegments = pReader->pSegments;
+    unsigned char *p = pScratch;
+    unsigned long skip, n;
+    int i;
+
+    if (offset < pReader->start) {
+        pReader->index = 0;
+        pReader->start = 0;
+    }
+    while ((pReader->index < pReader->numSegments) &&
+           (offset >= pReader->start + pSegments[pReader->index].length)) {
+        pReader->start += pSegments[pReader->index].length;
+        pReader->index++;
+    }
+    skip = offset - pReader->start;
+    if ((pReader->index < pReader->numSegments) && (skip + length <= pSegments[pReader->index].length))
+        return pSegments[pReader->index].pData + skip;
+    for (i=pReader->index; (i<pReader->numSegments) && (length>0); i++) {
+        n = pSegments[i].length - skip;
+        if (n > length) n = length;
+        memcpy(p, pSegments[i].pData + skip, n);
+        p += n;
+        length -= n;
+        skip = 0;
+    }
+    if (length > 0) memset(p, 0, length);
+    return pScratch;
+}
+
+/** Copies a row of 8-bit samples into a line */
+static inline void decodeRow(const BayerFrame *pFrame, const unsigned char *pSrc, unsigned char *pLine,
+                             unsigned long width)
+{
+    memcpy(pLine, pSrc, width);
+}
+
+/** Copies a row of 16-bit samples into a line, from the big-endian order they are sent in */
+static inline void decodeRow(const BayerFrame *pFrame, const unsigned char *pSrc, unsigned short *pLine,
+                             unsigned long width)
+{
+    unsigned long x;
+
+    if (pFrame->pFormat) {
+        fdcNormalizeSamples(pFrame->pFormat, pSrc, pLine, width);
+        return;
+    }
+    for (x=0; x<width; x++) pLine[x] = (unsigned short)((pSrc[2*x] << 8) | pSrc[2*x + 1]);
+}
+
+/** Splits a row into the half lines of its even and of its odd columns, so that every kernel
+ * below reads and writes its samples one after the other */
+template <typename T>
+static inline void splitRow(const T *pRow, T *pEven, T *pOdd, unsigned long width)
+{
+    unsigned long k;
+
+    for (k=0; k<width/2; k++) {
+        pEven[k] = pRow[2*k];
+        pOdd[k] = pRow[2*k + 1];
+    }
+    if (width & 1) pEven[k] = pRow[2*k];
+}
+
+/** Mirrors the samples next to the edges of the half line of the columns of the given parity into
+ * its padding, like the columns -1 and width of the row, which keeps their colors */
+template <typename T>
+static inline void padHalf(T *pHalf, unsigned long width, int parity)
+{
+    unsigned long n = (width + 1 - parity) / 2;
+
+    pHalf[-1] = pHalf[1 - parity];
+    pHalf[n] = pHalf[n - 1 - ((width + parity) & 1)];
+}
+
+/** Row of the frame that is read for row y, mirrored at the edges like the columns */
+static inline unsigned long mirrorRow(long y, unsigned long height)
+{
+    if (y < 0) return (unsigned long)-y;
+    if (y >= (long)height) return 2 * height - 2 - y;
+    return (unsigned long)y;
+}
+
+template <typename T>
+static inline T clampSample(int v, int maxValue)
+{
+    return (T)((v < 0) ? 0 : ((v > maxValue) ? maxValue : v));
+}
+
+/** The half lines of a row and of the rows next to it that a kernel reads. The chroma columns hold
+ * the red or blue samples of the row and the green columns its green samples; in the rows above and
+ * below the same columns hold the other colors. Chroma column k is column
+ * 2k+chromaCol of the row; its green neighbours left and right are pGreenCols[k+chromaCol-1] and
+ * pGreenCols[k+chromaCol], and the chroma neighbours of green column k are pChromaCols[k-chromaCol]
+ * and pChromaCols[k-chromaCol+1]. */
+template <typename T>
+struct BayerRow {
+    const T *pUpChroma;         /**< The chroma columns in the row above */
+    const T *pChroma;           /**< The chroma columns of the row */
+    const T *pDownChroma;       /**< The chroma columns in the row below */
+    const T *pUpGreen;          /**< The green columns in the row above */
+    const T *pGreen;            /**< The green columns of the row */
+    const T *pDownGreen;        /**< The green columns in the row below */
+    unsigned long numChroma;    /**< Number of chroma columns */
+    unsigned long numGreen;     /**< Number of green columns */
+    int chromaCol;              /**< Parity of the chroma columns */
+};
+
+/** Points a BayerRow at the half lines of the line pLine and the lines above and below it */
+template <typename T>
+static inline void setRow(BayerRow<T> *pRow, const T *pLine, unsigned long stride, unsigned long halfStride,
+                          unsigned long width, int chromaCol)
+{
+    const T *pChroma = pLine + chromaCol * halfStride;
+    const T *pGreen = pLine + (1 - chromaCol) * halfStride;
+
+    pRow->pUpChroma = pChroma - stride;
+    pRow->pChroma = pChroma;
+    pRow->pDownChroma = pChroma + stride;
+    pRow->pUpGreen = pGreen - stride;
+    pRow->pGreen = pGreen;
+    pRow->pDownGreen = pGreen + stride;
+    pRow->numChroma = (width + 1 - chromaCol) / 2;
+    pRow->numGreen = (width + chromaCol) / 2;
+    pRow->chromaCol = chromaCol;
+}
+
+/** Demosaics a row with bilinear interpolation, into the missing colors of its chroma columns,
+ * pChromaG and pChromaOther, and of its green columns, pGreenC and pGreenOther. */
+template <typename T>
+static void bilinearRow(const BayerRow<T> *pRow, T *pChromaG, T *pChromaOther, T *pGreenC, T *pGreenOther)
+{
+    const T *pUp = pRow->pUpChroma, *pDown = pRow->pDownChroma;
+    const T *pLeft = pRow->pGreen + pRow->chromaCol - 1;
+    const T *pUpDiag = pRow->pUpGreen + pRow->chromaCol - 1, *pDownDiag = pRow->pDownGreen + pRow->chromaCol - 1;
+    const T *pSide = pRow->pChroma - pRow->chromaCol;
+    const T *pUpG = pRow->pUpGreen, *pDownG = pRow->pDownGreen;
+    unsigned long k, n;
+
+    n = pRow->numChroma;
+    for (k=0; k<n; k++) pChromaG[k] = (T)((pUp[k] + pDown[k] + pLeft[k] + pLeft[k+1] + 2) >> 2);
+    for (k=0; k<n; k++) pChromaOther[k] = (T)((pUpDiag[k] + pUpDiag[k+1] + pDownDiag[k] + pDownDiag[k+1] + 2) >> 2);
+    n = pRow->numGreen;
+    for (k=0; k<n; k++) pGreenC[k] = (T)((pSide[k] + pSide[k+1] + 1) >> 1);
+    for (k=0; k<n; k++) pGreenOther[k] = (T)((pUpG[k] + pDownG[k] + 1) >> 1);
+}
+
+/** Interpolates the green of the chroma columns of a row along the direction with the smaller
+ * gradient, Hamilton-Adams. pUp2Chroma and pDown2Chroma are the chroma columns of the rows y-2 and
+ * y+2, which have the same colors as those of the row. */
+template <typename T>
+static void greenRow(const BayerRow<T> *pRow, const T *pUp2Chroma, const T *pDown2Chroma, T *pOut,
+                     int maxValue)
+{
+    const T *pMid = pRow->pChroma, *pUp = pRow->pUpChroma, *pDown = pRow->pDownChroma;
+    const T *pLeft = pRow->pGreen + pRow->chromaCol - 1;
+    int c, lapH, lapV, gradH, gradV, g;
+    unsigned long k;
+
+    for (k=0; k<pRow->numChroma; k++) {
+        c = pMid[k];
+        lapH = 2*c - pMid[k-1] - pMid[k+1];
+        lapV = 2*c - pUp2Chroma[k] - pDown2Chroma[k];
+        gradH = abs(pLeft[k] - pLeft[k+1]) + abs(lapH);
+        gradV = abs(pUp[k] - pDown[k]) + abs(lapV);
+        if (gradH < gradV) {
+            g = (2*(pLeft[k] + pLeft[k+1]) + lapH) / 4;
+        } else if (gradV < gradH) {
+            g = (2*(pUp[k] + pDown[k]) + lapV) / 4;
+        } else {
+            g = (2*(pLeft[k] + pLeft[k+1] + pUp[k] + pDown[k]) + lapH + lapV) / 8;
+        }
+        pOut[k] = clampSample<T>(g, maxValue);
+    }
+}
+
+/** Demosaics a row from its samples and the green interpolated at the chroma columns of it and of
+ * the rows above and below, pGreenChroma to pDownGreenChroma, interpolating red and blue from their
+ * differences to green. The green columns of the rows above and below are their chroma columns, so
+ * every green a kernel reads is at hand. Writes the missing colors like bilinearRow(), but for
+ * pChromaG, which is pGreenChroma. */
+template <typename T>
+static void edgeRow(const BayerRow<T> *pRow, const T *pUpGreenChroma, const T *pGreenChroma,
+                    const T *pDownGreenChroma, T *pChromaOther, T *pGreenC, T *pGreenOther, int maxValue)
+{
+    int off = pRow->chromaCol - 1;
+    const T *pUpDiag = pRow->pUpGreen + off, *pUpDiagG = pUpGreenChroma + off;
+    const T *pDownDiag = pRow->pDownGreen + off, *pDownDiagG = pDownGreenChroma + off;
+    const T *pSide = pRow->pChroma - pRow->chromaCol, *pSideG = pGreenChroma - pRow->chromaCol;
+    const T *pMid = pRow->pGreen;
+    const T *pUp = pRow->pUpGreen, *pUpG = pUpGreenChroma, *pDown = pRow->pDownGreen, *pDownG = pDownGreenChroma;
+    unsigned long k, n;
+    int d;
+
+    n = pRow->numChroma;
+    for (k=0; k<n; k++) {
+        d = (pUpDiag[k] - pUpDiagG[k]) + (pUpDiag[k+1] - pUpDiagG[k+1]) +
+            (pDownDiag[k] - pDownDiagG[k]) + (pDownDiag[k+1] - pDownDiagG[k+1]);
+        pChromaOther[k] = clampSample<T>(pGreenChroma[k] + d / 4, maxValue);
+    }
+    n = pRow->numGreen;
+    for (k=0; k<n; k++) {
+        d = (pSide[k] - pSideG[k]) + (pSide[k+1] - pSideG[k+1]);
+        pGreenC[k] = clampSample<T>(pMid[k] + d / 2, maxValue);
+    }
+    for (k=0; k<n; k++) {
+        d = (pUp[k] - pUpG[k]) + (pDown[k] - pDownG[k]);
+        pGreenOther[k] = clampSample<T>(pMid[k] + d / 2, maxValue);
+    }
+}
+
+/** Interleaves the red, green and blue of the even columns, pRed0 to pBlue0, and of the odd
+ * columns, pRed1 to pBlue1, into an RGB row */
+template <typename T>
+static void interleaveRow(const T *pRed0, const T *pGreen0, const T *pBlue0, const T *pRed1,
+                          const T *pGreen1, const T *pBlue1, T *pOut, unsigned long width)
+{
+    unsigned long k;
+
+    for (k=0; k<width/2; k++) {
+        pOut[6*k] = pRed0[k];
+        pOut[6*k + 1] = pGreen0[k];
+        pOut[6*k + 2] = pBlue0[k];
+        pOut[6*k + 3] = pRed1[k];
+        pOut[6*k + 4] = pGreen1[k];
+        pOut[6*k + 5] = pBlue1[k];
+    }
+    if (width & 1) {
+        pOut[6*k] = pRed0[k];
+        pOut[6*k + 1] = pGreen0[k];
+        pOut[6*k + 2] = pBlue0[k];
+    }
+}
+
+/** Demosaics the rows [first, first+count) of a frame, in blocks of rows that stay in the cache.
+ * The samples of a block and the rows around it are read into lines once, each split into the half
+ * lines of its even and odd columns; the lines that the next block needs as well are moved to the
+ * top instead of being read again. The kernels work on whole half lines with a stride of one and
+ * the RGB row is only interleaved at the end. */
+template <typename T>
+static void demosaicRows(BayerFrame *pFrame, unsigned long first, unsigned long count)
+{
+    unsigned long width = pFrame->width;
+    unsigned long half = (width + 1) / 2;
+    unsigned long halfStride = half + 2 * BAYER_PAD;
+    unsigned long stride = 2 * halfStride;
+    unsigned long rowBytes = width * sizeof(T);
+    unsigned long blockRows, rows, y, i, numRead;
+    int maxValue = (sizeof(T) == 1) ? 0xFF : 0xFFFF;
+    /* Position of the red sample in the top left 2x2 pixels */
+    int redRow = (pFrame->filter == FDC_COLOR_FILTER_GBRG) || (pFrame->filter == FDC_COLOR_FILTER_BGGR);
+    int redCol = (pFrame->filter == FDC_COLOR_FILTER_GRBG) || (pFrame->filter == FDC_COLOR_FILTER_BGGR);
+    int edge = (pFrame->method == FDCDemosaicEdge);
+    int chroma, chromaCol;
+    RowReader reader;
+    BayerRow<T> row;
+    T *pLines, *pGreen, *pRow, *pLine, *pOut;
+    T *pChromaOther, *pGreenC, *pGreenOther, *pChromaG;
+    const T *pColumns[2][3];
+    unsigned char *pScratch;
+    const unsigned char *pSrc;
+
+    blockRows = FDC_STRIP_BYTES / (3 * rowBytes);
+    if (blockRows < 2 * BAYER_MARGIN) blockRows = 2 * BAYER_MARGIN;
+    if (blockRows > count) blockRows = count;
+    /* The lines, the green half lines, the decoded row, the four half lines of missing colors and
+     * the row gathered from two buffers share the working memory of the thread */
+    pLines = (T *)fdcStripScratch(((blockRows + 2 * BAYER_MARGIN) * stride + (blockRows + 2) * halfStride +
+                                   width + 4 * half) * sizeof(T) + rowBytes);
+    if (!pLines) {
+        pFrame->failed = 1;
+        return;
+    }
+    pGreen = pLines + (blockRows + 2 * BAYER_MARGIN) * stride;
+    pRow = pGreen + (blockRows + 2) * halfStride;
+    pChromaG = pRow + width;
+    pChromaOther = pChromaG + half;
+    pGreenC = pChromaOther + half;
+    pGreenOther = pGreenC + half;
+    pScratch = (unsigned char *)(pGreenOther + half);
+    if ((sizeof(T) == 2) && pFrame->pFormat) maxValue = pFrame->pFormat->maxValue << pFrame->pFormat->outShift;
+    memset(&reader, 0, sizeof(reader));
+    reader.pSegments = pFrame->pSegments;
+    reader.numSegments = pFrame->numSegments;
+
+    /* Line k holds row y - BAYER_MARGIN + k of the block starting at row y, its even columns from
+     * BAYER_PAD on and its odd columns halfStride later */
+    numRead = 0;
+    for (y=first; y<first+count; y+=rows) {
+        rows = (first + count - y < blockRows) ? first + count - y : blockRows;
+        for (i=numRead; i<rows+2*BAYER_MARGIN; i++) {
+            pLine = pLines + i * stride + BAYER_PAD;
+            pSrc = readBytes(&reader, mirrorRow((long)(y + i) - BAYER_MARGIN, pFrame->height) * width * pFrame->bytesPerSample,
+                             width * pFrame->bytesPerSample, pScratch);
+            decodeRow(pFrame, pSrc, pRow, width);
+            splitRow(pRow, pLine, pLine + halfStride, width);
+            padHalf(pLine, width, 0);
+            padHalf(pLine + halfStride, width, 1);
+        }
+        /* Half line k of pGreen holds the green of the chroma columns of row y - 1 + k */
+        if (edge) {
+            for (i=0; i<rows+2; i++) {
+                pLine = pLines + (i + BAYER_MARGIN - 1) * stride + BAYER_PAD;
+                chromaCol = ((mirrorRow((long)(y + i) - 1, pFrame->height) & 1) == (unsigned long)redRow) ? redCol : 1 - redCol;
+                setRow(&row, pLine, stride, halfStride, width, chromaCol);
+                greenRow(&row, pLine - 2*stride + chromaCol * halfStride, pLine + 2*stride + chromaCol * halfStride,
+                         pGreen + i * halfStride + BAYER_PAD, maxValue);
+                padHalf(pGreen + i * halfStride + BAYER_PAD, width, chromaCol);
+            }
+        }
+        for (i=0; i<rows; i++) {
+            pLine = pLines + (i + BAYER_MARGIN) * stride + BAYER_PAD;
+            pOut = (T *)pFrame->pDst + (y + i) * width * 3;
+            if (((y + i) & 1) == (unsigned long)redRow) {
+                chroma = 0;
+                chromaCol = redCol;
+            } else {
+                chroma = 2;
+                chromaCol = 1 - redCol;
+            }
+            setRow(&row, pLine, stride, halfStride, width, chromaCol);
+            pColumns[chromaCol][chroma] = row.pChroma;
+            pColumns[chromaCol][2 - chroma] = pChromaOther;
+            pColumns[1 - chromaCol][1] = row.pGreen;
+            pColumns[1 - chromaCol][chroma] = pGreenC;
+            pColumns[1 - chromaCol][2 - chroma] = pGreenOther;
+            if (edge) {
+                pColumns[chromaCol][1] = pGreen + (i + 1) * halfStride + BAYER_PAD;
+                edgeRow(&row, pGreen + i * halfStride + BAYER_PAD, pColumns[chromaCol][1],
+                        pGreen + (i + 2) * halfStride + BAYER_PAD, pChromaOther, pGreenC, pGreenOther, maxValue);
+            } else {
+                pColumns[chromaCol][1] = pChromaG;
+                bilinearRow(&row, pChromaG, pChromaOther, pGreenC, pGreenOther);
+            }
+            interleaveRow(pColumns[0][0], pColumns[0][1], pColumns[0][2],
+                          pColumns[1][0], pColumns[1][1], pColumns[1][2], pOut, width);
+        }
+        /* The last lines of this block are the first of the next */
+        memmove(pLines, pLines + rows * stride, 2 * BAYER_MARGIN * stride * sizeof(T));
+        numRead = 2 * BAYER_MARGIN;
+    }
+}
+
+/** Demosaics a strip of rows, see FDCStripWork */
+static void demosaicStrip(void *pvt, unsigned long first, unsigned long count)
+{
+    BayerFrame *pFrame = (BayerFrame *)pvt;
+
+    if (pFrame->bytesPerSample == 2) demosaicRows<unsigned short>(pFrame, first, count);
+    else demosaicRows<unsigned char>(pFrame, first, count);
+}
+
+/** Demosaics a raw Bayer frame received into several buffers to RGB, in strips.
+ * \param[in] pJob The strip job of the calling thread, NULL to demosaic in the calling thread alone.
+ * \param[in] threads The most threads demosaicing, see fdcStripsRun().
+ * \param[in] method FDCDemosaicBilinear or FDCDemosaicEdge.
+ * \param[in] filter The color filter of the sensor.
+ * \param[in] pSegments The buffers of the frame, in order.
+ * \param[in] numSegments Number of buffers.
+ * \param[out] pDst The RGB frame, width*height*3 samples of bytesPerSample bytes in the host order.
+ * \param[in] width Frame width, at least FDC_BAYER_MIN_SIZE.
+ * \param[in] height Frame height, at least FDC_BAYER_MIN_SIZE.
+ * \param[in] bytesPerSample 1, or 2 for big-endian 16-bit samples.
+ * \param[in] pFormat How 16-bit samples are changed as they are read, see fdcSampleFormat(); NULL to
+ *            read them as they are sent.
+ * \return The number of threads the frame was offered to, -1 if it cannot be demosaiced or a strip
+ *         had no memory to demosaic in, in which case pDst is not complete.
+ */
+int fdcDemosaicStrips(FDCStripJob *pJob, int threads, FDCDemosaic method, FDCColorFilter filter,
+                      const FDCSegment *pSegments, int numSegments, unsigned char *pDst,
+                      unsigned long width, unsigned long height, int bytesPerSample,
+                      const FDCSampleFormat *pFormat)
+{
+    BayerFrame frame;
+    int threadsRun;
+
+    if ((method != FDCDemosaicBilinear) && (method != FDCDemosaicEdge)) return -1;
+    if ((filter < 0) || (filter >= FDC_COLOR_FILTER_MAX)) return -1;
+    if ((width < FDC_BAYER_MIN_SIZE) || (height < FDC_BAYER_MIN_SIZE)) return -1;
+    if ((bytesPerSample != 1) && (bytesPerSample != 2)) return -1;
+    frame.method = method;
+    frame.filter = filter;
+    frame.pSegments = pSegments;
+    frame.numSegments = numSegments;
+    frame.pDst = pDst;
+    frame.width = width;
+    frame.height = height;
+    frame.bytesPerSample = bytesPerSample;
+    frame.pFormat = (bytesPerSample == 2) ? pFormat : NULL;
+    frame.failed = 0;
+    threadsRun = fdcStripsRun(pJob, threads, height, width * 3 * bytesPerSample, demosaicStrip, &frame);
+    return frame.failed ? -1 : threadsRun;
+}
@@ -0,0 +1,47 @@
+/*
+ * firewireWinDCAMBayer.h
+ *
+ * Demosaicing of raw Bayer frames for the firewireWinDCAM driver.
+ *
+ * A raw camera sends one color per pixel, laid out in 2x2 cells by its color filter. Published
+ * as NDColorModeBayer the frame is demosaiced by a downstream plugin, a second pass over the
+ * frame into a second buffer. These functions produce the RGB1 frame straight from the buffers
+ * the frame was received into instead. 16-bit samples are read big-endian as they are sent, so
+ * the byte swap, and the change of samples of fewer significant bits, see fdcSampleFormat(), are
+ * done by the same pass. Rows are read into small line buffers, split into their even and odd
+ * columns so that each missing color is computed by a loop over consecutive samples the compiler
+ * vectorizes, and interleaved to RGB at the end. The frame is processed in blocks of rows of about
+ * FDC_STRIP_BYTES of output, and in strips by several threads with fdcDemosaicStrips(), see
+ * firewireWinDCAMStrips.h.
+ *
+ * Bilinear interpolation averages the nearest samples of each missing color. The edge-aware
+ * method interpolates green along the direction with the smaller gradient, with the correction
+ * of Hamilton and Adams, and red and blue from their differences to green, which keeps the
+ * colors of edges from fringing.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMBAYER_H
+#define FIREWIREWINDCAMBAYER_H
+
+#include "firewireWinDCAMCamera.h"
+#include "firewireWinDCAMStrips.h"
+#include "firewireWinDCAMConvert.h"
+
+/** Demosaicing methods, see FDC_DEMOSAIC */
+typedef enum {
+    FDCDemosaicOff,
+    FDCDemosaicBilinear,
+    FDCDemosaicEdge
+} FDCDemosaic;
+
+/** Smallest frame that can be demosaiced, in pixels each way */
+#define FDC_BAYER_MIN_SIZE 4
+
+int fdcDemosaicStrips(FDCStripJob *pJob, int threads, FDCDemosaic method, FDCColorFilter filter,
+                      const FDCSegment *pSegments, int numSegments, unsigned char *pDst,
+                      unsigned long width, unsigned long height, int bytesPerSample,
+                      const FDCSampleFormat *pFormat);
+
+#endif
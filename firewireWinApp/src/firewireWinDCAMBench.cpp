@@ -0,0 +1,413 @@
+/*
+ * firewireWinDCAMBench.cpp
+ *
+ * Benchmark of the work the firewireWinDCAM driver does for each frame once it has arrived:
+ * allocating the NDArray, copying monochrome frames (with the byte swap of 16-bit samples) or
+ * converting color frames to RGB, and releasing the NDArray. Synthetic frames of every IIDC
+ * color code are processed at representative Format 0, 1, 2 and 7 sizes.
+ *
+ * Usage: firewireWinDCAMBench [-n frames] [-m maxMemoryMB] [-s segmentBytes] [-t maxThreads]
+ *
+ * The results are written to stdout as CSV with a header line, one line per stage, color code
+ * and size, so runs on different releases and machines can be compared with a script:
+ *   stage       alloc (NDArray alloc and release), copy (memcpy or swab), rgb (conversion to RGB)
+ *               or frame (all of them, as done by the driver for one frame); with -s also segcopy
+ *               and segrgb, the copy and conversion from a frame split into segments of
+ *               segmentBytes (or more, up to FDC_MAX_SEGMENTS), as received into DMA sub-buffers. Their output is checked against
+ *               the contiguous copy and conversion, and a mismatch makes the exit status 1.
+ *               stripcopy and striprgb are the copy and conversion in strips by a pool of threads
+ *               (see firewireWinDCAMStrips.h), run with 1, 2, 4 ... up to maxThreads threads (one
+ *               per CPU core by default) to show how they scale; they are checked the same way.
+ *               normcopy is stripcopy of the 16-bit mono and raw frames with their samples moved
+ *               from the high 12 bits to the low ones (see fdcSampleFormat()), checked against
+ *               the result of one thread.
+ *               bilinear and edge demosaic the RAW8 and RAW16 frames (see firewireWinDCAMBayer.h)
+ *               in the same way, checked against the result of one thread.
+ *   MBps        camera data processed per second, using the size of the frame on the wire
+ *   nsPerPixel  mean time per pixel
+ *   p50us, p99us, maxUs  percentiles of the time per frame in microseconds
+ *   threads     threads the frame was converted by, 1 except for the strip stages
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+
+#include <ADDriver.h>
+
+#include "firewireWinDCAMConvert.h"
+#include "firewireWinDCAMBayer.h"
+
+#define BENCH_DEFAULT_FRAMES 200
+#define BENCH_WARMUP_FRAMES 5
+
+/** Frame sizes of the fixed formats and a typical Format 7 sensor */
+typedef struct {
+    int format;
+    int width;
+    int height;
+} BenchSize;
+
+static const BenchSize benchSizes[] = {
+    {0,  160,  120},
+    {0,  640,  480},
+    {1,  800,  600},
+    {1, 1024,  768},
+    {2, 1280,  960},
+    {2, 1600, 1200},
+    {7, 2448, 2048}
+};
+
+static const char *colorCodeNames[FDC_COLOR_CODE_MAX] = {
+    "Y8", "YUV411", "YUV422", "YUV444", "RGB8", "Y16", "RGB16", "Y16_SIGNED", "RGB16_SIGNED", "RAW8", "RAW16"
+};
+
+typedef enum {
+    BenchAlloc,
+    BenchCopy,
+    BenchRGB,
+    BenchFrame,
+    BenchSegCopy,
+    BenchSegRGB,
+    BenchStripCopy,
+    BenchStripRGB,
+    BenchNormCopy,
+    BenchBilinear,
+    BenchEdge
+} BenchStage;
+
+static const char *stageNames[] = {"alloc", "copy", "rgb", "frame", "segcopy", "segrgb", "stripcopy", "striprgb",
+                                   "normcopy", "bilinear", "edge"};
+
+/** Depth and alignment of the samples of the normcopy stage */
+#define BENCH_NORM_DEPTH 12
+static FDCSampleFormat normFormat;
+
+/** Only used for its NDArrayPool, which is created the same way as the driver's */
+class FDCBenchDriver : public ADDriver
+{
+public:
+    FDCBenchDriver(size_t maxMemory)
+        : ADDriver("FDCBENCH", 1, 0, -1, maxMemory, 0, 0, 0, 1, 0, 0) {}
+    NDArrayPool *pool() { return this->pNDArrayPool; }
+};
+
+static int isRaw(FDCColorCode code)
+{
+    return (code == FDC_COLOR_CODE_RAW8) || (code == FDC_COLOR_CODE_RAW16);
+}
+
+static int is16Bit(FDCColorCode code)
+{
+    return (code == FDC_COLOR_CODE_Y16) || (code == FDC_COLOR_CODE_RAW16);
+}
+
+static int isMono(FDCColorCode code)
+{
+    return (code == FDC_COLOR_CODE_Y8)  || (code == FDC_COLOR_CODE_RAW8) ||
+           (code == FDC_COLOR_CODE_Y16) || (code == FDC_COLOR_CODE_RAW16) ||
+           (code == FDC_COLOR_CODE_Y16_SIGNED);
+}
+
+/** The NDArray the driver allocates for a color code, see FirewireWinDCAM::grabImage() */
+static void arrayLayout(FDCColorCode code, int width, int height, int *pNDims, size_t *dims,
+                        NDDataType_t *pDataType, int *pBytesPerSample)
+{
+    *pBytesPerSample = 1;
+    switch (code) {
+        case FDC_COLOR_CODE_Y16:
+        case FDC_COLOR_CODE_RAW16:
+            *pDataType = NDUInt16;
+            *pBytesPerSample = 2;
+            break;
+        case FDC_COLOR_CODE_Y16_SIGNED:
+            *pDataType = NDInt16;
+            *pBytesPerSample = 2;
+            break;
+        case FDC_COLOR_CODE_RGB16_SIGNED:
+            *pDataType = NDInt8;
+            break;
+        default:
+            *pDataType = NDUInt8;
+            break;
+    }
+    if (isMono(code)) {
+        *pNDims = 2;
+        dims[0] = width;
+        dims[1] = height;
+    } else {
+        *pNDims = 3;
+        dims[0] = 3;
+        dims[1] = width;
+        dims[2] = height;
+    }
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/** Splits a frame into segments of segmentBytes, the last one shorter. Segments are made larger
+ * if there would be more than FDC_MAX_SEGMENTS; an odd size stays odd, so samples and groups are
+ * still split between segments.
+ * \return The number of segments. */
+static int splitFrame(const unsigned char *pSrc, unsigned long length, unsigned long segmentBytes,
+                      FDCSegment *pSegments)
+{
+    unsigned long offset;
+    unsigned long size = segmentBytes;
+    int n = 0;
+
+    if (length / size >= FDC_MAX_SEGMENTS) {
+        size = (length + FDC_MAX_SEGMENTS - 1) / FDC_MAX_SEGMENTS;
+        if ((segmentBytes & 1) && !(size & 1)) size++;
+    }
+    for (offset=0; offset<length; offset+=size, n++) {
+        pSegments[n].pData = pSrc + offset;
+        pSegments[n].length = (length - offset < size) ? length - offset : size;
+    }
+    return n;
+}
+
+/** Checks that the segmented or strip copy or conversion gives the same result as the contiguous one.
+ * \return 0 if they match, -1 if not. */
+static int checkSegments(BenchStage stage, FDCColorCode code, const BenchSize *pSize,
+                         const unsigned char *pSrc, const FDCSegment *pSegments, int numSegments,
+                         unsigned long length, int bytesPerSample, FDCStripJob *pJob, int threads)
+{
+    unsigned char *pExpected = (unsigned char *)malloc(length);
+    unsigned char *pActual = (unsigned char *)calloc(1, length);
+    int status;
+
+    if (stage == BenchSegCopy) {
+        fdcCopyMono(pSrc, pExpected, length, bytesPerSample);
+        fdcCopyMonoSegments(pSegments, numSegments, pActual, length, bytesPerSample);
+    } else if (stage == BenchStripCopy) {
+        fdcCopyMono(pSrc, pExpected, length, bytesPerSample);
+        fdcCopyMonoStrips(pJob, threads, pSegments, numSegments, pActual, length, bytesPerSample, NULL);
+    } else if (stage == BenchNormCopy) {
+        FDCSegment whole = {pSrc, length};
+
+        fdcNormalizeMonoSegments(&normFormat, &whole, 1, pExpected, length);
+        fdcCopyMonoStrips(pJob, threads, pSegments, numSegments, pActual, length, bytesPerSample, &normFormat);
+    } else if (stage == BenchStripRGB) {
+        fdcConvertToRGB8(code, pSrc, pExpected, pSize->width, pSize->height);
+        fdcConvertToRGB8Strips(pJob, threads, code, pSegments, numSegments, pActual, pSize->width, pSize->height);
+    } else if (stage >= BenchBilinear) {
+        FDCSegment whole = {pSrc, fdcFrameBytes(code, pSize->width, pSize->height)};
+        FDCDemosaic method = (stage == BenchEdge) ? FDCDemosaicEdge : FDCDemosaicBilinear;
+
+        if ((fdcDemosaicStrips(NULL, 1, method, FDC_COLOR_FILTER_RGGB, &whole, 1, pExpected,
+                               pSize->width, pSize->height, bytesPerSample, NULL) < 0) ||
+            (fdcDemosaicStrips(pJob, threads, method, FDC_COLOR_FILTER_RGGB, pSegments, numSegments, pActual,
+                               pSize->width, pSize->height, bytesPerSample, NULL) < 0)) {
+            free(pExpected);
+            free(pActual);
+            return -1;
+        }
+    } else {
+        fdcConvertToRGB8(code, pSrc, pExpected, pSize->width, pSize->height);
+        fdcConvertToRGB8Segments(code, pSegments, numSegments, pActual, pSize->width, pSize->height);
+    }
+    status = memcmp(pExpected, pActual, length) ? -1 : 0;
+    free(pExpected);
+    free(pActual);
+    return status;
+}
+
+/** Runs one stage for numFrames frames and prints its line.
+ * \return 0 on success, -1 if the NDArrayPool ran out of memory, -2 if the segmented result differs
+ *         from the contiguous one. */
+static int runStage(NDArrayPool *pPool, BenchStage stage, FDCColorCode code, const BenchSize *pSize,
+                    const unsigned char *pSrc, unsigned long segmentBytes, int numFrames, double *times,
+                    FDCStripJob *pJob, int threads)
+{
+    int ndims, bytesPerSample;
+    size_t dims[3];
+    NDDataType_t dataType;
+    NDArray *pArray = NULL, *pKeep = NULL;
+    unsigned long wireBytes = fdcFrameBytes(code, pSize->width, pSize->height);
+    double pixels = (double)pSize->width * pSize->height;
+    double total = 0.0;
+    epicsTimeStamp t0, t1;
+    FDCSegment segments[FDC_MAX_SEGMENTS];
+    int numSegments = 0;
+    int i;
+
+    arrayLayout(code, pSize->width, pSize->height, &ndims, dims, &dataType, &bytesPerSample);
+    if (stage >= BenchBilinear) {
+        /* A demosaiced frame has three colors of the size of the raw samples */
+        ndims = 3;
+        dims[0] = 3;
+        dims[1] = pSize->width;
+        dims[2] = pSize->height;
+    }
+    if (stage >= BenchSegCopy) {
+        /* The strip stages read the frame as one segment, unless it is split with -s */
+        numSegments = splitFrame(pSrc, wireBytes, segmentBytes ? segmentBytes : wireBytes, segments);
+        if (checkSegments(stage, code, pSize, pSrc, segments, numSegments,
+                          ((stage == BenchSegCopy) || (stage == BenchStripCopy) || (stage == BenchNormCopy)) ? wireBytes :
+                          (unsigned long)(pixels * 3) * ((stage >= BenchBilinear) ? bytesPerSample : 1),
+                          bytesPerSample, pJob, threads))
+            return -2;
+    }
+    /* The copy and rgb stages write into one NDArray allocated beforehand */
+    if ((stage != BenchAlloc) && (stage != BenchFrame)) {
+        pKeep = pPool->alloc(ndims, dims, dataType, 0, NULL);
+        if (!pKeep) return -1;
+    }
+    for (i=-BENCH_WARMUP_FRAMES; i<numFrames; i++) {
+        epicsTimeGetCurrent(&t0);
+        pArray = pKeep;
+        if ((stage == BenchAlloc) || (stage == BenchFrame)) {
+            pArray = pPool->alloc(ndims, dims, dataType, 0, NULL);
+            if (!pArray) return -1;
+        }
+        if (stage == BenchSegCopy) {
+            fdcCopyMonoSegments(segments, numSegments, (unsigned char *)pArray->pData, wireBytes, bytesPerSample);
+        } else if (stage == BenchSegRGB) {
+            fdcConvertToRGB8Segments(code, segments, numSegments, (unsigned char *)pArray->pData,
+                                     pSize->width, pSize->height);
+        } else if (stage == BenchStripCopy) {
+            fdcCopyMonoStrips(pJob, threads, segments, numSegments, (unsigned char *)pArray->pData,
+                              wireBytes, bytesPerSample, NULL);
+        } else if (stage == BenchNormCopy) {
+            fdcCopyMonoStrips(pJob, threads, segments, numSegments, (unsigned char *)pArray->pData,
+                              wireBytes, bytesPerSample, &normFormat);
+        } else if (stage == BenchStripRGB) {
+            fdcConvertToRGB8Strips(pJob, threads, code, segments, numSegments, (unsigned char *)pArray->pData,
+                                   pSize->width, pSize->height);
+        } else if (stage >= BenchBilinear) {
+            fdcDemosaicStrips(pJob, threads, (stage == BenchEdge) ? FDCDemosaicEdge : FDCDemosaicBilinear,
+                              FDC_COLOR_FILTER_RGGB, segments, numSegments, (unsigned char *)pArray->pData,
+                              pSize->width, pSize->height, bytesPerSample, NULL);
+        } else if ((stage == BenchCopy) || ((stage == BenchFrame) && isMono(code))) {
+            fdcCopyMono(pSrc, (unsigned char *)pArray->pData, wireBytes, bytesPerSample);
+        } else if ((stage == BenchRGB) || (stage == BenchFrame)) {
+            fdcConvertToRGB8(code, pSrc, (unsigned char *)pArray->pData, pSize->width, pSize->height);
+        }
+        if (pArray != pKeep) pArray->release();
+        epicsTimeGetCurrent(&t1);
+        if (i >= 0) {
+            times[i] = epicsTimeDiffInSeconds(&t1, &t0);
+            total += times[i];
+        }
+    }
+    if (pKeep) pKeep->release();
+    qsort(times, numFrames, sizeof(double), compareDouble);
+    if (total <= 0) total = 1e-9;
+    printf("%s,%s,%d,%d,%d,%d,%.1f,%.1f,%.3f,%.1f,%.1f,%.1f,%d\n",
+        stageNames[stage], colorCodeNames[code], pSize->format, pSize->width, pSize->height, numFrames,
+        numFrames / total,
+        numFrames * (double)wireBytes / total / 1e6,
+        total * 1e9 / (numFrames * pixels),
+        times[numFrames / 2] * 1e6,
+        times[(numFrames * 99) / 100] * 1e6,
+        times[numFrames - 1] * 1e6,
+        (stage >= BenchStripCopy) ? threads : 1);
+    return 0;
+}
+
+/** Returns the thread count the strip stages are run with after threads: the next power of 2, then
+ * maxThreads, then more than maxThreads to end */
+static int nextThreads(int threads, int maxThreads)
+{
+    if (threads >= maxThreads) return maxThreads + 1;
+    return (threads * 2 < maxThreads) ? threads * 2 : maxThreads;
+}
+
+int main(int argc, char *argv[])
+{
+    int numFrames = BENCH_DEFAULT_FRAMES;
+    size_t maxMemory = 0;
+    unsigned long segmentBytes = 0;
+    int maxThreads = 0, threads;
+    FDCStripJob *pJob;
+    FDCBenchDriver *pDriver;
+    NDArrayPool *pPool;
+    unsigned char *pSrc;
+    double *times;
+    unsigned long bytes, maxBytes = 0, i;
+    int arg, code, stage, size, status = 0;
+    int numSizes = sizeof(benchSizes) / sizeof(benchSizes[0]);
+
+    for (arg=1; arg<argc; arg++) {
+        if (!strcmp(argv[arg], "-n") && (arg+1 < argc)) {
+            numFrames = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "-m") && (arg+1 < argc)) {
+            maxMemory = (size_t)atoi(argv[++arg]) * 1024 * 1024;
+        } else if (!strcmp(argv[arg], "-s") && (arg+1 < argc)) {
+            segmentBytes = (unsigned long)atol(argv[++arg]);
+        } else if (!strcmp(argv[arg], "-t") && (arg+1 < argc)) {
+            maxThreads = atoi(argv[++arg]);
+        } else {
+            fprintf(stderr, "Usage: %s [-n frames] [-m maxMemoryMB] [-s segmentBytes] [-t maxThreads]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (numFrames < 1) numFrames = 1;
+    if (maxThreads <= 0) maxThreads = epicsThreadGetCPUs();
+
+    for (size=0; size<numSizes; size++) {
+        bytes = (unsigned long)benchSizes[size].width * benchSizes[size].height * 6;
+        if (bytes > maxBytes) maxBytes = bytes;
+    }
+    /* Synthetic frame, a ramp that is the same for every run */
+    pSrc = (unsigned char *)malloc(maxBytes);
+    times = (double *)malloc(numFrames * sizeof(double));
+    if (!pSrc || !times) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (i=0; i<maxBytes; i++) pSrc[i] = (unsigned char)((i * 7) ^ (i >> 9));
+
+    pDriver = new FDCBenchDriver(maxMemory);
+    pPool = pDriver->pool();
+    pJob = fdcStripJobCreate();
+    fdcSampleFormat(BENCH_NORM_DEPTH, 1, FDCAlignRight, 0, &normFormat);
+
+    printf("stage,colorCode,format,width,height,frames,fps,MBps,nsPerPixel,p50us,p99us,maxUs,threads\n");
+    for (size=0; size<numSizes; size++) {
+        for (code=0; code<FDC_COLOR_CODE_MAX; code++) {
+            for (stage=BenchAlloc; stage<=BenchEdge; stage++) {
+                if (((stage == BenchSegCopy) || (stage == BenchSegRGB)) && (segmentBytes == 0)) continue;
+                if (((stage == BenchCopy) || (stage == BenchSegCopy) || (stage == BenchStripCopy)) &&
+                    !isMono((FDCColorCode)code)) continue;
+                if (((stage == BenchRGB) || (stage == BenchSegRGB) || (stage == BenchStripRGB)) &&
+                    isMono((FDCColorCode)code)) continue;
+                if ((stage == BenchNormCopy) && !is16Bit((FDCColorCode)code)) continue;
+                if ((stage >= BenchBilinear) && !isRaw((FDCColorCode)code)) continue;
+                /* The strip stages are run with 1, 2, 4 ... threads and maxThreads, the others once */
+                for (threads=1; threads<=maxThreads; threads=nextThreads(threads, maxThreads)) {
+                    switch (runStage(pPool, (BenchStage)stage, (FDCColorCode)code, &benchSizes[size], pSrc,
+                                     segmentBytes, numFrames, times, pJob, threads)) {
+                        case -1:
+                            fprintf(stderr, "NDArrayPool out of memory at %s %dx%d\n",
+                                colorCodeNames[code], benchSizes[size].width, benchSizes[size].height);
+                            status = 1;
+                            break;
+                        case -2:
+                            fprintf(stderr, "%s differs from the contiguous result at %s %dx%d with %d threads\n",
+                                stageNames[stage], colorCodeNames[code], benchSizes[size].width,
+                                benchSizes[size].height, threads);
+                            status = 1;
+                            break;
+                    }
+                    if (stage < BenchStripCopy) break;
+                }
+            }
+        }
+    }
+    fdcStripJobDestroy(pJob);
+    free(times);
+    free(pSrc);
+    return status;
+}
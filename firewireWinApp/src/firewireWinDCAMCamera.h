@@ -0,0 +1,244 @@
+/*
+ * firewireWinDCAMCamera.h
+ *
+ * Camera backend interface for the firewireWinDCAM driver.
+ *
+ * The driver talks to a camera only through the classes declared here, which cover the calls
+ * it makes to the CMU 1394Camera library: format/mode/rate selection, the Format 7 size control,
+ * the feature controls and acquisition. Their methods have the names and semantics of the
+ * C1394Camera, C1394CameraControl and C1394CameraControlSize methods they stand for, but use
+ * portable types so the driver can be built without the Windows 1394 stack.
+ *
+ * A backend provides cameras of one kind: firewireWinDCAMCmu.cpp wraps the CMU library (Windows
+ * only) and firewireWinDCAMSim.cpp provides simulated cameras. Backends are registered with
+ * fdcRegisterBackend() and their cameras are found through the enumeration service in
+ * firewireWinDCAMEnum.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMCAMERA_H
+#define FIREWIREWINDCAMCAMERA_H
+
+/** Error codes returned by the camera methods; same values as the CMU CAM_* codes */
+#define FDC_CAM_SUCCESS                         0
+#define FDC_CAM_ERROR                          -1
+#define FDC_CAM_ERROR_UNSUPPORTED             -10
+#define FDC_CAM_ERROR_NOT_INITIALIZED         -11
+#define FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS  -12
+#define FDC_CAM_ERROR_BUSY                    -13
+#define FDC_CAM_ERROR_INSUFFICIENT_RESOURCES  -14
+#define FDC_CAM_ERROR_PARAM_OUT_OF_RANGE      -15
+#define FDC_CAM_ERROR_FRAME_TIMEOUT           -16
+
+/** StartImageAcquisitionEx() flag; same value as the CMU ACQ_START_VIDEO_STREAM */
+#define FDC_ACQ_START_VIDEO_STREAM 0x01
+
+/** IIDC color codes; same values as the CMU COLOR_CODE enum */
+typedef enum {
+    FDC_COLOR_CODE_Y8 = 0,
+    FDC_COLOR_CODE_YUV411,
+    FDC_COLOR_CODE_YUV422,
+    FDC_COLOR_CODE_YUV444,
+    FDC_COLOR_CODE_RGB8,
+    FDC_COLOR_CODE_Y16,
+    FDC_COLOR_CODE_RGB16,
+    FDC_COLOR_CODE_Y16_SIGNED,
+    FDC_COLOR_CODE_RGB16_SIGNED,
+    FDC_COLOR_CODE_RAW8,
+    FDC_COLOR_CODE_RAW16,
+    FDC_COLOR_CODE_MAX,
+    FDC_COLOR_CODE_INVALID = -1
+} FDCColorCode;
+
+/** Layout of the color filter of a raw Bayer sensor, the colors of the top left 2x2 pixels row by
+ * row; same values as the IIDC COLOR_FILTER_ID register and the ADCore NDBayerPattern_t */
+typedef enum {
+    FDC_COLOR_FILTER_RGGB = 0,
+    FDC_COLOR_FILTER_GBRG,
+    FDC_COLOR_FILTER_GRBG,
+    FDC_COLOR_FILTER_BGGR,
+    FDC_COLOR_FILTER_MAX,
+    FDC_COLOR_FILTER_NONE = -1
+} FDCColorFilter;
+
+/** IIDC features; same values as the CMU CAMERA_FEATURE enum */
+typedef enum {
+    FDC_FEATURE_BRIGHTNESS = 0,
+    FDC_FEATURE_AUTO_EXPOSURE,
+    FDC_FEATURE_SHARPNESS,
+    FDC_FEATURE_WHITE_BALANCE,
+    FDC_FEATURE_HUE,
+    FDC_FEATURE_SATURATION,
+    FDC_FEATURE_GAMMA,
+    FDC_FEATURE_SHUTTER,
+    FDC_FEATURE_GAIN,
+    FDC_FEATURE_IRIS,
+    FDC_FEATURE_FOCUS,
+    FDC_FEATURE_TEMPERATURE,
+    FDC_FEATURE_TRIGGER_MODE,
+    FDC_FEATURE_TRIGGER_DELAY,
+    FDC_FEATURE_WHITE_SHADING,
+    FDC_FEATURE_FRAME_RATE,
+    FDC_FEATURE_ZOOM = 32,
+    FDC_FEATURE_PAN,
+    FDC_FEATURE_TILT,
+    FDC_FEATURE_OPTICAL_FILTER,
+    FDC_FEATURE_CAPTURE_SIZE = 48,
+    FDC_FEATURE_CAPTURE_QUALITY,
+    FDC_FEATURE_NUM_FEATURES = 64
+} FDCFeature;
+
+/** One feature control, see C1394CameraControl */
+class FDCCameraControl
+{
+public:
+    virtual ~FDCCameraControl() {}
+
+    virtual int  Inquire() = 0;
+    virtual bool HasPresence() = 0;
+    virtual bool HasAbsControl() = 0;
+    virtual bool HasOnePush() = 0;
+    virtual bool HasReadout() = 0;
+    virtual bool HasOnOff() = 0;
+    virtual bool HasAutoMode() = 0;
+    virtual bool HasManualMode() = 0;
+    virtual void GetRange(unsigned short *min, unsigned short *max) = 0;
+    virtual void GetRangeAbsolute(float *fmin, float *fmax) = 0;
+
+    virtual int  Status() = 0;
+    virtual bool StatusAbsControl() = 0;
+    virtual bool StatusOnOff() = 0;
+    virtual bool StatusOnePush() = 0;
+    virtual bool StatusAutoMode() = 0;
+    virtual void GetValue(unsigned short *v_lo, unsigned short *v_hi=0) = 0;
+    virtual void GetValueAbsolute(float *f) = 0;
+
+    virtual int  SetAbsControl(int on) = 0;
+    virtual int  SetAutoMode(int on) = 0;
+    virtual int  SetValue(unsigned short v_lo, unsigned short v_hi=0) = 0;
+    virtual int  SetValueAbsolute(float f) = 0;
+
+    virtual const char *GetName() = 0;
+    virtual const char *GetUnits() = 0;
+};
+
+/** The Format 7 size control, see C1394CameraControlSize */
+class FDCCameraControlSize
+{
+public:
+    virtual ~FDCCameraControlSize() {}
+
+    virtual void GetSizeLimits(unsigned short *hMax, unsigned short *vMax) = 0;
+    virtual void GetSizeUnits(unsigned short *hUnit, unsigned short *vUnit) = 0;
+    virtual void GetSize(unsigned short *width, unsigned short *height) = 0;
+    virtual int  SetSize(unsigned short width, unsigned short height) = 0;
+    virtual void GetPosLimits(unsigned short *hMax, unsigned short *vMax) = 0;
+    virtual void GetPosUnits(unsigned short *hUnit, unsigned short *vUnit) = 0;
+    virtual void GetPos(unsigned short *left, unsigned short *top) = 0;
+    virtual int  SetPos(unsigned short left, unsigned short top) = 0;
+    virtual bool HasColorCode(FDCColorCode code) = 0;
+    virtual void GetColorCode(FDCColorCode *code) = 0;
+    virtual int  SetColorCode(FDCColorCode code) = 0;
+    virtual void GetBytesPerPacketRange(unsigned short *min, unsigned short *max) = 0;
+    virtual void GetBytesPerPacket(unsigned short *current, unsigned short *recommended=0) = 0;
+    virtual int  SetBytesPerPacket(unsigned short bpp) = 0;
+    virtual void GetPacketsPerFrame(unsigned long *ppf) = 0;
+    virtual void GetDataDepth(unsigned short *depth) = 0;
+    virtual void GetColorFilter(FDCColorFilter *filter) = 0;
+    virtual void GetFrameInterval(float *interval) = 0;
+};
+
+/** Maximum number of segments of a frame; same value as the CMU MAX_SUB_BUFFERS */
+#define FDC_MAX_SEGMENTS 64
+
+/** One of the buffers a frame was received into, see FDCCamera::GetRawSegments() */
+typedef struct {
+    const unsigned char *pData;
+    unsigned long length;
+} FDCSegment;
+
+/** One camera, see C1394Camera. The camera owns its control objects. */
+class FDCCamera
+{
+public:
+    virtual ~FDCCamera() {}
+
+    virtual int  InitCamera(int reset) = 0;
+    virtual void GetCameraName(char *buf, int len) = 0;
+    virtual void GetCameraVendor(char *buf, int len) = 0;
+    virtual void GetCameraUniqueID(unsigned long long *pGuid) = 0;
+    virtual unsigned long GetVersion() = 0;
+    /** Returns the fastest speed of the link to the camera in Mb/s: 100, 200, 400, 800... */
+    virtual int  GetMaxSpeed() = 0;
+    /** 1394b operation mode, needed to send faster than S400. Only set with the stream stopped. */
+    virtual bool Has1394b() = 0;
+    virtual bool Status1394b() = 0;
+    virtual int  Set1394b(bool on) = 0;
+
+    virtual bool HasVideoFormat(unsigned long format) = 0;
+    virtual int  SetVideoFormat(unsigned long format) = 0;
+    virtual int  GetVideoFormat() = 0;
+    virtual bool HasVideoMode(unsigned long format, unsigned long mode) = 0;
+    virtual int  SetVideoMode(unsigned long mode) = 0;
+    virtual int  GetVideoMode() = 0;
+    virtual bool HasVideoFrameRate(unsigned long format, unsigned long mode, unsigned long rate) = 0;
+    virtual int  SetVideoFrameRate(unsigned long rate) = 0;
+    virtual int  GetVideoFrameRate() = 0;
+    virtual void GetVideoFrameDimensions(unsigned long *pWidth, unsigned long *pHeight) = 0;
+    virtual void GetVideoDataDepth(unsigned short *depth) = 0;
+    virtual bool HasOneShot() = 0;
+    virtual bool HasMultiShot() = 0;
+
+    virtual int  StartImageAcquisitionEx(int nBuffers, int frameTimeout, int flags) = 0;
+    virtual int  AcquireImageEx(int dropStaleFrames, int *pDroppedFrames) = 0;
+    virtual int  StopImageAcquisition() = 0;
+    /** Returns the OS event that is signalled when AcquireImageEx() has a frame, a HANDLE on
+     * Windows, NULL if the camera has none. It may change after each AcquireImageEx(). */
+    virtual void *GetFrameEvent()   { return NULL; }
+    /** For cameras without a frame event: returns the time in seconds until AcquireImageEx() has a
+     * frame, 0 if it has one now or if that is not known, in which case AcquireImageEx() waits. */
+    virtual double GetFrameWait()   { return 0.; }
+    /** Returns the bus cycle time at which AcquireImageEx() returned the current frame, see
+     * fdcIsoCycleTimeSeconds(). The cameras of a bus share this clock. It is the time the frame
+     * was received only if AcquireImageEx() did not find it already waiting in the ring.
+     * \return FDC_CAM_ERROR_UNSUPPORTED if the camera is not on a bus. */
+    virtual int  GetFrameCycleTime(unsigned long *pCycleTime)   { return FDC_CAM_ERROR_UNSUPPORTED; }
+    virtual unsigned char *GetRawData(unsigned long *pLength) = 0;
+    virtual int  getRGB(unsigned char *pBitmap, unsigned long length) = 0;
+    /** Returns the current frame as the list of buffers it was received into, in order, so it
+     * can be copied without first being made contiguous. The default is the one buffer returned
+     * by GetRawData(). \return The number of segments, 0 if there is no frame. */
+    virtual int  GetRawSegments(FDCSegment *pSegments, int maxSegments)
+    {
+        unsigned long length = 0;
+        unsigned char *pData = GetRawData(&length);
+
+        if (!pData || (maxSegments < 1)) return 0;
+        pSegments[0].pData = pData;
+        pSegments[0].length = length;
+        return 1;
+    }
+
+    virtual FDCCameraControl *GetCameraControl(FDCFeature feature) = 0;
+    virtual FDCCameraControlSize *GetCameraControlSize() = 0;
+};
+
+typedef struct FDCCameraInfo FDCCameraInfo;
+
+/** A kind of camera */
+typedef struct {
+    const char *name;
+    /** Finds the cameras of this backend. Fills guid, node, version, vendor and model of up to
+     * maxCameras entries and returns the number of cameras found. */
+    int (*enumerate)(FDCCameraInfo *pInfo, int maxCameras);
+    /** Opens a camera found by enumerate(). Returns NULL on error. */
+    FDCCamera *(*open)(const FDCCameraInfo *pInfo);
+} FDCBackend;
+
+void fdcRegisterBackend(const FDCBackend *pBackend);
+void fdcCmuRegisterBackend(void);
+void fdcSimRegisterBackend(void);
+void fdcReplayRegisterBackend(void);
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * firewireWinDCAMCapCache.cpp
+ *
+ * Capability cache for the firewireWinDCAM driver. See firewireWinDCAMCapCache.h.
+ *
+ * The cache file is plain text so it can be inspected and deleted by hand:
+ *   FDC_CAPABILITY_CACHE <version>
+ *   guid <hex>
+ *   iidc <hex>
+ *   formats <hex>
+ *   modes <format> <hex>
+ *   rates <format> <mode> <hex>
+ *   format7 <mode> <hsMax> <vsMax> <hsUnit> <vsUnit> <hpUnit> <vpUnit> <colorCodes hex>
+ *   features <count>
+ *   feature <index> <flags hex> <min> <max> <absMin> <absMax>
+ *   end
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsStdio.h>
+
+#include "firewireWinDCAMCapCache.h"
+
+#define CACHE_MAGIC "FDC_CAPABILITY_CACHE"
+
+/** Builds the name of the cache file for a camera.
+ * \param[in] directory The cache directory.
+ * \param[in] guid The camera unique ID.
+ * \param[out] fileName The file name.
+ * \param[in] maxChars The size of fileName.
+ * \return 0 on success, -1 if the name does not fit.
+ */
+int fdcCapCacheFileName(const char *directory, unsigned long long guid, char *fileName, int maxChars)
+{
+    int len;
+
+    len = epicsSnprintf(fileName, maxChars, "%s/fdc_%16.16llX.cache", directory, guid);
+    if ((len < 0) || (len >= maxChars)) return -1;
+    return 0;
+}
+
+/** Reads a cache file.
+ * \param[in] fileName The cache file.
+ * \param[out] pCaps The capabilities read from the file.
+ * \return 0 on success, -1 if the file does not exist, has a different version or is incomplete.
+ */
+int fdcCapCacheRead(const char *fileName, FDCCapabilities *pCaps)
+{
+    FILE *fp;
+    char line[256];
+    char magic[32];
+    int version;
+    int format, mode, index, n;
+    unsigned int flags;
+    unsigned int hsMax, vsMax, hsUnit, vsUnit, hpUnit, vpUnit, min, max;
+    double absMin, absMax;
+    int complete = 0;
+
+    fp = fopen(fileName, "r");
+    if (!fp) return -1;
+    memset(pCaps, 0, sizeof(*pCaps));
+    if (!fgets(line, sizeof(line), fp) ||
+        (sscanf(line, "%31s %d", magic, &version) != 2) ||
+        strcmp(magic, CACHE_MAGIC) || (version != FDC_CAP_CACHE_VERSION)) {
+        fclose(fp);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "guid %llx", &pCaps->guid) == 1) continue;
+        if (sscanf(line, "iidc %lx", &pCaps->version) == 1) continue;
+        if (sscanf(line, "formats %lx", &pCaps->formats) == 1) continue;
+        if (sscanf(line, "modes %d %n", &format, &n) == 1) {
+            if ((format < 0) || (format >= FDC_CAP_MAX_FORMATS)) break;
+            if (sscanf(line + n, "%lx", &pCaps->modes[format]) != 1) break;
+            continue;
+        }
+        if (sscanf(line, "rates %d %d %n", &format, &mode, &n) == 2) {
+            if ((format < 0) || (format >= FDC_CAP_MAX_FORMATS) ||
+                (mode < 0)   || (mode >= FDC_CAP_MAX_MODES)) break;
+            if (sscanf(line + n, "%lx", &pCaps->rates[format][mode]) != 1) break;
+            continue;
+        }
+        if (sscanf(line, "format7 %d %u %u %u %u %u %u %n",
+                   &mode, &hsMax, &vsMax, &hsUnit, &vsUnit, &hpUnit, &vpUnit, &n) == 7) {
+            if ((mode < 0) || (mode >= FDC_CAP_MAX_MODES)) break;
+            if (sscanf(line + n, "%lx", &pCaps->format7[mode].colorCodes) != 1) break;
+            pCaps->format7[mode].hsMax  = (unsigned short)hsMax;
+            pCaps->format7[mode].vsMax  = (unsigned short)vsMax;
+            pCaps->format7[mode].hsUnit = (unsigned short)hsUnit;
+            pCaps->format7[mode].vsUnit = (unsigned short)vsUnit;
+            pCaps->format7[mode].hpUnit = (unsigned short)hpUnit;
+            pCaps->format7[mode].vpUnit = (unsigned short)vpUnit;
+            continue;
+        }
+        if (sscanf(line, "features %d", &pCaps->numFeatures) == 1) {
+            if ((pCaps->numFeatures < 0) || (pCaps->numFeatures > FDC_CAP_MAX_FEATURES)) break;
+            continue;
+        }
+        if (sscanf(line, "feature %d %x %u %u %lf %lf", &index, &flags, &min, &max,
+                   &absMin, &absMax) == 6) {
+            if ((index < 0) || (index >= pCaps->numFeatures)) break;
+            pCaps->features[index].flags  = flags;
+            pCaps->features[index].min    = (unsigned short)min;
+            pCaps->features[index].max    = (unsigned short)max;
+            pCaps->features[index].absMin = absMin;
+            pCaps->features[index].absMax = absMax;
+            continue;
+        }
+        if (strncmp(line, "end", 3) == 0) {
+            complete = 1;
+            break;
+        }
+    }
+    fclose(fp);
+    if (!complete || (pCaps->guid == 0)) return -1;
+    return 0;
+}
+
+/** Writes a cache file.
+ * The file is first written under a temporary name and then renamed, so an IOC that is killed
+ * while writing, or another IOC reading at the same time, never sees a partial file.
+ * \param[in] fileName The cache file.
+ * \param[in] pCaps The capabilities to write.
+ * \return 0 on success, -1 on error.
+ */
+int fdcCapCacheWrite(const char *fileName, const FDCCapabilities *pCaps)
+{
+    FILE *fp;
+    char tmpName[300];
+    int format, mode, i;
+    int status;
+
+    if (epicsSnprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName) >= (int)sizeof(tmpName)) return -1;
+    fp = fopen(tmpName, "w");
+    if (!fp) return -1;
+    fprintf(fp, "%s %d\n", CACHE_MAGIC, FDC_CAP_CACHE_VERSION);
+    fprintf(fp, "guid %16.16llX\n", pCaps->guid);
+    fprintf(fp, "iidc %lX\n", pCaps->version);
+    fprintf(fp, "formats %lX\n", pCaps->formats);
+    for (format=0; format<FDC_CAP_MAX_FORMATS; format++) {
+        fprintf(fp, "modes %d %lX\n", format, pCaps->modes[format]);
+    }
+    for (format=0; format<FDC_CAP_MAX_FORMATS; format++) {
+        for (mode=0; mode<FDC_CAP_MAX_MODES; mode++) {
+            if (pCaps->rates[format][mode])
+                fprintf(fp, "rates %d %d %lX\n", format, mode, pCaps->rates[format][mode]);
+        }
+    }
+    for (mode=0; mode<FDC_CAP_MAX_MODES; mode++) {
+        if (!(pCaps->modes[7] & (1 << mode))) continue;
+        fprintf(fp, "format7 %d %u %u %u %u %u %u %lX\n", mode,
+            pCaps->format7[mode].hsMax,  pCaps->format7[mode].vsMax,
+            pCaps->format7[mode].hsUnit, pCaps->format7[mode].vsUnit,
+            pCaps->format7[mode].hpUnit, pCaps->format7[mode].vpUnit,
+            pCaps->format7[mode].colorCodes);
+    }
+    fprintf(fp, "features %d\n", pCaps->numFeatures);
+    for (i=0; i<pCaps->numFeatures; i++) {
+        fprintf(fp, "feature %d %X %u %u %.9g %.9g\n", i, pCaps->features[i].flags,
+            pCaps->features[i].min, pCaps->features[i].max,
+            pCaps->features[i].absMin, pCaps->features[i].absMax);
+    }
+    fprintf(fp, "end\n");
+    status = ferror(fp);
+    if (fclose(fp) || status) {
+        remove(tmpName);
+        return -1;
+    }
+    /* rename() does not replace an existing file on Windows */
+    remove(fileName);
+    if (rename(tmpName, fileName)) {
+        remove(tmpName);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * firewireWinDCAMCapCache.h
+ *
+ * Capability cache for the firewireWinDCAM driver.
+ *
+ * The static capabilities of a camera (supported formats, modes and rates, the Format 7 mode
+ * descriptors and the feature capabilities and ranges) take several seconds to probe over the bus,
+ * mostly because every Format 7 mode must be selected to read its descriptor. This file defines
+ * a structure holding them and functions to save it to and load it from a versioned text file
+ * keyed by the camera GUID and IIDC version, so an IOC restart can skip the probing.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMCAPCACHE_H
+#define FIREWIREWINDCAMCAPCACHE_H
+
+/** Version of the cache file format; files with a different version are ignored */
+#define FDC_CAP_CACHE_VERSION 1
+
+#define FDC_CAP_MAX_FORMATS  8
+#define FDC_CAP_MAX_MODES    8
+#define FDC_CAP_MAX_FEATURES 32
+
+/** Feature capability flags */
+#define FDC_CAP_FEAT_PRESENT  0x01
+#define FDC_CAP_FEAT_ABS      0x02
+#define FDC_CAP_FEAT_AUTO     0x04
+#define FDC_CAP_FEAT_MANUAL   0x08
+#define FDC_CAP_FEAT_ONOFF    0x10
+#define FDC_CAP_FEAT_ONEPUSH  0x20
+#define FDC_CAP_FEAT_READOUT  0x40
+
+/** Descriptor of one Format 7 mode */
+typedef struct {
+    unsigned short hsMax, vsMax;    /**< Maximum size */
+    unsigned short hsUnit, vsUnit;  /**< Size increment */
+    unsigned short hpUnit, vpUnit;  /**< Position increment */
+    unsigned long colorCodes;       /**< Bit mask of supported color codes */
+} FDCFormat7Caps;
+
+/** Capabilities and range of one feature */
+typedef struct {
+    int flags;                      /**< FDC_CAP_FEAT_* flags */
+    unsigned short min, max;
+    double absMin, absMax;
+} FDCFeatureCaps;
+
+/** All the cached capabilities of one camera */
+typedef struct {
+    unsigned long long guid;        /**< Camera unique ID, the cache key */
+    unsigned long version;          /**< IIDC version, part of the cache key */
+    unsigned long formats;          /**< Bit mask of supported formats */
+    unsigned long modes[FDC_CAP_MAX_FORMATS];                       /**< Bit mask of supported modes per format */
+    unsigned long rates[FDC_CAP_MAX_FORMATS][FDC_CAP_MAX_MODES];    /**< Bit mask of supported rates per format and mode */
+    FDCFormat7Caps format7[FDC_CAP_MAX_MODES];
+    int numFeatures;
+    FDCFeatureCaps features[FDC_CAP_MAX_FEATURES];
+} FDCCapabilities;
+
+int fdcCapCacheFileName(const char *directory, unsigned long long guid, char *fileName, int maxChars);
+int fdcCapCacheRead(const char *fileName, FDCCapabilities *pCaps);
+int fdcCapCacheWrite(const char *fileName, const FDCCapabilities *pCaps);
+
+#endif
@@ -0,0 +1,241 @@
+/*
+ * firewireWinDCAMCmu.cpp
+ *
+ * Camera backend for the CMU 1394Camera library. This is a thin layer mapping the
+ * firewireWinDCAMCamera.h classes onto C1394Camera, C1394CameraControl and
+ * C1394CameraControlSize. Windows only.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <stdafx.h>
+#include <1394Camera.h>
+
+#include "firewireWinDCAMCamera.h"
+#include "firewireWinDCAMEnum.h"
+
+class FDCCmuControl : public FDCCameraControl
+{
+public:
+    FDCCmuControl(C1394Camera *pCamera, FDCFeature feature)
+        : control(pCamera, (CAMERA_FEATURE)feature) {}
+
+    int  Inquire()                  { return control.Inquire(); }
+    bool HasPresence()              { return control.HasPresence(); }
+    bool HasAbsControl()            { return control.HasAbsControl(); }
+    bool HasOnePush()               { return control.HasOnePush(); }
+    bool HasReadout()               { return control.HasReadout(); }
+    bool HasOnOff()                 { return control.HasOnOff(); }
+    bool HasAutoMode()              { return control.HasAutoMode(); }
+    bool HasManualMode()            { return control.HasManualMode(); }
+    void GetRange(unsigned short *min, unsigned short *max)     { control.GetRange(min, max); }
+    void GetRangeAbsolute(float *fmin, float *fmax)             { control.GetRangeAbsolute(fmin, fmax); }
+    int  Status()                   { return control.Status(); }
+    bool StatusAbsControl()         { return control.StatusAbsControl(); }
+    bool StatusOnOff()              { return control.StatusOnOff(); }
+    bool StatusOnePush()            { return control.StatusOnePush(); }
+    bool StatusAutoMode()           { return control.StatusAutoMode(); }
+    void GetValue(unsigned short *v_lo, unsigned short *v_hi)   { control.GetValue(v_lo, v_hi); }
+    void GetValueAbsolute(float *f) { control.GetValueAbsolute(f); }
+    int  SetAbsControl(int on)      { return control.SetAbsControl(on ? TRUE : FALSE); }
+    int  SetAutoMode(int on)        { return control.SetAutoMode(on ? TRUE : FALSE); }
+    int  SetValue(unsigned short v_lo, unsigned short v_hi)     { return control.SetValue(v_lo, v_hi); }
+    int  SetValueAbsolute(float f)  { return control.SetValueAbsolute(f); }
+    const char *GetName()           { return control.GetName(); }
+    const char *GetUnits()          { return control.GetUnits(); }
+
+private:
+    C1394CameraControl control;
+};
+
+class FDCCmuControlSize : public FDCCameraControlSize
+{
+public:
+    FDCCmuControlSize(C1394CameraControlSize *pSize) : pSize(pSize) {}
+
+    void GetSizeLimits(unsigned short *hMax, unsigned short *vMax)  { pSize->GetSizeLimits(hMax, vMax); }
+    void GetSizeUnits(unsigned short *hUnit, unsigned short *vUnit) { pSize->GetSizeUnits(hUnit, vUnit); }
+    void GetSize(unsigned short *width, unsigned short *height)     { pSize->GetSize(width, height); }
+    int  SetSize(unsigned short width, unsigned short height)       { return pSize->SetSize(width, height); }
+    void GetPosLimits(unsigned short *hMax, unsigned short *vMax)   { pSize->GetPosLimits(hMax, vMax); }
+    void GetPosUnits(unsigned short *hUnit, unsigned short *vUnit)  { pSize->GetPosUnits(hUnit, vUnit); }
+    void GetPos(unsigned short *left, unsigned short *top)          { pSize->GetPos(left, top); }
+    int  SetPos(unsigned short left, unsigned short top)            { return pSize->SetPos(left, top); }
+    bool HasColorCode(FDCColorCode code)    { return pSize->HasColorCode((COLOR_CODE)code); }
+    void GetColorCode(FDCColorCode *code)   { pSize->GetColorCode((COLOR_CODE *)code); }
+    int  SetColorCode(FDCColorCode code)    { return pSize->SetColorCode((COLOR_CODE)code); }
+    void GetBytesPerPacketRange(unsigned short *min, unsigned short *max) { pSize->GetBytesPerPacketRange(min, max); }
+    void GetBytesPerPacket(unsigned short *current, unsigned short *recommended) { pSize->GetBytesPerPacket(current, recommended); }
+    int  SetBytesPerPacket(unsigned short bpp)      { return pSize->SetBytesPerPacket(bpp); }
+    void GetPacketsPerFrame(unsigned long *ppf)     { pSize->GetPacketsPerFrame(ppf); }
+    void GetDataDepth(unsigned short *depth)        { pSize->GetDataDepth(depth); }
+    void GetColorFilter(FDCColorFilter *filter)
+    {
+        unsigned short id;
+
+        /* The COLOR_FILTER_ID of IIDC 1.31, only meaningful in the raw color codes */
+        pSize->GetColorFilter(&id);
+        *filter = (id < FDC_COLOR_FILTER_MAX) ? (FDCColorFilter)id : FDC_COLOR_FILTER_NONE;
+    }
+    void GetFrameInterval(float *interval)          { pSize->GetFrameInterval(interval); }
+
+private:
+    C1394CameraControlSize *pSize;
+};
+
+/** Returns the fastest speed in Mb/s set in SPEED_FLAGS_* bits, S100 if none is */
+static int cmuSpeedMbps(unsigned long flags)
+{
+    if (flags & SPEED_FLAGS_3200) return 3200;
+    if (flags & SPEED_FLAGS_1600) return 1600;
+    if (flags & SPEED_FLAGS_800)  return 800;
+    if (flags & SPEED_FLAGS_400)  return 400;
+    if (flags & SPEED_FLAGS_200)  return 200;
+    return 100;
+}
+
+class FDCCmuCamera : public FDCCamera
+{
+public:
+    FDCCmuCamera() : pSize(NULL), frameCycleTime(0), haveCycleTime(0)
+    {
+        memset(controls, 0, sizeof(controls));
+    }
+    ~FDCCmuCamera()
+    {
+        int i;
+
+        for (i=0; i<FDC_FEATURE_NUM_FEATURES; i++) delete controls[i];
+        delete pSize;
+    }
+
+    int  InitCamera(int reset)      { return camera.InitCamera(reset ? TRUE : FALSE); }
+    void GetCameraName(char *buf, int len)      { camera.GetCameraName(buf, len); }
+    void GetCameraVendor(char *buf, int len)    { camera.GetCameraVendor(buf, len); }
+    void GetCameraUniqueID(unsigned long long *pGuid)
+    {
+        LARGE_INTEGER uniqueId;
+
+        camera.GetCameraUniqueID(&uniqueId);
+        *pGuid = (unsigned long long)uniqueId.QuadPart;
+    }
+    unsigned long GetVersion()      { return camera.GetVersion(); }
+    /* The library returns m_maxSpeed, which it gets from GetMaxIsochSpeed() as SPEED_FLAGS_* bits,
+     * not as a speed code */
+    int  GetMaxSpeed()              { return cmuSpeedMbps((unsigned long)camera.GetMaxSpeed()); }
+    bool Has1394b()                 { return camera.Has1394b(); }
+    bool Status1394b()              { return camera.Status1394b(); }
+    int  Set1394b(bool on)          { return camera.Set1394b(on ? TRUE : FALSE); }
+
+    bool HasVideoFormat(unsigned long format)   { return camera.HasVideoFormat(format) ? true : false; }
+    int  SetVideoFormat(unsigned long format)   { return camera.SetVideoFormat(format); }
+    int  GetVideoFormat()                       { return camera.GetVideoFormat(); }
+    bool HasVideoMode(unsigned long format, unsigned long mode) { return camera.HasVideoMode(format, mode) ? true : false; }
+    int  SetVideoMode(unsigned long mode)       { return camera.SetVideoMode(mode); }
+    int  GetVideoMode()                         { return camera.GetVideoMode(); }
+    bool HasVideoFrameRate(unsigned long format, unsigned long mode, unsigned long rate)
+                                                { return camera.HasVideoFrameRate(format, mode, rate) ? true : false; }
+    int  SetVideoFrameRate(unsigned long rate)  { return camera.SetVideoFrameRate(rate); }
+    int  GetVideoFrameRate()                    { return camera.GetVideoFrameRate(); }
+    void GetVideoFrameDimensions(unsigned long *pWidth, unsigned long *pHeight) { camera.GetVideoFrameDimensions(pWidth, pHeight); }
+    void GetVideoDataDepth(unsigned short *depth)   { camera.GetVideoDataDepth(depth); }
+    bool HasOneShot()                           { return camera.HasOneShot(); }
+    bool HasMultiShot()                         { return camera.HasMultiShot(); }
+
+    int  StartImageAcquisitionEx(int nBuffers, int frameTimeout, int flags)
+                                                { return camera.StartImageAcquisitionEx(nBuffers, frameTimeout, flags); }
+    int  AcquireImageEx(int dropStaleFrames, int *pDroppedFrames)
+    {
+        CYCLE_TIME cycleTime;
+        int status = camera.AcquireImageEx(dropStaleFrames ? TRUE : FALSE, pDroppedFrames);
+
+        /* The library does not time-stamp the frames, read the cycle timer of the adapter as soon
+         * as the frame is handed over. That is when it was dequeued, which is later than when it
+         * was received if it was waiting in the ring. */
+        haveCycleTime = 0;
+        if ((status == CAM_SUCCESS) &&
+            (t1394IsochQueryCurrentCycleTime((PSTR)camera.GetDevicePath(), &cycleTime) == ERROR_SUCCESS)) {
+            memcpy(&frameCycleTime, &cycleTime, sizeof(frameCycleTime));
+            haveCycleTime = 1;
+        }
+        return status;
+    }
+    int  GetFrameCycleTime(unsigned long *pCycleTime)
+    {
+        if (!haveCycleTime) return FDC_CAM_ERROR_UNSUPPORTED;
+        *pCycleTime = frameCycleTime;
+        return FDC_CAM_SUCCESS;
+    }
+    /* The event of the oldest buffer in the DMA ring, set by the 1394 driver when it is filled */
+    void *GetFrameEvent()                       { return (void *)camera.GetFrameEvent(); }
+    int  StopImageAcquisition()                 { return camera.StopImageAcquisition(); }
+    unsigned char *GetRawData(unsigned long *pLength)   { return camera.GetRawData(pLength); }
+    int  getRGB(unsigned char *pBitmap, unsigned long length) { return camera.getRGB(pBitmap, length); }
+
+    FDCCameraControl *GetCameraControl(FDCFeature feature)
+    {
+        if ((feature < 0) || (feature >= FDC_FEATURE_NUM_FEATURES)) return NULL;
+        if (!controls[feature]) controls[feature] = new FDCCmuControl(&camera, feature);
+        return controls[feature];
+    }
+    FDCCameraControlSize *GetCameraControlSize()
+    {
+        if (!pSize) pSize = new FDCCmuControlSize(camera.GetCameraControlSize());
+        return pSize;
+    }
+
+    C1394Camera camera;
+
+private:
+    FDCCmuControl *controls[FDC_FEATURE_NUM_FEATURES];
+    FDCCmuControlSize *pSize;
+    unsigned long frameCycleTime;
+    int haveCycleTime;
+};
+
+static int cmuEnumerate(FDCCameraInfo *pInfo, int maxCameras)
+{
+    C1394Camera camera;
+    LARGE_INTEGER uniqueId;
+    int nodes, node;
+    int numCameras = 0;
+
+    nodes = camera.RefreshCameraList();
+    for (node=0; (node<nodes) && (numCameras<maxCameras); node++) {
+        if (camera.SelectCamera(node) != CAM_SUCCESS) continue;
+        camera.GetCameraUniqueID(&uniqueId);
+        pInfo[numCameras].guid = (unsigned long long)uniqueId.QuadPart;
+        pInfo[numCameras].node = node;
+        /* The library does not tell which host adapter a node is on */
+        pInfo[numCameras].bus = 0;
+        pInfo[numCameras].version = camera.GetVersion();
+        camera.GetCameraVendor(pInfo[numCameras].vendor, sizeof(pInfo[numCameras].vendor));
+        camera.GetCameraName(pInfo[numCameras].model, sizeof(pInfo[numCameras].model));
+        numCameras++;
+    }
+    return numCameras;
+}
+
+static FDCCamera *cmuOpen(const FDCCameraInfo *pInfo)
+{
+    FDCCmuCamera *pCamera = new FDCCmuCamera();
+
+    /* The list of device paths in the C1394Camera must be current for SelectCamera().
+     * This does not read anything from the cameras. */
+    pCamera->camera.RefreshCameraList();
+    if (pCamera->camera.SelectCamera(pInfo->node) != CAM_SUCCESS) {
+        delete pCamera;
+        return NULL;
+    }
+    return pCamera;
+}
+
+static const FDCBackend cmuBackend = {"CMU", cmuEnumerate, cmuOpen};
+
+void fdcCmuRegisterBackend(void)
+{
+    fdcRegisterBackend(&cmuBackend);
+}
@@ -0,0 +1,519 @@
+/*
+ * firewireWinDCAMConvert.cpp
+ *
+ * Conversion of frames from the IIDC wire formats to RGB. See firewireWinDCAMConvert.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsEndian.h>
+
+#ifndef _WIN32
+/* swab() */
+#include <unistd.h>
+#endif
+
+#include "firewireWinDCAMConvert.h"
+
+static inline unsigned char clip(int x)
+{
+    return (unsigned char)((x < 0) ? 0 : ((x > 255) ? 255 : x));
+}
+
+/* Same coefficients as the CMU library */
+static inline void yuv2rgb(int y, int u, int v, unsigned char *pRGB)
+{
+    pRGB[0] = clip(y + ((v * 1436) >> 10));
+    pRGB[1] = clip(y - ((u * 352 + v * 731) >> 10));
+    pRGB[2] = clip(y + ((u * 1814) >> 10));
+}
+
+/** Returns the size of a frame on the wire in bytes, 0 for an invalid color code. */
+unsigned long fdcFrameBytes(FDCColorCode code, unsigned long width, unsigned long height)
+{
+    unsigned long pixels = width * height;
+
+    switch (code) {
+        case FDC_COLOR_CODE_Y8:
+        case FDC_COLOR_CODE_RAW8:           return pixels;
+        case FDC_COLOR_CODE_YUV411:         return pixels * 3 / 2;
+        case FDC_COLOR_CODE_YUV422:
+        case FDC_COLOR_CODE_Y16:
+        case FDC_COLOR_CODE_Y16_SIGNED:
+        case FDC_COLOR_CODE_RAW16:          return pixels * 2;
+        case FDC_COLOR_CODE_YUV444:
+        case FDC_COLOR_CODE_RGB8:           return pixels * 3;
+        case FDC_COLOR_CODE_RGB16:
+        case FDC_COLOR_CODE_RGB16_SIGNED:   return pixels * 6;
+        default:                            return 0;
+    }
+}
+
+/** Returns the color code of a fixed (format 0-2) video mode.
+ * \return 0 on success, -1 if the format and mode are not a fixed video mode.
+ */
+int fdcColorCodeForMode(unsigned long format, unsigned long mode, FDCColorCode *pCode)
+{
+    static const FDCColorCode codes[3][8] = {
+        {FDC_COLOR_CODE_YUV444, FDC_COLOR_CODE_YUV422, FDC_COLOR_CODE_YUV411, FDC_COLOR_CODE_YUV422,
+         FDC_COLOR_CODE_RGB8,   FDC_COLOR_CODE_Y8,     FDC_COLOR_CODE_Y16,    FDC_COLOR_CODE_INVALID},
+        {FDC_COLOR_CODE_YUV422, FDC_COLOR_CODE_RGB8,   FDC_COLOR_CODE_Y8,     FDC_COLOR_CODE_YUV422,
+         FDC_COLOR_CODE_RGB8,   FDC_COLOR_CODE_Y8,     FDC_COLOR_CODE_Y16,    FDC_COLOR_CODE_Y16},
+        {FDC_COLOR_CODE_YUV422, FDC_COLOR_CODE_RGB8,   FDC_COLOR_CODE_Y8,     FDC_COLOR_CODE_YUV422,
+         FDC_COLOR_CODE_RGB8,   FDC_COLOR_CODE_Y8,     FDC_COLOR_CODE_Y16,    FDC_COLOR_CODE_Y16}
+    };
+
+    if ((format > 2) || (mode > 7) || (codes[format][mode] == FDC_COLOR_CODE_INVALID)) return -1;
+    *pCode = codes[format][mode];
+    return 0;
+}
+
+/** Copies a monochrome or raw frame into an NDArray.
+ * \param[in] pSrc The frame as sent by the camera.
+ * \param[out] pDst The NDArray data.
+ * \param[in] length Number of bytes to copy.
+ * \param[in] bytesPerSample 1 or 2. The Firewire byte order is big-endian, so 16-bit samples are
+ *            byte swapped on a little-endian host.
+ */
+void fdcCopyMono(const unsigned char *pSrc, unsigned char *pDst, unsigned long length, int bytesPerSample)
+{
+    if ((bytesPerSample == 1) || (EPICS_BYTE_ORDER == EPICS_ENDIAN_BIG)) {
+        memcpy(pDst, pSrc, length);
+    } else {
+        swab((char *)pSrc, (char *)pDst, length);
+    }
+}
+
+/** Copies a monochrome or raw frame received into several buffers into an NDArray.
+ * \param[in] pSegments The buffers of the frame, in order.
+ * \param[in] numSegments Number of buffers.
+ * \param[out] pDst The NDArray data.
+ * \param[in] length Maximum number of bytes to copy.
+ * \param[in] bytesPerSample 1 or 2, see fdcCopyMono().
+ */
+void fdcCopyMonoSegments(const FDCSegment *pSegments, int numSegments, unsigned char *pDst,
+                         unsigned long length, int bytesPerSample)
+{
+    int swap = (bytesPerSample == 2) && (EPICS_BYTE_ORDER != EPICS_ENDIAN_BIG);
+    const unsigned char *pSrc;
+    unsigned char highByte = 0;
+    int split = 0;
+    unsigned long n;
+    int i;
+
+    for (i=0; (i<numSegments) && (length>0); i++) {
+        pSrc = pSegments[i].pData;
+        n = (pSegments[i].length < length) ? pSegments[i].length : length;
+        length -= n;
+        if (!swap) {
+            memcpy(pDst, pSrc, n);
+            pDst += n;
+            continue;
+        }
+        /* Finish a sample whose first byte was at the end of the previous segment */
+        if (split && (n > 0)) {
+            pDst[0] = pSrc[0];
+            pDst[1] = highByte;
+            pDst += 2;
+            pSrc++;
+            n--;
+            split = 0;
+        }
+        swab((char *)pSrc, (char *)pDst, n & ~1UL);
+        pDst += n & ~1UL;
+        if (n & 1) {
+            highByte = pSrc[n - 1];
+            split = 1;
+        }
+    }
+}
+
+/** Works out how the 16-bit samples of a camera are to be changed.
+ * \param[in] depth The number of significant bits, the data depth.
+ * \param[in] sentLeft 1 if the camera sends the significant bits in the high bits of the samples, as
+ *            IIDC cameras normally do, 0 if it sends them in the low bits.
+ * \param[in] align Where the significant bits are published.
+ * \param[in] clamp For samples sent in the low bits, 1 to set values beyond the data depth to its
+ *            largest value, 0 to mask the bits above it.
+ * \param[out] pFormat The change, for fdcNormalizeMonoSegments().
+ * \return 1 if the samples must be changed, 0 if they are published as they are sent.
+ */
+int fdcSampleFormat(int depth, int sentLeft, FDCSampleAlign align, int clamp, FDCSampleFormat *pFormat)
+{
+    if (((align != FDCAlignRight) && (align != FDCAlignLeft)) || (depth <= 0) || (depth >= 16)) return 0;
+    pFormat->inShift = sentLeft ? 16 - depth : 0;
+    pFormat->maxValue = (1 << depth) - 1;
+    pFormat->clamp = clamp && !sentLeft;
+    pFormat->outShift = (align == FDCAlignLeft) ? 16 - depth : 0;
+    return 1;
+}
+
+/** Converts big-endian 16-bit samples to the host order, changed as given by a sample format.
+ * \param[in] pFormat The change, see fdcSampleFormat().
+ * \param[in] pSrc The samples as they are sent.
+ * \param[out] pDst The samples in the host order.
+ * \param[in] samples Number of samples.
+ */
+void fdcNormalizeSamples(const FDCSampleFormat *pFormat, const unsigned char *pSrc, unsigned short *pDst,
+                             unsigned long samples)
+{
+    int inShift = pFormat->inShift, outShift = pFormat->outShift, maxValue = pFormat->maxValue;
+    unsigned long i;
+    int v;
+
+    /* Branch-free loops, so the compiler can vectorize them */
+    if (pFormat->clamp) {
+        for (i=0; i<samples; i++) {
+            v = ((pSrc[2*i] << 8) | pSrc[2*i + 1]) >> inShift;
+            pDst[i] = (unsigned short)(((v < maxValue) ? v : maxValue) << outShift);
+        }
+    } else {
+        for (i=0; i<samples; i++) {
+            v = ((pSrc[2*i] << 8) | pSrc[2*i + 1]) >> inShift;
+            pDst[i] = (unsigned short)((v & maxValue) << outShift);
+        }
+    }
+}
+
+/** Copies a 16-bit monochrome or raw frame received into several buffers into an NDArray, with
+ * the bytes swapped to the host order and the samples changed as given by a sample format, in one
+ * pass. See fdcCopyMonoSegments().
+ * \param[in] pFormat The change, see fdcSampleFormat().
+ * \param[in] pSegments The buffers of the frame, in order.
+ * \param[in] numSegments Number of buffers.
+ * \param[out] pDst The NDArray data.
+ * \param[in] length Maximum number of bytes to copy.
+ */
+void fdcNormalizeMonoSegments(const FDCSampleFormat *pFormat, const FDCSegment *pSegments, int numSegments,
+                              unsigned char *pDst, unsigned long length)
+{
+    const unsigned char *pSrc;
+    unsigned char sample[2];
+    int split = 0;
+    unsigned long n;
+    int i;
+
+    for (i=0; (i<numSegments) && (length>0); i++) {
+        pSrc = pSegments[i].pData;
+        n = (pSegments[i].length < length) ? pSegments[i].length : length;
+        length -= n;
+        /* Finish a sample whose first byte was at the end of the previous segment */
+        if (split && (n > 0)) {
+            sample[1] = pSrc[0];
+            fdcNormalizeSamples(pFormat, sample, (unsigned short *)pDst, 1);
+            pDst += 2;
+            pSrc++;
+            n--;
+            split = 0;
+        }
+        fdcNormalizeSamples(pFormat, pSrc, (unsigned short *)pDst, n / 2);
+        pDst += n & ~1UL;
+        if (n & 1) {
+            sample[0] = pSrc[n - 1];
+            split = 1;
+        }
+    }
+}
+
+/** Returns the number of bytes and pixels of the smallest unit of a color code that can be
+ * converted on its own. \return 0 on success, -1 for an invalid color code. */
+static int groupSize(FDCColorCode code, unsigned long *pBytes, unsigned long *pPixels)
+{
+    *pPixels = 1;
+    switch (code) {
+        case FDC_COLOR_CODE_Y8:
+        case FDC_COLOR_CODE_RAW8:           *pBytes = 1; break;
+        case FDC_COLOR_CODE_Y16:
+        case FDC_COLOR_CODE_RAW16:
+        case FDC_COLOR_CODE_Y16_SIGNED:     *pBytes = 2; break;
+        case FDC_COLOR_CODE_RGB8:
+        case FDC_COLOR_CODE_YUV444:         *pBytes = 3; break;
+        case FDC_COLOR_CODE_RGB16:
+        case FDC_COLOR_CODE_RGB16_SIGNED:   *pBytes = 6; break;
+        case FDC_COLOR_CODE_YUV422:         *pBytes = 4; *pPixels = 2; break;
+        case FDC_COLOR_CODE_YUV411:         *pBytes = 6; *pPixels = 4; break;
+        default:                            return -1;
+    }
+    return 0;
+}
+
+/** Converts whole groups (see groupSize()) of a color code to 8-bit RGB */
+static void convertGroups(FDCColorCode code, const unsigned char *pSrc, unsigned char *pDst,
+                          unsigned long groups)
+{
+    unsigned long i;
+    int u, v;
+
+    switch (code) {
+        case FDC_COLOR_CODE_Y8:
+        case FDC_COLOR_CODE_RAW8:
+            for (i=0; i<groups; i++, pDst+=3) pDst[0] = pDst[1] = pDst[2] = pSrc[i];
+            break;
+        case FDC_COLOR_CODE_Y16:
+        case FDC_COLOR_CODE_RAW16:
+            for (i=0; i<groups; i++, pDst+=3) pDst[0] = pDst[1] = pDst[2] = pSrc[2*i];
+            break;
+        case FDC_COLOR_CODE_Y16_SIGNED:
+            for (i=0; i<groups; i++, pDst+=3) pDst[0] = pDst[1] = pDst[2] = pSrc[2*i] ^ 0x80;
+            break;
+        case FDC_COLOR_CODE_RGB8:
+            memcpy(pDst, pSrc, groups * 3);
+            break;
+        case FDC_COLOR_CODE_RGB16:
+            for (i=0; i<groups*3; i++) pDst[i] = pSrc[2*i];
+            break;
+        case FDC_COLOR_CODE_RGB16_SIGNED:
+            for (i=0; i<groups*3; i++) pDst[i] = pSrc[2*i] ^ 0x80;
+            break;
+        case FDC_COLOR_CODE_YUV444:
+            for (i=0; i<groups; i++, pSrc+=3, pDst+=3) {
+                yuv2rgb(pSrc[1], pSrc[0] - 128, pSrc[2] - 128, pDst);
+            }
+            break;
+        case FDC_COLOR_CODE_YUV422:
+            for (i=0; i<groups; i++, pSrc+=4, pDst+=6) {
+                u = pSrc[0] - 128;
+                v = pSrc[2] - 128;
+                yuv2rgb(pSrc[1], u, v, pDst);
+                yuv2rgb(pSrc[3], u, v, pDst + 3);
+            }
+            break;
+        case FDC_COLOR_CODE_YUV411:
+            for (i=0; i<groups; i++, pSrc+=6, pDst+=12) {
+                u = pSrc[0] - 128;
+                v = pSrc[3] - 128;
+                yuv2rgb(pSrc[1], u, v, pDst);
+                yuv2rgb(pSrc[2], u, v, pDst + 3);
+                yuv2rgb(pSrc[4], u, v, pDst + 6);
+                yuv2rgb(pSrc[5], u, v, pDst + 9);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/** Converts pixels of a color code to 8-bit RGB, writing no more than pixels*3 bytes.
+ * A last group that is only partly inside the frame is converted aside and clipped. */
+static void convertPixels(FDCColorCode code, const unsigned char *pSrc, unsigned char *pDst,
+                          unsigned long pixels, unsigned long groupBytes, unsigned long groupPixels)
+{
+    unsigned long whole = pixels / groupPixels;
+    unsigned long rest = pixels % groupPixels;
+    unsigned char rgb[12];
+
+    convertGroups(code, pSrc, pDst, whole);
+    if (rest == 0) return;
+    convertGroups(code, pSrc + whole * groupBytes, rgb, 1);
+    memcpy(pDst + whole * groupPixels * 3, rgb, rest * 3);
+}
+
+/** Converts a frame to 8-bit RGB.
+ * Monochrome and raw frames are replicated into the three colors, 16-bit samples are
+ * reduced to their most significant byte.
+ * \param[in] code The color code of the frame.
+ * \param[in] pSrc The frame as sent by the camera.
+ * \param[out] pDst The RGB frame, width*height*3 bytes.
+ * \param[in] width Frame width.
+ * \param[in] height Frame height.
+ * \return 0 on success, -1 for an invalid color code.
+ */
+int fdcConvertToRGB8(FDCColorCode code, const unsigned char *pSrc, unsigned char *pDst,
+                     unsigned long width, unsigned long height)
+{
+    unsigned long groupBytes, groupPixels;
+
+    if (groupSize(code, &groupBytes, &groupPixels)) return -1;
+    convertPixels(code, pSrc, pDst, width * height, groupBytes, groupPixels);
+    return 0;
+}
+
+/** Converts a frame received into several buffers to 8-bit RGB, see fdcConvertToRGB8().
+ * A group of bytes split between two buffers is gathered and converted on its own, everything
+ * else is converted in place. If the buffers hold less than a frame the end of pDst is not written.
+ * \param[in] code The color code of the frame.
+ * \param[in] pSegments The buffers of the frame, in order.
+ * \param[in] numSegments Number of buffers.
+ * \param[out] pDst The RGB frame, width*height*3 bytes.
+ * \param[in] width Frame width.
+ * \param[in] height Frame height.
+ * \return 0 on success, -1 for an invalid color code.
+ */
+int fdcConvertToRGB8Segments(FDCColorCode code, const FDCSegment *pSegments, int numSegments,
+                             unsigned char *pDst, unsigned long width, unsigned long height)
+{
+    unsigned long groupBytes, groupPixels;
+    unsigned long pixels, groups, whole, n, take, done;
+    unsigned char group[6];
+    unsigned long groupFill = 0;
+    const unsigned char *pSrc;
+    int i;
+
+    if (groupSize(code, &groupBytes, &groupPixels)) return -1;
+    pixels = width * height;
+    for (i=0; (i<numSegments) && (pixels>0); i++) {
+        pSrc = pSegments[i].pData;
+        n = pSegments[i].length;
+        /* Complete the group started at the end of the previous segment */
+        if (groupFill > 0) {
+            take = (groupBytes - groupFill < n) ? groupBytes - groupFill : n;
+            memcpy(group + groupFill, pSrc, take);
+            groupFill += take;
+            pSrc += take;
+            n -= take;
+            if (groupFill < groupBytes) continue;
+            done = (groupPixels < pixels) ? groupPixels : pixels;
+            convertPixels(code, group, pDst, done, groupBytes, groupPixels);
+            pDst += done * 3;
+            pixels -= done;
+            groupFill = 0;
+        }
+        whole = n / groupBytes;
+        groups = (pixels + groupPixels - 1) / groupPixels;
+        if (whole > groups) whole = groups;
+        done = (whole * groupPixels < pixels) ? whole * groupPixels : pixels;
+        convertPixels(code, pSrc, pDst, done, groupBytes, groupPixels);
+        pDst += done * 3;
+        pixels -= done;
+        pSrc += whole * groupBytes;
+        n -= whole * groupBytes;
+        if ((pixels > 0) && (n > 0)) {
+            memcpy(group, pSrc, n);
+            groupFill = n;
+        }
+    }
+    return 0;
+}
+
+/** Returns the part of a frame received into several buffers that starts offset bytes into it
+ * and is at most length bytes long, as a list of buffers.
+ * \return The number of buffers in pSlice. */
+static int sliceSegments(const FDCSegment *pSegments, int numSegments, unsigned long offset,
+                         unsigned long length, FDCSegment *pSlice)
+{
+    unsigned long n;
+    int i, numSlice = 0;
+
+    for (i=0; (i<numSegments) && (length>0); i++) {
+        if (offset >= pSegments[i].length) {
+            offset -= pSegments[i].length;
+            continue;
+        }
+        n = pSegments[i].length - offset;
+        if (n > length) n = length;
+        pSlice[numSlice].pData = pSegments[i].pData + offset;
+        pSlice[numSlice].length = n;
+        numSlice++;
+        length -= n;
+        offset = 0;
+    }
+    return numSlice;
+}
+
+/** A frame being copied or converted in strips */
+typedef struct {
+    FDCColorCode code;
+    const FDCSegment *pSegments;
+    int numSegments;
+    unsigned char *pDst;
+    unsigned long length;       /**< Bytes to copy, for fdcCopyMonoStrips() */
+    int bytesPerSample;
+    const FDCSampleFormat *pFormat; /**< The change of 16-bit samples, NULL for none */
+    unsigned long groupBytes;
+    unsigned long groupPixels;
+    unsigned long pixels;       /**< Pixels in the frame, for fdcConvertToRGB8Strips() */
+} StripFrame;
+
+/** Copies the samples [first, first+count) of a monochrome frame */
+static void copyMonoStrip(void *pvt, unsigned long first, unsigned long count)
+{
+    StripFrame *pFrame = (StripFrame *)pvt;
+    FDCSegment slice[FDC_MAX_SEGMENTS];
+    unsigned long offset = first * pFrame->bytesPerSample;
+    unsigned long n = count * pFrame->bytesPerSample;
+    int numSlice;
+
+    if (offset >= pFrame->length) return;
+    if (n > pFrame->length - offset) n = pFrame->length - offset;
+    numSlice = sliceSegments(pFrame->pSegments, pFrame->numSegments, offset, n, slice);
+    if (pFrame->pFormat) fdcNormalizeMonoSegments(pFrame->pFormat, slice, numSlice, pFrame->pDst + offset, n);
+    else fdcCopyMonoSegments(slice, numSlice, pFrame->pDst + offset, n, pFrame->bytesPerSample);
+}
+
+/** Converts the groups [first, first+count) of a color frame */
+static void convertRGB8Strip(void *pvt, unsigned long first, unsigned long count)
+{
+    StripFrame *pFrame = (StripFrame *)pvt;
+    FDCSegment slice[FDC_MAX_SEGMENTS];
+    unsigned long pixels = count * pFrame->groupPixels;
+    int numSlice;
+
+    /* The last group of the frame may be only partly inside it */
+    if (first * pFrame->groupPixels >= pFrame->pixels) return;
+    if (pixels > pFrame->pixels - first * pFrame->groupPixels) pixels = pFrame->pixels - first * pFrame->groupPixels;
+    numSlice = sliceSegments(pFrame->pSegments, pFrame->numSegments, first * pFrame->groupBytes,
+                             count * pFrame->groupBytes, slice);
+    fdcConvertToRGB8Segments(pFrame->code, slice, numSlice, pFrame->pDst + first * pFrame->groupPixels * 3,
+                             pixels, 1);
+}
+
+/** Copies a monochrome or raw frame received into several buffers into an NDArray in strips, see
+ * fdcCopyMonoSegments().
+ * \param[in] pJob The strip job of the calling thread, NULL to copy in the calling thread alone.
+ * \param[in] threads The most threads copying, see fdcStripsRun().
+ * \param[in] pSegments The buffers of the frame, in order.
+ * \param[in] numSegments Number of buffers.
+ * \param[out] pDst The NDArray data.
+ * \param[in] length Maximum number of bytes to copy.
+ * \param[in] bytesPerSample 1 or 2, see fdcCopyMono().
+ * \param[in] pFormat How 16-bit samples are changed, see fdcNormalizeMonoSegments(); NULL to copy
+ *            them as they are sent.
+ * \return The number of threads the copy was offered to.
+ */
+int fdcCopyMonoStrips(FDCStripJob *pJob, int threads, const FDCSegment *pSegments, int numSegments,
+                      unsigned char *pDst, unsigned long length, int bytesPerSample,
+                      const FDCSampleFormat *pFormat)
+{
+    StripFrame frame;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.pSegments = pSegments;
+    frame.numSegments = numSegments;
+    frame.pDst = pDst;
+    frame.length = length;
+    frame.bytesPerSample = bytesPerSample;
+    frame.pFormat = (bytesPerSample == 2) ? pFormat : NULL;
+    return fdcStripsRun(pJob, threads, (length + bytesPerSample - 1) / bytesPerSample, bytesPerSample,
+                        copyMonoStrip, &frame);
+}
+
+/** Converts a frame received into several buffers to 8-bit RGB in strips, see
+ * fdcConvertToRGB8Segments().
+ * \param[in] pJob The strip job of the calling thread, NULL to convert in the calling thread alone.
+ * \param[in] threads The most threads converting, see fdcStripsRun().
+ * \param[in] code The color code of the frame.
+ * \param[in] pSegments The buffers of the frame, in order.
+ * \param[in] numSegments Number of buffers.
+ * \param[out] pDst The RGB frame, width*height*3 bytes.
+ * \param[in] width Frame width.
+ * \param[in] height Frame height.
+ * \return The number of threads the conversion was offered to, -1 for an invalid color code.
+ */
+int fdcConvertToRGB8Strips(FDCStripJob *pJob, int threads, FDCColorCode code, const FDCSegment *pSegments,
+                           int numSegments, unsigned char *pDst, unsigned long width, unsigned long height)
+{
+    StripFrame frame;
+
+    memset(&frame, 0, sizeof(frame));
+    if (groupSize(code, &frame.groupBytes, &frame.groupPixels)) return -1;
+    frame.code = code;
+    frame.pSegments = pSegments;
+    frame.numSegments = numSegments;
+    frame.pDst = pDst;
+    frame.pixels = width * height;
+    return fdcStripsRun(pJob, threads, (width * height + frame.groupPixels - 1) / frame.groupPixels,
+                        frame.groupPixels * 3, convertRGB8Strip, &frame);
+}
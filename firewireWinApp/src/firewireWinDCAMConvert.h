@@ -0,0 +1,62 @@
+/*
+ * firewireWinDCAMConvert.h
+ *
+ * Conversion of frames from the IIDC wire formats to RGB for the firewireWinDCAM driver.
+ *
+ * IIDC cameras send YUV in the packed orders U-Y-V (4:4:4), U-Y0-V-Y1 (4:2:2) and U-Y0-Y1-V-Y2-Y3
+ * (4:1:1), and 16-bit samples big-endian. These functions produce 8-bit RGB triplets with the
+ * same integer arithmetic as the CMU library, so simulated and real cameras give identical images.
+ * Monochrome frames are only copied, with the bytes of 16-bit samples swapped to the host order.
+ * The *Segments variants read a frame that was received into several buffers (FDCSegment) straight
+ * from those buffers; a sample or YUV group may be split between two of them. The *Strips variants
+ * do the same in strips, in parallel, see firewireWinDCAMStrips.h.
+ *
+ * Cameras whose 16-bit samples have fewer significant bits, the data depth, can have them moved to
+ * the bottom or the top of the sample, with the other bits cleared, by the pass that swaps the
+ * bytes, see fdcSampleFormat().
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMCONVERT_H
+#define FIREWIREWINDCAMCONVERT_H
+
+#include "firewireWinDCAMCamera.h"
+#include "firewireWinDCAMStrips.h"
+
+/** Where the significant bits of 16-bit samples are published, see FDC_SAMPLE_ALIGN */
+typedef enum {
+    FDCAlignAsSent,             /**< The samples are published as the camera sends them */
+    FDCAlignRight,              /**< In the low bits, so the samples range from 0 to 2^depth-1 */
+    FDCAlignLeft                /**< In the high bits, the low bits are 0 */
+} FDCSampleAlign;
+
+/** How 16-bit samples are changed when they are copied, filled in by fdcSampleFormat() */
+typedef struct {
+    int inShift;                /**< Bits below the significant bits in the samples sent */
+    int maxValue;               /**< Largest value of the significant bits */
+    int clamp;                  /**< Larger values are set to maxValue rather than masked */
+    int outShift;               /**< Bits below the significant bits in the samples published */
+} FDCSampleFormat;
+
+int fdcSampleFormat(int depth, int sentLeft, FDCSampleAlign align, int clamp, FDCSampleFormat *pFormat);
+unsigned long fdcFrameBytes(FDCColorCode code, unsigned long width, unsigned long height);
+int fdcColorCodeForMode(unsigned long format, unsigned long mode, FDCColorCode *pCode);
+void fdcCopyMono(const unsigned char *pSrc, unsigned char *pDst, unsigned long length, int bytesPerSample);
+void fdcCopyMonoSegments(const FDCSegment *pSegments, int numSegments, unsigned char *pDst,
+                         unsigned long length, int bytesPerSample);
+int fdcConvertToRGB8(FDCColorCode code, const unsigned char *pSrc, unsigned char *pDst,
+                     unsigned long width, unsigned long height);
+int fdcConvertToRGB8Segments(FDCColorCode code, const FDCSegment *pSegments, int numSegments,
+                             unsigned char *pDst, unsigned long width, unsigned long height);
+void fdcNormalizeSamples(const FDCSampleFormat *pFormat, const unsigned char *pSrc, unsigned short *pDst,
+                         unsigned long samples);
+void fdcNormalizeMonoSegments(const FDCSampleFormat *pFormat, const FDCSegment *pSegments, int numSegments,
+                              unsigned char *pDst, unsigned long length);
+int fdcCopyMonoStrips(FDCStripJob *pJob, int threads, const FDCSegment *pSegments, int numSegments,
+                      unsigned char *pDst, unsigned long length, int bytesPerSample,
+                      const FDCSampleFormat *pFormat);
+int fdcConvertToRGB8Strips(FDCStripJob *pJob, int threads, FDCColorCode code, const FDCSegment *pSegments,
+                           int numSegments, unsigned char *pDst, unsigned long width, unsigned long height);
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * firewireWinDCAMEnum.cpp
+ *
+ * Camera enumeration service shared by all the firewireWinDCAM driver instances.
+ * See firewireWinDCAMEnum.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+
+#include "firewireWinDCAMEnum.h"
+#include "firewireWinDCAMFault.h"
+
+static epicsThreadOnceId enumOnceId = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId enumMutexId;
+
+/** The registered backends, in the order they are scanned. Protected by enumMutexId. */
+static const FDCBackend *backends[FDC_ENUM_MAX_BACKENDS];
+static int numBackends;
+
+/** The index, sorted by GUID. Protected by enumMutexId. */
+static FDCCameraInfo cameras[FDC_ENUM_MAX_CAMERAS];
+static int numCameras;
+static int scanValid;
+static unsigned long generation;    /**< Number of scans done */
+static epicsTimeStamp scanTime;     /**< When the last scan finished */
+static double scanDuration;         /**< How long the last scan took in seconds */
+
+static void enumInit(void *arg)
+{
+    enumMutexId = epicsMutexMustCreate();
+}
+
+static int compareGuid(const void *a, const void *b)
+{
+    unsigned long long ga = ((const FDCCameraInfo *)a)->guid;
+    unsigned long long gb = ((const FDCCameraInfo *)b)->guid;
+
+    if (ga < gb) return -1;
+    if (ga > gb) return 1;
+    return 0;
+}
+
+/** Parses a camera ID.
+ * The ID is hexadecimal if it starts with "0x", contains one of the letters a-f or has the
+ * FDC_GUID_DIGITS digits of a GUID printed in hexadecimal by the vendor tools. Otherwise it is
+ * decimal, which is how the driver used to parse it.
+ * \param[in] camid The camera ID. NULL or "" means the first camera found.
+ * \param[out] pGuid The GUID, 0 for the first camera found.
+ * \return 0 on success, -1 if the ID is not a valid number or does not fit in 64 bits.
+ */
+int fdcParseGuid(const char *camid, unsigned long long *pGuid)
+{
+    unsigned long long guid = 0;
+    unsigned long long limit;
+    const char *p;
+    int base = 10;
+    int digit;
+
+    *pGuid = 0;
+    if (!camid) return 0;
+    while (isspace((unsigned char)*camid)) camid++;
+    if (*camid == '\0') return 0;
+    if ((camid[0] == '0') && ((camid[1] == 'x') || (camid[1] == 'X'))) {
+        base = 16;
+        camid += 2;
+    } else {
+        for (p=camid; *p && !isspace((unsigned char)*p); p++) {
+            if (isxdigit((unsigned char)*p) && !isdigit((unsigned char)*p)) base = 16;
+        }
+        if (p - camid == FDC_GUID_DIGITS) base = 16;
+    }
+    if (*camid == '\0') return -1;
+    limit = ~0ULL / base;
+    for (p=camid; *p && !isspace((unsigned char)*p); p++) {
+        if (isdigit((unsigned char)*p)) digit = *p - '0';
+        else if ((base == 16) && isxdigit((unsigned char)*p)) digit = tolower((unsigned char)*p) - 'a' + 10;
+        else return -1;
+        if ((guid > limit) || (guid * base > ~0ULL - digit)) return -1;
+        guid = guid * base + digit;
+    }
+    while (isspace((unsigned char)*p)) p++;
+    if (*p != '\0') return -1;
+    *pGuid = guid;
+    return 0;
+}
+
+/** Scans the bus and rebuilds the index. Called with enumMutexId held. */
+static void scanBus(void)
+{
+    epicsTimeStamp start;
+    int b, i, found;
+
+    epicsTimeGetCurrent(&start);
+    numCameras = 0;
+    for (b=0; b<numBackends; b++) {
+        found = numCameras + backends[b]->enumerate(&cameras[numCameras], FDC_ENUM_MAX_CAMERAS - numCameras);
+        for (i=numCameras; i<found; i++) {
+            /* A camera whose link is down because of an injected fault is not on the bus */
+            if (fdcFaultLinkDown(cameras[i].guid)) continue;
+            cameras[numCameras] = cameras[i];
+            cameras[numCameras].pBackend = backends[b];
+            cameras[numCameras].order = numCameras;
+            numCameras++;
+        }
+    }
+    qsort(cameras, numCameras, sizeof(cameras[0]), compareGuid);
+    epicsTimeGetCurrent(&scanTime);
+    scanDuration = epicsTimeDiffInSeconds(&scanTime, &start);
+    scanValid = 1;
+    generation++;
+}
+
+/** Looks up a camera in the index. Called with enumMutexId held.
+ * \return The camera, NULL if it is not in the index. GUID 0 returns the first camera scanned.
+ */
+static FDCCameraInfo *lookup(unsigned long long guid)
+{
+    FDCCameraInfo key;
+    FDCCameraInfo *pFirst = NULL;
+    int i;
+
+    if (guid == 0) {
+        for (i=0; i<numCameras; i++) {
+            if (!pFirst || (cameras[i].order < pFirst->order)) pFirst = &cameras[i];
+        }
+        return pFirst;
+    }
+    key.guid = guid;
+    return (FDCCameraInfo *)bsearch(&key, cameras, numCameras, sizeof(cameras[0]), compareGuid);
+}
+
+/** Registers a backend. The backends are scanned in the order they are registered.
+ * Registering the same backend twice has no effect. */
+void fdcRegisterBackend(const FDCBackend *pBackend)
+{
+    int i;
+
+    epicsThreadOnce(&enumOnceId, enumInit, NULL);
+    epicsMutexMustLock(enumMutexId);
+    for (i=0; i<numBackends; i++) {
+        if (backends[i] == pBackend) break;
+    }
+    if ((i == numBackends) && (numBackends < FDC_ENUM_MAX_BACKENDS)) {
+        backends[numBackends++] = pBackend;
+        scanValid = 0;
+    }
+    epicsMutexUnlock(enumMutexId);
+}
+
+/** Finds a camera.
+ * The bus is scanned the first time, and again if the camera is not in the index and the last
+ * scan is older than FDC_ENUM_MIN_RESCAN_INTERVAL.
+ * \param[in] guid The camera GUID, 0 for the first camera found.
+ * \param[out] pInfo The camera.
+ * \return 0 if the camera was found, -1 if not.
+ */
+int fdcEnumFind(unsigned long long guid, FDCCameraInfo *pInfo)
+{
+    FDCCameraInfo *pFound;
+    epicsTimeStamp now;
+    int status = -1;
+
+    epicsThreadOnce(&enumOnceId, enumInit, NULL);
+    epicsMutexMustLock(enumMutexId);
+    if (!scanValid) scanBus();
+    pFound = lookup(guid);
+    if (!pFound) {
+        epicsTimeGetCurrent(&now);
+        if (epicsTimeDiffInSeconds(&now, &scanTime) >= FDC_ENUM_MIN_RESCAN_INTERVAL) {
+            scanBus();
+            pFound = lookup(guid);
+        }
+    }
+    if (pFound) {
+        *pInfo = *pFound;
+        status = 0;
+    }
+    epicsMutexUnlock(enumMutexId);
+    return status;
+}
+
+/** Scans the bus now.
+ * \return The number of cameras found.
+ */
+int fdcEnumRescan(void)
+{
+    int n;
+
+    epicsThreadOnce(&enumOnceId, enumInit, NULL);
+    epicsMutexMustLock(enumMutexId);
+    scanBus();
+    n = numCameras;
+    epicsMutexUnlock(enumMutexId);
+    return n;
+}
+
+/** Marks the index as out of date, for instance because a driver found its camera on a
+ * different node after a bus reset. The next fdcEnumFind() scans the bus. */
+void fdcEnumInvalidate(void)
+{
+    epicsThreadOnce(&enumOnceId, enumInit, NULL);
+    epicsMutexMustLock(enumMutexId);
+    scanValid = 0;
+    epicsMutexUnlock(enumMutexId);
+}
+
+/** Returns statistics of the last scan.
+ * \param[out] pNumCameras Number of cameras found.
+ * \param[out] pScanTime How long the scan took in seconds.
+ * \param[out] pGeneration Number of scans done since the IOC started.
+ */
+void fdcEnumGetStats(int *pNumCameras, double *pScanTime, unsigned long *pGeneration)
+{
+    epicsThreadOnce(&enumOnceId, enumInit, NULL);
+    epicsMutexMustLock(enumMutexId);
+    *pNumCameras = numCameras;
+    *pScanTime = scanDuration;
+    *pGeneration = generation;
+    epicsMutexUnlock(enumMutexId);
+}
+
+/** Prints the index */
+void fdcEnumReport(FILE *fp)
+{
+    int i;
+
+    epicsThreadOnce(&enumOnceId, enumInit, NULL);
+    epicsMutexMustLock(enumMutexId);
+    fprintf(fp, "%d cameras found in %.3f s (scan %lu)\n", numCameras, scanDuration, generation);
+    for (i=0; i<numCameras; i++) {
+        fprintf(fp, "  %s node %2d: 0x%16.16llX %s %s (IIDC 0x%lX)\n", cameras[i].pBackend->name,
+            cameras[i].node, cameras[i].guid, cameras[i].vendor, cameras[i].model, cameras[i].version);
+    }
+    epicsMutexUnlock(enumMutexId);
+}
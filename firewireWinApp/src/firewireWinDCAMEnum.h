@@ -0,0 +1,50 @@
+/*
+ * firewireWinDCAMEnum.h
+ *
+ * Camera enumeration service shared by all the firewireWinDCAM driver instances.
+ *
+ * Finding a camera by GUID means selecting every node on the bus and reading its unique ID.
+ * Done by each driver instance this costs N*N node selections for N cameras. This service scans
+ * the bus once per process, keeps an index of the cameras sorted by GUID and serves every
+ * instance from it. The bus is scanned again when a camera is not found in the index (it may
+ * have been plugged in or moved to another node by a bus reset) or after fdcEnumInvalidate().
+ * A scan asks every registered backend (see firewireWinDCAMCamera.h) for its cameras.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMENUM_H
+#define FIREWIREWINDCAMENUM_H
+
+#include <stdio.h>
+
+#include "firewireWinDCAMCamera.h"
+
+#define FDC_ENUM_MAX_CAMERAS 63     /**< Maximum number of nodes on a 1394 bus */
+#define FDC_ENUM_MAX_BACKENDS 8
+#define FDC_ENUM_NAME_LEN    64
+#define FDC_GUID_DIGITS      16     /**< Hexadecimal digits of a GUID */
+
+/** Minimum time between two scans caused by a camera not being found, in seconds */
+#define FDC_ENUM_MIN_RESCAN_INTERVAL 1.0
+
+/** One camera found on the bus */
+struct FDCCameraInfo {
+    unsigned long long guid;            /**< Camera unique ID */
+    int node;                           /**< Index of the camera in its backend, e.g. for C1394Camera::SelectCamera() */
+    int bus;                            /**< Bus the camera shares bandwidth on, -1 if it does not use a bus */
+    unsigned long version;              /**< IIDC version */
+    char vendor[FDC_ENUM_NAME_LEN];
+    char model[FDC_ENUM_NAME_LEN];
+    const FDCBackend *pBackend;         /**< Backend that found the camera */
+    int order;                          /**< Position in the scan; the first camera is the one with the lowest */
+};
+
+int  fdcParseGuid(const char *camid, unsigned long long *pGuid);
+int  fdcEnumFind(unsigned long long guid, FDCCameraInfo *pInfo);
+int  fdcEnumRescan(void);
+void fdcEnumInvalidate(void);
+void fdcEnumGetStats(int *pNumCameras, double *pScanTime, unsigned long *pGeneration);
+void fdcEnumReport(FILE *fp);
+
+#endif
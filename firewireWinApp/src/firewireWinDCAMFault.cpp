@@ -0,0 +1,474 @@
+/*
+ * firewireWinDCAMFault.cpp
+ *
+ * Fault injection for the firewireWinDCAM driver. See firewireWinDCAMFault.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+
+#include "firewireWinDCAMCamera.h"
+#include "firewireWinDCAMEnum.h"
+#include "firewireWinDCAMFault.h"
+
+/** Longest time AcquireImageEx() waits before failing while the link is down, in seconds */
+#define FAULT_LINK_DOWN_WAIT 1.0
+
+typedef enum {
+    FaultDelay,
+    FaultDrop,
+    FaultAcqErr,
+    FaultStartErr,
+    FaultCorrupt,
+    FaultLinkLoss,
+    NUM_FAULT_KINDS
+} FaultKind;
+
+static const char *faultNames[NUM_FAULT_KINDS] = {"delay", "drop", "acqerr", "starterr", "corrupt", "linkloss"};
+static const double faultDefaults[NUM_FAULT_KINDS] = {0.0, 1, FDC_CAM_ERROR_FRAME_TIMEOUT, FDC_CAM_ERROR, 1, 1.0};
+
+typedef struct {
+    FaultKind kind;
+    double value;
+    unsigned long first;        /**< Call that triggers the rule, 0 if it is random */
+    unsigned long every;        /**< Period after the first call, 0 for once */
+    double probability;         /**< Probability per call, in [0,1] */
+} FaultRule;
+
+/** The schedule and the state of one camera. Protected by faultMutexId. */
+typedef struct {
+    unsigned long long guid;
+    char schedule[256];
+    FaultRule rules[FDC_FAULT_MAX_RULES];
+    int numRules;
+    unsigned int seed;
+    unsigned int rng;
+    unsigned long frames;               /**< AcquireImageEx() calls */
+    unsigned long starts;               /**< StartImageAcquisitionEx() calls */
+    int linkDown;
+    epicsTimeStamp linkUpTime;
+    unsigned long counts[NUM_FAULT_KINDS];
+    unsigned long framesDropped;        /**< Frames discarded by drop rules */
+} FaultConfig;
+
+static epicsThreadOnceId faultOnceId = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId faultMutexId;
+static FaultConfig faults[FDC_FAULT_MAX_CAMERAS];
+static int numFaults;
+
+static void faultInit(void *arg)
+{
+    faultMutexId = epicsMutexMustCreate();
+}
+
+/** xorshift32, never returns 0 */
+static unsigned int nextRandom(FaultConfig *pConfig)
+{
+    unsigned int x = pConfig->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pConfig->rng = x;
+    return x;
+}
+
+static FaultConfig *findConfig(unsigned long long guid)
+{
+    int i;
+
+    for (i=0; i<numFaults; i++) {
+        if (faults[i].guid == guid) return &faults[i];
+    }
+    return NULL;
+}
+
+/** Parses one rule. \return 0 on success, -1 on a syntax error. */
+static int parseRule(const char *text, FaultRule *pRule)
+{
+    char kind[32];
+    const char *p = text;
+    char *end;
+    int i, len;
+
+    len = (int)strcspn(p, "=@");
+    if ((len == 0) || (len >= (int)sizeof(kind))) return -1;
+    memcpy(kind, p, len);
+    kind[len] = '\0';
+    for (i=0; i<NUM_FAULT_KINDS; i++) {
+        if (strcmp(kind, faultNames[i]) == 0) break;
+    }
+    if (i == NUM_FAULT_KINDS) return -1;
+    pRule->kind = (FaultKind)i;
+    pRule->value = faultDefaults[i];
+    p += len;
+    if (*p == '=') {
+        pRule->value = strtod(p+1, &end);
+        if (end == p+1) return -1;
+        p = end;
+    }
+    if (*p != '@') return -1;
+    p++;
+    pRule->first = 0;
+    pRule->every = 0;
+    pRule->probability = strtod(p, &end);
+    if (end == p) return -1;
+    if (*end == '%') {
+        pRule->probability /= 100.0;
+        if ((pRule->probability <= 0.0) || (pRule->probability > 1.0)) return -1;
+        end++;
+    } else {
+        pRule->probability = 0.0;
+        pRule->first = strtoul(p, &end, 10);
+        if (pRule->first == 0) return -1;
+        if (*end == '+') {
+            p = end + 1;
+            pRule->every = strtoul(p, &end, 10);
+            if ((end == p) || (pRule->every == 0)) return -1;
+        }
+    }
+    if (*end != '\0') return -1;
+    if ((pRule->kind == FaultAcqErr) || (pRule->kind == FaultStartErr)) {
+        /* The driver only knows the error codes of firewireWinDCAMCamera.h */
+        if ((pRule->value != (int)pRule->value) ||
+            (pRule->value < FDC_CAM_ERROR_FRAME_TIMEOUT) || (pRule->value > FDC_CAM_ERROR)) return -1;
+    } else if (pRule->value < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/** Sets the fault schedule of a camera.
+ * Must be called before the camera is opened by WinFDC_Config(). Calling it again for the same
+ * camera replaces the schedule, restarts the call counts and reseeds the generator; an empty
+ * schedule stops the injection.
+ * \param[in] camid The camera GUID, in the same format as for WinFDC_Config().
+ * \param[in] schedule The rules, see firewireWinDCAMFault.h.
+ * \param[in] seed The seed of the generator.
+ * \return 0 on success, -1 on error.
+ */
+int fdcFaultConfigure(const char *camid, const char *schedule, unsigned int seed)
+{
+    FaultConfig *pConfig;
+    FaultRule rules[FDC_FAULT_MAX_RULES];
+    char text[256];
+    char *rule, *next;
+    unsigned long long guid;
+    int numRules = 0;
+
+    if (fdcParseGuid(camid, &guid) || (guid == 0)) {
+        fprintf(stderr, "fdcFaultConfigure: the camera GUID is required, got \"%s\"\n", camid ? camid : "");
+        return -1;
+    }
+    if (!schedule) schedule = "";
+    if (strlen(schedule) >= sizeof(text)) {
+        fprintf(stderr, "fdcFaultConfigure: schedule too long\n");
+        return -1;
+    }
+    strcpy(text, schedule);
+    for (rule=text; rule && *rule; rule=next) {
+        next = strchr(rule, ';');
+        if (next) *next++ = '\0';
+        while (*rule == ' ') rule++;
+        if (*rule == '\0') continue;
+        if ((numRules == FDC_FAULT_MAX_RULES) || parseRule(rule, &rules[numRules])) {
+            fprintf(stderr, "fdcFaultConfigure: invalid or too many rules at \"%s\"\n", rule);
+            return -1;
+        }
+        numRules++;
+    }
+
+    epicsThreadOnce(&faultOnceId, faultInit, NULL);
+    epicsMutexMustLock(faultMutexId);
+    pConfig = findConfig(guid);
+    if (!pConfig) {
+        if (numFaults == FDC_FAULT_MAX_CAMERAS) {
+            epicsMutexUnlock(faultMutexId);
+            fprintf(stderr, "fdcFaultConfigure: too many cameras\n");
+            return -1;
+        }
+        pConfig = &faults[numFaults++];
+    }
+    memset(pConfig, 0, sizeof(*pConfig));
+    pConfig->guid = guid;
+    strcpy(pConfig->schedule, schedule);
+    memcpy(pConfig->rules, rules, numRules * sizeof(rules[0]));
+    pConfig->numRules = numRules;
+    pConfig->seed = seed;
+    pConfig->rng = seed ? seed : 1;
+    epicsMutexUnlock(faultMutexId);
+    return 0;
+}
+
+/** Returns 1 if a rule triggers on this call. Called with faultMutexId held.
+ * Draws a random number for every random rule, so the sequence does not depend on which rules fire. */
+static int triggers(FaultConfig *pConfig, FaultRule *pRule, unsigned long count)
+{
+    if (pRule->probability > 0.0)
+        return (nextRandom(pConfig) / 4294967296.0) < pRule->probability;
+    if (count < pRule->first) return 0;
+    if (count == pRule->first) return 1;
+    return (pRule->every > 0) && (((count - pRule->first) % pRule->every) == 0);
+}
+
+/** Checks whether the link is down, bringing it back up when its time has passed.
+ * Called with faultMutexId held. \return The remaining down time in seconds, 0 if the link is up. */
+static double linkDownTime(FaultConfig *pConfig)
+{
+    epicsTimeStamp now;
+    double remaining;
+
+    if (!pConfig->linkDown) return 0.0;
+    epicsTimeGetCurrent(&now);
+    remaining = epicsTimeDiffInSeconds(&pConfig->linkUpTime, &now);
+    if (remaining > 0.0) return remaining;
+    pConfig->linkDown = 0;
+    return 0.0;
+}
+
+/** A camera with faults injected into the calls to the camera it wraps */
+class FDCFaultCamera : public FDCCamera
+{
+public:
+    FDCFaultCamera(FDCCamera *pInner, FaultConfig *pConfig) : pInner(pInner), pConfig(pConfig) {}
+    ~FDCFaultCamera() { delete pInner; }
+
+    int  InitCamera(int reset);
+    void GetCameraName(char *buf, int len)      { pInner->GetCameraName(buf, len); }
+    void GetCameraVendor(char *buf, int len)    { pInner->GetCameraVendor(buf, len); }
+    void GetCameraUniqueID(unsigned long long *pGuid) { pInner->GetCameraUniqueID(pGuid); }
+    unsigned long GetVersion()                  { return pInner->GetVersion(); }
+    int  GetMaxSpeed()                          { return pInner->GetMaxSpeed(); }
+    bool Has1394b()                             { return pInner->Has1394b(); }
+    bool Status1394b()                          { return pInner->Status1394b(); }
+    int  Set1394b(bool on)                      { return pInner->Set1394b(on); }
+
+    bool HasVideoFormat(unsigned long format)   { return pInner->HasVideoFormat(format); }
+    int  SetVideoFormat(unsigned long format)   { return pInner->SetVideoFormat(format); }
+    int  GetVideoFormat()                       { return pInner->GetVideoFormat(); }
+    bool HasVideoMode(unsigned long format, unsigned long mode) { return pInner->HasVideoMode(format, mode); }
+    int  SetVideoMode(unsigned long mode)       { return pInner->SetVideoMode(mode); }
+    int  GetVideoMode()                         { return pInner->GetVideoMode(); }
+    bool HasVideoFrameRate(unsigned long format, unsigned long mode, unsigned long rate)
+                                                { return pInner->HasVideoFrameRate(format, mode, rate); }
+    int  SetVideoFrameRate(unsigned long rate)  { return pInner->SetVideoFrameRate(rate); }
+    int  GetVideoFrameRate()                    { return pInner->GetVideoFrameRate(); }
+    void GetVideoFrameDimensions(unsigned long *pWidth, unsigned long *pHeight) { pInner->GetVideoFrameDimensions(pWidth, pHeight); }
+    void GetVideoDataDepth(unsigned short *depth)   { pInner->GetVideoDataDepth(depth); }
+    bool HasOneShot()                           { return pInner->HasOneShot(); }
+    bool HasMultiShot()                         { return pInner->HasMultiShot(); }
+
+    int  StartImageAcquisitionEx(int nBuffers, int frameTimeout, int flags);
+    int  AcquireImageEx(int dropStaleFrames, int *pDroppedFrames);
+    int  StopImageAcquisition()                 { return pInner->StopImageAcquisition(); }
+    void *GetFrameEvent()                       { return pInner->GetFrameEvent(); }
+    double GetFrameWait()                       { return pInner->GetFrameWait(); }
+    int  GetFrameCycleTime(unsigned long *pCycleTime)   { return pInner->GetFrameCycleTime(pCycleTime); }
+    unsigned char *GetRawData(unsigned long *pLength)   { return pInner->GetRawData(pLength); }
+    int  GetRawSegments(FDCSegment *pSegments, int maxSegments) { return pInner->GetRawSegments(pSegments, maxSegments); }
+    int  getRGB(unsigned char *pBitmap, unsigned long length) { return pInner->getRGB(pBitmap, length); }
+
+    FDCCameraControl *GetCameraControl(FDCFeature feature)  { return pInner->GetCameraControl(feature); }
+    FDCCameraControlSize *GetCameraControlSize()            { return pInner->GetCameraControlSize(); }
+
+private:
+    FDCCamera *pInner;
+    FaultConfig *pConfig;
+};
+
+int FDCFaultCamera::InitCamera(int reset)
+{
+    double down;
+
+    epicsMutexMustLock(faultMutexId);
+    down = linkDownTime(pConfig);
+    epicsMutexUnlock(faultMutexId);
+    if (down > 0.0) return FDC_CAM_ERROR;
+    return pInner->InitCamera(reset);
+}
+
+int FDCFaultCamera::StartImageAcquisitionEx(int nBuffers, int frameTimeout, int flags)
+{
+    int i;
+    int status = FDC_CAM_SUCCESS;
+
+    epicsMutexMustLock(faultMutexId);
+    pConfig->starts++;
+    if (linkDownTime(pConfig) > 0.0) {
+        status = FDC_CAM_ERROR;
+    } else {
+        for (i=0; i<pConfig->numRules; i++) {
+            if (pConfig->rules[i].kind != FaultStartErr) continue;
+            if (triggers(pConfig, &pConfig->rules[i], pConfig->starts) && (status == FDC_CAM_SUCCESS)) {
+                status = (int)pConfig->rules[i].value;
+                pConfig->counts[FaultStartErr]++;
+            }
+        }
+    }
+    epicsMutexUnlock(faultMutexId);
+    if (status != FDC_CAM_SUCCESS) return status;
+    return pInner->StartImageAcquisitionEx(nBuffers, frameTimeout, flags);
+}
+
+int FDCFaultCamera::AcquireImageEx(int dropStaleFrames, int *pDroppedFrames)
+{
+    double delay = 0.0, linkLoss = 0.0, down;
+    int drop = 0, corrupt = 0, acqErr = FDC_CAM_SUCCESS;
+    int fired[NUM_FAULT_KINDS];
+    int i, status, discarded = 0, dropped = 0, newDropped = 0;
+    unsigned char *pData;
+    unsigned long length;
+
+    memset(fired, 0, sizeof(fired));
+    epicsMutexMustLock(faultMutexId);
+    pConfig->frames++;
+    down = linkDownTime(pConfig);
+    if (down == 0.0) {
+        for (i=0; i<pConfig->numRules; i++) {
+            FaultRule *pRule = &pConfig->rules[i];
+            if ((pRule->kind == FaultStartErr) || !triggers(pConfig, pRule, pConfig->frames)) continue;
+            fired[pRule->kind]++;
+            switch (pRule->kind) {
+                case FaultDelay:    delay += pRule->value; break;
+                case FaultDrop:     drop += (int)pRule->value; break;
+                case FaultAcqErr:   if (acqErr == FDC_CAM_SUCCESS) acqErr = (int)pRule->value; break;
+                case FaultCorrupt:  corrupt += (int)pRule->value; break;
+                case FaultLinkLoss: if (pRule->value > linkLoss) linkLoss = pRule->value; break;
+                default: break;
+            }
+        }
+        /* A link loss hides an error, which hides the faults on the frame. Only the faults
+         * that take effect are counted. */
+        if (linkLoss > 0.0) {
+            pConfig->counts[FaultLinkLoss]++;
+            pConfig->linkDown = 1;
+            epicsTimeGetCurrent(&pConfig->linkUpTime);
+            epicsTimeAddSeconds(&pConfig->linkUpTime, linkLoss);
+            down = linkLoss;
+        } else if (acqErr != FDC_CAM_SUCCESS) {
+            pConfig->counts[FaultAcqErr]++;
+        } else {
+            pConfig->counts[FaultDelay]   += fired[FaultDelay];
+            pConfig->counts[FaultDrop]    += fired[FaultDrop];
+            pConfig->counts[FaultCorrupt] += fired[FaultCorrupt];
+        }
+    }
+    epicsMutexUnlock(faultMutexId);
+
+    if (down > 0.0) {
+        /* A lost camera drops its isochronous stream and disappears from the bus */
+        if (linkLoss > 0.0) {
+            pInner->StopImageAcquisition();
+            fdcEnumInvalidate();
+        }
+        /* Wait as a frame timeout would rather than have the caller spin */
+        epicsThreadSleep((down < FAULT_LINK_DOWN_WAIT) ? down : FAULT_LINK_DOWN_WAIT);
+        return FDC_CAM_ERROR;
+    }
+    if (acqErr != FDC_CAM_SUCCESS) return acqErr;
+
+    status = FDC_CAM_SUCCESS;
+    for (discarded=0; (discarded<drop) && (status == FDC_CAM_SUCCESS); ) {
+        status = pInner->AcquireImageEx(dropStaleFrames, &newDropped);
+        if (status == FDC_CAM_SUCCESS) discarded++;
+        dropped += newDropped;
+        newDropped = 0;
+    }
+    if (status == FDC_CAM_SUCCESS) status = pInner->AcquireImageEx(dropStaleFrames, &newDropped);
+    if (pDroppedFrames) *pDroppedFrames = dropped + discarded + newDropped;
+    if (discarded > 0) {
+        epicsMutexMustLock(faultMutexId);
+        pConfig->framesDropped += discarded;
+        epicsMutexUnlock(faultMutexId);
+    }
+    if (status != FDC_CAM_SUCCESS) return status;
+
+    if (corrupt > 0) {
+        pData = pInner->GetRawData(&length);
+        if (pData && (length > 0)) {
+            epicsMutexMustLock(faultMutexId);
+            for (i=0; i<corrupt; i++) {
+                unsigned int r = nextRandom(pConfig);
+                pData[r % length] ^= (unsigned char)(1 + (r >> 24) % 255);
+            }
+            epicsMutexUnlock(faultMutexId);
+        }
+    }
+    if (delay > 0.0) epicsThreadSleep(delay);
+    return FDC_CAM_SUCCESS;
+}
+
+/** Wraps a camera that has a fault schedule.
+ * \param[in] guid The camera GUID.
+ * \param[in] pCamera The camera opened by its backend.
+ * \return The wrapped camera, which owns pCamera, or pCamera itself if it has no schedule.
+ */
+FDCCamera *fdcFaultWrap(unsigned long long guid, FDCCamera *pCamera)
+{
+    FaultConfig *pConfig;
+
+    epicsThreadOnce(&faultOnceId, faultInit, NULL);
+    epicsMutexMustLock(faultMutexId);
+    pConfig = findConfig(guid);
+    epicsMutexUnlock(faultMutexId);
+    if (!pConfig) return pCamera;
+    return new FDCFaultCamera(pCamera, pConfig);
+}
+
+/** Returns 1 if an injected link loss is in progress for a camera, so a bus scan must not find it */
+int fdcFaultLinkDown(unsigned long long guid)
+{
+    FaultConfig *pConfig;
+    int down = 0;
+
+    epicsThreadOnce(&faultOnceId, faultInit, NULL);
+    epicsMutexMustLock(faultMutexId);
+    pConfig = findConfig(guid);
+    if (pConfig) down = (linkDownTime(pConfig) > 0.0);
+    epicsMutexUnlock(faultMutexId);
+    return down;
+}
+
+/** Returns the number of faults injected into a camera since its schedule was set */
+unsigned long fdcFaultCount(unsigned long long guid)
+{
+    FaultConfig *pConfig;
+    unsigned long count = 0;
+    int i;
+
+    epicsThreadOnce(&faultOnceId, faultInit, NULL);
+    epicsMutexMustLock(faultMutexId);
+    pConfig = findConfig(guid);
+    if (pConfig) {
+        for (i=0; i<NUM_FAULT_KINDS; i++) count += pConfig->counts[i];
+    }
+    epicsMutexUnlock(faultMutexId);
+    return count;
+}
+
+/** Prints the schedules and the faults injected so far */
+void fdcFaultReport(FILE *fp)
+{
+    FaultConfig *pConfig;
+    int i, j;
+
+    epicsThreadOnce(&faultOnceId, faultInit, NULL);
+    epicsMutexMustLock(faultMutexId);
+    for (i=0; i<numFaults; i++) {
+        pConfig = &faults[i];
+        fprintf(fp, "Faults 0x%16.16llX: \"%s\" seed %u, %lu frames, %lu starts%s\n", pConfig->guid,
+            pConfig->schedule, pConfig->seed, pConfig->frames, pConfig->starts,
+            (linkDownTime(pConfig) > 0.0) ? ", link down" : "");
+        fprintf(fp, " ");
+        for (j=0; j<NUM_FAULT_KINDS; j++) fprintf(fp, " %s %lu", faultNames[j], pConfig->counts[j]);
+        fprintf(fp, ", frames dropped %lu\n", pConfig->framesDropped);
+    }
+    epicsMutexUnlock(faultMutexId);
+}
@@ -0,0 +1,53 @@
+/*
+ * firewireWinDCAMFault.h
+ *
+ * Fault injection for the firewireWinDCAM driver.
+ *
+ * A camera with a fault schedule is opened wrapped in a layer that injects faults into the calls
+ * the driver makes: frames delivered late or dropped, errors returned by AcquireImageEx() and
+ * StartImageAcquisitionEx(), corrupted frame data and loss of the link to the camera. This works
+ * with any backend, so the recovery and the frame accounting of the driver can be tested with the
+ * simulated cameras as well as with real ones.
+ *
+ * A schedule is a list of rules separated by ';'. Each rule is kind[=value]@when, where when is
+ *   N      the Nth call (the first call is 1)
+ *   N+M    the Nth call and every Mth call after it
+ *   P%     each call with probability P percent
+ * and kind is one of
+ *   delay=S      AcquireImageEx() returns the frame S seconds late
+ *   drop=N       N frames are discarded and reported as dropped (default 1)
+ *   acqerr=C     AcquireImageEx() returns error code C without a frame (default
+ *                FDC_CAM_ERROR_FRAME_TIMEOUT)
+ *   starterr=C   StartImageAcquisitionEx() returns error code C (default FDC_CAM_ERROR)
+ *   corrupt=N    N random bytes of the frame are overwritten (default 1)
+ *   linkloss=S   the link is lost for S seconds: the stream stops, the camera calls that need the
+ *                bus fail and the camera is not found by a bus scan
+ * The codes C of acqerr and starterr must be FDC_CAM_ERROR_* codes, from -1 to -16.
+ * starterr counts StartImageAcquisitionEx() calls, the other kinds count AcquireImageEx() calls.
+ * For instance "acqerr@100+100;drop=2@1%;linkloss=3@5000" returns a frame timeout every 100
+ * frames, drops 2 frames with probability 1% and loses the link for 3 s at frame 5000.
+ *
+ * The probabilities and the corrupted bytes are drawn from a generator seeded with the seed of
+ * the schedule, so a run with the same schedule, seed and sequence of calls injects the same
+ * faults.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMFAULT_H
+#define FIREWIREWINDCAMFAULT_H
+
+#include <stdio.h>
+
+#include "firewireWinDCAMCamera.h"
+
+#define FDC_FAULT_MAX_CAMERAS 16
+#define FDC_FAULT_MAX_RULES   16
+
+int  fdcFaultConfigure(const char *camid, const char *schedule, unsigned int seed);
+FDCCamera *fdcFaultWrap(unsigned long long guid, FDCCamera *pCamera);
+int  fdcFaultLinkDown(unsigned long long guid);
+unsigned long fdcFaultCount(unsigned long long guid);
+void fdcFaultReport(FILE *fp);
+
+#endif
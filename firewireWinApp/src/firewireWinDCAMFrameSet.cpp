@@ -0,0 +1,641 @@
+/*
+ * firewireWinDCAMFrameSet.cpp
+ *
+ * Frame set assembler for the firewireWinDCAM driver.
+ *
+ * For stereo and multi-view setups the frames of several cameras taken at the same time are
+ * wanted together. The assembler is an areaDetector port that receives the NDArrays of several
+ * driver ports, as a plugin does, and groups them into sets of one frame per camera whose
+ * times agree within a tolerance. A set is published either as one NDArray with the frames
+ * stacked along a new last dimension, on address 0, or as one copy of each frame on the address
+ * of its camera, all with the same uniqueId and time stamp.
+ *
+ * Frames are matched on the CycleTime attribute the driver adds, the time the frame started to
+ * be sent on the cycle timer of the bus, when all the cameras of a set have it and are on one
+ * bus. That clock is shared by the cameras. The driver only adds it when the frame was taken as
+ * soon as it arrived, as the timer is read when the frame is taken. Otherwise they are matched on
+ * their EPICS time stamps.
+ *
+ * A frame waits for the frames of the other cameras at most FDC_SET_TIMEOUT, which bounds the
+ * latency the matching adds. Frames that are given up, or that are passed over because the other
+ * cameras have newer frames, are counted as unmatched; frames that arrive after their set has
+ * been published or given up are counted as late.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsString.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsStdio.h>
+#include <iocsh.h>
+
+#include <asynNDArrayDriver.h>
+
+#include "firewireWinDCAMIso.h"
+
+#include <epicsExport.h>
+
+static const char *driverName = "FirewireWinFrameSet";
+
+/** Most cameras in a set */
+#define FDC_SET_MAX_CAMERAS 16
+/** Most frames of a camera waiting to be matched */
+#define FDC_SET_QUEUE_SIZE 16
+
+#define FDC_set_modeString          "FDC_SET_MODE"
+#define FDC_set_toleranceString     "FDC_SET_TOLERANCE"
+#define FDC_set_timeoutString       "FDC_SET_TIMEOUT"
+#define FDC_set_camerasString       "FDC_SET_CAMERAS"
+#define FDC_set_clockString         "FDC_SET_CLOCK"
+#define FDC_set_matchedString       "FDC_SET_MATCHED"
+#define FDC_set_unmatchedString     "FDC_SET_UNMATCHED"
+#define FDC_set_lateString          "FDC_SET_LATE"
+#define FDC_set_droppedString       "FDC_SET_DROPPED"
+#define FDC_set_pendingString       "FDC_SET_PENDING"
+#define FDC_set_spreadString        "FDC_SET_SPREAD"
+#define FDC_set_latencyString       "FDC_SET_LATENCY"
+#define FDC_set_latency_maxString   "FDC_SET_LATENCY_MAX"
+#define FDC_set_resetString         "FDC_SET_RESET"
+
+/** How a set is published */
+typedef enum {
+    FDCSetStack,                /**< One NDArray with the frames stacked along a new last dimension */
+    FDCSetSeparate              /**< A copy of each frame on the address of its camera */
+} FDCSetMode_t;
+
+/** The clock the frames of a set were matched on */
+typedef enum {
+    FDCSetClockHost,            /**< The EPICS time stamps */
+    FDCSetClockCycle            /**< The bus cycle timer, see the CycleTime attribute */
+} FDCSetClock_t;
+
+/** When a frame was taken */
+typedef struct {
+    double cycleTime;           /**< The CycleTime attribute of the frame */
+    int bus;                    /**< The Bus attribute, -1 if the frame has no CycleTime */
+    double hostTime;            /**< The EPICS time stamp of the frame in seconds */
+} SetKey;
+
+/** A frame waiting to be matched */
+typedef struct {
+    NDArray *pArray;
+    SetKey key;
+    epicsTimeStamp arrival;
+} SetFrame;
+
+class FirewireWinFrameSet;
+
+/** A camera port the assembler receives frames from */
+typedef struct {
+    FirewireWinFrameSet *pSet;
+    int index;
+    char portName[40];
+    asynUser *pasynUser;
+    void *interruptPvt;
+    SetFrame queue[FDC_SET_QUEUE_SIZE];
+    int head, count;
+} SetInput;
+
+/** Groups the frames of several firewireWinDCAM ports taken at the same time into sets */
+class FirewireWinFrameSet : public asynNDArrayDriver {
+public:
+    FirewireWinFrameSet(const char *portName, const char *cameraPorts, int maxBuffers, size_t maxMemory,
+                        int priority, int stackSize);
+
+    /* These are the methods that we override from asynNDArrayDriver */
+    virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    virtual void report(FILE *fp, int details);
+
+    /* These are called from C and so must be public */
+    void arrayCallback(SetInput *pInput, NDArray *pArray);
+    void setTask();
+
+protected:
+    int FDC_set_mode;
+#define FIRST_FDC_SET_PARAM FDC_set_mode
+    int FDC_set_tolerance;
+    int FDC_set_timeout;
+    int FDC_set_cameras;
+    int FDC_set_clock;
+    int FDC_set_matched;
+    int FDC_set_unmatched;
+    int FDC_set_late;
+    int FDC_set_dropped;
+    int FDC_set_pending;
+    int FDC_set_spread;
+    int FDC_set_latency;
+    int FDC_set_latency_max;
+    int FDC_set_reset;
+#define LAST_FDC_SET_PARAM FDC_set_reset
+
+private:
+    int connectInput(const char *cameraPort);
+    double assemble();
+    void publish(SetFrame **pFrames, int useCycle, double spread);
+    void dropHead(SetInput *pInput, int param);
+    void countParam(int param, int n);
+
+    SetInput inputs[FDC_SET_MAX_CAMERAS];
+    int numInputs;
+    epicsEventId wakeEventId;
+    SetKey doneKey;             /**< The newest frame of the last set published or given up */
+    int haveDone;
+};
+
+#define NUM_FDC_SET_PARAMS ((int)(&LAST_FDC_SET_PARAM - &FIRST_FDC_SET_PARAM + 1))
+
+/** Returns a-b, on the cycle timer if useCycle */
+static double keyDiff(const SetKey *a, const SetKey *b, int useCycle)
+{
+    if (useCycle) return fdcIsoCycleTimeDiff(a->cycleTime, b->cycleTime);
+    return a->hostTime - b->hostTime;
+}
+
+static void setArrayCallbackC(void *userPvt, asynUser *pasynUser, void *genericPointer)
+{
+    SetInput *pInput = (SetInput *)userPvt;
+
+    pInput->pSet->arrayCallback(pInput, (NDArray *)genericPointer);
+}
+
+static void setTaskC(void *drvPvt)
+{
+    FirewireWinFrameSet *pSet = (FirewireWinFrameSet *)drvPvt;
+
+    pSet->setTask();
+}
+
+/** Configures a frame set assembler.
+ * \param[in] portName The name of the asyn port of the assembler.
+ * \param[in] cameraPorts The ports of the cameras, separated by spaces or commas. The ports must
+ *            have been configured already. A frame set has one frame of each, in this order.
+ * \param[in] maxBuffers The maximum number of NDArray buffers the assembler allocates; 0 for unlimited.
+ * \param[in] maxMemory The maximum amount of memory its NDArrays use; 0 for unlimited.
+ * \param[in] priority The thread priority of the asyn port, 0 for the default.
+ * \param[in] stackSize The stack size of the asyn port thread, 0 for the default.
+ */
+extern "C" int WinFDC_FrameSet(const char *portName, const char *cameraPorts, int maxBuffers, size_t maxMemory,
+                               int priority, int stackSize)
+{
+    new FirewireWinFrameSet(portName, cameraPorts, maxBuffers, maxMemory, priority, stackSize);
+    return asynSuccess;
+}
+
+FirewireWinFrameSet::FirewireWinFrameSet(const char *portName, const char *cameraPorts, int maxBuffers,
+                                         size_t maxMemory, int priority, int stackSize)
+    : asynNDArrayDriver(portName, FDC_SET_MAX_CAMERAS, NUM_FDC_SET_PARAMS, maxBuffers, maxMemory,
+                        asynInt32Mask | asynFloat64Mask | asynGenericPointerMask | asynDrvUserMask,
+                        asynInt32Mask | asynFloat64Mask | asynGenericPointerMask,
+                        ASYN_MULTIDEVICE, 1, priority, stackSize),
+      numInputs(0), haveDone(0)
+{
+    int status = asynSuccess;
+    char ports[256], *pPort, *pLast;
+    const char *functionName = "FirewireWinFrameSet";
+
+    memset(inputs, 0, sizeof(inputs));
+    memset(&doneKey, 0, sizeof(doneKey));
+    this->wakeEventId = epicsEventMustCreate(epicsEventEmpty);
+
+    createParam(FDC_set_modeString,             asynParamInt32,   &FDC_set_mode);
+    createParam(FDC_set_toleranceString,        asynParamFloat64, &FDC_set_tolerance);
+    createParam(FDC_set_timeoutString,          asynParamFloat64, &FDC_set_timeout);
+    createParam(FDC_set_camerasString,          asynParamInt32,   &FDC_set_cameras);
+    createParam(FDC_set_clockString,            asynParamInt32,   &FDC_set_clock);
+    createParam(FDC_set_matchedString,          asynParamInt32,   &FDC_set_matched);
+    createParam(FDC_set_unmatchedString,        asynParamInt32,   &FDC_set_unmatched);
+    createParam(FDC_set_lateString,             asynParamInt32,   &FDC_set_late);
+    createParam(FDC_set_droppedString,          asynParamInt32,   &FDC_set_dropped);
+    createParam(FDC_set_pendingString,          asynParamInt32,   &FDC_set_pending);
+    createParam(FDC_set_spreadString,           asynParamFloat64, &FDC_set_spread);
+    createParam(FDC_set_latencyString,          asynParamFloat64, &FDC_set_latency);
+    createParam(FDC_set_latency_maxString,      asynParamFloat64, &FDC_set_latency_max);
+    createParam(FDC_set_resetString,            asynParamInt32,   &FDC_set_reset);
+
+    status |= setIntegerParam(FDC_set_mode, FDCSetStack);
+    status |= setDoubleParam(FDC_set_tolerance, 0.001);
+    status |= setDoubleParam(FDC_set_timeout, 0.5);
+    status |= setIntegerParam(FDC_set_clock, FDCSetClockHost);
+    status |= setIntegerParam(FDC_set_matched, 0);
+    status |= setIntegerParam(FDC_set_unmatched, 0);
+    status |= setIntegerParam(FDC_set_late, 0);
+    status |= setIntegerParam(FDC_set_dropped, 0);
+    status |= setIntegerParam(FDC_set_pending, 0);
+    status |= setDoubleParam(FDC_set_spread, 0.0);
+    status |= setDoubleParam(FDC_set_latency, 0.0);
+    status |= setDoubleParam(FDC_set_latency_max, 0.0);
+    status |= setIntegerParam(FDC_set_reset, 0);
+    if (status) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s [%s]: unable to set parameters\n",
+            driverName, functionName, portName);
+    }
+
+    /* The camera threads only queue their frames, the sets are made and published by this thread */
+    if (!epicsThreadCreate("FDCFrameSet", epicsThreadPriorityMedium,
+                           epicsThreadGetStackSize(epicsThreadStackMedium), setTaskC, this)) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s [%s]: epicsThreadCreate failure for the frame set task\n",
+            driverName, functionName, portName);
+        return;
+    }
+
+    strncpy(ports, cameraPorts ? cameraPorts : "", sizeof(ports));
+    ports[sizeof(ports) - 1] = '\0';
+    for (pPort = epicsStrtok_r(ports, " ,", &pLast); pPort; pPort = epicsStrtok_r(NULL, " ,", &pLast)) {
+        this->connectInput(pPort);
+    }
+    if (this->numInputs < 2) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s [%s]: only %d camera ports connected, a frame set needs at least 2\n",
+            driverName, functionName, portName, this->numInputs);
+    }
+    setIntegerParam(FDC_set_cameras, this->numInputs);
+    callParamCallbacks();
+}
+
+/** Subscribes to the NDArrays of a camera port, as a plugin does
+ * \return 0 on success, -1 on error.
+ */
+int FirewireWinFrameSet::connectInput(const char *cameraPort)
+{
+    SetInput *pInput;
+    asynInterface *pasynInterface;
+    asynGenericPointer *pasynGenericPointer;
+    asynStatus status;
+    const char *functionName = "connectInput";
+
+    if (this->numInputs >= FDC_SET_MAX_CAMERAS) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s [%s]: more than %d camera ports, %s ignored\n",
+            driverName, functionName, this->portName, FDC_SET_MAX_CAMERAS, cameraPort);
+        return -1;
+    }
+    pInput = &this->inputs[this->numInputs];
+    pInput->pSet = this;
+    pInput->index = this->numInputs;
+    epicsSnprintf(pInput->portName, sizeof(pInput->portName), "%s", cameraPort);
+    pInput->pasynUser = pasynManager->createAsynUser(0, 0);
+    status = pasynManager->connectDevice(pInput->pasynUser, cameraPort, 0);
+    if (status == asynSuccess) {
+        pasynInterface = pasynManager->findInterface(pInput->pasynUser, asynGenericPointerType, 1);
+        if (!pasynInterface) status = asynError;
+    }
+    if (status == asynSuccess) {
+        /* All the areaDetector ports have the same index for NDArrayData */
+        pasynGenericPointer = (asynGenericPointer *)pasynInterface->pinterface;
+        pInput->pasynUser->reason = NDArrayData;
+        status = pasynGenericPointer->registerInterruptUser(pasynInterface->drvPvt, pInput->pasynUser,
+                                                             setArrayCallbackC, pInput, &pInput->interruptPvt);
+    }
+    if (status != asynSuccess) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s [%s]: unable to receive the NDArrays of port %s\n",
+            driverName, functionName, this->portName, cameraPort);
+        pasynManager->freeAsynUser(pInput->pasynUser);
+        pInput->pasynUser = NULL;
+        return -1;
+    }
+    this->numInputs++;
+    return 0;
+}
+
+/** Queues a frame of a camera. Called from the thread of the camera port, with that port locked. */
+void FirewireWinFrameSet::arrayCallback(SetInput *pInput, NDArray *pArray)
+{
+    NDAttribute *pAttribute;
+    SetFrame *pFrame;
+    SetKey key;
+    double tolerance;
+    int tail, pending;
+
+    key.bus = -1;
+    key.cycleTime = 0.;
+    key.hostTime = pArray->epicsTS.secPastEpoch + pArray->epicsTS.nsec / 1.e9;
+    pAttribute = pArray->pAttributeList->find("CycleTime");
+    if (pAttribute && (pAttribute->getValue(NDAttrFloat64, &key.cycleTime) == asynSuccess)) {
+        pAttribute = pArray->pAttributeList->find("Bus");
+        if (!pAttribute || (pAttribute->getValue(NDAttrInt32, &key.bus) != asynSuccess)) key.bus = 0;
+        if (key.bus < 0) key.bus = 0;
+    }
+
+    this->lock();
+    /* Frames no newer than the last set missed it: it was published without them or given up */
+    getDoubleParam(FDC_set_tolerance, &tolerance);
+    if (this->haveDone &&
+        (keyDiff(&key, &this->doneKey, (key.bus >= 0) && (key.bus == this->doneKey.bus)) <= tolerance)) {
+        this->countParam(FDC_set_late, 1);
+        callParamCallbacks();
+        this->unlock();
+        return;
+    }
+    if (pInput->count >= FDC_SET_QUEUE_SIZE) this->dropHead(pInput, FDC_set_unmatched);
+    pArray->reserve();
+    tail = (pInput->head + pInput->count) % FDC_SET_QUEUE_SIZE;
+    pFrame = &pInput->queue[tail];
+    pFrame->pArray = pArray;
+    pFrame->key = key;
+    epicsTimeGetCurrent(&pFrame->arrival);
+    pInput->count++;
+    getIntegerParam(FDC_set_pending, &pending);
+    setIntegerParam(FDC_set_pending, pending + 1);
+    this->unlock();
+    epicsEventSignal(this->wakeEventId);
+}
+
+/** Adds to a counter parameter */
+void FirewireWinFrameSet::countParam(int param, int n)
+{
+    int value;
+
+    getIntegerParam(param, &value);
+    setIntegerParam(param, value + n);
+}
+
+/** Takes the oldest frame of a camera off its queue, counting it in a parameter */
+void FirewireWinFrameSet::dropHead(SetInput *pInput, int param)
+{
+    SetFrame *pFrame = &pInput->queue[pInput->head];
+
+    if (pInput->count <= 0) return;
+    if (param >= 0) this->countParam(param, 1);
+    /* Partners of this frame that arrive from now on are late */
+    if (!this->haveDone || (keyDiff(&pFrame->key, &this->doneKey,
+                                    (pFrame->key.bus >= 0) && (pFrame->key.bus == this->doneKey.bus)) > 0)) {
+        this->doneKey = pFrame->key;
+        this->haveDone = 1;
+    }
+    pFrame->pArray->release();
+    pFrame->pArray = NULL;
+    pInput->head = (pInput->head + 1) % FDC_SET_QUEUE_SIZE;
+    pInput->count--;
+    this->countParam(FDC_set_pending, -1);
+}
+
+/** Makes and publishes the sets the queued frames allow and gives up the frames that have
+ * waited too long. Called with the port locked.
+ * \return The time in seconds until the oldest queued frame is given up, -1 if none is queued.
+ */
+double FirewireWinFrameSet::assemble()
+{
+    SetFrame *pFrames[FDC_SET_MAX_CAMERAS];
+    SetFrame *pLatest, *pEarliest;
+    SetInput *pInput;
+    epicsTimeStamp now;
+    double tolerance, timeout, age, wait;
+    int i, useCycle, ready, passed;
+
+    getDoubleParam(FDC_set_tolerance, &tolerance);
+    getDoubleParam(FDC_set_timeout, &timeout);
+    while (1) {
+        /* Give up the frames that have waited longer than the timeout for their partners */
+        epicsTimeGetCurrent(&now);
+        for (i=0; i<this->numInputs; i++) {
+            pInput = &this->inputs[i];
+            while ((pInput->count > 0) &&
+                   (epicsTimeDiffInSeconds(&now, &pInput->queue[pInput->head].arrival) >= timeout)) {
+                this->dropHead(pInput, FDC_set_unmatched);
+            }
+        }
+
+        /* A set needs a frame of each camera. They are compared on the cycle timer if they all
+         * have one and it is the same for all of them. */
+        ready = (this->numInputs > 0);
+        useCycle = 1;
+        for (i=0; (i<this->numInputs) && ready; i++) {
+            pInput = &this->inputs[i];
+            if (pInput->count == 0) {
+                ready = 0;
+                break;
+            }
+            pFrames[i] = &pInput->queue[pInput->head];
+            if ((pFrames[i]->key.bus < 0) || (pFrames[i]->key.bus != pFrames[0]->key.bus)) useCycle = 0;
+        }
+        if (!ready) break;
+
+        /* The frames older than the newest by more than the tolerance have no partners */
+        pLatest = pFrames[0];
+        for (i=1; i<this->numInputs; i++) {
+            if (keyDiff(&pFrames[i]->key, &pLatest->key, useCycle) > 0) pLatest = pFrames[i];
+        }
+        passed = 0;
+        for (i=0; i<this->numInputs; i++) {
+            if (keyDiff(&pLatest->key, &pFrames[i]->key, useCycle) > tolerance) {
+                this->dropHead(&this->inputs[i], FDC_set_unmatched);
+                passed = 1;
+            }
+        }
+        if (passed) continue;
+
+        pEarliest = pFrames[0];
+        for (i=1; i<this->numInputs; i++) {
+            if (keyDiff(&pFrames[i]->key, &pEarliest->key, useCycle) < 0) pEarliest = pFrames[i];
+        }
+        this->publish(pFrames, useCycle, keyDiff(&pLatest->key, &pEarliest->key, useCycle));
+        for (i=0; i<this->numInputs; i++) this->dropHead(&this->inputs[i], -1);
+    }
+
+    /* Wake up again when the oldest frame is due to be given up */
+    wait = -1.;
+    epicsTimeGetCurrent(&now);
+    for (i=0; i<this->numInputs; i++) {
+        pInput = &this->inputs[i];
+        if (pInput->count == 0) continue;
+        age = epicsTimeDiffInSeconds(&now, &pInput->queue[pInput->head].arrival);
+        if ((wait < 0.) || (timeout - age < wait)) wait = timeout - age;
+    }
+    if ((wait >= 0.) && (wait < 1.e-3)) wait = 1.e-3;
+    return wait;
+}
+
+/** Publishes a set of frames, one per camera in the order of the cameras */
+void FirewireWinFrameSet::publish(SetFrame **pFrames, int useCycle, double spread)
+{
+    NDArray *pFirst = pFrames[0]->pArray;
+    NDArray *pArray;
+    NDArrayInfo_t info;
+    size_t dims[ND_ARRAY_MAX_DIMS];
+    epicsTimeStamp now;
+    double latency, latencyMax;
+    int mode, arrayCallbacks, arrayCounter;
+    int i, j, ndims, stack;
+    const char *functionName = "publish";
+
+    getIntegerParam(FDC_set_mode, &mode);
+    getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
+    getIntegerParam(NDArrayCounter, &arrayCounter);
+    arrayCounter++;
+
+    /* Stacking needs frames of one size and type, and a dimension to spare */
+    stack = (mode == FDCSetStack);
+    ndims = pFirst->ndims;
+    if (stack) {
+        for (i=1; i<this->numInputs; i++) {
+            pArray = pFrames[i]->pArray;
+            if ((pArray->ndims != ndims) || (pArray->dataType != pFirst->dataType)) break;
+            for (j=0; j<ndims; j++) {
+                if (pArray->dims[j].size != pFirst->dims[j].size) break;
+            }
+            if (j < ndims) break;
+        }
+        if ((i < this->numInputs) || (ndims >= ND_ARRAY_MAX_DIMS)) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s::%s [%s]: the frames of set %d differ in size or type and cannot be stacked\n",
+                driverName, functionName, this->portName, arrayCounter);
+            this->countParam(FDC_set_dropped, 1);
+            return;
+        }
+    }
+
+    setIntegerParam(NDArrayCounter, arrayCounter);
+    setIntegerParam(FDC_set_clock, useCycle ? FDCSetClockCycle : FDCSetClockHost);
+    setDoubleParam(FDC_set_spread, spread);
+    this->countParam(FDC_set_matched, 1);
+
+    if (stack) {
+        for (j=0; j<ndims; j++) dims[j] = pFirst->dims[j].size;
+        dims[ndims] = this->numInputs;
+        pArray = this->pNDArrayPool->alloc(ndims + 1, dims, pFirst->dataType, 0, NULL);
+        if (!pArray) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s::%s [%s]: no NDArray for set %d\n",
+                driverName, functionName, this->portName, arrayCounter);
+            this->countParam(FDC_set_dropped, 1);
+        } else {
+            pFirst->getInfo(&info);
+            for (i=0; i<this->numInputs; i++) {
+                memcpy((char *)pArray->pData + i * info.totalBytes, pFrames[i]->pArray->pData, info.totalBytes);
+            }
+            pFirst->pAttributeList->copy(pArray->pAttributeList);
+            pArray->uniqueId = arrayCounter;
+            pArray->timeStamp = pFirst->timeStamp;
+            pArray->epicsTS = pFirst->epicsTS;
+            pArray->pAttributeList->add("SetSpread", "Time between the first and last frame of the set",
+                                        NDAttrFloat64, &spread);
+            this->getAttributes(pArray->pAttributeList);
+            setIntegerParam(NDArraySizeX, (int)dims[0]);
+            setIntegerParam(NDArraySizeY, (ndims > 1) ? (int)dims[1] : 0);
+            setIntegerParam(NDArraySizeZ, (int)dims[ndims]);
+            setIntegerParam(NDDataType, pArray->dataType);
+            callParamCallbacks();
+            if (arrayCallbacks) doCallbacksGenericPointer(pArray, NDArrayData, 0);
+            pArray->release();
+        }
+    } else {
+        /* The frames may still be used by the plugins of their cameras, so the set gets copies */
+        for (i=0; i<this->numInputs; i++) {
+            pArray = this->pNDArrayPool->copy(pFrames[i]->pArray, NULL, 1);
+            if (!pArray) {
+                asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s::%s [%s]: no NDArray for frame %d of set %d\n",
+                    driverName, functionName, this->portName, i, arrayCounter);
+                this->countParam(FDC_set_dropped, 1);
+                continue;
+            }
+            pArray->uniqueId = arrayCounter;
+            pArray->timeStamp = pFirst->timeStamp;
+            pArray->epicsTS = pFirst->epicsTS;
+            pArray->pAttributeList->add("SetIndex", "Camera of the set the frame is from", NDAttrInt32, &i);
+            pArray->pAttributeList->add("SetSpread", "Time between the first and last frame of the set",
+                                        NDAttrFloat64, &spread);
+            this->getAttributes(pArray->pAttributeList);
+            if (arrayCallbacks) doCallbacksGenericPointer(pArray, NDArrayData, i);
+            pArray->release();
+        }
+    }
+
+    /* The latency is counted from the arrival of the first frame of the set */
+    epicsTimeGetCurrent(&now);
+    latency = 0.;
+    for (i=0; i<this->numInputs; i++) {
+        if (epicsTimeDiffInSeconds(&now, &pFrames[i]->arrival) > latency)
+            latency = epicsTimeDiffInSeconds(&now, &pFrames[i]->arrival);
+    }
+    getDoubleParam(FDC_set_latency_max, &latencyMax);
+    setDoubleParam(FDC_set_latency, latency);
+    if (latency > latencyMax) setDoubleParam(FDC_set_latency_max, latency);
+}
+
+/** Makes the sets from the frames queued by the cameras */
+void FirewireWinFrameSet::setTask()
+{
+    double wait = -1.;
+
+    while (1) {
+        if (wait < 0.) epicsEventWait(this->wakeEventId);
+        else epicsEventWaitWithTimeout(this->wakeEventId, wait);
+        this->lock();
+        wait = this->assemble();
+        callParamCallbacks();
+        this->unlock();
+    }
+}
+
+/** Called when asyn clients call pasynInt32->write().
+ * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+ * \param[in] value Value to write. */
+asynStatus FirewireWinFrameSet::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+
+    status = setIntegerParam(function, value);
+    if (function == FDC_set_reset) {
+        setIntegerParam(FDC_set_matched, 0);
+        setIntegerParam(FDC_set_unmatched, 0);
+        setIntegerParam(FDC_set_late, 0);
+        setIntegerParam(FDC_set_dropped, 0);
+        setDoubleParam(FDC_set_latency_max, 0.0);
+        setIntegerParam(FDC_set_reset, 0);
+    } else if (function < FIRST_FDC_SET_PARAM) {
+        status = asynNDArrayDriver::writeInt32(pasynUser, value);
+    }
+    callParamCallbacks();
+    return status;
+}
+
+/** Reports on the cameras of the set and their queues */
+void FirewireWinFrameSet::report(FILE *fp, int details)
+{
+    int i;
+
+    fprintf(fp, "Frame set assembler %s, %d cameras\n", this->portName, this->numInputs);
+    if (details > 0) {
+        for (i=0; i<this->numInputs; i++) {
+            fprintf(fp, "  %d: %s, %d frames queued\n", i, this->inputs[i].portName, this->inputs[i].count);
+        }
+    }
+    asynNDArrayDriver::report(fp, details);
+}
+
+static const iocshArg setArg0 = {"Port name", iocshArgString};
+static const iocshArg setArg1 = {"Camera ports", iocshArgString};
+static const iocshArg setArg2 = {"maxBuffers", iocshArgInt};
+static const iocshArg setArg3 = {"maxMemory", iocshArgInt};
+static const iocshArg setArg4 = {"priority", iocshArgInt};
+static const iocshArg setArg5 = {"stackSize", iocshArgInt};
+static const iocshArg * const setArgs[] = {&setArg0,
+                                           &setArg1,
+                                           &setArg2,
+                                           &setArg3,
+                                           &setArg4,
+                                           &setArg5};
+static const iocshFuncDef configFrameSet = {"WinFDC_FrameSet", 6, setArgs};
+static void frameSetCallFunc(const iocshArgBuf *args)
+{
+    WinFDC_FrameSet(args[0].sval, args[1].sval, args[2].ival, args[3].ival, args[4].ival, args[5].ival);
+}
+
+static void firewireWinFrameSetRegister(void)
+{
+    iocshRegister(&configFrameSet, frameSetCallFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(firewireWinFrameSetRegister);
+}
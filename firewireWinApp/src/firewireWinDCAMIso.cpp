@@ -0,0 +1,271 @@
+/*
+ * firewireWinDCAMIso.cpp
+ *
+ * Isochronous bandwidth arithmetic and bandwidth manager for the firewireWinDCAM driver.
+ * See firewireWinDCAMIso.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <epicsThread.h>
+#include <epicsMutex.h>
+
+#include "firewireWinDCAMIso.h"
+
+/** The bandwidth taken by a streaming camera */
+typedef struct {
+    int bus;
+    unsigned long long guid;
+    unsigned long units;
+} IsoAllocation;
+
+static epicsThreadOnceId isoOnceId = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId isoMutexId;
+
+/** The streaming cameras. Protected by isoMutexId. */
+static IsoAllocation allocations[FDC_ISO_MAX_ALLOCATIONS];
+static int numAllocations;
+
+static void isoInit(void *arg)
+{
+    isoMutexId = epicsMutexMustCreate();
+}
+
+/** Returns the bandwidth taken on a bus by the cameras other than one. Called with isoMutexId held. */
+static unsigned long busUnits(int bus, unsigned long long exceptGuid, int *pCameras)
+{
+    unsigned long units = 0;
+    int i;
+
+    if (pCameras) *pCameras = 0;
+    for (i=0; i<numAllocations; i++) {
+        if ((allocations[i].bus != bus) || (allocations[i].guid == exceptGuid)) continue;
+        units += allocations[i].units;
+        if (pCameras) (*pCameras)++;
+    }
+    return units;
+}
+
+/** Removes the allocation of a camera. Called with isoMutexId held. */
+static void removeAllocation(unsigned long long guid)
+{
+    int i;
+
+    for (i=0; i<numAllocations; i++) {
+        if (allocations[i].guid != guid) continue;
+        allocations[i] = allocations[--numAllocations];
+        return;
+    }
+}
+
+/** Returns the largest isochronous payload in bytes a cycle can carry at a bus speed.
+ * \param[in] speed The speed in Mb/s: 100, 200, 400, 800, ...; anything else is taken as S400.
+ */
+unsigned long fdcIsoMaxPayload(int speed)
+{
+    switch (speed) {
+        case 100:  return 1024;
+        case 200:  return 2048;
+        case 800:  return 8192;
+        case 1600: return 16384;
+        case 3200: return 32768;
+        default:   return 4096;
+    }
+}
+
+/** Returns the isochronous speed in Mb/s a camera sends at.
+ * \param[in] linkSpeed The fastest speed both the camera and the host adapter support.
+ * \param[in] mode1394b 1 if the camera is in 1394b mode; without it the speed is at most S400.
+ */
+int fdcIsoSpeed(int linkSpeed, int mode1394b)
+{
+    if (linkSpeed <= 0) return FDC_ISO_LEGACY_SPEED;
+    if (!mode1394b && (linkSpeed > FDC_ISO_LEGACY_SPEED)) return FDC_ISO_LEGACY_SPEED;
+    return linkSpeed;
+}
+
+/** Returns the most image data in bytes/s one camera can send at a speed: the largest packet that
+ * fits both in a cycle and in the isochronous bandwidth of a bus, in every cycle */
+double fdcIsoMaxBytesPerSecond(int speed)
+{
+    return (double)fdcIsoFitBytesPerPacket(FDC_ISO_BANDWIDTH_UNITS, speed, 4) * FDC_ISO_CYCLES_PER_SECOND;
+}
+
+/** Returns the number of packets, and so of bus cycles, a frame is sent in */
+unsigned long fdcPacketsPerFrame(unsigned long frameBytes, unsigned short bytesPerPacket)
+{
+    if (bytesPerPacket == 0) return 0;
+    return (frameBytes + bytesPerPacket - 1) / bytesPerPacket;
+}
+
+/** Returns the shortest time between frames in seconds a packet size allows */
+double fdcPacketFrameInterval(unsigned long frameBytes, unsigned short bytesPerPacket)
+{
+    return (double)fdcPacketsPerFrame(frameBytes, bytesPerPacket) / FDC_ISO_CYCLES_PER_SECOND;
+}
+
+/** Returns the time in seconds, modulo FDC_ISO_CYCLE_TIMER_PERIOD, of a value of the bus cycle
+ * timer: seconds in bits 25-31, cycles in bits 12-24 and 1/3072 parts of a cycle in bits 0-11 */
+double fdcIsoCycleTimeSeconds(unsigned long cycleTime)
+{
+    unsigned long seconds = (cycleTime >> 25) & 0x7f;
+    unsigned long cycles = (cycleTime >> 12) & 0x1fff;
+    unsigned long offset = cycleTime & 0xfff;
+
+    return seconds + (cycles + offset / 3072.) / FDC_ISO_CYCLES_PER_SECOND;
+}
+
+/** Returns the cycle timer value of a time in seconds, taken modulo FDC_ISO_CYCLE_TIMER_PERIOD */
+unsigned long fdcIsoCycleTimeFromSeconds(double seconds)
+{
+    unsigned long long ticks;
+
+    if (seconds < 0.) seconds = 0.;
+    ticks = (unsigned long long)(seconds * FDC_ISO_CYCLES_PER_SECOND * 3072.);
+    return (unsigned long)((((ticks / (3072ULL * FDC_ISO_CYCLES_PER_SECOND)) % FDC_ISO_CYCLE_TIMER_PERIOD) << 25) |
+                           (((ticks / 3072) % FDC_ISO_CYCLES_PER_SECOND) << 12) |
+                           (ticks % 3072));
+}
+
+/** Returns a-b for two cycle timer times in seconds, taking the wrap of the timer into account:
+ * the result is between -FDC_ISO_CYCLE_TIMER_PERIOD/2 and FDC_ISO_CYCLE_TIMER_PERIOD/2 */
+double fdcIsoCycleTimeDiff(double a, double b)
+{
+    double diff = a - b;
+
+    while (diff >= FDC_ISO_CYCLE_TIMER_PERIOD / 2.) diff -= FDC_ISO_CYCLE_TIMER_PERIOD;
+    while (diff < -FDC_ISO_CYCLE_TIMER_PERIOD / 2.) diff += FDC_ISO_CYCLE_TIMER_PERIOD;
+    return diff;
+}
+
+/** Chooses the Format 7 packet size for a frame.
+ * The packet size is a multiple of bppUnit, at most bppMax and at most what a cycle carries at the
+ * bus speed. With a period > 0 it is the smallest size that sends a frame within the period, so
+ * the camera takes no more of the bus than it needs; if no size is large enough the largest is
+ * used. With a period <= 0 the largest size is used, for the highest frame rate.
+ * \param[in] frameBytes Size of a frame in bytes.
+ * \param[in] bppUnit Packet size increment, which is also the smallest packet size.
+ * \param[in] bppMax Largest packet size the camera accepts.
+ * \param[in] speed Bus speed in Mb/s.
+ * \param[in] period Requested time between frames in seconds, <= 0 for the fastest.
+ * \param[out] pPlan The packet size, the packets per frame and the resulting frame interval.
+ */
+void fdcPlanBytesPerPacket(unsigned long frameBytes, unsigned short bppUnit, unsigned short bppMax,
+                           int speed, double period, FDCPacketPlan *pPlan)
+{
+    unsigned long unit = (bppUnit > 0) ? bppUnit : 1;
+    unsigned long maxBpp = bppMax;
+    unsigned long bpp, packets;
+
+    if (maxBpp > fdcIsoMaxPayload(speed)) maxBpp = fdcIsoMaxPayload(speed);
+    maxBpp = (maxBpp / unit) * unit;
+    if (maxBpp < unit) maxBpp = unit;
+    bpp = maxBpp;
+    if (period > 0.) {
+        /* The most cycles a frame may take, allowing for rounding of the period */
+        packets = (unsigned long)(period * FDC_ISO_CYCLES_PER_SECOND + 1e-6);
+        if (packets < 1) packets = 1;
+        bpp = (frameBytes + packets - 1) / packets;
+        bpp = ((bpp + unit - 1) / unit) * unit;
+        if (bpp < unit) bpp = unit;
+        if (bpp > maxBpp) bpp = maxBpp;
+    }
+    pPlan->bytesPerPacket = (unsigned short)bpp;
+    pPlan->packetsPerFrame = fdcPacketsPerFrame(frameBytes, pPlan->bytesPerPacket);
+    pPlan->interval = fdcPacketFrameInterval(frameBytes, pPlan->bytesPerPacket);
+    pPlan->periodMet = (period <= 0.) || (pPlan->interval <= period + 1e-9);
+}
+
+/** Returns the bandwidth units a camera sending one packet per cycle takes.
+ * \param[in] bytesPerPacket The packet payload in bytes.
+ * \param[in] speed The bus speed in Mb/s.
+ */
+unsigned long fdcIsoPacketUnits(unsigned long bytesPerPacket, int speed)
+{
+    unsigned long quadlets = (bytesPerPacket + 3) / 4 + FDC_ISO_PACKET_OVERHEAD;
+
+    if (speed < 100) speed = 400;
+    return (quadlets * 1600 + speed - 1) / speed;
+}
+
+/** Returns the largest packet size, a multiple of bppUnit, that fits in a number of bandwidth
+ * units at a bus speed, 0 if none does. */
+unsigned short fdcIsoFitBytesPerPacket(unsigned long units, int speed, unsigned short bppUnit)
+{
+    unsigned long unit = (bppUnit > 0) ? bppUnit : 1;
+    unsigned long quadlets, bpp;
+
+    if (speed < 100) speed = 400;
+    quadlets = units * speed / 1600;
+    if (quadlets <= FDC_ISO_PACKET_OVERHEAD) return 0;
+    bpp = (quadlets - FDC_ISO_PACKET_OVERHEAD) * 4;
+    if (bpp > fdcIsoMaxPayload(speed)) bpp = fdcIsoMaxPayload(speed);
+    return (unsigned short)((bpp / unit) * unit);
+}
+
+/** Reserves the bandwidth of a camera that is about to start streaming.
+ * An earlier allocation of the same camera is replaced. Cameras that are not on a bus (bus < 0),
+ * such as replayed ones, always get their bandwidth and are not counted.
+ * \param[in] bus The bus the camera is on.
+ * \param[in] guid The camera.
+ * \param[in] units The bandwidth units the camera needs, see fdcIsoPacketUnits().
+ * \param[out] pAvailable The units left on the bus by the other cameras, may be NULL.
+ * \return 0 if the bandwidth is reserved, -1 if it does not fit; nothing is then reserved.
+ */
+int fdcIsoAllocate(int bus, unsigned long long guid, unsigned long units, unsigned long *pAvailable)
+{
+    unsigned long used, available;
+    int status = 0;
+
+    epicsThreadOnce(&isoOnceId, isoInit, NULL);
+    epicsMutexMustLock(isoMutexId);
+    removeAllocation(guid);
+    used = busUnits(bus, guid, NULL);
+    available = (used < FDC_ISO_BANDWIDTH_UNITS) ? FDC_ISO_BANDWIDTH_UNITS - used : 0;
+    if (pAvailable) *pAvailable = available;
+    if (bus >= 0) {
+        if ((units > available) || (numAllocations >= FDC_ISO_MAX_ALLOCATIONS)) {
+            status = -1;
+        } else {
+            allocations[numAllocations].bus = bus;
+            allocations[numAllocations].guid = guid;
+            allocations[numAllocations].units = units;
+            numAllocations++;
+        }
+    }
+    epicsMutexUnlock(isoMutexId);
+    return status;
+}
+
+/** Gives back the bandwidth of a camera that has stopped streaming */
+void fdcIsoRelease(unsigned long long guid)
+{
+    epicsThreadOnce(&isoOnceId, isoInit, NULL);
+    epicsMutexMustLock(isoMutexId);
+    removeAllocation(guid);
+    epicsMutexUnlock(isoMutexId);
+}
+
+/** Returns the bandwidth units reserved on a bus and the number of cameras they are reserved for */
+void fdcIsoGetBusUsage(int bus, unsigned long *pUnits, int *pCameras)
+{
+    epicsThreadOnce(&isoOnceId, isoInit, NULL);
+    epicsMutexMustLock(isoMutexId);
+    *pUnits = busUnits(bus, 0, pCameras);
+    epicsMutexUnlock(isoMutexId);
+}
+
+/** Prints the bandwidth reserved on each bus */
+void fdcIsoReport(FILE *fp)
+{
+    int i;
+
+    epicsThreadOnce(&isoOnceId, isoInit, NULL);
+    epicsMutexMustLock(isoMutexId);
+    fprintf(fp, "%d cameras streaming\n", numAllocations);
+    for (i=0; i<numAllocations; i++) {
+        fprintf(fp, "  bus %d: 0x%16.16llX %lu units (%.1f%%)\n", allocations[i].bus, allocations[i].guid,
+            allocations[i].units, 100. * allocations[i].units / FDC_ISO_BANDWIDTH_UNITS);
+    }
+    epicsMutexUnlock(isoMutexId);
+}
@@ -0,0 +1,70 @@
+/*
+ * firewireWinDCAMIso.h
+ *
+ * Isochronous bandwidth arithmetic and bandwidth manager for the firewireWinDCAM driver.
+ *
+ * An IIDC camera sends one isochronous packet per bus cycle, 8000 cycles per second. In Format 7
+ * the size of the packets is chosen by the host within the range the camera reports, so the
+ * packet size sets both the share of the bus the camera takes and the fastest frame rate it can
+ * reach: a frame of N bytes sent in packets of B bytes takes ceil(N/B) cycles. The largest packet
+ * a cycle can carry depends on the bus speed, 4096 bytes at S400. IIDC cameras only send faster
+ * than S400 in 1394b operation mode, so the speed used is the link speed, the fastest both ends
+ * of the link support, capped at S400 unless 1394b mode is on.
+ *
+ * The cycles are shared by all the cameras on a bus. The bandwidth manager, shared by all the
+ * driver instances in the process, keeps the share each streaming camera takes of each bus, in
+ * bandwidth units of one quadlet at S1600, so a camera is only started when its packets fit in
+ * what the others leave.
+ *
+ * The bus cycle timer, a clock shared by all the nodes of a bus, counts seconds modulo 128 in
+ * cycles of 125 us. The time a frame was sent, read off the cycle timer, can be compared between
+ * the cameras of a bus without regard to the host clock.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMISO_H
+#define FIREWIREWINDCAMISO_H
+
+#include <stdio.h>
+
+/** Isochronous cycles per second */
+#define FDC_ISO_CYCLES_PER_SECOND 8000
+/** Bandwidth units of a cycle available to isochronous traffic, out of 6144 */
+#define FDC_ISO_BANDWIDTH_UNITS 4915
+/** Header and CRC quadlets sent with each isochronous packet */
+#define FDC_ISO_PACKET_OVERHEAD 3
+/** Fastest isochronous speed in Mb/s without 1394b mode */
+#define FDC_ISO_LEGACY_SPEED 400
+/** Seconds the bus cycle timer counts before it wraps */
+#define FDC_ISO_CYCLE_TIMER_PERIOD 128
+/** Maximum number of cameras the bandwidth manager keeps track of */
+#define FDC_ISO_MAX_ALLOCATIONS 64
+
+/** The result of fdcPlanBytesPerPacket() */
+typedef struct {
+    unsigned short bytesPerPacket;
+    unsigned long packetsPerFrame;
+    double interval;            /**< Time between frames in seconds the packet size allows */
+    int periodMet;              /**< The requested period can be reached */
+} FDCPacketPlan;
+
+unsigned long fdcIsoMaxPayload(int speed);
+int fdcIsoSpeed(int linkSpeed, int mode1394b);
+double fdcIsoMaxBytesPerSecond(int speed);
+unsigned long fdcPacketsPerFrame(unsigned long frameBytes, unsigned short bytesPerPacket);
+double fdcPacketFrameInterval(unsigned long frameBytes, unsigned short bytesPerPacket);
+double fdcIsoCycleTimeSeconds(unsigned long cycleTime);
+unsigned long fdcIsoCycleTimeFromSeconds(double seconds);
+double fdcIsoCycleTimeDiff(double a, double b);
+void fdcPlanBytesPerPacket(unsigned long frameBytes, unsigned short bppUnit, unsigned short bppMax,
+                           int speed, double period, FDCPacketPlan *pPlan);
+
+unsigned long fdcIsoPacketUnits(unsigned long bytesPerPacket, int speed);
+unsigned short fdcIsoFitBytesPerPacket(unsigned long units, int speed, unsigned short bppUnit);
+int  fdcIsoAllocate(int bus, unsigned long long guid, unsigned long units, unsigned long *pAvailable);
+void fdcIsoRelease(unsigned long long guid);
+void fdcIsoGetBusUsage(int bus, unsigned long *pUnits, int *pCameras);
+void fdcIsoReport(FILE *fp);
+
+#endif
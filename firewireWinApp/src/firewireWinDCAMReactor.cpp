@@ -0,0 +1,325 @@
+/*
+ * firewireWinDCAMReactor.cpp
+ *
+ * Shared grab reactor for the firewireWinDCAM driver. See firewireWinDCAMReactor.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+
+#include "firewireWinDCAMReactor.h"
+
+/** Longest the reactor waits before it looks at the cameras again, in seconds */
+#define REACTOR_MAX_WAIT 1.0
+
+/** Where a camera is */
+typedef enum {
+    ReactorParked,              /**< Not waited for, see fdcReactorWake() */
+    ReactorArmed,               /**< Waited for by the reactor thread, which owns it */
+    ReactorQueued,              /**< In the run queue */
+    ReactorRunning              /**< Being serviced by a worker, which owns it */
+} ReactorState;
+
+struct FDCReactorCamera {
+    char name[40];
+    FDCReactorService service;
+    void *pvt;
+    ReactorState state;
+    int wake;                   /**< fdcReactorWake() was called while the camera was armed or running */
+    int timedOut;               /**< It was queued because of the timeout */
+    FDCReactorArm arm;
+    epicsTimeStamp armedTime;
+    FDCReactorCamera *pNext;    /**< Next in the run queue */
+    unsigned long serviced;
+    unsigned long timeouts;
+};
+
+/** The reactor. Everything is protected by mutexId. */
+static struct {
+    int workers;
+    epicsMutexId mutexId;
+    epicsEventId runEventId;    /**< Signalled when a camera is queued, the workers wait on it */
+#ifdef _WIN32
+    HANDLE wakeEvent;           /**< Signalled to make the reactor thread look at the cameras again */
+#else
+    epicsEventId wakeEventId;
+#endif
+    FDCReactorCamera cameras[FDC_REACTOR_MAX_CAMERAS];
+    int numCameras;
+    FDCReactorCamera *pHead, *pTail;
+    unsigned long waits;
+} reactor;
+
+static void wakeReactor(void)
+{
+#ifdef _WIN32
+    SetEvent(reactor.wakeEvent);
+#else
+    epicsEventSignal(reactor.wakeEventId);
+#endif
+}
+
+/** Appends a camera to the run queue. Called with mutexId held. */
+static void enqueue(FDCReactorCamera *pCam, int timedOut)
+{
+    pCam->state = ReactorQueued;
+    pCam->timedOut = timedOut;
+    pCam->pNext = NULL;
+    if (reactor.pTail) reactor.pTail->pNext = pCam;
+    else reactor.pHead = pCam;
+    reactor.pTail = pCam;
+    epicsEventSignal(reactor.runEventId);
+}
+
+static FDCReactorCamera *dequeue(void)
+{
+    FDCReactorCamera *pCam = reactor.pHead;
+
+    if (!pCam) return NULL;
+    reactor.pHead = pCam->pNext;
+    if (!reactor.pHead) reactor.pTail = NULL;
+    return pCam;
+}
+
+/** Services the queued cameras, one at a time each */
+static void workerTask(void *arg)
+{
+    FDCReactorCamera *pCam;
+    FDCReactorArm arm;
+    int timedOut;
+
+    while (1) {
+        epicsEventMustWait(reactor.runEventId);
+        epicsMutexMustLock(reactor.mutexId);
+        while ((pCam = dequeue()) != NULL) {
+            /* The event only counts one camera, let another worker take the next one */
+            if (reactor.pHead) epicsEventSignal(reactor.runEventId);
+            pCam->state = ReactorRunning;
+            pCam->wake = 0;
+            timedOut = pCam->timedOut;
+            epicsMutexUnlock(reactor.mutexId);
+
+            memset(&arm, 0, sizeof(arm));
+            pCam->service(pCam->pvt, timedOut, &arm);
+
+            epicsMutexMustLock(reactor.mutexId);
+            pCam->arm = arm;
+            pCam->serviced++;
+            if (timedOut) pCam->timeouts++;
+            if (pCam->wake) {
+                enqueue(pCam, 0);
+            } else if (arm.park || !arm.pCamera) {
+                pCam->state = ReactorParked;
+            } else {
+                pCam->state = ReactorArmed;
+                epicsTimeGetCurrent(&pCam->armedTime);
+                wakeReactor();
+            }
+        }
+        epicsMutexUnlock(reactor.mutexId);
+    }
+}
+
+/** Waits for the frame events of the armed cameras and queues those with a frame, or a timeout */
+static void reactorTask(void *arg)
+{
+    FDCReactorCamera *pCam;
+    epicsTimeStamp now;
+    double wait, left, frameWait;
+    int i;
+#ifdef _WIN32
+    FDCReactorCamera *owners[FDC_REACTOR_MAX_CAMERAS];
+    int n;
+    void *event;
+    HANDLE handles[FDC_REACTOR_MAX_CAMERAS + 1];
+    DWORD result;
+    int first;
+#endif
+
+    while (1) {
+#ifdef _WIN32
+        n = 0;
+#endif
+        wait = REACTOR_MAX_WAIT;
+        epicsMutexMustLock(reactor.mutexId);
+        epicsTimeGetCurrent(&now);
+        for (i=0; i<reactor.numCameras; i++) {
+            pCam = &reactor.cameras[i];
+            if (pCam->state != ReactorArmed) continue;
+            if (pCam->wake) {
+                enqueue(pCam, 0);
+                continue;
+            }
+            if (pCam->arm.timeout > 0) {
+                left = pCam->arm.timeout - epicsTimeDiffInSeconds(&now, &pCam->armedTime);
+                if (left <= 0) {
+                    enqueue(pCam, 1);
+                    continue;
+                }
+                if (left < wait) wait = left;
+            }
+#ifdef _WIN32
+            event = pCam->arm.pCamera->GetFrameEvent();
+            if (event) {
+                handles[n+1] = (HANDLE)event;
+                owners[n++] = pCam;
+                continue;
+            }
+#endif
+            frameWait = pCam->arm.pCamera->GetFrameWait();
+            if (frameWait <= 0) {
+                enqueue(pCam, 0);
+                continue;
+            }
+            if (frameWait < wait) wait = frameWait;
+        }
+        reactor.waits++;
+        epicsMutexUnlock(reactor.mutexId);
+
+#ifdef _WIN32
+        handles[0] = reactor.wakeEvent;
+        result = WaitForMultipleObjects(n + 1, handles, FALSE, (DWORD)(wait * 1000. + 0.5));
+        if ((result > WAIT_OBJECT_0) && (result <= WAIT_OBJECT_0 + (DWORD)n)) {
+            /* Only the first signalled event is reported, look at the ones after it as well */
+            first = (int)(result - WAIT_OBJECT_0) - 1;
+            epicsMutexMustLock(reactor.mutexId);
+            for (i=first; i<n; i++) {
+                if ((i == first) || (WaitForSingleObject(handles[i+1], 0) == WAIT_OBJECT_0)) enqueue(owners[i], 0);
+            }
+            epicsMutexUnlock(reactor.mutexId);
+        } else if (result == WAIT_FAILED) {
+            /* An event is no longer valid; let the cameras find out what happened to their stream */
+            epicsMutexMustLock(reactor.mutexId);
+            for (i=0; i<n; i++) enqueue(owners[i], 0);
+            epicsMutexUnlock(reactor.mutexId);
+        }
+#else
+        epicsEventWaitWithTimeout(reactor.wakeEventId, wait);
+#endif
+    }
+}
+
+/** Creates the reactor thread and its workers. After this the driver instances configured use the
+ * reactor instead of a thread of their own.
+ * \param[in] workers The number of worker threads, 0 for one per CPU core.
+ * \return 0 on success, -1 on error or if the reactor is already running.
+ */
+int fdcReactorConfigure(int workers)
+{
+    int i;
+
+    if (reactor.workers > 0) {
+        fprintf(stderr, "fdcReactorConfigure: the grab reactor is already running with %d workers\n",
+            reactor.workers);
+        return -1;
+    }
+    if (workers <= 0) workers = epicsThreadGetCPUs();
+    if (workers > FDC_REACTOR_MAX_WORKERS) workers = FDC_REACTOR_MAX_WORKERS;
+    reactor.mutexId = epicsMutexMustCreate();
+    reactor.runEventId = epicsEventMustCreate(epicsEventEmpty);
+#ifdef _WIN32
+    reactor.wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!reactor.wakeEvent) {
+        fprintf(stderr, "fdcReactorConfigure: unable to create the wake event\n");
+        return -1;
+    }
+#else
+    reactor.wakeEventId = epicsEventMustCreate(epicsEventEmpty);
+#endif
+    if (!epicsThreadCreate("FDCReactor", epicsThreadPriorityHigh,
+                           epicsThreadGetStackSize(epicsThreadStackSmall), reactorTask, NULL)) {
+        fprintf(stderr, "fdcReactorConfigure: unable to create the reactor thread\n");
+        return -1;
+    }
+    for (i=0; i<workers; i++) {
+        char name[20];
+
+        epicsSnprintf(name, sizeof(name), "FDCWorker%d", i);
+        if (!epicsThreadCreate(name, epicsThreadPriorityMedium,
+                               epicsThreadGetStackSize(epicsThreadStackMedium), workerTask, NULL)) {
+            fprintf(stderr, "fdcReactorConfigure: unable to create worker %d\n", i);
+            break;
+        }
+    }
+    reactor.workers = i;
+    return (i > 0) ? 0 : -1;
+}
+
+/** Adds a camera to the reactor. The camera is parked until fdcReactorWake() is called.
+ * \param[in] name The name shown by fdcReactorReport(), normally the port name.
+ * \param[in] service The grab step of the camera.
+ * \param[in] pvt Passed to service.
+ * \return The camera, NULL if the reactor is not running or has no room for it; the camera then
+ *         needs a thread of its own.
+ */
+FDCReactorCamera *fdcReactorAdd(const char *name, FDCReactorService service, void *pvt)
+{
+    FDCReactorCamera *pCam = NULL;
+
+    if (reactor.workers <= 0) return NULL;
+    epicsMutexMustLock(reactor.mutexId);
+    if (reactor.numCameras < FDC_REACTOR_MAX_CAMERAS) {
+        pCam = &reactor.cameras[reactor.numCameras++];
+        memset(pCam, 0, sizeof(*pCam));
+        epicsSnprintf(pCam->name, sizeof(pCam->name), "%s", name);
+        pCam->service = service;
+        pCam->pvt = pvt;
+        pCam->state = ReactorParked;
+    }
+    epicsMutexUnlock(reactor.mutexId);
+    return pCam;
+}
+
+/** Has a camera serviced as soon as possible, whether or not it has a frame: a parked camera is
+ * queued, an armed one is taken out of the wait, and one being serviced is serviced again.
+ * Called when acquisition starts, and when the stream must be stopped or restarted.
+ */
+void fdcReactorWake(FDCReactorCamera *pCam)
+{
+    epicsMutexMustLock(reactor.mutexId);
+    switch (pCam->state) {
+        case ReactorParked:
+            enqueue(pCam, 0);
+            break;
+        case ReactorArmed:
+            /* Only the reactor thread takes armed cameras out of its wait */
+            pCam->wake = 1;
+            wakeReactor();
+            break;
+        default:
+            pCam->wake = 1;
+            break;
+    }
+    epicsMutexUnlock(reactor.mutexId);
+}
+
+/** Prints the state of the reactor and of its cameras */
+void fdcReactorReport(FILE *fp)
+{
+    static const char *stateNames[] = {"parked", "armed", "queued", "running"};
+    FDCReactorCamera *pCam;
+    int i;
+
+    if (reactor.workers <= 0) return;
+    epicsMutexMustLock(reactor.mutexId);
+    fprintf(fp, "Grab reactor: %d workers, %d cameras, %lu waits\n",
+        reactor.workers, reactor.numCameras, reactor.waits);
+    for (i=0; i<reactor.numCameras; i++) {
+        pCam = &reactor.cameras[i];
+        fprintf(fp, "  %s: %s, %lu steps, %lu timeouts\n",
+            pCam->name, stateNames[pCam->state], pCam->serviced, pCam->timeouts);
+    }
+    epicsMutexUnlock(reactor.mutexId);
+}
@@ -0,0 +1,54 @@
+/*
+ * firewireWinDCAMReactor.h
+ *
+ * Shared grab reactor for the firewireWinDCAM driver.
+ *
+ * Without the reactor each driver instance has its own thread that blocks in AcquireImageEx()
+ * and converts and publishes the frames of its camera. With many cameras in one IOC that is
+ * one busy thread per camera competing for the cores. The reactor is one thread that waits
+ * for the frame events of all the streaming cameras at once and hands the cameras that have a
+ * frame ready to a fixed pool of worker threads, which run the same grab step as the thread of
+ * a single camera would. A camera is only ever serviced by one worker at a time and is waited
+ * for again when its step is done, so its frames are taken and published in order.
+ *
+ * Cameras that have no OS frame event, such as simulated and replayed ones, tell the reactor
+ * how long it is until their next frame instead, see FDCCamera::GetFrameWait().
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMREACTOR_H
+#define FIREWIREWINDCAMREACTOR_H
+
+#include <stdio.h>
+
+#include "firewireWinDCAMCamera.h"
+
+/** Most cameras one reactor waits for; the Windows limit on the events of one wait, less one */
+#define FDC_REACTOR_MAX_CAMERAS 63
+/** Most worker threads */
+#define FDC_REACTOR_MAX_WORKERS 64
+
+/** What the reactor does with a camera after a worker has serviced it, filled in by the service */
+typedef struct {
+    int park;                   /**< Not waited for until fdcReactorWake() is called */
+    FDCCamera *pCamera;         /**< The camera whose frame event or frame wait is watched */
+    double timeout;             /**< Seconds without a frame after which the camera is serviced with
+                                     timedOut=1, <= 0 to wait for ever */
+} FDCReactorArm;
+
+/** Runs one grab step of a camera in a worker thread.
+ * \param[in] pvt The pointer given to fdcReactorAdd().
+ * \param[in] timedOut 1 if no frame arrived within the timeout, so AcquireImageEx() must not be called.
+ * \param[out] pArm How the camera is to be waited for next.
+ */
+typedef void (*FDCReactorService)(void *pvt, int timedOut, FDCReactorArm *pArm);
+
+typedef struct FDCReactorCamera FDCReactorCamera;
+
+int  fdcReactorConfigure(int workers);
+FDCReactorCamera *fdcReactorAdd(const char *name, FDCReactorService service, void *pvt);
+void fdcReactorWake(FDCReactorCamera *pCamera);
+void fdcReactorReport(FILE *fp);
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ * firewireWinDCAMRecord.cpp
+ *
+ * Raw frame recordings for the firewireWinDCAM driver. See firewireWinDCAMRecord.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "firewireWinDCAMRecord.h"
+
+struct FDCRecordFile {
+    FILE *fp;
+    unsigned long frames;       /**< Frames written, or read since the last rewind */
+};
+
+/** Moves forward in a file that may be larger than 2 GB */
+static int skipBytes(FILE *fp, unsigned long long count)
+{
+#ifdef _WIN32
+    return _fseeki64(fp, (__int64)count, SEEK_CUR);
+#else
+    return fseeko(fp, (off_t)count, SEEK_CUR);
+#endif
+}
+
+static void put16(unsigned char **pp, unsigned int value)
+{
+    unsigned char *p = *pp;
+
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+    *pp = p + 2;
+}
+
+static void put32(unsigned char **pp, unsigned long value)
+{
+    unsigned char *p = *pp;
+
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+    *pp = p + 4;
+}
+
+static unsigned int get16(const unsigned char **pp)
+{
+    const unsigned char *p = *pp;
+
+    *pp = p + 2;
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned long get32(const unsigned char **pp)
+{
+    const unsigned char *p = *pp;
+
+    *pp = p + 4;
+    return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/** Creates a recording.
+ * \param[in] fileName The file, overwritten if it exists.
+ * \param[in] pInfo The camera the frames come from.
+ * \return The recording, NULL on error.
+ */
+FDCRecordFile *fdcRecordCreate(const char *fileName, const FDCRecordInfo *pInfo)
+{
+    unsigned char header[FDC_RECORD_HEADER_SIZE];
+    unsigned char *p = header;
+    FDCRecordFile *pFile;
+    FILE *fp;
+
+    pFile = (FDCRecordFile *)calloc(1, sizeof(*pFile));
+    if (!pFile) return NULL;
+    fp = fopen(fileName, "wb");
+    if (!fp) {
+        free(pFile);
+        return NULL;
+    }
+    memset(header, 0, sizeof(header));
+    memcpy(p, FDC_RECORD_MAGIC, FDC_RECORD_MAGIC_LEN);
+    p += FDC_RECORD_MAGIC_LEN;
+    put32(&p, (unsigned long)(pInfo->guid & 0xFFFFFFFFUL));
+    put32(&p, (unsigned long)(pInfo->guid >> 32));
+    strncpy((char *)p, pInfo->vendor, FDC_RECORD_NAME_LEN - 1);
+    p += FDC_RECORD_NAME_LEN;
+    strncpy((char *)p, pInfo->model, FDC_RECORD_NAME_LEN - 1);
+    if (fwrite(header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        free(pFile);
+        return NULL;
+    }
+    pFile->fp = fp;
+    return pFile;
+}
+
+/** Appends a frame to a recording. \return 0 on success, -1 on a write error. */
+int fdcRecordWrite(FDCRecordFile *pFile, const FDCRecordFrame *pFrame, const unsigned char *pData)
+{
+    unsigned char header[FDC_RECORD_FRAME_HEADER_SIZE];
+    unsigned char *p = header;
+
+    put32(&p, FDC_RECORD_FRAME_HEADER_SIZE);
+    put32(&p, pFrame->arrivalTime.secPastEpoch);
+    put32(&p, pFrame->arrivalTime.nsec);
+    put16(&p, pFrame->format);
+    put16(&p, pFrame->mode);
+    put16(&p, pFrame->rate);
+    put16(&p, pFrame->colorCode);
+    put16(&p, pFrame->depth);
+    put16(&p, pFrame->sizeX);
+    put16(&p, pFrame->sizeY);
+    put16(&p, pFrame->left);
+    put16(&p, pFrame->top);
+    /* 0 in older recordings, which did not record the color filter */
+    put16(&p, pFrame->colorFilter + 1);
+    put32(&p, pFrame->droppedFrames);
+    put32(&p, pFrame->dataLength);
+    if (fwrite(header, sizeof(header), 1, pFile->fp) != 1) return -1;
+    if ((pFrame->dataLength > 0) && (fwrite(pData, pFrame->dataLength, 1, pFile->fp) != 1)) return -1;
+    pFile->frames++;
+    return 0;
+}
+
+/** Opens a recording for reading.
+ * \param[in] fileName The file.
+ * \param[out] pInfo The camera the frames came from.
+ * \return The recording positioned before the first frame, NULL if the file can not be read or
+ *         is not a recording.
+ */
+FDCRecordFile *fdcRecordOpen(const char *fileName, FDCRecordInfo *pInfo)
+{
+    unsigned char header[FDC_RECORD_HEADER_SIZE];
+    const unsigned char *p = header;
+    FDCRecordFile *pFile;
+    unsigned long lo, hi;
+    FILE *fp;
+
+    pFile = (FDCRecordFile *)calloc(1, sizeof(*pFile));
+    if (!pFile) return NULL;
+    fp = fopen(fileName, "rb");
+    if (!fp) {
+        free(pFile);
+        return NULL;
+    }
+    if ((fread(header, sizeof(header), 1, fp) != 1) ||
+        memcmp(header, FDC_RECORD_MAGIC, FDC_RECORD_MAGIC_LEN)) {
+        fclose(fp);
+        free(pFile);
+        return NULL;
+    }
+    p += FDC_RECORD_MAGIC_LEN;
+    lo = get32(&p);
+    hi = get32(&p);
+    pInfo->guid = ((unsigned long long)hi << 32) | lo;
+    memcpy(pInfo->vendor, p, FDC_RECORD_NAME_LEN);
+    pInfo->vendor[FDC_RECORD_NAME_LEN - 1] = '\0';
+    p += FDC_RECORD_NAME_LEN;
+    memcpy(pInfo->model, p, FDC_RECORD_NAME_LEN);
+    pInfo->model[FDC_RECORD_NAME_LEN - 1] = '\0';
+    pFile->fp = fp;
+    return pFile;
+}
+
+/** Reads the header of the next frame. The data must then be read with fdcRecordReadData() or
+ * skipped with fdcRecordSkipData().
+ * \return 0 on success, 1 at the end of the recording, -1 if the file is damaged.
+ */
+int fdcRecordRead(FDCRecordFile *pFile, FDCRecordFrame *pFrame)
+{
+    unsigned char header[FDC_RECORD_FRAME_HEADER_SIZE];
+    const unsigned char *p = header;
+    unsigned long size;
+    size_t n;
+
+    n = fread(header, 1, sizeof(header), pFile->fp);
+    if (n == 0) return 1;
+    if (n != sizeof(header)) return -1;
+    size = get32(&p);
+    if (size < FDC_RECORD_FRAME_HEADER_SIZE) return -1;
+    pFrame->arrivalTime.secPastEpoch = get32(&p);
+    pFrame->arrivalTime.nsec = get32(&p);
+    pFrame->format = get16(&p);
+    pFrame->mode = get16(&p);
+    pFrame->rate = get16(&p);
+    pFrame->colorCode = get16(&p);
+    pFrame->depth = get16(&p);
+    pFrame->sizeX = get16(&p);
+    pFrame->sizeY = get16(&p);
+    pFrame->left = get16(&p);
+    pFrame->top = get16(&p);
+    pFrame->colorFilter = (int)get16(&p) - 1;
+    pFrame->droppedFrames = (int)get32(&p);
+    pFrame->dataLength = get32(&p);
+    /* Skip the fields added by later versions */
+    if ((size > FDC_RECORD_FRAME_HEADER_SIZE) && skipBytes(pFile->fp, size - FDC_RECORD_FRAME_HEADER_SIZE)) return -1;
+    pFile->frames++;
+    return 0;
+}
+
+/** Reads the data of the frame whose header was just read. \return 0 on success, -1 on error. */
+int fdcRecordReadData(FDCRecordFile *pFile, const FDCRecordFrame *pFrame, unsigned char *pData)
+{
+    if (pFrame->dataLength == 0) return 0;
+    return (fread(pData, pFrame->dataLength, 1, pFile->fp) == 1) ? 0 : -1;
+}
+
+/** Skips the data of the frame whose header was just read. \return 0 on success, -1 on error. */
+int fdcRecordSkipData(FDCRecordFile *pFile, const FDCRecordFrame *pFrame)
+{
+    return skipBytes(pFile->fp, pFrame->dataLength) ? -1 : 0;
+}
+
+/** Goes back to the first frame. \return 0 on success, -1 on error. */
+int fdcRecordRewind(FDCRecordFile *pFile)
+{
+    pFile->frames = 0;
+    return fseek(pFile->fp, FDC_RECORD_HEADER_SIZE, SEEK_SET) ? -1 : 0;
+}
+
+/** Returns the number of frames written, or read since the last rewind */
+unsigned long fdcRecordFrames(FDCRecordFile *pFile)
+{
+    return pFile->frames;
+}
+
+void fdcRecordClose(FDCRecordFile *pFile)
+{
+    if (!pFile) return;
+    fclose(pFile->fp);
+    free(pFile);
+}
@@ -0,0 +1,70 @@
+/*
+ * firewireWinDCAMRecord.h
+ *
+ * Raw frame recordings for the firewireWinDCAM driver.
+ *
+ * A recording holds the frames as returned by GetRawData(), before any conversion, with the
+ * settings they were captured with and their arrival time. It is written by the driver while
+ * acquiring and can be played back by the replay backend (firewireWinDCAMReplay.h), so a stream
+ * can be reproduced on a machine without the camera.
+ *
+ * The file is a header followed by the frames, each a fixed size frame header followed by the
+ * raw bytes. All the numbers are little-endian:
+ *   file header   "FDCRAW01", guid (8 bytes), vendor (64 bytes), model (64 bytes)
+ *   frame header  size of the frame header (4), arrival time seconds past the EPICS epoch (4)
+ *                 and nanoseconds (4), format (2), mode (2), frame rate (2), color code (2),
+ *                 data depth (2), width (2), height (2), ROI left (2), ROI top (2), color filter + 1 (2),
+ *                 dropped frames (4), number of raw bytes (4)
+ * Readers skip any frame header bytes beyond the fields they know, so fields can be added.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMRECORD_H
+#define FIREWIREWINDCAMRECORD_H
+
+#include <stdio.h>
+
+#include <epicsTime.h>
+
+#define FDC_RECORD_MAGIC        "FDCRAW01"
+#define FDC_RECORD_MAGIC_LEN    8
+#define FDC_RECORD_NAME_LEN     64
+#define FDC_RECORD_HEADER_SIZE  (FDC_RECORD_MAGIC_LEN + 8 + 2 * FDC_RECORD_NAME_LEN)
+#define FDC_RECORD_FRAME_HEADER_SIZE 40
+
+/** The camera a recording was made with */
+typedef struct {
+    unsigned long long guid;
+    char vendor[FDC_RECORD_NAME_LEN];
+    char model[FDC_RECORD_NAME_LEN];
+} FDCRecordInfo;
+
+/** One recorded frame, without its data */
+typedef struct {
+    epicsTimeStamp arrivalTime;
+    int format;
+    int mode;
+    int rate;                           /**< Frame rate index, 0 for Format 7 */
+    int colorCode;                      /**< FDCColorCode of the data */
+    int depth;                          /**< Data depth in bits */
+    int sizeX, sizeY;
+    int left, top;                      /**< Format 7 ROI origin, 0 for the fixed formats */
+    int colorFilter;                    /**< FDCColorFilter of a raw frame, FDC_COLOR_FILTER_NONE if not known */
+    int droppedFrames;                  /**< Frames dropped by the camera before this one */
+    unsigned long dataLength;
+} FDCRecordFrame;
+
+typedef struct FDCRecordFile FDCRecordFile;
+
+FDCRecordFile *fdcRecordCreate(const char *fileName, const FDCRecordInfo *pInfo);
+int  fdcRecordWrite(FDCRecordFile *pFile, const FDCRecordFrame *pFrame, const unsigned char *pData);
+FDCRecordFile *fdcRecordOpen(const char *fileName, FDCRecordInfo *pInfo);
+int  fdcRecordRead(FDCRecordFile *pFile, FDCRecordFrame *pFrame);
+int  fdcRecordReadData(FDCRecordFile *pFile, const FDCRecordFrame *pFrame, unsigned char *pData);
+int  fdcRecordSkipData(FDCRecordFile *pFile, const FDCRecordFrame *pFrame);
+int  fdcRecordRewind(FDCRecordFile *pFile);
+unsigned long fdcRecordFrames(FDCRecordFile *pFile);
+void fdcRecordClose(FDCRecordFile *pFile);
+
+#endif
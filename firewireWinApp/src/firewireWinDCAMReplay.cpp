@@ -0,0 +1,537 @@
+/*
+ * firewireWinDCAMReplay.cpp
+ *
+ * Replay camera backend. See firewireWinDCAMReplay.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsStdio.h>
+
+#include "firewireWinDCAMCamera.h"
+#include "firewireWinDCAMConvert.h"
+#include "firewireWinDCAMEnum.h"
+#include "firewireWinDCAMRecord.h"
+#include "firewireWinDCAMReplay.h"
+
+#define REPLAY_VERSION 0x131
+#define REPLAY_NUM_FORMATS 8
+#define REPLAY_NUM_MODES 8
+
+/** A registered replay camera and what its recording contains */
+typedef struct {
+    char fileName[256];
+    FDCRecordInfo info;
+    double speed;               /**< 1 for the original speed, 0 for as fast as possible */
+    int loop;
+    unsigned long numFrames;
+    double duration;            /**< Time from the first to the last frame in seconds */
+    double meanInterval;        /**< Mean time between frames in seconds */
+    FDCRecordFrame first;
+    unsigned int formats;
+    unsigned int modes[REPLAY_NUM_FORMATS];
+    unsigned int rates[REPLAY_NUM_FORMATS][REPLAY_NUM_MODES];
+    unsigned int colorCodes[REPLAY_NUM_MODES];         /**< Format 7 color codes of each mode */
+    unsigned short maxSizeX[REPLAY_NUM_MODES];          /**< Format 7 extent of each mode */
+    unsigned short maxSizeY[REPLAY_NUM_MODES];
+} ReplayConfig;
+
+static ReplayConfig replayCameras[FDC_REPLAY_MAX_CAMERAS];
+static int numReplayCameras;
+
+/** The controls of a replay camera; recordings have no features */
+class FDCReplayControl : public FDCCameraControl
+{
+public:
+    int  Inquire()                  { return FDC_CAM_SUCCESS; }
+    bool HasPresence()              { return false; }
+    bool HasAbsControl()            { return false; }
+    bool HasOnePush()               { return false; }
+    bool HasReadout()               { return false; }
+    bool HasOnOff()                 { return false; }
+    bool HasAutoMode()              { return false; }
+    bool HasManualMode()            { return false; }
+    void GetRange(unsigned short *min, unsigned short *max)     { *min = *max = 0; }
+    void GetRangeAbsolute(float *fmin, float *fmax)             { *fmin = *fmax = 0.0f; }
+    int  Status()                   { return FDC_CAM_SUCCESS; }
+    bool StatusAbsControl()         { return false; }
+    bool StatusOnOff()              { return false; }
+    bool StatusOnePush()            { return false; }
+    bool StatusAutoMode()           { return false; }
+    void GetValue(unsigned short *v_lo, unsigned short *v_hi)
+    {
+        *v_lo = 0;
+        if (v_hi) *v_hi = 0;
+    }
+    void GetValueAbsolute(float *f) { *f = 0.0f; }
+    int  SetAbsControl(int on)      { return FDC_CAM_ERROR_UNSUPPORTED; }
+    int  SetAutoMode(int on)        { return FDC_CAM_ERROR_UNSUPPORTED; }
+    int  SetValue(unsigned short v_lo, unsigned short v_hi)     { return FDC_CAM_ERROR_UNSUPPORTED; }
+    int  SetValueAbsolute(float f)  { return FDC_CAM_ERROR_UNSUPPORTED; }
+    const char *GetName()           { return "Unsupported"; }
+    const char *GetUnits()          { return ""; }
+};
+
+class FDCReplayCamera;
+
+class FDCReplayControlSize : public FDCCameraControlSize
+{
+public:
+    FDCReplayControlSize(FDCReplayCamera *pCamera) : pCamera(pCamera) {}
+
+    void GetSizeLimits(unsigned short *hMax, unsigned short *vMax);
+    void GetSizeUnits(unsigned short *hUnit, unsigned short *vUnit)    { *hUnit = *vUnit = 1; }
+    void GetSize(unsigned short *width, unsigned short *height);
+    int  SetSize(unsigned short width, unsigned short height)          { return FDC_CAM_SUCCESS; }
+    void GetPosLimits(unsigned short *hMax, unsigned short *vMax);
+    void GetPosUnits(unsigned short *hUnit, unsigned short *vUnit)     { *hUnit = *vUnit = 1; }
+    void GetPos(unsigned short *left, unsigned short *top);
+    int  SetPos(unsigned short left, unsigned short top)               { return FDC_CAM_SUCCESS; }
+    bool HasColorCode(FDCColorCode code);
+    void GetColorCode(FDCColorCode *code);
+    int  SetColorCode(FDCColorCode code);
+    void GetBytesPerPacketRange(unsigned short *min, unsigned short *max)
+    {
+        *min = 8;
+        *max = 4096;
+    }
+    void GetBytesPerPacket(unsigned short *current, unsigned short *recommended)
+    {
+        *current = 4096;
+        if (recommended) *recommended = 4096;
+    }
+    int  SetBytesPerPacket(unsigned short bpp)      { return FDC_CAM_SUCCESS; }
+    void GetPacketsPerFrame(unsigned long *ppf);
+    void GetDataDepth(unsigned short *depth);
+    void GetColorFilter(FDCColorFilter *filter);
+    void GetFrameInterval(float *interval);
+
+private:
+    FDCReplayCamera *pCamera;
+};
+
+class FDCReplayCamera : public FDCCamera
+{
+public:
+    FDCReplayCamera(const ReplayConfig *pConfig);
+    ~FDCReplayCamera();
+
+    int  InitCamera(int reset)      { return FDC_CAM_SUCCESS; }
+    void GetCameraName(char *buf, int len)      { epicsSnprintf(buf, len, "%s", pConfig->info.model); }
+    void GetCameraVendor(char *buf, int len)    { epicsSnprintf(buf, len, "%s", pConfig->info.vendor); }
+    void GetCameraUniqueID(unsigned long long *pGuid)   { *pGuid = pConfig->info.guid; }
+    unsigned long GetVersion()      { return REPLAY_VERSION; }
+    int  GetMaxSpeed()              { return 400; }
+    bool Has1394b()                 { return false; }
+    bool Status1394b()              { return false; }
+    int  Set1394b(bool on)          { return on ? FDC_CAM_ERROR_UNSUPPORTED : FDC_CAM_SUCCESS; }
+
+    bool HasVideoFormat(unsigned long format)
+    {
+        return (format < REPLAY_NUM_FORMATS) && (pConfig->formats & (1 << format));
+    }
+    int  SetVideoFormat(unsigned long format)
+    {
+        return HasVideoFormat(format) ? FDC_CAM_SUCCESS : FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS;
+    }
+    int  GetVideoFormat()           { return frame.format; }
+    bool HasVideoMode(unsigned long format, unsigned long mode)
+    {
+        return HasVideoFormat(format) && (mode < REPLAY_NUM_MODES) && (pConfig->modes[format] & (1 << mode));
+    }
+    int  SetVideoMode(unsigned long mode)
+    {
+        return HasVideoMode(frame.format, mode) ? FDC_CAM_SUCCESS : FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS;
+    }
+    int  GetVideoMode()             { return frame.mode; }
+    bool HasVideoFrameRate(unsigned long format, unsigned long mode, unsigned long rate)
+    {
+        return HasVideoMode(format, mode) && (format != 7) && (rate < 8) && (pConfig->rates[format][mode] & (1 << rate));
+    }
+    int  SetVideoFrameRate(unsigned long rate)
+    {
+        return HasVideoFrameRate(frame.format, frame.mode, rate) ? FDC_CAM_SUCCESS : FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS;
+    }
+    int  GetVideoFrameRate()        { return frame.rate; }
+    void GetVideoFrameDimensions(unsigned long *pWidth, unsigned long *pHeight)
+    {
+        *pWidth = frame.sizeX;
+        *pHeight = frame.sizeY;
+    }
+    void GetVideoDataDepth(unsigned short *depth)   { *depth = (unsigned short)frame.depth; }
+    bool HasOneShot()               { return false; }
+    bool HasMultiShot()             { return false; }
+
+    int  StartImageAcquisitionEx(int nBuffers, int frameTimeout, int flags);
+    int  AcquireImageEx(int dropStaleFrames, int *pDroppedFrames);
+    int  StopImageAcquisition();
+    double GetFrameWait();
+    unsigned char *GetRawData(unsigned long *pLength)
+    {
+        *pLength = frame.dataLength;
+        return pData;
+    }
+    int  getRGB(unsigned char *pBitmap, unsigned long length);
+
+    FDCCameraControl *GetCameraControl(FDCFeature feature)  { return &control; }
+    FDCCameraControlSize *GetCameraControlSize()            { return &controlSize; }
+
+    const ReplayConfig *pConfig;
+    FDCRecordFrame frame;       /**< The frame being played back */
+
+private:
+    int readHeader(FDCRecordFrame *pFrame);
+    double dueTime(const FDCRecordFrame *pFrame);
+
+    FDCReplayControl control;
+    FDCReplayControlSize controlSize;
+    FDCRecordFile *pFile;
+    FDCRecordFrame pending;     /**< Header read but not yet due when the last call timed out */
+    int havePending;
+    unsigned char *pData;
+    unsigned long dataSize;
+    int acquiring;
+    int nBuffers;
+    int frameTimeout;
+    epicsTimeStamp startTime;
+    double loopOffset;          /**< Time added to the recorded times on each pass of a looped recording */
+};
+
+FDCReplayCamera::FDCReplayCamera(const ReplayConfig *pConfig)
+    : pConfig(pConfig), frame(pConfig->first), controlSize(this), pFile(NULL), havePending(0), pData(NULL),
+      dataSize(0), acquiring(0), nBuffers(0), frameTimeout(0), loopOffset(0.0)
+{
+}
+
+FDCReplayCamera::~FDCReplayCamera()
+{
+    fdcRecordClose(pFile);
+    free(pData);
+}
+
+int FDCReplayCamera::StartImageAcquisitionEx(int nBuffers, int frameTimeout, int flags)
+{
+    FDCRecordInfo info;
+
+    if (acquiring) return FDC_CAM_ERROR_BUSY;
+    if (!pFile) pFile = fdcRecordOpen(pConfig->fileName, &info);
+    if (!pFile || fdcRecordRewind(pFile)) return FDC_CAM_ERROR;
+    this->nBuffers = (nBuffers > 0) ? nBuffers : 1;
+    this->frameTimeout = frameTimeout;
+    havePending = 0;
+    loopOffset = 0.0;
+    epicsTimeGetCurrent(&startTime);
+    acquiring = 1;
+    return FDC_CAM_SUCCESS;
+}
+
+int FDCReplayCamera::StopImageAcquisition()
+{
+    if (!acquiring) return FDC_CAM_ERROR_NOT_INITIALIZED;
+    acquiring = 0;
+    return FDC_CAM_SUCCESS;
+}
+
+/** Reads the next frame header, going back to the start of a looped recording.
+ * \return 0 on success, 1 at the end of the recording, -1 on a read error. */
+int FDCReplayCamera::readHeader(FDCRecordFrame *pFrame)
+{
+    int status = fdcRecordRead(pFile, pFrame);
+
+    if ((status == 1) && pConfig->loop) {
+        loopOffset += pConfig->duration + pConfig->meanInterval;
+        if (fdcRecordRewind(pFile)) return -1;
+        status = fdcRecordRead(pFile, pFrame);
+    }
+    return status;
+}
+
+/** Returns when a frame is due, in seconds from the start of acquisition */
+double FDCReplayCamera::dueTime(const FDCRecordFrame *pFrame)
+{
+    return (epicsTimeDiffInSeconds(&pFrame->arrivalTime, &pConfig->first.arrivalTime) + loopOffset) / pConfig->speed;
+}
+
+/** Returns the time until the next frame is due. Its header is read ahead and kept for
+ * AcquireImageEx(), as when a call times out. */
+double FDCReplayCamera::GetFrameWait()
+{
+    epicsTimeStamp now;
+    double wait;
+    int status;
+
+    if (!acquiring || (pConfig->speed <= 0)) return 0.;
+    if (!havePending) {
+        status = readHeader(&pending);
+        /* At the end of the recording no frame will come, so the frame timeout of the caller
+         * applies; a read error is left for AcquireImageEx() to report */
+        if (status > 0) return 1.e9;
+        if (status < 0) return 0.;
+        havePending = 1;
+    }
+    epicsTimeGetCurrent(&now);
+    wait = dueTime(&pending) - epicsTimeDiffInSeconds(&now, &startTime);
+    return (wait > 0.) ? wait : 0.;
+}
+
+/** Plays back the next frame.
+ * In real time the frame is returned at its recorded time, scaled by the speed. A frame that is
+ * more than nBuffers frames late is lost as it would be in the DMA ring, and with dropStaleFrames
+ * every frame but the newest one due is skipped. The dropped frames reported are those recorded
+ * plus those lost in playback.
+ */
+int FDCReplayCamera::AcquireImageEx(int dropStaleFrames, int *pDroppedFrames)
+{
+    FDCRecordFrame next;
+    epicsTimeStamp now;
+    double elapsed, wait, late;
+    int dropped = 0;
+    int status;
+
+    if (pDroppedFrames) *pDroppedFrames = 0;
+    if (!acquiring) return FDC_CAM_ERROR_NOT_INITIALIZED;
+    if (havePending) {
+        next = pending;
+        havePending = 0;
+        status = 0;
+    } else {
+        status = readHeader(&next);
+    }
+    if (status) {
+        /* The recording is over: behave as a camera that stopped sending */
+        if (frameTimeout > 0) epicsThreadSleep(frameTimeout / 1000.0);
+        return (status > 0) ? FDC_CAM_ERROR_FRAME_TIMEOUT : FDC_CAM_ERROR;
+    }
+    if (pConfig->speed > 0) {
+        epicsTimeGetCurrent(&now);
+        elapsed = epicsTimeDiffInSeconds(&now, &startTime);
+        wait = dueTime(&next) - elapsed;
+        if ((frameTimeout > 0) && (wait > frameTimeout / 1000.0)) {
+            /* Keep the frame for the next call */
+            pending = next;
+            havePending = 1;
+            epicsThreadSleep(frameTimeout / 1000.0);
+            return FDC_CAM_ERROR_FRAME_TIMEOUT;
+        }
+        if (wait > 0) epicsThreadSleep(wait);
+        /* Skip the frames the ring would have overwritten, or all but the newest with dropStaleFrames */
+        while (1) {
+            late = elapsed - dueTime(&next);
+            if (dropStaleFrames) {
+                if (late <= pConfig->meanInterval / pConfig->speed) break;
+            } else {
+                if (late <= nBuffers * pConfig->meanInterval / pConfig->speed) break;
+            }
+            if (fdcRecordSkipData(pFile, &next)) return FDC_CAM_ERROR;
+            dropped += next.droppedFrames + 1;
+            status = readHeader(&next);
+            if (status) return (status > 0) ? FDC_CAM_ERROR_FRAME_TIMEOUT : FDC_CAM_ERROR;
+        }
+    }
+    if (next.dataLength > dataSize) {
+        free(pData);
+        pData = (unsigned char *)malloc(next.dataLength);
+        dataSize = pData ? next.dataLength : 0;
+        if (!pData) return FDC_CAM_ERROR_INSUFFICIENT_RESOURCES;
+    }
+    if (fdcRecordReadData(pFile, &next, pData)) return FDC_CAM_ERROR;
+    frame = next;
+    if (pDroppedFrames) *pDroppedFrames = dropped + frame.droppedFrames;
+    return FDC_CAM_SUCCESS;
+}
+
+int FDCReplayCamera::getRGB(unsigned char *pBitmap, unsigned long length)
+{
+    if (!pData) return FDC_CAM_ERROR_NOT_INITIALIZED;
+    if (length < (unsigned long)frame.sizeX * frame.sizeY * 3) return FDC_CAM_ERROR_PARAM_OUT_OF_RANGE;
+    if (fdcConvertToRGB8((FDCColorCode)frame.colorCode, pData, pBitmap, frame.sizeX, frame.sizeY))
+        return FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS;
+    return FDC_CAM_SUCCESS;
+}
+
+void FDCReplayControlSize::GetSizeLimits(unsigned short *hMax, unsigned short *vMax)
+{
+    *hMax = pCamera->pConfig->maxSizeX[pCamera->frame.mode];
+    *vMax = pCamera->pConfig->maxSizeY[pCamera->frame.mode];
+}
+
+void FDCReplayControlSize::GetSize(unsigned short *width, unsigned short *height)
+{
+    *width = (unsigned short)pCamera->frame.sizeX;
+    *height = (unsigned short)pCamera->frame.sizeY;
+}
+
+void FDCReplayControlSize::GetPosLimits(unsigned short *hMax, unsigned short *vMax)
+{
+    GetSizeLimits(hMax, vMax);
+    *hMax = *hMax - pCamera->frame.sizeX;
+    *vMax = *vMax - pCamera->frame.sizeY;
+}
+
+void FDCReplayControlSize::GetPos(unsigned short *left, unsigned short *top)
+{
+    *left = (unsigned short)pCamera->frame.left;
+    *top = (unsigned short)pCamera->frame.top;
+}
+
+bool FDCReplayControlSize::HasColorCode(FDCColorCode code)
+{
+    return (code >= 0) && (code < FDC_COLOR_CODE_MAX) &&
+           (pCamera->pConfig->colorCodes[pCamera->frame.mode] & (1 << code));
+}
+
+void FDCReplayControlSize::GetColorCode(FDCColorCode *code)
+{
+    *code = (FDCColorCode)pCamera->frame.colorCode;
+}
+
+int FDCReplayControlSize::SetColorCode(FDCColorCode code)
+{
+    return HasColorCode(code) ? FDC_CAM_SUCCESS : FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS;
+}
+
+void FDCReplayControlSize::GetPacketsPerFrame(unsigned long *ppf)
+{
+    *ppf = (pCamera->frame.dataLength + 4095) / 4096;
+}
+
+void FDCReplayControlSize::GetDataDepth(unsigned short *depth)
+{
+    *depth = (unsigned short)pCamera->frame.depth;
+}
+
+void FDCReplayControlSize::GetColorFilter(FDCColorFilter *filter)
+{
+    *filter = (FDCColorFilter)pCamera->frame.colorFilter;
+}
+
+void FDCReplayControlSize::GetFrameInterval(float *interval)
+{
+    const ReplayConfig *pConfig = pCamera->pConfig;
+
+    *interval = (pConfig->speed > 0) ? (float)(pConfig->meanInterval / pConfig->speed) : 0.0f;
+}
+
+static int replayEnumerate(FDCCameraInfo *pInfo, int maxCameras)
+{
+    int i;
+
+    for (i=0; (i<numReplayCameras) && (i<maxCameras); i++) {
+        pInfo[i].guid = replayCameras[i].info.guid;
+        pInfo[i].node = i;
+        pInfo[i].bus = -1;
+        pInfo[i].version = REPLAY_VERSION;
+        epicsSnprintf(pInfo[i].vendor, sizeof(pInfo[i].vendor), "%s", replayCameras[i].info.vendor);
+        epicsSnprintf(pInfo[i].model, sizeof(pInfo[i].model), "%s", replayCameras[i].info.model);
+    }
+    return i;
+}
+
+static FDCCamera *replayOpen(const FDCCameraInfo *pInfo)
+{
+    if ((pInfo->node < 0) || (pInfo->node >= numReplayCameras)) return NULL;
+    return new FDCReplayCamera(&replayCameras[pInfo->node]);
+}
+
+static const FDCBackend replayBackend = {"Replay", replayEnumerate, replayOpen};
+
+void fdcReplayRegisterBackend(void)
+{
+    fdcRegisterBackend(&replayBackend);
+}
+
+/** Reads the frame headers of a recording to find what it contains.
+ * \return 0 on success, -1 if the recording is damaged or empty. */
+static int scanRecording(FDCRecordFile *pFile, ReplayConfig *pConfig)
+{
+    FDCRecordFrame frame;
+    int status;
+
+    while ((status = fdcRecordRead(pFile, &frame)) == 0) {
+        if ((frame.format >= REPLAY_NUM_FORMATS) || (frame.mode >= REPLAY_NUM_MODES) ||
+            (frame.rate >= 8) || (frame.colorCode >= FDC_COLOR_CODE_MAX)) return -1;
+        if (pConfig->numFrames == 0) pConfig->first = frame;
+        pConfig->numFrames++;
+        pConfig->duration = epicsTimeDiffInSeconds(&frame.arrivalTime, &pConfig->first.arrivalTime);
+        pConfig->formats |= 1 << frame.format;
+        pConfig->modes[frame.format] |= 1 << frame.mode;
+        if (frame.format == 7) {
+            pConfig->colorCodes[frame.mode] |= 1 << frame.colorCode;
+            if (frame.left + frame.sizeX > pConfig->maxSizeX[frame.mode])
+                pConfig->maxSizeX[frame.mode] = (unsigned short)(frame.left + frame.sizeX);
+            if (frame.top + frame.sizeY > pConfig->maxSizeY[frame.mode])
+                pConfig->maxSizeY[frame.mode] = (unsigned short)(frame.top + frame.sizeY);
+        } else {
+            pConfig->rates[frame.format][frame.mode] |= 1 << frame.rate;
+        }
+        if (fdcRecordSkipData(pFile, &frame)) return -1;
+    }
+    if ((status < 0) || (pConfig->numFrames == 0)) return -1;
+    if (pConfig->numFrames > 1) pConfig->meanInterval = pConfig->duration / (pConfig->numFrames - 1);
+    return 0;
+}
+
+/** Adds a replay camera. Must be called before the driver that uses it is configured.
+ * \param[in] fileName The recording.
+ * \param[in] camid The GUID the camera has, in the same format as for WinFDC_Config. If empty
+ *            the GUID of the camera the recording was made with.
+ * \param[in] speed 1 to play at the recorded speed, 2 for twice as fast and so on, 0 to play the
+ *            frames as fast as they are read.
+ * \param[in] loop Non-zero to play the recording again from the start when it ends. A looped
+ *            recording played in real time must span some time, or its passes would all be due at
+ *            once.
+ * \return 0 on success, -1 on error.
+ */
+int fdcReplayAddCamera(const char *fileName, const char *camid, double speed, int loop)
+{
+    ReplayConfig *pConfig;
+    FDCRecordFile *pFile;
+    unsigned long long guid;
+    int status;
+
+    if (numReplayCameras >= FDC_REPLAY_MAX_CAMERAS) {
+        fprintf(stderr, "fdcReplayAddCamera: too many replay cameras\n");
+        return -1;
+    }
+    if (!fileName || (strlen(fileName) >= sizeof(pConfig->fileName)) || (speed < 0)) {
+        fprintf(stderr, "fdcReplayAddCamera: invalid file name or speed\n");
+        return -1;
+    }
+    if (fdcParseGuid(camid, &guid)) {
+        fprintf(stderr, "fdcReplayAddCamera: invalid camera ID \"%s\"\n", camid);
+        return -1;
+    }
+    pConfig = &replayCameras[numReplayCameras];
+    memset(pConfig, 0, sizeof(*pConfig));
+    pFile = fdcRecordOpen(fileName, &pConfig->info);
+    if (!pFile) {
+        fprintf(stderr, "fdcReplayAddCamera: %s is not a recording\n", fileName);
+        return -1;
+    }
+    status = scanRecording(pFile, pConfig);
+    fdcRecordClose(pFile);
+    if (status) {
+        fprintf(stderr, "fdcReplayAddCamera: %s is damaged or empty\n", fileName);
+        return -1;
+    }
+    if (loop && (speed > 0) && (pConfig->duration <= 0)) {
+        fprintf(stderr, "fdcReplayAddCamera: %s spans no time, it can only be looped with speed 0\n", fileName);
+        return -1;
+    }
+    strcpy(pConfig->fileName, fileName);
+    if (guid) pConfig->info.guid = guid;
+    pConfig->speed = speed;
+    pConfig->loop = loop;
+    numReplayCameras++;
+    printf("fdcReplayAddCamera: %s, %lu frames in %.3f s from %s %s (0x%16.16llX)\n", fileName,
+        pConfig->numFrames, pConfig->duration, pConfig->info.vendor, pConfig->info.model, pConfig->info.guid);
+    fdcReplayRegisterBackend();
+    fdcEnumInvalidate();
+    return 0;
+}
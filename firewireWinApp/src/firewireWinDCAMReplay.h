@@ -0,0 +1,24 @@
+/*
+ * firewireWinDCAMReplay.h
+ *
+ * Replay camera backend for the firewireWinDCAM driver.
+ *
+ * A replay camera plays back a recording made with the FDC_RECORD parameters (see
+ * firewireWinDCAMRecord.h) through the same acquisition and conversion path as a live camera.
+ * It supports the formats, modes, rates and color codes found in the recording. The settings it
+ * reports are always those of the frame being played back, writing other settings has no effect.
+ * Each start of acquisition plays the recording from the beginning, at the original speed, at a
+ * multiple of it, or as fast as the frames are read. When playing in real time frames that fall
+ * further behind than the number of DMA buffers are lost, as they would be with a live camera.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMREPLAY_H
+#define FIREWIREWINDCAMREPLAY_H
+
+#define FDC_REPLAY_MAX_CAMERAS 16
+
+int fdcReplayAddCamera(const char *fileName, const char *camid, double speed, int loop);
+
+#endif
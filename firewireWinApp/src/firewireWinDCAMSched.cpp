@@ -0,0 +1,192 @@
+/*
+ * firewireWinDCAMSched.cpp
+ *
+ * Thread placement for the firewireWinDCAM driver. See firewireWinDCAMSched.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <epicsThread.h>
+
+#include "firewireWinDCAMSched.h"
+
+/** Most CPUs a mask can select */
+#define SCHED_MAX_CPUS 64
+
+/** Reads a CPU set.
+ * \param[in] cpus A list of CPUs and ranges such as "0-3,8", or a hexadecimal mask such as "0x10f".
+ *            An empty string or NULL selects all the CPUs.
+ * \param[out] pMask The CPUs, bit n for CPU n; 0 for all.
+ * \return 0 on success, -1 if the set cannot be read or selects a CPU above 63.
+ */
+int fdcSchedParseCpus(const char *cpus, unsigned long long *pMask)
+{
+    unsigned long long mask = 0;
+    const char *p = cpus;
+    char *pEnd;
+    unsigned long first, last, cpu;
+
+    *pMask = 0;
+    if (!p) return 0;
+    while (isspace((unsigned char)*p)) p++;
+    if (!*p) return 0;
+    if ((p[0] == '0') && ((p[1] == 'x') || (p[1] == 'X'))) {
+        mask = strtoull(p, &pEnd, 16);
+        while (isspace((unsigned char)*pEnd)) pEnd++;
+        if ((pEnd == p + 2) || *pEnd) return -1;
+        *pMask = mask;
+        return 0;
+    }
+    while (*p) {
+        if (!isdigit((unsigned char)*p)) return -1;
+        first = strtoul(p, &pEnd, 10);
+        last = first;
+        p = pEnd;
+        if (*p == '-') {
+            p++;
+            if (!isdigit((unsigned char)*p)) return -1;
+            last = strtoul(p, &pEnd, 10);
+            p = pEnd;
+        }
+        if ((last < first) || (last >= SCHED_MAX_CPUS)) return -1;
+        for (cpu=first; cpu<=last; cpu++) mask |= 1ULL << cpu;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == ',') {
+            p++;
+            while (isspace((unsigned char)*p)) p++;
+        } else if (*p) {
+            return -1;
+        }
+    }
+    *pMask = mask;
+    return 0;
+}
+
+/** Restricts the calling thread to a set of CPUs.
+ * \param[in] mask The CPUs, see fdcSchedParseCpus(); 0 allows all the CPUs of the process again.
+ * \return 0 on success, -1 on error or if the OS is not supported.
+ */
+int fdcSchedSetAffinity(unsigned long long mask)
+{
+#if defined(_WIN32)
+    DWORD_PTR processMask, systemMask;
+
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) return -1;
+    if (mask == 0) mask = processMask;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) ? 0 : -1;
+#elif defined(__linux__)
+    cpu_set_t set;
+    int cpu;
+
+    CPU_ZERO(&set);
+    for (cpu=0; cpu<CPU_SETSIZE; cpu++) {
+        if ((mask == 0) || ((cpu < SCHED_MAX_CPUS) && (mask & (1ULL << cpu)))) CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) ? -1 : 0;
+#else
+    return (mask == 0) ? 0 : -1;
+#endif
+}
+
+/** The placement last applied to a thread, see fdcSchedApply() */
+typedef struct {
+    int priority;
+    unsigned long long mask;
+} SchedPlacement;
+
+static epicsThreadOnceId placementOnce = EPICS_THREAD_ONCE_INIT;
+static epicsThreadPrivateId placementId;
+
+static void placementInit(void *arg)
+{
+    placementId = epicsThreadPrivateCreate();
+}
+
+/** Gives the calling thread a priority and a set of CPUs, unless it already has them from an
+ * earlier call. A thread that works for several cameras in turn, a reactor or strip worker,
+ * calls it for each camera and is only moved when the camera it works for wants another placement.
+ * \param[in] priority The EPICS priority.
+ * \param[in] mask The CPUs, see fdcSchedSetAffinity().
+ * \return 0 on success, -1 if the thread cannot be restricted to the CPUs.
+ */
+int fdcSchedApply(int priority, unsigned long long mask)
+{
+    SchedPlacement *pPlacement;
+
+    epicsThreadOnce(&placementOnce, placementInit, NULL);
+    pPlacement = (SchedPlacement *)epicsThreadPrivateGet(placementId);
+    if (!pPlacement) {
+        pPlacement = (SchedPlacement *)calloc(1, sizeof(SchedPlacement));
+        if (!pPlacement) return -1;
+        pPlacement->priority = -1;
+        epicsThreadPrivateSet(placementId, pPlacement);
+    } else if ((pPlacement->priority == priority) && (pPlacement->mask == mask)) {
+        return 0;
+    }
+    if (pPlacement->priority != priority) epicsThreadSetPriority(epicsThreadGetIdSelf(), priority);
+    pPlacement->priority = priority;
+    if (fdcSchedSetAffinity(mask)) return -1;
+    pPlacement->mask = mask;
+    return 0;
+}
+
+/** Returns the CPU the calling thread is running on, -1 if it is not known */
+int fdcSchedCurrentCpu(void)
+{
+#if defined(_WIN32)
+    return (int)GetCurrentProcessorNumber();
+#elif defined(__linux__)
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+/** Returns the NUMA node of a CPU, 0 on hosts with one node, -1 if it is not known */
+int fdcSchedCpuNode(int cpu)
+{
+#if defined(_WIN32)
+    UCHAR node;
+
+    if ((cpu < 0) || (cpu > 255) || !GetNumaProcessorNode((UCHAR)cpu, &node) || (node == 0xff)) return -1;
+    return node;
+#elif defined(__linux__)
+    char path[64];
+    DIR *pDir;
+    struct dirent *pEntry;
+    int node = 0;
+
+    if (cpu < 0) return -1;
+    /* The directory of a CPU has a link named after its node; without NUMA there is none */
+    sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+    pDir = opendir(path);
+    if (!pDir) return -1;
+    while ((pEntry = readdir(pDir)) != NULL) {
+        if ((strncmp(pEntry->d_name, "node", 4) == 0) && isdigit((unsigned char)pEntry->d_name[4])) {
+            node = atoi(pEntry->d_name + 4);
+            break;
+        }
+    }
+    closedir(pDir);
+    return node;
+#else
+    return -1;
+#endif
+}
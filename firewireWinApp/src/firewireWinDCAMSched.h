@@ -0,0 +1,31 @@
+/*
+ * firewireWinDCAMSched.h
+ *
+ * Thread placement for the firewireWinDCAM driver.
+ *
+ * On hosts with several processor sockets the grab thread of a camera can be kept on the cores of
+ * one socket, away from the rest of the IOC, and the NDArrays it fills allocated in the memory of
+ * that socket's NUMA node. Windows and Linux both place a page in the node of the thread that
+ * first touches it, so a pinned grab thread that allocates and fills its own arrays gets local
+ * memory without a NUMA allocator.
+ *
+ * CPU sets are written as a list of CPUs and ranges, "0-3,8", or as a hexadecimal mask, "0x10f".
+ * Only the first 64 CPUs can be selected.
+ *
+ * With the grab reactor the frames of a camera are grabbed by the shared reactor workers, and with
+ * strip conversion they are converted by the shared strip workers as well. These threads take the
+ * placement of the camera they are working for, see fdcSchedApply().
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMSCHED_H
+#define FIREWIREWINDCAMSCHED_H
+
+int fdcSchedParseCpus(const char *cpus, unsigned long long *pMask);
+int fdcSchedSetAffinity(unsigned long long mask);
+int fdcSchedApply(int priority, unsigned long long mask);
+int fdcSchedCurrentCpu(void);
+int fdcSchedCpuNode(int cpu);
+
+#endif
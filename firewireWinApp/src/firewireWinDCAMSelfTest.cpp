@@ -0,0 +1,834 @@
+/*
+ * firewireWinDCAMSelfTest.cpp
+ *
+ * Self-test of the firewireWinDCAM driver against simulated cameras. Each check adds a simulated
+ * camera and a driver for it, drives the driver through its asyn parameters as the records
+ * would, and checks what it reads back, so it needs neither Firewire hardware nor an IOC.
+ *
+ * Usage: firewireWinDCAMSelfTest [check ...]
+ *
+ * The checks given are run, or all of them if none is:
+ *   reconfig    changes the video mode, frame rate, video format, Format 7 mode and Format 7 ROI
+ *               while acquiring, and checks after each change that acquisition is still on, that
+ *               frames of the new size are published and that the gap is reported in
+ *               FDC_RECONFIG_GAP.
+ *   faults      runs a seeded fault schedule of errors, dropped and corrupted frames, and then a
+ *               link loss, and checks the frames captured, the drop counters, the faults injected
+ *               and the retries, restarts, re-initializations and reconnections of the watchdog.
+ *   drain       stalls the grab thread with a fault schedule in latest-only and lossless mode, and
+ *               checks that the frames queued meanwhile are skipped, drained or lost to overruns
+ *               as the policy and the depth of the DMA ring say.
+ *   packet      plans the Format 7 packet size for an acquire period, and checks the packet size,
+ *               the packets per frame, the predicted frame rate and the capture rate.
+ *   pool        makes the frames grow while a plugin holds arrays of the old size, and checks that
+ *               the frames are dropped with the Drop pool policy and published with the Free
+ *               memory policy once the plugin has released the arrays.
+ *   depth       takes 16-bit frames from cameras with 12 significant bits, sent in the high or the
+ *               low bits with the unused bits not cleared, and checks FDC_DATA_DEPTH and every
+ *               sample published with each alignment and with the unused bits masked or clamped.
+ *
+ * A line is printed for each check, with the reason if it failed, and the exit status is 1 if
+ * any check failed.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <asynDriver.h>
+#include <asynDrvUser.h>
+#include <asynGenericPointer.h>
+#include <asynInt32SyncIO.h>
+#include <asynFloat64SyncIO.h>
+
+#include <ADDriver.h>
+
+#include "firewireWinDCAMConvert.h"
+
+/* The configuration functions of the driver, see firewireWinDCAM.cpp */
+extern "C" int WinFDC_Config(const char *portName, const char* camid, int maxBuffers, size_t maxMemory,
+                             int priority, int stackSize, int dmaBuffers);
+extern "C" int WinFDC_SimCamera(const char *camid, int maxSizeX, int maxSizeY, double frameRate, int bus,
+                                int speed, int dataDepth, int sentAlign);
+extern "C" int WinFDC_FaultInject(const char *camid, const char *schedule, int seed);
+
+/** Timeout of each read and write of a parameter, in seconds */
+#define SELFTEST_IO_TIMEOUT 2.0
+/** Longest wait for the camera to be initialized, in seconds */
+#define SELFTEST_INIT_TIMEOUT 10.0
+/** Frames waited for after each change, and the longest wait for them in seconds */
+#define SELFTEST_FRAMES 5
+#define SELFTEST_FRAMES_TIMEOUT 5.0
+/** Longest stream gap accepted for a reconfiguration, in seconds */
+#define SELFTEST_MAX_GAP 2.0
+/** Exposure time of the simulated cameras, in seconds */
+#define SELFTEST_EXPOSURE 0.001
+/** FDCInitReady, see FDCInitState_t in firewireWinDCAM.cpp */
+#define SELFTEST_INIT_READY 3
+/** FDCDrainLatest and FDCDrainLossless, see FDCDrainPolicy_t in firewireWinDCAM.cpp */
+#define SELFTEST_DRAIN_LATEST 0
+#define SELFTEST_DRAIN_LOSSLESS 1
+/** FDCPacketPlanned, see FDCPacketMode_t in firewireWinDCAM.cpp */
+#define SELFTEST_PACKET_PLANNED 1
+/** WATCHDOG_RETRIES, see firewireWinDCAM.cpp */
+#define SELFTEST_WD_RETRIES 2
+
+/** A check being run */
+typedef struct {
+    const char *name;
+    const char *portName;
+    int failed;
+} SelfTest;
+
+/** Reports the failure of a check; only the first one is printed */
+static void fail(SelfTest *pTest, const char *format, ...)
+{
+    va_list args;
+
+    if (pTest->failed++) return;
+    printf("%s: FAILED, ", pTest->name);
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+}
+
+static int getInt(SelfTest *pTest, const char *param)
+{
+    epicsInt32 value = 0;
+
+    if (pasynInt32SyncIO->readOnce(pTest->portName, 0, &value, SELFTEST_IO_TIMEOUT, param) != asynSuccess)
+        fail(pTest, "unable to read %s", param);
+    return value;
+}
+
+static double getDouble(SelfTest *pTest, const char *param)
+{
+    epicsFloat64 value = 0.;
+
+    if (pasynFloat64SyncIO->readOnce(pTest->portName, 0, &value, SELFTEST_IO_TIMEOUT, param) != asynSuccess)
+        fail(pTest, "unable to read %s", param);
+    return value;
+}
+
+static void putInt(SelfTest *pTest, const char *param, int value)
+{
+    if (pasynInt32SyncIO->writeOnce(pTest->portName, 0, value, SELFTEST_IO_TIMEOUT, param) != asynSuccess)
+        fail(pTest, "unable to write %s=%d", param, value);
+}
+
+static void putDouble(SelfTest *pTest, const char *param, double value)
+{
+    if (pasynFloat64SyncIO->writeOnce(pTest->portName, 0, value, SELFTEST_IO_TIMEOUT, param) != asynSuccess)
+        fail(pTest, "unable to write %s=%g", param, value);
+}
+
+/** Waits until an integer parameter has a value.
+ * \return 0 if it has, -1 on timeout. */
+static int waitInt(SelfTest *pTest, const char *param, int value, double timeout)
+{
+    epicsTimeStamp start, now;
+
+    epicsTimeGetCurrent(&start);
+    do {
+        if (getInt(pTest, param) == value) return 0;
+        epicsThreadSleep(0.01);
+        epicsTimeGetCurrent(&now);
+    } while (epicsTimeDiffInSeconds(&now, &start) < timeout);
+    return -1;
+}
+
+/** Waits until a counter reaches a value.
+ * \return 0 if it does, -1 on timeout. */
+static int waitCount(SelfTest *pTest, const char *param, int count, double timeout)
+{
+    epicsTimeStamp start, now;
+
+    epicsTimeGetCurrent(&start);
+    do {
+        if (getInt(pTest, param) >= count) return 0;
+        epicsThreadSleep(0.01);
+        epicsTimeGetCurrent(&now);
+    } while (epicsTimeDiffInSeconds(&now, &start) < timeout);
+    return -1;
+}
+
+/** Waits until frames more frames are published.
+ * \return 0 if they are, -1 on timeout. */
+static int waitFrames(SelfTest *pTest, int frames, double timeout)
+{
+    epicsTimeStamp start, now;
+    int first = getInt(pTest, NDArrayCounterString);
+
+    epicsTimeGetCurrent(&start);
+    do {
+        if (getInt(pTest, NDArrayCounterString) >= first + frames) return 0;
+        epicsThreadSleep(0.01);
+        epicsTimeGetCurrent(&now);
+    } while (epicsTimeDiffInSeconds(&now, &start) < timeout);
+    return -1;
+}
+
+/** Adds a simulated camera and a driver for it, and waits until the camera is ready.
+ * \param[in] maxMemory The memory limit of the NDArrayPool in bytes, 0 for none.
+ * \param[in] dataDepth The significant bits of the 16-bit samples, 0 for 16.
+ * \param[in] sentAlign Where the camera sends them, as FDC_SENT_ALIGN.
+ * \return 0 if it is, -1 if not. */
+static int startCamera(SelfTest *pTest, const char *camid, double frameRate, int dmaBuffers, size_t maxMemory,
+                       int dataDepth, int sentAlign)
+{
+    if (WinFDC_SimCamera(camid, 0, 0, frameRate, -1, 0, dataDepth, sentAlign) != 0) {
+        fail(pTest, "unable to add the simulated camera %s", camid);
+        return -1;
+    }
+    WinFDC_Config(pTest->portName, camid, -1, maxMemory, 0, 0, dmaBuffers);
+    if (waitInt(pTest, "FDC_INIT_STATE", SELFTEST_INIT_READY, SELFTEST_INIT_TIMEOUT)) {
+        fail(pTest, "camera %s not ready", camid);
+        return -1;
+    }
+    /* The shutter of a simulated camera starts at half its range, 5 s, which would set the frame
+     * timeout and the expected frame rate; a short one leaves them to the video mode */
+    putDouble(pTest, ADAcquireTimeString, SELFTEST_EXPOSURE);
+    return pTest->failed ? -1 : 0;
+}
+
+/** Stops acquisition and waits until the driver is idle */
+static void stopAcquire(SelfTest *pTest)
+{
+    putInt(pTest, ADAcquireString, 0);
+    if (waitInt(pTest, ADStatusString, ADStatusIdle, SELFTEST_FRAMES_TIMEOUT))
+        fail(pTest, "acquisition did not stop");
+}
+
+/** A change made while acquiring and the frame size it gives */
+typedef struct {
+    const char *param;
+    int value;
+    int sizeX, sizeY;
+} ReconfigStep;
+
+/* The simulated camera is 1280x960 and starts in Format 0 mode 5, 640x480 Mono8 */
+static const ReconfigStep reconfigSteps[] = {
+    {"FDC_MODE",        1,  320, 240},      /* Format 0 mode 1, 320x240 YUV422 */
+    {"FDC_FRAMERATE",   3,  320, 240},      /* 15 fps */
+    {"FDC_FORMAT",      1,  800, 600},      /* Format 1 keeps mode 1, 800x600 RGB8 */
+    {"FDC_FORMAT",      7,  640, 480},      /* Format 7 keeps mode 1, binned 2x2 */
+    {"FDC_MODE",        0,  640, 480},      /* Format 7 mode 0, the ROI is kept */
+    {ADSizeXString,  1024, 1024, 480},
+    {ADSizeYString,   768, 1024, 768},
+    {"FDC_FORMAT",      0,  160, 120}       /* Format 0 mode 0, 160x120 YUV444 */
+};
+
+static void checkReconfig(SelfTest *pTest)
+{
+    int numSteps = sizeof(reconfigSteps) / sizeof(reconfigSteps[0]);
+    const ReconfigStep *pStep;
+    double gap;
+    int step;
+
+    if (startCamera(pTest, "0x0000fdc0005e0001", 0., 0, 0, 0, 0)) return;
+    /* The Format 7 ROI the camera is given when Format 7 is selected */
+    putInt(pTest, ADMinXString, 0);
+    putInt(pTest, ADMinYString, 0);
+    putInt(pTest, ADSizeXString, 640);
+    putInt(pTest, ADSizeYString, 480);
+    putInt(pTest, "FDC_COLORCODE", 0);
+    putInt(pTest, ADImageModeString, ADImageContinuous);
+    putInt(pTest, ADAcquireString, 1);
+    if (waitFrames(pTest, SELFTEST_FRAMES, SELFTEST_FRAMES_TIMEOUT)) {
+        fail(pTest, "no frames before the first change");
+        stopAcquire(pTest);
+        return;
+    }
+    for (step=0; (step<numSteps) && !pTest->failed; step++) {
+        pStep = &reconfigSteps[step];
+        putInt(pTest, pStep->param, pStep->value);
+        if (waitFrames(pTest, SELFTEST_FRAMES, SELFTEST_FRAMES_TIMEOUT)) {
+            fail(pTest, "no frames after %s=%d", pStep->param, pStep->value);
+            break;
+        }
+        if (getInt(pTest, ADAcquireString) != 1) {
+            fail(pTest, "acquisition stopped by %s=%d", pStep->param, pStep->value);
+        }
+        if ((getInt(pTest, NDArraySizeXString) != pStep->sizeX) ||
+            (getInt(pTest, NDArraySizeYString) != pStep->sizeY)) {
+            fail(pTest, "frames of %dx%d after %s=%d, expected %dx%d",
+                getInt(pTest, NDArraySizeXString), getInt(pTest, NDArraySizeYString),
+                pStep->param, pStep->value, pStep->sizeX, pStep->sizeY);
+        }
+        gap = getDouble(pTest, "FDC_RECONFIG_GAP");
+        if ((gap <= 0.) || (gap > SELFTEST_MAX_GAP)) {
+            fail(pTest, "gap of %g s after %s=%d", gap, pStep->param, pStep->value);
+        }
+    }
+    stopAcquire(pTest);
+}
+
+/** Acquires numImages frames in multiple mode and waits until acquisition is done.
+ * \return 0 if it is, -1 on timeout. */
+static int acquireFrames(SelfTest *pTest, int numImages, double timeout)
+{
+    putInt(pTest, ADImageModeString, ADImageMultiple);
+    putInt(pTest, ADNumImagesString, numImages);
+    putInt(pTest, ADAcquireString, 1);
+    if (waitInt(pTest, ADAcquireString, 0, timeout) ||
+        waitInt(pTest, ADStatusString, ADStatusIdle, SELFTEST_FRAMES_TIMEOUT)) {
+        fail(pTest, "%d frames not acquired in %g s", numImages, timeout);
+        stopAcquire(pTest);
+        return -1;
+    }
+    return 0;
+}
+
+/** Checks that an integer parameter has a value */
+static void checkInt(SelfTest *pTest, const char *param, int expected)
+{
+    int value = getInt(pTest, param);
+
+    if (value != expected) fail(pTest, "%s is %d, expected %d", param, value, expected);
+}
+
+/** Checks that a counter has changed by delta since it was read as before */
+static void checkDelta(SelfTest *pTest, const char *param, int before, int delta)
+{
+    int value = getInt(pTest, param);
+
+    if (value - before != delta) fail(pTest, "%s went from %d to %d, expected +%d", param, before, value, delta);
+}
+
+/** The watchdog counters, read before a fault so that what it did can be checked */
+typedef struct {
+    int retries, restarts, reinits, reconnects;
+} WatchdogCounts;
+
+static void getWatchdogCounts(SelfTest *pTest, WatchdogCounts *pCounts)
+{
+    pCounts->retries    = getInt(pTest, "FDC_WD_RETRIES");
+    pCounts->restarts   = getInt(pTest, "FDC_WD_RESTARTS");
+    pCounts->reinits    = getInt(pTest, "FDC_WD_REINITS");
+    pCounts->reconnects = getInt(pTest, "FDC_WD_RECONNECTS");
+}
+
+static void checkWatchdogCounts(SelfTest *pTest, const WatchdogCounts *pBefore, int retries, int restarts,
+                                int reinits, int reconnects)
+{
+    checkDelta(pTest, "FDC_WD_RETRIES",    pBefore->retries,    retries);
+    checkDelta(pTest, "FDC_WD_RESTARTS",   pBefore->restarts,   restarts);
+    checkDelta(pTest, "FDC_WD_REINITS",    pBefore->reinits,    reinits);
+    checkDelta(pTest, "FDC_WD_RECONNECTS", pBefore->reconnects, reconnects);
+}
+
+#define FAULTS_CAMERA "0x0000fdc0005e0002"
+#define FAULTS_SEED 1234
+/** Frame rate of the simulated camera, in frames per second */
+#define FAULTS_FRAME_RATE 100.
+/** Frames acquired with the schedule below, and the longest wait for them in seconds */
+#define FAULTS_FRAMES 200
+#define FAULTS_FRAMES_TIMEOUT 20.0
+/** Each rule fires on 4 of the about 204 calls it takes to get FAULTS_FRAMES frames: the errors on
+ * calls 20, 70, 120 and 170, the drops of 2 frames on calls 30, 80, 130 and 180, and the corrupted
+ * frames on calls 40, 90, 140 and 190 */
+#define FAULTS_SCHEDULE "acqerr@20+50;drop=2@30+50;corrupt=1@40+50"
+#define FAULTS_ERRORS 4
+#define FAULTS_INJECTED 12
+#define FAULTS_DROPPED 8
+/** The camera leaves the bus on call 20 for FAULTS_LINK_DOWN seconds, and is looked for until it is back */
+#define FAULTS_LINK_SCHEDULE "linkloss=5@20"
+#define FAULTS_LINK_DOWN 5.0
+#define FAULTS_RECONNECT_TIMEOUT 20.0
+
+static void checkFaults(SelfTest *pTest)
+{
+    WatchdogCounts before;
+    int dropped;
+
+    /* The schedule must be set before the camera is opened */
+    if (WinFDC_FaultInject(FAULTS_CAMERA, FAULTS_SCHEDULE, FAULTS_SEED) != 0) {
+        fail(pTest, "unable to set the fault schedule");
+        return;
+    }
+    if (startCamera(pTest, FAULTS_CAMERA, FAULTS_FRAME_RATE, 0, 0, 0, 0)) return;
+    putInt(pTest, "FDC_WD_ENABLE", 1);
+    putInt(pTest, "FDC_DRAIN_POLICY", SELFTEST_DRAIN_LATEST);
+
+    /* Errors, drops and corrupted frames: the errors are retried, the drops are counted as
+     * skipped to the newest frame in latest-only mode, and all the frames asked for arrive */
+    getWatchdogCounts(pTest, &before);
+    if (acquireFrames(pTest, FAULTS_FRAMES, FAULTS_FRAMES_TIMEOUT)) return;
+    checkInt(pTest, "FDC_FRAMES_CAPTURED", FAULTS_FRAMES);
+    checkInt(pTest, "FDC_FAULTS_INJECTED", FAULTS_INJECTED);
+    checkWatchdogCounts(pTest, &before, FAULTS_ERRORS, 0, 0, 0);
+    dropped = getInt(pTest, "FDC_DROPPED_FRAMES");
+    if (dropped < FAULTS_DROPPED) fail(pTest, "%d frames dropped, expected at least %d", dropped, FAULTS_DROPPED);
+    checkInt(pTest, "FDC_DROPPED_STALE", dropped);
+    checkInt(pTest, "FDC_DROPPED_OVERRUN", 0);
+    if (pTest->failed) return;
+
+    /* A link loss: the retries and the restart fail while the camera is off the bus, so it is
+     * re-initialized, given up and looked for, and acquisition goes on once it is back */
+    if (WinFDC_FaultInject(FAULTS_CAMERA, FAULTS_LINK_SCHEDULE, FAULTS_SEED) != 0) {
+        fail(pTest, "unable to set the link loss schedule");
+        return;
+    }
+    getWatchdogCounts(pTest, &before);
+    putInt(pTest, ADImageModeString, ADImageContinuous);
+    putInt(pTest, ADAcquireString, 1);
+    if (waitInt(pTest, "FDC_WD_RECONNECTS", before.reconnects + 1, FAULTS_RECONNECT_TIMEOUT)) {
+        fail(pTest, "camera not reconnected %g s after a link loss of %g s", FAULTS_RECONNECT_TIMEOUT,
+            FAULTS_LINK_DOWN);
+    } else if (waitFrames(pTest, SELFTEST_FRAMES, SELFTEST_FRAMES_TIMEOUT)) {
+        fail(pTest, "no frames after the camera was reconnected");
+    } else if (getInt(pTest, ADAcquireString) != 1) {
+        fail(pTest, "acquisition stopped by the link loss");
+    }
+    checkInt(pTest, "FDC_FAULTS_INJECTED", 1);
+    checkWatchdogCounts(pTest, &before, SELFTEST_WD_RETRIES, 1, 1, 1);
+    stopAcquire(pTest);
+}
+
+/** A stall of the grab thread under a drain policy, and the drops it gives */
+typedef struct {
+    int policy;
+    const char *schedule;
+    int faults;
+    int minStale, minOverrun;       /**< -1 if no frame may be dropped that way */
+} DrainPhase;
+
+#define DRAIN_CAMERA "0x0000fdc0005e0003"
+#define DRAIN_FRAME_RATE 100.
+#define DRAIN_DMA_DEPTH 16
+#define DRAIN_FRAMES 200
+#define DRAIN_FRAMES_TIMEOUT 20.0
+
+/* Stalls of 0.1 s on calls 20, 60, 100, 140 and 180 queue 10 frames each, which the ring of 16 holds,
+ * and a stall of 0.5 s queues 50, which overflow it */
+static const DrainPhase drainPhases[] = {
+    {SELFTEST_DRAIN_LATEST,   "delay=0.1@20+40", 5, 25, -1},    /* about 9 frames skipped per stall */
+    {SELFTEST_DRAIN_LOSSLESS, "delay=0.1@20+40", 5, -1, -1},    /* every queued frame is drained */
+    {SELFTEST_DRAIN_LOSSLESS, "delay=0.5@20",    1, -1, 20}     /* about 34 frames lost */
+};
+
+/** Checks a drop counter against its lower limit, -1 if it must be 0 */
+static void checkDropped(SelfTest *pTest, const char *param, int minimum, const char *schedule)
+{
+    int value = getInt(pTest, param);
+
+    if ((minimum < 0) && (value != 0))
+        fail(pTest, "%s is %d with %s, expected 0", param, value, schedule);
+    else if (value < minimum)
+        fail(pTest, "%s is %d with %s, expected at least %d", param, value, schedule, minimum);
+}
+
+static void checkDrain(SelfTest *pTest)
+{
+    int numPhases = sizeof(drainPhases) / sizeof(drainPhases[0]);
+    const DrainPhase *pPhase;
+    int phase;
+
+    if (WinFDC_FaultInject(DRAIN_CAMERA, drainPhases[0].schedule, 0) != 0) {
+        fail(pTest, "unable to set the fault schedule");
+        return;
+    }
+    if (startCamera(pTest, DRAIN_CAMERA, DRAIN_FRAME_RATE, DRAIN_DMA_DEPTH, 0, 0, 0)) return;
+    for (phase=0; (phase<numPhases) && !pTest->failed; phase++) {
+        pPhase = &drainPhases[phase];
+        /* Setting the schedule again restarts its call counts */
+        if (WinFDC_FaultInject(DRAIN_CAMERA, pPhase->schedule, 0) != 0) {
+            fail(pTest, "unable to set the fault schedule %s", pPhase->schedule);
+            return;
+        }
+        putInt(pTest, "FDC_DRAIN_POLICY", pPhase->policy);
+        /* Also resets the stale and overrun counts */
+        putInt(pTest, "FDC_DROPPED_FRAMES", 0);
+        if (acquireFrames(pTest, DRAIN_FRAMES, DRAIN_FRAMES_TIMEOUT)) return;
+        checkInt(pTest, "FDC_FRAMES_CAPTURED", DRAIN_FRAMES);
+        checkInt(pTest, "FDC_FAULTS_INJECTED", pPhase->faults);
+        checkDropped(pTest, "FDC_DROPPED_STALE", pPhase->minStale, pPhase->schedule);
+        checkDropped(pTest, "FDC_DROPPED_OVERRUN", pPhase->minOverrun, pPhase->schedule);
+        checkInt(pTest, "FDC_DROPPED_FRAMES",
+            getInt(pTest, "FDC_DROPPED_STALE") + getInt(pTest, "FDC_DROPPED_OVERRUN"));
+    }
+}
+
+#define PACKET_CAMERA "0x0000fdc0005e0004"
+/** A 640x480 Mono8 frame of 307200 bytes in an acquire period of 0.1 s, 800 bus cycles, takes
+ * packets of 384 bytes, a multiple of the unit of 8 bytes */
+#define PACKET_PERIOD 0.1
+#define PACKET_SIZE 384
+#define PACKET_PACKETS 800
+/** Time acquired for, in seconds, and the error accepted on the frame rate, as a fraction */
+#define PACKET_ACQUIRE_TIME 2.5
+#define PACKET_RATE_ERROR 0.2
+
+static void checkPacket(SelfTest *pTest)
+{
+    double fps, rate;
+
+    if (startCamera(pTest, PACKET_CAMERA, 0., 0, 0, 0, 0)) return;
+    /* Format 7 mode 0 is selected from Format 0 mode 0 with the ROI and color code set before */
+    putInt(pTest, "FDC_MODE", 0);
+    putInt(pTest, ADMinXString, 0);
+    putInt(pTest, ADMinYString, 0);
+    putInt(pTest, ADSizeXString, 640);
+    putInt(pTest, ADSizeYString, 480);
+    putInt(pTest, "FDC_COLORCODE", 0);
+    putInt(pTest, "FDC_FORMAT", 7);
+    putInt(pTest, "FDC_PACKET_MODE", SELFTEST_PACKET_PLANNED);
+    putDouble(pTest, ADAcquirePeriodString, PACKET_PERIOD);
+    checkInt(pTest, "FDC_PACKET_SIZE", PACKET_SIZE);
+    checkInt(pTest, "FDC_PACKETS_PER_FRAME", PACKET_PACKETS);
+    checkInt(pTest, "FDC_PACKET_LIMITED", 0);
+    fps = getDouble(pTest, "FDC_PREDICTED_FPS");
+    if ((fps < (1. - PACKET_RATE_ERROR) / PACKET_PERIOD) || (fps > (1. + PACKET_RATE_ERROR) / PACKET_PERIOD))
+        fail(pTest, "predicted frame rate %g fps, expected %g fps", fps, 1. / PACKET_PERIOD);
+    if (pTest->failed) return;
+
+    /* The stream runs at the planned rate */
+    putInt(pTest, ADImageModeString, ADImageContinuous);
+    putInt(pTest, ADAcquireString, 1);
+    epicsThreadSleep(PACKET_ACQUIRE_TIME);
+    rate = getDouble(pTest, "FDC_CAPTURE_RATE");
+    checkInt(pTest, "FDC_PACKET_SIZE", PACKET_SIZE);
+    stopAcquire(pTest);
+    if ((rate < (1. - PACKET_RATE_ERROR) / PACKET_PERIOD) || (rate > (1. + PACKET_RATE_ERROR) / PACKET_PERIOD))
+        fail(pTest, "capture rate %g fps, expected %g fps", rate, 1. / PACKET_PERIOD);
+}
+
+/** Number of arrays held by the plugin of the pool check */
+#define POOL_HELD 4
+/** The pool has room for the 4 held arrays of 307200 bytes, 640x480 Mono8, and one more, but not
+ * for them and one array of 786432 bytes, 1024x768 Mono8 */
+#define POOL_MAX_MEMORY 1572864
+/** FDCPoolDrop and FDCPoolFreeMemory, see FDCPoolPolicy_t in firewireWinDCAM.cpp */
+#define POOL_DROP 0
+#define POOL_FREE_MEMORY 2
+/** Time frames are counted for after the held arrays are released, in seconds */
+#define POOL_COUNT_TIME 1.0
+
+/** A plugin that holds the arrays it receives until it is told to release them */
+typedef struct {
+    epicsMutexId mutexId;
+    NDArray *pArrays[POOL_HELD];
+    int count;
+    int wanted;                 /**< Arrays held before the others are let go */
+    asynUser *pasynUser;
+    asynInterface *pPointerInterface;
+    void *interruptPvt;
+} ArrayHolder;
+
+/** Receives an array. Called from the grab thread with the driver locked. */
+static void holdArray(void *userPvt, asynUser *pasynUser, void *pointer)
+{
+    ArrayHolder *pHolder = (ArrayHolder *)userPvt;
+    NDArray *pArray = (NDArray *)pointer;
+
+    epicsMutexMustLock(pHolder->mutexId);
+    if (pHolder->count < pHolder->wanted) {
+        pArray->reserve();
+        pHolder->pArrays[pHolder->count++] = pArray;
+    }
+    epicsMutexUnlock(pHolder->mutexId);
+}
+
+/** Releases the arrays held, and holds the next ones received
+ * \param[in] wanted The number of arrays to hold next, up to POOL_HELD. */
+static void releaseArrays(ArrayHolder *pHolder, int wanted)
+{
+    int i;
+
+    epicsMutexMustLock(pHolder->mutexId);
+    for (i=0; i<pHolder->count; i++) {
+        if (pHolder->pArrays[i]) pHolder->pArrays[i]->release();
+        pHolder->pArrays[i] = NULL;
+    }
+    pHolder->count = 0;
+    pHolder->wanted = wanted;
+    epicsMutexUnlock(pHolder->mutexId);
+}
+
+/** Receives the arrays of the port of a check as a plugin does
+ * \param[in] wanted The number of arrays to hold first, up to POOL_HELD.
+ * \return 0 on success, -1 if the check failed. */
+static int holdArrays(SelfTest *pTest, ArrayHolder *pHolder, int wanted)
+{
+    asynInterface *pDrvUserInterface;
+    asynGenericPointer *pasynGenericPointer;
+    asynStatus status;
+
+    memset(pHolder, 0, sizeof(*pHolder));
+    pHolder->mutexId = epicsMutexMustCreate();
+    pHolder->wanted = wanted;
+    pHolder->pasynUser = pasynManager->createAsynUser(0, 0);
+    status = pasynManager->connectDevice(pHolder->pasynUser, pTest->portName, 0);
+    if (status == asynSuccess) {
+        pDrvUserInterface = pasynManager->findInterface(pHolder->pasynUser, asynDrvUserType, 1);
+        pHolder->pPointerInterface = pasynManager->findInterface(pHolder->pasynUser, asynGenericPointerType, 1);
+        if (!pDrvUserInterface || !pHolder->pPointerInterface) status = asynError;
+    }
+    if (status == asynSuccess)
+        status = ((asynDrvUser *)pDrvUserInterface->pinterface)->create(pDrvUserInterface->drvPvt,
+                                                                        pHolder->pasynUser,
+                                                                        NDArrayDataString, NULL, NULL);
+    if (status == asynSuccess) {
+        pasynGenericPointer = (asynGenericPointer *)pHolder->pPointerInterface->pinterface;
+        status = pasynGenericPointer->registerInterruptUser(pHolder->pPointerInterface->drvPvt,
+                                                            pHolder->pasynUser, holdArray, pHolder,
+                                                            &pHolder->interruptPvt);
+    }
+    if (status != asynSuccess) {
+        fail(pTest, "unable to receive the arrays of port %s", pTest->portName);
+        pasynManager->freeAsynUser(pHolder->pasynUser);
+        pHolder->pasynUser = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/** Stops receiving arrays and releases the ones held */
+static void stopHolding(ArrayHolder *pHolder)
+{
+    asynGenericPointer *pasynGenericPointer;
+
+    if (!pHolder->pasynUser) return;
+    pasynGenericPointer = (asynGenericPointer *)pHolder->pPointerInterface->pinterface;
+    pasynGenericPointer->cancelInterruptUser(pHolder->pPointerInterface->drvPvt, pHolder->pasynUser,
+                                             pHolder->interruptPvt);
+    pasynManager->freeAsynUser(pHolder->pasynUser);
+    pHolder->pasynUser = NULL;
+    releaseArrays(pHolder, 0);
+}
+
+/** Runs a camera whose frames grow while a plugin holds arrays of the old size, which go back to
+ * the free list once the plugin releases them. Only the policy that frees their memory makes room
+ * for the new frames.
+ * \param[out] pPublished The frames published after the arrays were released.
+ * \param[out] pReclaims The frames that got an array after the free list was freed.
+ * \return 0 on success, -1 if the check failed. */
+static int runPool(SelfTest *pTest, const char *camid, int policy, int *pPublished, int *pReclaims)
+{
+    ArrayHolder holder;
+    int first;
+
+    if (startCamera(pTest, camid, 0., 0, POOL_MAX_MEMORY, 0, 0)) return -1;
+    putInt(pTest, "FDC_POOL_POLICY", policy);
+    if (holdArrays(pTest, &holder, POOL_HELD)) return -1;
+
+    /* The plugin holds POOL_HELD arrays of 640x480 */
+    putInt(pTest, ADImageModeString, ADImageContinuous);
+    putInt(pTest, ADAcquireString, 1);
+    if (waitFrames(pTest, POOL_HELD + SELFTEST_FRAMES, SELFTEST_FRAMES_TIMEOUT))
+        fail(pTest, "no frames of 640x480 with policy %d", policy);
+    stopAcquire(pTest);
+
+    /* Format 1 keeps mode 5, 1024x768 Mono8. The arrays held leave no room for its frames. */
+    putInt(pTest, "FDC_FORMAT", 1);
+    putInt(pTest, ADAcquireString, 1);
+    if (waitCount(pTest, "FDC_POOL_DROPS", 1, SELFTEST_FRAMES_TIMEOUT))
+        fail(pTest, "frames of 1024x768 not dropped with policy %d while the arrays are held", policy);
+
+    /* The arrays released are too small for the frames */
+    releaseArrays(&holder, 0);
+    first = getInt(pTest, NDArrayCounterString);
+    epicsThreadSleep(POOL_COUNT_TIME);
+    *pPublished = getInt(pTest, NDArrayCounterString) - first;
+    *pReclaims = getInt(pTest, "FDC_POOL_RECLAIMS");
+    stopAcquire(pTest);
+    stopHolding(&holder);
+    return pTest->failed ? -1 : 0;
+}
+
+static void checkPool(SelfTest *pTest)
+{
+    const char *portName = pTest->portName;
+    char policyPort[40];
+    int published, reclaims;
+
+    /* A port for each policy */
+    sprintf(policyPort, "%s_DROP", portName);
+    pTest->portName = policyPort;
+    if (runPool(pTest, "0x0000fdc0005e0005", POOL_DROP, &published, &reclaims) == 0) {
+        if (published != 0)
+            fail(pTest, "%d frames published with the Drop policy, the pool should have been full", published);
+    }
+    sprintf(policyPort, "%s_FREE", portName);
+    if (!pTest->failed && (runPool(pTest, "0x0000fdc0005e0006", POOL_FREE_MEMORY, &published, &reclaims) == 0)) {
+        if (published == 0) fail(pTest, "no frames published with the Free memory policy");
+        else if (reclaims < 1) fail(pTest, "FDC_POOL_RECLAIMS is %d with the Free memory policy", reclaims);
+    }
+    pTest->portName = portName;
+}
+
+/** Significant bits of the samples of the cameras of the depth check */
+#define DEPTH_BITS 12
+/** Format 0 mode 6, 640x480 Y16 */
+#define DEPTH_MODE 6
+#define DEPTH_SIZE_X 640
+#define DEPTH_SIZE_Y 480
+
+/** The settings of a frame of the depth check, and what is published */
+typedef struct {
+    int sentAlign;              /**< Where the camera sends the significant bits, as FDC_SENT_ALIGN */
+    int dataBits;               /**< FDC_DATA_BITS */
+    FDCSampleAlign align;       /**< FDC_SAMPLE_ALIGN */
+    int clamp;                  /**< FDC_UNUSED_BITS */
+    int depth;                  /**< FDC_DATA_DEPTH */
+} DepthCase;
+
+static const DepthCase depthCases[] = {
+    {0, 0,  FDCAlignAsSent, 0, DEPTH_BITS},
+    {0, 0,  FDCAlignRight,  0, DEPTH_BITS},
+    {0, 0,  FDCAlignLeft,   0, DEPTH_BITS},
+    {0, 10, FDCAlignRight,  0, 10},
+    {1, 0,  FDCAlignRight,  0, DEPTH_BITS},
+    {1, 0,  FDCAlignRight,  1, DEPTH_BITS},
+    {1, 0,  FDCAlignLeft,   1, DEPTH_BITS}
+};
+
+/** Returns the sample published for a significant value of the simulated camera, see
+ * FDCSimCamera::sentSample(): in the high bits it is followed by the low bits of the column, and
+ * in the low bits every 16th column has the bit above it set.
+ * \param[in] value The significant value, DEPTH_BITS bits.
+ * \param[in] x The column.
+ */
+static int depthSample(const DepthCase *pCase, int value, int x)
+{
+    int unused = 16 - DEPTH_BITS, maxValue = (1 << pCase->depth) - 1;
+    int sent, v;
+
+    if (pCase->sentAlign == 0) sent = (value << unused) | (x & ((1 << unused) - 1));
+    else sent = ((x % 16) == 15) ? value | (1 << DEPTH_BITS) : value;
+    if (pCase->align == FDCAlignAsSent) return sent;
+    if (pCase->sentAlign == 0) v = (sent >> (16 - pCase->depth)) & maxValue;
+    else if (pCase->clamp) v = (sent < maxValue) ? sent : maxValue;
+    else v = sent & maxValue;
+    return (pCase->align == FDCAlignLeft) ? v << (16 - pCase->depth) : v;
+}
+
+/** Checks every sample of a frame of the depth check. The significant value of the Y16 test
+ * pattern at (x,y) is that at (0,0) plus x+2y, which is found from the first 16 samples.
+ */
+static void checkDepthFrame(SelfTest *pTest, const DepthCase *pCase, NDArray *pArray)
+{
+    const epicsUInt16 *pData = (const epicsUInt16 *)pArray->pData;
+    int mask = (1 << DEPTH_BITS) - 1;
+    int first, x, y;
+
+    if ((pArray->ndims != 2) || (pArray->dims[0].size != DEPTH_SIZE_X) ||
+        (pArray->dims[1].size != DEPTH_SIZE_Y) || (pArray->dataType != NDUInt16)) {
+        fail(pTest, "frame is not %dx%d UInt16", DEPTH_SIZE_X, DEPTH_SIZE_Y);
+        return;
+    }
+    for (first=0; first<=mask; first++) {
+        for (x=0; (x<16) && (pData[x] == depthSample(pCase, (first + x) & mask, x)); x++);
+        if (x == 16) break;
+    }
+    if (first > mask) {
+        fail(pTest, "first samples %d %d %d ... not published as expected, SENT_ALIGN=%d DATA_BITS=%d "
+            "SAMPLE_ALIGN=%d UNUSED_BITS=%d", pData[0], pData[1], pData[2], pCase->sentAlign,
+            pCase->dataBits, pCase->align, pCase->clamp);
+        return;
+    }
+    for (y=0; y<DEPTH_SIZE_Y; y++) {
+        for (x=0; x<DEPTH_SIZE_X; x++) {
+            if (pData[y*DEPTH_SIZE_X + x] != depthSample(pCase, (first + x + 2*y) & mask, x)) {
+                fail(pTest, "sample (%d,%d) is %d, expected %d, SENT_ALIGN=%d DATA_BITS=%d SAMPLE_ALIGN=%d "
+                    "UNUSED_BITS=%d", x, y, pData[y*DEPTH_SIZE_X + x], depthSample(pCase, (first + x + 2*y) & mask, x),
+                    pCase->sentAlign, pCase->dataBits, pCase->align, pCase->clamp);
+                return;
+            }
+        }
+    }
+}
+
+/** Takes a frame for each case of a camera and checks it */
+static void runDepth(SelfTest *pTest, const char *camid, int sentAlign)
+{
+    int numCases = sizeof(depthCases) / sizeof(depthCases[0]);
+    const DepthCase *pCase;
+    ArrayHolder holder;
+    int i;
+
+    if (startCamera(pTest, camid, 0., 0, 0, DEPTH_BITS, sentAlign)) return;
+    putInt(pTest, "FDC_MODE", DEPTH_MODE);
+    if (holdArrays(pTest, &holder, 0)) return;
+    for (i=0; (i<numCases) && !pTest->failed; i++) {
+        pCase = &depthCases[i];
+        if (pCase->sentAlign != sentAlign) continue;
+        putInt(pTest, "FDC_SENT_ALIGN", pCase->sentAlign);
+        putInt(pTest, "FDC_DATA_BITS", pCase->dataBits);
+        putInt(pTest, "FDC_SAMPLE_ALIGN", pCase->align);
+        putInt(pTest, "FDC_UNUSED_BITS", pCase->clamp);
+        releaseArrays(&holder, 1);
+        if (acquireFrames(pTest, 1, SELFTEST_FRAMES_TIMEOUT)) break;
+        checkInt(pTest, "FDC_DATA_DEPTH", pCase->depth);
+        epicsMutexMustLock(holder.mutexId);
+        if (holder.count != 1) fail(pTest, "no frame received");
+        else checkDepthFrame(pTest, pCase, holder.pArrays[0]);
+        epicsMutexUnlock(holder.mutexId);
+    }
+    stopHolding(&holder);
+}
+
+static void checkDepth(SelfTest *pTest)
+{
+    const char *portName = pTest->portName;
+    char alignPort[40];
+
+    /* A port for each camera */
+    sprintf(alignPort, "%s_HIGH", portName);
+    pTest->portName = alignPort;
+    runDepth(pTest, "0x0000fdc0005e0007", 0);
+    sprintf(alignPort, "%s_LOW", portName);
+    if (!pTest->failed) runDepth(pTest, "0x0000fdc0005e0008", 1);
+    pTest->portName = portName;
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(SelfTest *pTest);
+} SelfTestCheck;
+
+static const SelfTestCheck checks[] = {
+    {"reconfig", checkReconfig},
+    {"faults",   checkFaults},
+    {"drain",    checkDrain},
+    {"packet",   checkPacket},
+    {"pool",     checkPool},
+    {"depth",    checkDepth}
+};
+
+int main(int argc, char *argv[])
+{
+    int numChecks = sizeof(checks) / sizeof(checks[0]);
+    SelfTest test;
+    char portName[32];
+    int arg, check, run, status = 0;
+
+    for (arg=1; arg<argc; arg++) {
+        for (check=0; (check<numChecks) && strcmp(argv[arg], checks[check].name); check++);
+        if (check == numChecks) {
+            fprintf(stderr, "Usage: %s [check ...], checks:", argv[0]);
+            for (check=0; check<numChecks; check++) fprintf(stderr, " %s", checks[check].name);
+            fprintf(stderr, "\n");
+            return 1;
+        }
+    }
+    for (check=0; check<numChecks; check++) {
+        for (arg=1, run=(argc == 1); (arg<argc) && !run; arg++) run = !strcmp(argv[arg], checks[check].name);
+        if (!run) continue;
+        sprintf(portName, "FDCTEST%d", check + 1);
+        test.name = checks[check].name;
+        test.portName = portName;
+        test.failed = 0;
+        checks[check].run(&test);
+        if (test.failed) status = 1;
+        else printf("%s: OK\n", test.name);
+    }
+    return status;
+}
@@ -0,0 +1,914 @@
+/*
+ * firewireWinDCAMSim.cpp
+ *
+ * Simulated IIDC camera backend. See firewireWinDCAMSim.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsStdio.h>
+
+#include "firewireWinDCAMCamera.h"
+#include "firewireWinDCAMConvert.h"
+#include "firewireWinDCAMEnum.h"
+#include "firewireWinDCAMIso.h"
+#include "firewireWinDCAMSim.h"
+
+/** Isochronous cycles per second and payload per cycle at S400, the most without 1394b mode */
+#define SIM_CYCLES_PER_SECOND 8000
+#define SIM_MAX_BYTES_PER_PACKET 4096
+#define SIM_BYTES_PER_PACKET_UNIT 8
+/** Highest fixed frame rate index (60 fps) */
+#define SIM_MAX_RATE 5
+#define SIM_SIZE_UNIT_X 8
+#define SIM_SIZE_UNIT_Y 2
+#define SIM_FEATURE_MAX 1023
+/** Frames are handed out as sub-buffers of this size, like large frames by the CMU library */
+#define SIM_SUB_BUFFER_SIZE 65536
+/** IIDC 1.31 */
+#define SIM_VERSION 0x131
+
+/** A registered simulated camera */
+typedef struct {
+    unsigned long long guid;
+    unsigned short maxSizeX, maxSizeY;
+    double frameRate;       /**< >0 overrides the frame rate of the video mode, <0 delivers frames as fast as they are read */
+    int bus;                /**< Bus the camera is counted on by the bandwidth manager */
+    int speed;              /**< Link speed in Mb/s; above 400 the camera has 1394b mode */
+    int dataDepth;          /**< Significant bits of the 16-bit samples */
+    int sentLow;            /**< The significant bits are sent in the low bits rather than the high bits */
+} SimConfig;
+
+static SimConfig simCameras[FDC_SIM_MAX_CAMERAS];
+static int numSimCameras;
+/** The cycle timers of the simulated buses start when the first camera is added, each bus a few
+ * seconds from the others so that times from different buses do not agree */
+static epicsTimeStamp simBusEpoch;
+
+/** Frame sizes of the fixed video modes */
+static const unsigned short fixedSizes[3][8][2] = {
+    {{160, 120}, {320, 240}, {640, 480}, {640, 480}, {640, 480}, {640, 480}, {640, 480}, {0, 0}},
+    {{800, 600}, {800, 600}, {800, 600}, {1024, 768}, {1024, 768}, {1024, 768}, {800, 600}, {1024, 768}},
+    {{1280, 960}, {1280, 960}, {1280, 960}, {1600, 1200}, {1600, 1200}, {1600, 1200}, {1280, 960}, {1600, 1200}}
+};
+
+/** Features a simulated camera has, with the range of their absolute values (absMax=0 for none) */
+static const struct {
+    FDCFeature feature;
+    const char *name;
+    const char *units;
+    float absMin, absMax;
+} simFeatures[] = {
+    {FDC_FEATURE_BRIGHTNESS,    "Brightness",    "%",    0.0f,     100.0f},
+    {FDC_FEATURE_AUTO_EXPOSURE, "Auto Exposure", "EV",  -7.0f,     7.0f},
+    {FDC_FEATURE_SHARPNESS,     "Sharpness",     "",     0.0f,     0.0f},
+    {FDC_FEATURE_WHITE_BALANCE, "White Balance", "K",    0.0f,     0.0f},
+    {FDC_FEATURE_GAMMA,         "Gamma",         "",     0.5f,     4.0f},
+    {FDC_FEATURE_SHUTTER,       "Shutter",       "s",    0.00001f, 10.0f},
+    {FDC_FEATURE_GAIN,          "Gain",          "dB",   0.0f,     24.0f},
+    {FDC_FEATURE_FRAME_RATE,    "Frame Rate",    "fps",  1.0f,     240.0f}
+};
+static const int numSimFeatures = sizeof(simFeatures) / sizeof(simFeatures[0]);
+
+static bool isSixteenBit(FDCColorCode code)
+{
+    return (code == FDC_COLOR_CODE_Y16) || (code == FDC_COLOR_CODE_Y16_SIGNED) ||
+           (code == FDC_COLOR_CODE_RAW16) || (code == FDC_COLOR_CODE_RGB16) ||
+           (code == FDC_COLOR_CODE_RGB16_SIGNED);
+}
+
+class FDCSimControl : public FDCCameraControl
+{
+public:
+    FDCSimControl(int index)
+        : index(index), present(index >= 0), absControl(0), autoMode(0), value(SIM_FEATURE_MAX / 2) {}
+
+    int  Inquire()                  { return FDC_CAM_SUCCESS; }
+    bool HasPresence()              { return present; }
+    bool HasAbsControl()            { return present && (simFeatures[index].absMax > simFeatures[index].absMin); }
+    bool HasOnePush()               { return false; }
+    bool HasReadout()               { return present; }
+    bool HasOnOff()                 { return false; }
+    bool HasAutoMode()              { return present; }
+    bool HasManualMode()            { return present; }
+    void GetRange(unsigned short *min, unsigned short *max)
+    {
+        *min = 0;
+        *max = present ? SIM_FEATURE_MAX : 0;
+    }
+    void GetRangeAbsolute(float *fmin, float *fmax)
+    {
+        *fmin = HasAbsControl() ? simFeatures[index].absMin : 0.0f;
+        *fmax = HasAbsControl() ? simFeatures[index].absMax : 0.0f;
+    }
+    int  Status()                   { return FDC_CAM_SUCCESS; }
+    bool StatusAbsControl()         { return absControl ? true : false; }
+    bool StatusOnOff()              { return present; }
+    bool StatusOnePush()            { return false; }
+    bool StatusAutoMode()           { return autoMode ? true : false; }
+    void GetValue(unsigned short *v_lo, unsigned short *v_hi)
+    {
+        *v_lo = value;
+        if (v_hi) *v_hi = value;
+    }
+    void GetValueAbsolute(float *f)
+    {
+        float fmin, fmax;
+
+        GetRangeAbsolute(&fmin, &fmax);
+        *f = fmin + (fmax - fmin) * value / SIM_FEATURE_MAX;
+    }
+    int  SetAbsControl(int on)
+    {
+        if (on && !HasAbsControl()) return FDC_CAM_ERROR_UNSUPPORTED;
+        absControl = on;
+        return FDC_CAM_SUCCESS;
+    }
+    int  SetAutoMode(int on)
+    {
+        if (!present) return FDC_CAM_ERROR_UNSUPPORTED;
+        autoMode = on;
+        return FDC_CAM_SUCCESS;
+    }
+    int  SetValue(unsigned short v_lo, unsigned short v_hi)
+    {
+        if (!present) return FDC_CAM_ERROR_UNSUPPORTED;
+        if (v_lo > SIM_FEATURE_MAX) return FDC_CAM_ERROR_PARAM_OUT_OF_RANGE;
+        value = v_lo;
+        return FDC_CAM_SUCCESS;
+    }
+    int  SetValueAbsolute(float f)
+    {
+        float fmin, fmax;
+
+        if (!HasAbsControl()) return FDC_CAM_ERROR_UNSUPPORTED;
+        GetRangeAbsolute(&fmin, &fmax);
+        if ((f < fmin) || (f > fmax)) return FDC_CAM_ERROR_PARAM_OUT_OF_RANGE;
+        /* The camera only has integer steps, like a real one */
+        value = (unsigned short)((f - fmin) / (fmax - fmin) * SIM_FEATURE_MAX + 0.5f);
+        return FDC_CAM_SUCCESS;
+    }
+    const char *GetName()           { return present ? simFeatures[index].name : "Unsupported"; }
+    const char *GetUnits()          { return present ? simFeatures[index].units : ""; }
+
+private:
+    int index;
+    bool present;
+    int absControl;
+    int autoMode;
+    unsigned short value;
+};
+
+class FDCSimCamera;
+
+/** The Format 7 settings of one mode */
+typedef struct {
+    unsigned short sizeX, sizeY;
+    unsigned short left, top;
+    FDCColorCode colorCode;
+    unsigned short bytesPerPacket;
+} SimFormat7Mode;
+
+class FDCSimControlSize : public FDCCameraControlSize
+{
+public:
+    FDCSimControlSize(FDCSimCamera *pCamera) : pCamera(pCamera) {}
+
+    void GetSizeLimits(unsigned short *hMax, unsigned short *vMax);
+    void GetSizeUnits(unsigned short *hUnit, unsigned short *vUnit)
+    {
+        *hUnit = SIM_SIZE_UNIT_X;
+        *vUnit = SIM_SIZE_UNIT_Y;
+    }
+    void GetSize(unsigned short *width, unsigned short *height);
+    int  SetSize(unsigned short width, unsigned short height);
+    void GetPosLimits(unsigned short *hMax, unsigned short *vMax);
+    void GetPosUnits(unsigned short *hUnit, unsigned short *vUnit)
+    {
+        *hUnit = SIM_SIZE_UNIT_X;
+        *vUnit = SIM_SIZE_UNIT_Y;
+    }
+    void GetPos(unsigned short *left, unsigned short *top);
+    int  SetPos(unsigned short left, unsigned short top);
+    bool HasColorCode(FDCColorCode code);
+    void GetColorCode(FDCColorCode *code);
+    int  SetColorCode(FDCColorCode code);
+    void GetBytesPerPacketRange(unsigned short *min, unsigned short *max);
+    void GetBytesPerPacket(unsigned short *current, unsigned short *recommended);
+    int  SetBytesPerPacket(unsigned short bpp);
+    void GetPacketsPerFrame(unsigned long *ppf);
+    void GetDataDepth(unsigned short *depth);
+    void GetColorFilter(FDCColorFilter *filter)     { *filter = FDC_COLOR_FILTER_RGGB; }
+    void GetFrameInterval(float *interval);
+
+private:
+    FDCSimCamera *pCamera;
+};
+
+class FDCSimCamera : public FDCCamera
+{
+public:
+    FDCSimCamera(const SimConfig *pConfig);
+    ~FDCSimCamera();
+
+    int  InitCamera(int reset);
+    void GetCameraName(char *buf, int len)
+    {
+        epicsSnprintf(buf, len, "DCAM simulator %ux%u", config.maxSizeX, config.maxSizeY);
+    }
+    void GetCameraVendor(char *buf, int len)    { epicsSnprintf(buf, len, "Simulated"); }
+    void GetCameraUniqueID(unsigned long long *pGuid)   { *pGuid = config.guid; }
+    unsigned long GetVersion()      { return SIM_VERSION; }
+    int  GetMaxSpeed()              { return config.speed; }
+    bool Has1394b()                 { return config.speed > 400; }
+    bool Status1394b()              { return mode1394b != 0; }
+    int  Set1394b(bool on);
+
+    bool HasVideoFormat(unsigned long format);
+    int  SetVideoFormat(unsigned long format);
+    int  GetVideoFormat()           { return format; }
+    bool HasVideoMode(unsigned long format, unsigned long mode);
+    int  SetVideoMode(unsigned long mode);
+    int  GetVideoMode()             { return mode; }
+    bool HasVideoFrameRate(unsigned long format, unsigned long mode, unsigned long rate);
+    int  SetVideoFrameRate(unsigned long rate);
+    int  GetVideoFrameRate()        { return rate; }
+    void GetVideoFrameDimensions(unsigned long *pWidth, unsigned long *pHeight);
+    void GetVideoDataDepth(unsigned short *depth);
+    bool HasOneShot()               { return true; }
+    bool HasMultiShot()             { return true; }
+
+    int  StartImageAcquisitionEx(int nBuffers, int frameTimeout, int flags);
+    int  AcquireImageEx(int dropStaleFrames, int *pDroppedFrames);
+    int  StopImageAcquisition();
+    double GetFrameWait();
+    int  GetFrameCycleTime(unsigned long *pCycleTime);
+    unsigned char *GetRawData(unsigned long *pLength)
+    {
+        *pLength = frameBytes;
+        return pFrame;
+    }
+    int  getRGB(unsigned char *pBitmap, unsigned long length);
+    int  GetRawSegments(FDCSegment *pSegments, int maxSegments);
+
+    FDCCameraControl *GetCameraControl(FDCFeature feature);
+    FDCCameraControlSize *GetCameraControlSize()    { return &controlSize; }
+
+    /* Used by FDCSimControlSize */
+    void getFormat7Limits(int f7mode, unsigned short *hMax, unsigned short *vMax);
+    double getFrameInterval();
+    unsigned long getPacketsPerFrame();
+    unsigned short getMaxBytesPerPacket();
+
+    SimConfig config;
+    SimFormat7Mode format7[2];
+    int format, mode, rate;
+    int acquiring;
+    int mode1394b;
+
+private:
+    void getGeometry(unsigned long *pWidth, unsigned long *pHeight, FDCColorCode *pCode);
+    unsigned int sentSample(unsigned int v, unsigned long sx);
+    void fillFrame(unsigned long frame);
+
+    FDCSimControlSize controlSize;
+    FDCSimControl *controls[FDC_FEATURE_NUM_FEATURES];
+    unsigned char *pFrame;
+    unsigned long frameBytes;
+    unsigned long width, height;
+    FDCColorCode colorCode;
+    unsigned short left, top;
+    int nBuffers;
+    int frameTimeout;
+    double interval;
+    epicsTimeStamp startTime;
+    unsigned long nextFrame;
+    unsigned long frameCycleTime;
+};
+
+FDCSimCamera::FDCSimCamera(const SimConfig *pConfig)
+    : config(*pConfig), format(0), mode(0), rate(0), acquiring(0), mode1394b(0), controlSize(this),
+      pFrame(NULL), frameBytes(0), width(0), height(0), colorCode(FDC_COLOR_CODE_Y8),
+      left(0), top(0), nBuffers(0), frameTimeout(0), interval(0.0), nextFrame(0),
+      frameCycleTime(0)
+{
+    memset(controls, 0, sizeof(controls));
+    InitCamera(1);
+}
+
+FDCSimCamera::~FDCSimCamera()
+{
+    int i;
+
+    for (i=0; i<FDC_FEATURE_NUM_FEATURES; i++) delete controls[i];
+    free(pFrame);
+}
+
+/** Resets the camera to 640x480 Mono8 at 30 fps, or the largest rate that fits */
+int FDCSimCamera::InitCamera(int reset)
+{
+    int i;
+
+    if (acquiring) return FDC_CAM_ERROR_BUSY;
+    if (!reset) return FDC_CAM_SUCCESS;
+    /* Like a real camera it comes out of reset in legacy mode */
+    mode1394b = 0;
+    for (i=0; i<2; i++) {
+        getFormat7Limits(i, &format7[i].sizeX, &format7[i].sizeY);
+        format7[i].left = 0;
+        format7[i].top = 0;
+        format7[i].colorCode = FDC_COLOR_CODE_Y8;
+        format7[i].bytesPerPacket = SIM_MAX_BYTES_PER_PACKET;
+    }
+    format = 0;
+    mode = 5;
+    for (rate=4; (rate>0) && !HasVideoFrameRate(format, mode, rate); rate--);
+    return FDC_CAM_SUCCESS;
+}
+
+void FDCSimCamera::getFormat7Limits(int f7mode, unsigned short *hMax, unsigned short *vMax)
+{
+    int bin = (f7mode == 1) ? 2 : 1;
+
+    *hMax = (unsigned short)(config.maxSizeX / bin / SIM_SIZE_UNIT_X * SIM_SIZE_UNIT_X);
+    *vMax = (unsigned short)(config.maxSizeY / bin / SIM_SIZE_UNIT_Y * SIM_SIZE_UNIT_Y);
+}
+
+bool FDCSimCamera::HasVideoFormat(unsigned long format)
+{
+    unsigned long m;
+
+    if (format == 7) return true;
+    if (format > 2) return false;
+    for (m=0; m<8; m++) {
+        if (HasVideoMode(format, m)) return true;
+    }
+    return false;
+}
+
+bool FDCSimCamera::HasVideoMode(unsigned long format, unsigned long mode)
+{
+    FDCColorCode code;
+
+    if (format == 7) return (mode < 2);
+    if ((format > 2) || (mode > 7)) return false;
+    if (fdcColorCodeForMode(format, mode, &code)) return false;
+    return (fixedSizes[format][mode][0] <= config.maxSizeX) && (fixedSizes[format][mode][1] <= config.maxSizeY);
+}
+
+/** A rate is supported if the frames fit in the S400 isochronous bandwidth */
+bool FDCSimCamera::HasVideoFrameRate(unsigned long format, unsigned long mode, unsigned long rate)
+{
+    FDCColorCode code;
+    double bytesPerSecond;
+
+    if ((format > 2) || (rate > SIM_MAX_RATE) || !HasVideoMode(format, mode)) return false;
+    fdcColorCodeForMode(format, mode, &code);
+    bytesPerSecond = fdcFrameBytes(code, fixedSizes[format][mode][0], fixedSizes[format][mode][1]) *
+                     1.875 * (1 << rate);
+    return bytesPerSecond <= (double)SIM_MAX_BYTES_PER_PACKET * SIM_CYCLES_PER_SECOND;
+}
+
+int FDCSimCamera::SetVideoFormat(unsigned long format)
+{
+    unsigned long m;
+
+    if (acquiring) return FDC_CAM_ERROR_BUSY;
+    if (!HasVideoFormat(format)) return FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS;
+    this->format = format;
+    if (!HasVideoMode(format, mode)) {
+        for (m=0; !HasVideoMode(format, m); m++);
+        mode = m;
+    }
+    if ((format != 7) && !HasVideoFrameRate(format, mode, rate)) {
+        for (rate=SIM_MAX_RATE; (rate>0) && !HasVideoFrameRate(format, mode, rate); rate--);
+    }
+    return FDC_CAM_SUCCESS;
+}
+
+int FDCSimCamera::SetVideoMode(unsigned long mode)
+{
+    if (acquiring) return FDC_CAM_ERROR_BUSY;
+    if (!HasVideoMode(format, mode)) return FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS;
+    this->mode = mode;
+    if ((format != 7) && !HasVideoFrameRate(format, mode, rate)) {
+        for (rate=SIM_MAX_RATE; (rate>0) && !HasVideoFrameRate(format, mode, rate); rate--);
+    }
+    return FDC_CAM_SUCCESS;
+}
+
+int FDCSimCamera::SetVideoFrameRate(unsigned long rate)
+{
+    if (acquiring) return FDC_CAM_ERROR_BUSY;
+    if (format == 7) return FDC_CAM_ERROR_UNSUPPORTED;
+    if (!HasVideoFrameRate(format, mode, rate)) return FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS;
+    this->rate = rate;
+    return FDC_CAM_SUCCESS;
+}
+
+void FDCSimCamera::getGeometry(unsigned long *pWidth, unsigned long *pHeight, FDCColorCode *pCode)
+{
+    if (format == 7) {
+        *pWidth = format7[mode].sizeX;
+        *pHeight = format7[mode].sizeY;
+        *pCode = format7[mode].colorCode;
+    } else {
+        *pWidth = fixedSizes[format][mode][0];
+        *pHeight = fixedSizes[format][mode][1];
+        fdcColorCodeForMode(format, mode, pCode);
+    }
+}
+
+void FDCSimCamera::GetVideoFrameDimensions(unsigned long *pWidth, unsigned long *pHeight)
+{
+    FDCColorCode code;
+
+    getGeometry(pWidth, pHeight, &code);
+}
+
+void FDCSimCamera::GetVideoDataDepth(unsigned short *depth)
+{
+    unsigned long w, h;
+    FDCColorCode code;
+
+    getGeometry(&w, &h, &code);
+    *depth = isSixteenBit(code) ? config.dataDepth : 8;
+}
+
+/** Returns the time between frames in seconds, 0 if frames are not paced */
+double FDCSimCamera::getFrameInterval()
+{
+    if (config.frameRate > 0) return 1.0 / config.frameRate;
+    if (config.frameRate < 0) return 0.0;
+    if (format != 7) return 1.0 / (1.875 * (1 << rate));
+    return (double)getPacketsPerFrame() / SIM_CYCLES_PER_SECOND;
+}
+
+/** Returns the number of packets a Format 7 frame is sent in, one per isochronous cycle */
+unsigned long FDCSimCamera::getPacketsPerFrame()
+{
+    unsigned long w, h;
+    FDCColorCode code;
+
+    getGeometry(&w, &h, &code);
+    return (fdcFrameBytes(code, w, h) + format7[mode].bytesPerPacket - 1) / format7[mode].bytesPerPacket;
+}
+
+/** Returns the largest Format 7 packet: what a cycle carries at the link speed in 1394b mode, at S400 otherwise */
+unsigned short FDCSimCamera::getMaxBytesPerPacket()
+{
+    if (!mode1394b) return SIM_MAX_BYTES_PER_PACKET;
+    return (unsigned short)(SIM_MAX_BYTES_PER_PACKET / 400 * config.speed);
+}
+
+int FDCSimCamera::Set1394b(bool on)
+{
+    int i;
+
+    if (acquiring) return FDC_CAM_ERROR_BUSY;
+    if (on && !Has1394b()) return FDC_CAM_ERROR_UNSUPPORTED;
+    mode1394b = on ? 1 : 0;
+    /* Packets that only fit at the faster speed are reduced to the largest legacy packet */
+    for (i=0; i<2; i++) {
+        if (format7[i].bytesPerPacket > getMaxBytesPerPacket()) format7[i].bytesPerPacket = getMaxBytesPerPacket();
+    }
+    return FDC_CAM_SUCCESS;
+}
+
+int FDCSimCamera::StartImageAcquisitionEx(int nBuffers, int frameTimeout, int flags)
+{
+    if (acquiring) return FDC_CAM_ERROR_BUSY;
+    getGeometry(&width, &height, &colorCode);
+    frameBytes = fdcFrameBytes(colorCode, width, height);
+    free(pFrame);
+    pFrame = (unsigned char *)calloc(frameBytes, 1);
+    if (!pFrame) return FDC_CAM_ERROR_INSUFFICIENT_RESOURCES;
+    this->nBuffers = (nBuffers > 0) ? nBuffers : 1;
+    this->frameTimeout = frameTimeout;
+    interval = getFrameInterval();
+    nextFrame = 0;
+    epicsTimeGetCurrent(&startTime);
+    acquiring = 1;
+    return FDC_CAM_SUCCESS;
+}
+
+/** Waits for the next frame.
+ * Frames are produced at fixed times from the start of the acquisition. If the caller falls more
+ * than nBuffers frames behind the oldest frames are lost, as they would be in a DMA ring; with
+ * dropStaleFrames all but the newest frame are skipped.
+ */
+int FDCSimCamera::AcquireImageEx(int dropStaleFrames, int *pDroppedFrames)
+{
+    epicsTimeStamp now;
+    double elapsed, wait;
+    unsigned long available, dropped = 0;
+
+    if (pDroppedFrames) *pDroppedFrames = 0;
+    if (!acquiring) return FDC_CAM_ERROR_NOT_INITIALIZED;
+    if (interval > 0) {
+        epicsTimeGetCurrent(&now);
+        elapsed = epicsTimeDiffInSeconds(&now, &startTime);
+        available = (unsigned long)(elapsed / interval);
+        if (available <= nextFrame) {
+            wait = (nextFrame + 1) * interval - elapsed;
+            if ((frameTimeout > 0) && (wait > frameTimeout / 1000.0)) {
+                epicsThreadSleep(frameTimeout / 1000.0);
+                return FDC_CAM_ERROR_FRAME_TIMEOUT;
+            }
+            epicsThreadSleep(wait);
+            available = nextFrame + 1;
+        }
+        if (dropStaleFrames) {
+            dropped = available - 1 - nextFrame;
+        } else if (available - nextFrame > (unsigned long)nBuffers) {
+            dropped = available - nextFrame - nBuffers;
+        }
+        nextFrame += dropped;
+    }
+    fillFrame(nextFrame);
+    nextFrame++;
+    /* The frame is received at the end of its interval */
+    if (interval > 0) {
+        now = startTime;
+        epicsTimeAddSeconds(&now, nextFrame * interval);
+    } else {
+        epicsTimeGetCurrent(&now);
+    }
+    frameCycleTime = fdcIsoCycleTimeFromSeconds(epicsTimeDiffInSeconds(&now, &simBusEpoch) + config.bus * 10.);
+    if (pDroppedFrames) *pDroppedFrames = (int)dropped;
+    return FDC_CAM_SUCCESS;
+}
+
+int FDCSimCamera::GetFrameCycleTime(unsigned long *pCycleTime)
+{
+    if (config.bus < 0) return FDC_CAM_ERROR_UNSUPPORTED;
+    *pCycleTime = frameCycleTime;
+    return FDC_CAM_SUCCESS;
+}
+
+/** Returns the time until the next frame is due, with the same schedule as AcquireImageEx() */
+double FDCSimCamera::GetFrameWait()
+{
+    epicsTimeStamp now;
+    double wait;
+
+    if (!acquiring || (interval <= 0)) return 0.;
+    epicsTimeGetCurrent(&now);
+    wait = (nextFrame + 1) * interval - epicsTimeDiffInSeconds(&now, &startTime);
+    return (wait > 0.) ? wait : 0.;
+}
+
+int FDCSimCamera::StopImageAcquisition()
+{
+    if (!acquiring) return FDC_CAM_ERROR_NOT_INITIALIZED;
+    acquiring = 0;
+    return FDC_CAM_SUCCESS;
+}
+
+/** Returns a 16-bit sample of the test pattern as the camera sends it. The top dataDepth bits of the
+ * pattern are the significant bits. In the high bits they are followed by bits that count the
+ * columns; in the low bits every 16th column has the bit above them set. These are the unused bits
+ * a camera may leave uncleared, which the driver drops, masks or clamps as told.
+ * \param[in] v The 16-bit pattern.
+ * \param[in] sx The column on the sensor.
+ */
+unsigned int FDCSimCamera::sentSample(unsigned int v, unsigned long sx)
+{
+    int unused = 16 - config.dataDepth;
+
+    v &= 0xffff;
+    if (unused == 0) return v;
+    v >>= unused;
+    if (!config.sentLow) return (v << unused) | (unsigned int)(sx & ((1 << unused) - 1));
+    return ((sx % 16) == 15) ? v | (1 << config.dataDepth) : v;
+}
+
+/** Writes the test pattern of a frame into the frame buffer.
+ * The pattern depends on the frame number and on the position on the sensor, so moving the
+ * Format 7 ROI moves the window over a fixed scene.
+ */
+void FDCSimCamera::fillFrame(unsigned long frame)
+{
+    unsigned char *p = pFrame;
+    unsigned long x, y, sx, sy;
+    unsigned int v;
+    unsigned int shift = (unsigned int)(frame * 4);
+
+    if (format == 7) {
+        left = format7[mode].left;
+        top = format7[mode].top;
+    } else {
+        left = top = 0;
+    }
+    for (y=0; y<height; y++) {
+        sy = y + top;
+        for (x=0; x<width; ) {
+            sx = x + left;
+            switch (colorCode) {
+                case FDC_COLOR_CODE_Y8:
+                case FDC_COLOR_CODE_RAW8:
+                    *p++ = (unsigned char)(sx + sy + shift);
+                    x++;
+                    break;
+                case FDC_COLOR_CODE_Y16:
+                case FDC_COLOR_CODE_Y16_SIGNED:
+                case FDC_COLOR_CODE_RAW16:
+                    v = sentSample((unsigned int)(sx * 16 + sy * 32 + shift * 64), sx);
+                    *p++ = (unsigned char)(v >> 8);
+                    *p++ = (unsigned char)v;
+                    x++;
+                    break;
+                case FDC_COLOR_CODE_RGB8:
+                    *p++ = (unsigned char)(sx + shift);
+                    *p++ = (unsigned char)(sy + shift);
+                    *p++ = (unsigned char)(sx + sy);
+                    x++;
+                    break;
+                case FDC_COLOR_CODE_RGB16:
+                case FDC_COLOR_CODE_RGB16_SIGNED:
+                    v = sentSample((unsigned int)((sx + shift) * 256), sx);
+                    *p++ = (unsigned char)(v >> 8);  *p++ = (unsigned char)v;
+                    v = sentSample((unsigned int)((sy + shift) * 256), sx);
+                    *p++ = (unsigned char)(v >> 8);  *p++ = (unsigned char)v;
+                    v = sentSample((unsigned int)((sx + sy) * 256), sx);
+                    *p++ = (unsigned char)(v >> 8);  *p++ = (unsigned char)v;
+                    x++;
+                    break;
+                case FDC_COLOR_CODE_YUV444:
+                    *p++ = (unsigned char)(sx * 2 + shift);
+                    *p++ = (unsigned char)(sx + sy + shift);
+                    *p++ = (unsigned char)(sy * 2);
+                    x++;
+                    break;
+                case FDC_COLOR_CODE_YUV422:
+                    *p++ = (unsigned char)(sx * 2 + shift);
+                    *p++ = (unsigned char)(sx + sy + shift);
+                    *p++ = (unsigned char)(sy * 2);
+                    *p++ = (unsigned char)(sx + 1 + sy + shift);
+                    x += 2;
+                    break;
+                case FDC_COLOR_CODE_YUV411:
+                    *p++ = (unsigned char)(sx * 2 + shift);
+                    *p++ = (unsigned char)(sx + sy + shift);
+                    *p++ = (unsigned char)(sx + 1 + sy + shift);
+                    *p++ = (unsigned char)(sy * 2);
+                    *p++ = (unsigned char)(sx + 2 + sy + shift);
+                    *p++ = (unsigned char)(sx + 3 + sy + shift);
+                    x += 4;
+                    break;
+                default:
+                    return;
+            }
+        }
+    }
+}
+
+int FDCSimCamera::getRGB(unsigned char *pBitmap, unsigned long length)
+{
+    if (!acquiring || !pFrame) return FDC_CAM_ERROR_NOT_INITIALIZED;
+    if (length < width * height * 3) return FDC_CAM_ERROR_PARAM_OUT_OF_RANGE;
+    if (fdcConvertToRGB8(colorCode, pFrame, pBitmap, width, height)) return FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS;
+    return FDC_CAM_SUCCESS;
+}
+
+/** Returns the frame as consecutive sub-buffers of SIM_SUB_BUFFER_SIZE bytes, or larger if the
+ * frame does not fit in maxSegments of them, so the driver copies it as it would a segmented DMA
+ * buffer. */
+int FDCSimCamera::GetRawSegments(FDCSegment *pSegments, int maxSegments)
+{
+    unsigned long size = SIM_SUB_BUFFER_SIZE;
+    unsigned long offset;
+    int n = 0;
+
+    if (!pFrame || (maxSegments < 1)) return 0;
+    if (frameBytes / size >= (unsigned long)maxSegments) size = (frameBytes + maxSegments - 1) / maxSegments;
+    for (offset=0; offset<frameBytes; offset+=size, n++) {
+        pSegments[n].pData = pFrame + offset;
+        pSegments[n].length = (frameBytes - offset < size) ? frameBytes - offset : size;
+    }
+    return n;
+}
+
+FDCCameraControl *FDCSimCamera::GetCameraControl(FDCFeature feature)
+{
+    int i, index = -1;
+
+    if ((feature < 0) || (feature >= FDC_FEATURE_NUM_FEATURES)) return NULL;
+    if (!controls[feature]) {
+        for (i=0; i<numSimFeatures; i++) {
+            if (simFeatures[i].feature == feature) index = i;
+        }
+        controls[feature] = new FDCSimControl(index);
+    }
+    return controls[feature];
+}
+
+void FDCSimControlSize::GetSizeLimits(unsigned short *hMax, unsigned short *vMax)
+{
+    pCamera->getFormat7Limits(pCamera->mode, hMax, vMax);
+}
+
+void FDCSimControlSize::GetSize(unsigned short *width, unsigned short *height)
+{
+    *width = pCamera->format7[pCamera->mode].sizeX;
+    *height = pCamera->format7[pCamera->mode].sizeY;
+}
+
+int FDCSimControlSize::SetSize(unsigned short width, unsigned short height)
+{
+    SimFormat7Mode *pMode = &pCamera->format7[pCamera->mode];
+    unsigned short hMax, vMax;
+
+    if (pCamera->acquiring) return FDC_CAM_ERROR_BUSY;
+    GetSizeLimits(&hMax, &vMax);
+    if ((width == 0) || (height == 0) || (width % SIM_SIZE_UNIT_X) || (height % SIM_SIZE_UNIT_Y) ||
+        (pMode->left + width > hMax) || (pMode->top + height > vMax))
+        return FDC_CAM_ERROR_PARAM_OUT_OF_RANGE;
+    pMode->sizeX = width;
+    pMode->sizeY = height;
+    return FDC_CAM_SUCCESS;
+}
+
+void FDCSimControlSize::GetPosLimits(unsigned short *hMax, unsigned short *vMax)
+{
+    SimFormat7Mode *pMode = &pCamera->format7[pCamera->mode];
+
+    GetSizeLimits(hMax, vMax);
+    *hMax = *hMax - pMode->sizeX;
+    *vMax = *vMax - pMode->sizeY;
+}
+
+void FDCSimControlSize::GetPos(unsigned short *left, unsigned short *top)
+{
+    *left = pCamera->format7[pCamera->mode].left;
+    *top = pCamera->format7[pCamera->mode].top;
+}
+
+/** Like most cameras the position can be changed while streaming, it applies from the next frame */
+int FDCSimControlSize::SetPos(unsigned short left, unsigned short top)
+{
+    SimFormat7Mode *pMode = &pCamera->format7[pCamera->mode];
+    unsigned short hMax, vMax;
+
+    GetSizeLimits(&hMax, &vMax);
+    if ((left % SIM_SIZE_UNIT_X) || (top % SIM_SIZE_UNIT_Y) ||
+        (left + pMode->sizeX > hMax) || (top + pMode->sizeY > vMax))
+        return FDC_CAM_ERROR_PARAM_OUT_OF_RANGE;
+    pMode->left = left;
+    pMode->top = top;
+    return FDC_CAM_SUCCESS;
+}
+
+bool FDCSimControlSize::HasColorCode(FDCColorCode code)
+{
+    if ((code < 0) || (code >= FDC_COLOR_CODE_MAX)) return false;
+    if (pCamera->mode == 0) return true;
+    return (code == FDC_COLOR_CODE_Y8) || (code == FDC_COLOR_CODE_Y16) ||
+           (code == FDC_COLOR_CODE_RAW8) || (code == FDC_COLOR_CODE_RAW16);
+}
+
+void FDCSimControlSize::GetColorCode(FDCColorCode *code)
+{
+    *code = pCamera->format7[pCamera->mode].colorCode;
+}
+
+int FDCSimControlSize::SetColorCode(FDCColorCode code)
+{
+    if (pCamera->acquiring) return FDC_CAM_ERROR_BUSY;
+    if (!HasColorCode(code)) return FDC_CAM_ERROR_INVALID_VIDEO_SETTINGS;
+    pCamera->format7[pCamera->mode].colorCode = code;
+    return FDC_CAM_SUCCESS;
+}
+
+void FDCSimControlSize::GetBytesPerPacketRange(unsigned short *min, unsigned short *max)
+{
+    *min = SIM_BYTES_PER_PACKET_UNIT;
+    *max = pCamera->getMaxBytesPerPacket();
+}
+
+void FDCSimControlSize::GetBytesPerPacket(unsigned short *current, unsigned short *recommended)
+{
+    *current = pCamera->format7[pCamera->mode].bytesPerPacket;
+    if (recommended) *recommended = pCamera->getMaxBytesPerPacket();
+}
+
+int FDCSimControlSize::SetBytesPerPacket(unsigned short bpp)
+{
+    if (pCamera->acquiring) return FDC_CAM_ERROR_BUSY;
+    if ((bpp < SIM_BYTES_PER_PACKET_UNIT) || (bpp > pCamera->getMaxBytesPerPacket()) || (bpp % SIM_BYTES_PER_PACKET_UNIT))
+        return FDC_CAM_ERROR_PARAM_OUT_OF_RANGE;
+    pCamera->format7[pCamera->mode].bytesPerPacket = bpp;
+    return FDC_CAM_SUCCESS;
+}
+
+void FDCSimControlSize::GetPacketsPerFrame(unsigned long *ppf)
+{
+    *ppf = pCamera->getPacketsPerFrame();
+}
+
+void FDCSimControlSize::GetDataDepth(unsigned short *depth)
+{
+    *depth = isSixteenBit(pCamera->format7[pCamera->mode].colorCode) ? pCamera->config.dataDepth : 8;
+}
+
+void FDCSimControlSize::GetFrameInterval(float *interval)
+{
+    *interval = (float)pCamera->getFrameInterval();
+}
+
+static int simEnumerate(FDCCameraInfo *pInfo, int maxCameras)
+{
+    int i;
+
+    for (i=0; (i<numSimCameras) && (i<maxCameras); i++) {
+        pInfo[i].guid = simCameras[i].guid;
+        pInfo[i].node = i;
+        pInfo[i].bus = simCameras[i].bus;
+        pInfo[i].version = SIM_VERSION;
+        epicsSnprintf(pInfo[i].vendor, sizeof(pInfo[i].vendor), "Simulated");
+        epicsSnprintf(pInfo[i].model, sizeof(pInfo[i].model), "DCAM simulator %ux%u",
+            simCameras[i].maxSizeX, simCameras[i].maxSizeY);
+    }
+    return i;
+}
+
+static FDCCamera *simOpen(const FDCCameraInfo *pInfo)
+{
+    if ((pInfo->node < 0) || (pInfo->node >= numSimCameras)) return NULL;
+    return new FDCSimCamera(&simCameras[pInfo->node]);
+}
+
+static const FDCBackend simBackend = {"Sim", simEnumerate, simOpen};
+
+void fdcSimRegisterBackend(void)
+{
+    fdcRegisterBackend(&simBackend);
+}
+
+/** Adds a simulated camera. Must be called before the driver that uses it is configured.
+ * \param[in] camid The GUID of the camera, in the same format as for WinFDC_Config.
+ *            If empty a GUID is assigned: 0x0000FDC000000001 for the first camera and so on.
+ * \param[in] maxSizeX The sensor width, at least 160.
+ * \param[in] maxSizeY The sensor height, at least 120.
+ * \param[in] frameRate 0 to deliver frames at the rate of the video mode, >0 to deliver them at this
+ *            rate instead, <0 to deliver them as fast as they are read.
+ * \param[in] bus The bus the camera is counted on by the bandwidth manager, -1 for none.
+ * \param[in] speed The link speed in Mb/s, 0 for 400. Above 400 the camera has 1394b mode and
+ *            sends Format 7 packets up to the size a cycle carries at that speed while it is on.
+ * \param[in] dataDepth The significant bits of 16-bit samples, 1 to 16, reported as the data depth;
+ *            0 for 16.
+ * \param[in] sentLow The significant bits are sent in the low bits of the samples, with a bit above
+ *            them set in every 16th column; 0 sends them in the high bits, followed by bits that are
+ *            not 0.
+ * \return 0 on success, -1 on error.
+ */
+int fdcSimAddCamera(const char *camid, int maxSizeX, int maxSizeY, double frameRate, int bus, int speed,
+                    int dataDepth, int sentLow)
+{
+    SimConfig *pConfig;
+
+    if (numSimCameras >= FDC_SIM_MAX_CAMERAS) {
+        fprintf(stderr, "fdcSimAddCamera: too many simulated cameras\n");
+        return -1;
+    }
+    if (maxSizeX <= 0) maxSizeX = 1280;
+    if (maxSizeY <= 0) maxSizeY = 960;
+    if ((maxSizeX < 160) || (maxSizeY < 120) || (maxSizeX > 65535) || (maxSizeY > 65535)) {
+        fprintf(stderr, "fdcSimAddCamera: invalid size %dx%d\n", maxSizeX, maxSizeY);
+        return -1;
+    }
+    pConfig = &simCameras[numSimCameras];
+    if (fdcParseGuid(camid, &pConfig->guid)) {
+        fprintf(stderr, "fdcSimAddCamera: invalid camera ID \"%s\"\n", camid);
+        return -1;
+    }
+    if (speed <= 0) speed = 400;
+    if ((speed != 400) && (speed != 800) && (speed != 1600) && (speed != 3200)) {
+        fprintf(stderr, "fdcSimAddCamera: invalid speed %d, must be 400, 800, 1600 or 3200\n", speed);
+        return -1;
+    }
+    if (dataDepth == 0) dataDepth = 16;
+    if ((dataDepth < 1) || (dataDepth > 16)) {
+        fprintf(stderr, "fdcSimAddCamera: invalid data depth %d, must be 1 to 16\n", dataDepth);
+        return -1;
+    }
+    if (pConfig->guid == 0) pConfig->guid = 0x0000FDC000000001ULL + numSimCameras;
+    pConfig->maxSizeX = (unsigned short)maxSizeX;
+    pConfig->maxSizeY = (unsigned short)maxSizeY;
+    pConfig->frameRate = frameRate;
+    pConfig->bus = bus;
+    pConfig->speed = speed;
+    pConfig->dataDepth = dataDepth;
+    pConfig->sentLow = sentLow ? 1 : 0;
+    if (numSimCameras == 0) epicsTimeGetCurrent(&simBusEpoch);
+    numSimCameras++;
+    fdcSimRegisterBackend();
+    fdcEnumInvalidate();
+    return 0;
+}
@@ -0,0 +1,28 @@
+/*
+ * firewireWinDCAMSim.h
+ *
+ * Simulated IIDC camera backend for the firewireWinDCAM driver.
+ *
+ * A simulated camera supports the fixed video formats 0-2 (the modes that fit in its maximum
+ * size, at the rates that fit in the S400 isochronous bandwidth) and two Format 7 modes: mode 0 at
+ * full size with every color code and mode 1 binned 2x2 with the monochrome and raw color codes.
+ * A camera given a link speed above S400 has 1394b mode, in which its Format 7 packets can be as
+ * large as a cycle carries at that speed.
+ * The 16-bit samples of a camera can be given fewer significant bits, sent in the high or the low
+ * bits of the samples with the unused bits not cleared, to test how the driver aligns them.
+ * Frames are synthetic test patterns that depend only on the frame number and the pixel position
+ * on the sensor, and are delivered at the selected frame rate, so runs are reproducible and the
+ * driver can be built, tested and benchmarked without the Windows 1394 stack.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMSIM_H
+#define FIREWIREWINDCAMSIM_H
+
+#define FDC_SIM_MAX_CAMERAS 16
+
+int fdcSimAddCamera(const char *camid, int maxSizeX, int maxSizeY, double frameRate, int bus, int speed,
+                    int dataDepth, int sentLow);
+
+#endif
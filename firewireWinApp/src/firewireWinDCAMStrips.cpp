@@ -0,0 +1,265 @@
+/*
+ * firewireWinDCAMStrips.cpp
+ *
+ * Strip-parallel frame conversion for the firewireWinDCAM driver. See firewireWinDCAMStrips.h.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsStdio.h>
+
+#include "firewireWinDCAMStrips.h"
+#include "firewireWinDCAMSched.h"
+
+struct FDCStripJob {
+    epicsEventId doneEventId;   /**< Signalled when the last strip is done */
+    FDCStripWork work;
+    void *pvt;
+    unsigned long units;
+    unsigned long stripUnits;
+    int numStrips;
+    int nextStrip;              /**< The next strip to be taken */
+    int doneStrips;
+    int helpers;                /**< Workers that have joined the job */
+    int maxHelpers;
+    int queued;
+    int priority;               /**< Priority of the workers helping, -1 to leave them as they are */
+    unsigned long long mask;    /**< CPUs of the workers helping, see fdcStripJobSchedule() */
+    FDCStripJob *pNext;
+};
+
+/** The worker pool. Everything, including the jobs being converted, is protected by mutexId. */
+static struct {
+    epicsMutexId mutexId;
+    epicsEventId runEventId;    /**< Signalled when a job is queued, the workers wait on it */
+    int workers;
+    FDCStripJob *pHead, *pTail;
+} pool;
+
+/** The working memory of a thread, see fdcStripScratch() */
+typedef struct {
+    void *pData;
+    unsigned long size;
+} StripScratch;
+
+static epicsThreadOnceId poolOnce = EPICS_THREAD_ONCE_INIT;
+static epicsThreadPrivateId scratchId;
+
+static void poolInit(void *arg)
+{
+    pool.mutexId = epicsMutexMustCreate();
+    pool.runEventId = epicsEventMustCreate(epicsEventEmpty);
+    scratchId = epicsThreadPrivateCreate();
+}
+
+/** Takes a job out of the queue once all its strips are taken or it has all its helpers.
+ * Called with mutexId held. */
+static void dequeueJob(FDCStripJob *pJob)
+{
+    FDCStripJob *pPrev = NULL, *p;
+
+    if (!pJob->queued) return;
+    for (p = pool.pHead; p && (p != pJob); p = p->pNext) pPrev = p;
+    if (p) {
+        if (pPrev) pPrev->pNext = pJob->pNext;
+        else pool.pHead = pJob->pNext;
+        if (pool.pTail == pJob) pool.pTail = pPrev;
+    }
+    pJob->queued = 0;
+}
+
+/** Converts strips of a job until none are left to take. Called with mutexId held, which is
+ * released while a strip is converted. A thread does not touch the job after it has done its
+ * last strip, as the job may then be reused for the next frame. */
+static void runStrips(FDCStripJob *pJob)
+{
+    unsigned long first, count;
+    int strip;
+
+    while (pJob->nextStrip < pJob->numStrips) {
+        strip = pJob->nextStrip++;
+        if (pJob->nextStrip == pJob->numStrips) dequeueJob(pJob);
+        first = strip * pJob->stripUnits;
+        count = (pJob->units - first < pJob->stripUnits) ? pJob->units - first : pJob->stripUnits;
+        epicsMutexUnlock(pool.mutexId);
+        pJob->work(pJob->pvt, first, count);
+        epicsMutexMustLock(pool.mutexId);
+        if (++pJob->doneStrips == pJob->numStrips) {
+            epicsEventSignal(pJob->doneEventId);
+            break;
+        }
+    }
+}
+
+/** Helps with the queued jobs */
+static void workerTask(void *arg)
+{
+    FDCStripJob *pJob;
+
+    while (1) {
+        epicsEventMustWait(pool.runEventId);
+        epicsMutexMustLock(pool.mutexId);
+        while ((pJob = pool.pHead) != NULL) {
+            if (++pJob->helpers >= pJob->maxHelpers) dequeueJob(pJob);
+            /* The event only counts one worker, let another one help as well */
+            if (pool.pHead) epicsEventSignal(pool.runEventId);
+            if (pJob->priority >= 0) fdcSchedApply(pJob->priority, pJob->mask);
+            runStrips(pJob);
+        }
+        epicsMutexUnlock(pool.mutexId);
+    }
+}
+
+/** Starts workers until there are at least the number given, at a priority. Called with mutexId held. */
+static void startWorkers(int workers, int priority)
+{
+    char name[20];
+
+    if (workers > FDC_STRIPS_MAX_WORKERS) workers = FDC_STRIPS_MAX_WORKERS;
+    while (pool.workers < workers) {
+        epicsSnprintf(name, sizeof(name), "FDCStrip%d", pool.workers);
+        if (!epicsThreadCreate(name, priority,
+                               epicsThreadGetStackSize(epicsThreadStackMedium), workerTask, NULL)) {
+            fprintf(stderr, "fdcStripsRun: unable to create worker %d\n", pool.workers);
+            break;
+        }
+        pool.workers++;
+    }
+}
+
+/** Creates the job a thread converts its frames with.
+ * \return The job, NULL if there is no memory for it. */
+FDCStripJob *fdcStripJobCreate(void)
+{
+    FDCStripJob *pJob;
+
+    epicsThreadOnce(&poolOnce, poolInit, NULL);
+    pJob = (FDCStripJob *)calloc(1, sizeof(FDCStripJob));
+    if (!pJob) return NULL;
+    pJob->doneEventId = epicsEventCreate(epicsEventEmpty);
+    if (!pJob->doneEventId) {
+        free(pJob);
+        return NULL;
+    }
+    pJob->priority = -1;
+    return pJob;
+}
+
+/** Sets the placement of the workers that help with a job: before converting strips of it a
+ * worker is given the priority and CPUs, see fdcSchedApply(). A worker keeps them until it helps
+ * with a job that wants another placement. Workers of a job without placement are left as they
+ * are, and are started at the priority of the thread that first needs them.
+ * \param[in] pJob The job.
+ * \param[in] priority The EPICS priority, -1 to leave the workers as they are.
+ * \param[in] mask The CPUs, see fdcSchedSetAffinity().
+ */
+void fdcStripJobSchedule(FDCStripJob *pJob, int priority, unsigned long long mask)
+{
+    epicsMutexMustLock(pool.mutexId);
+    pJob->priority = priority;
+    pJob->mask = mask;
+    epicsMutexUnlock(pool.mutexId);
+}
+
+/** Frees a job that is not converting a frame */
+void fdcStripJobDestroy(FDCStripJob *pJob)
+{
+    if (!pJob) return;
+    epicsEventDestroy(pJob->doneEventId);
+    free(pJob);
+}
+
+/** Converts a frame in strips, and returns when it is done.
+ * \param[in] pJob The job of the calling thread, NULL to convert in the calling thread alone.
+ * \param[in] threads The most threads converting the frame, the calling thread included; 0 for one
+ *            per CPU core, 1 to convert in the calling thread alone.
+ * \param[in] units The number of units in the frame, see FDCStripWork.
+ * \param[in] unitBytes The bytes of output of a unit.
+ * \param[in] work Converts a strip.
+ * \param[in] pvt Passed to work.
+ * \return The number of threads the frame was offered to.
+ */
+int fdcStripsRun(FDCStripJob *pJob, int threads, unsigned long units, unsigned long unitBytes,
+                 FDCStripWork work, void *pvt)
+{
+    unsigned long stripUnits;
+    int numStrips;
+
+    if (threads <= 0) threads = epicsThreadGetCPUs();
+    if (threads > FDC_STRIPS_MAX_WORKERS + 1) threads = FDC_STRIPS_MAX_WORKERS + 1;
+    if (!pJob || (threads < 2) || (unitBytes == 0) || ((double)units * unitBytes < FDC_STRIP_MIN_BYTES)) {
+        work(pvt, 0, units);
+        return 1;
+    }
+    /* Cache-sized strips, but at least one for each thread */
+    stripUnits = FDC_STRIP_BYTES / unitBytes;
+    if (stripUnits < 1) stripUnits = 1;
+    if (units / stripUnits < (unsigned long)threads) stripUnits = (units + threads - 1) / threads;
+    numStrips = (int)((units + stripUnits - 1) / stripUnits);
+    if (threads > numStrips) threads = numStrips;
+
+    epicsMutexMustLock(pool.mutexId);
+    startWorkers(threads - 1, (pJob->priority >= 0) ? pJob->priority : (int)epicsThreadGetPrioritySelf());
+    pJob->work = work;
+    pJob->pvt = pvt;
+    pJob->units = units;
+    pJob->stripUnits = stripUnits;
+    pJob->numStrips = numStrips;
+    pJob->nextStrip = 0;
+    pJob->doneStrips = 0;
+    pJob->helpers = 0;
+    pJob->maxHelpers = threads - 1;
+    pJob->queued = 1;
+    pJob->pNext = NULL;
+    if (pool.pTail) pool.pTail->pNext = pJob;
+    else pool.pHead = pJob;
+    pool.pTail = pJob;
+    epicsEventSignal(pool.runEventId);
+
+    /* The calling thread converts strips as well, then waits for the workers to finish theirs */
+    runStrips(pJob);
+    while (pJob->doneStrips < pJob->numStrips) {
+        epicsMutexUnlock(pool.mutexId);
+        epicsEventMustWait(pJob->doneEventId);
+        epicsMutexMustLock(pool.mutexId);
+    }
+    dequeueJob(pJob);
+    epicsMutexUnlock(pool.mutexId);
+    return threads;
+}
+
+/** Returns the number of workers in the pool */
+int fdcStripsWorkers(void)
+{
+    return pool.workers;
+}
+
+/** Returns working memory for the strip being converted by the calling thread. The buffer belongs
+ * to the thread and is kept for its next strip; it only grows, and is never freed, as the threads
+ * that convert strips run for the life of the IOC.
+ * \param[in] size The bytes needed.
+ * \return The buffer, NULL if there is no memory for it. */
+void *fdcStripScratch(unsigned long size)
+{
+    StripScratch *pScratch;
+
+    epicsThreadOnce(&poolOnce, poolInit, NULL);
+    pScratch = (StripScratch *)epicsThreadPrivateGet(scratchId);
+    if (!pScratch) {
+        pScratch = (StripScratch *)calloc(1, sizeof(StripScratch));
+        if (!pScratch) return NULL;
+        epicsThreadPrivateSet(scratchId, pScratch);
+    }
+    if (pScratch->size < size) {
+        free(pScratch->pData);
+        pScratch->pData = malloc(size);
+        pScratch->size = pScratch->pData ? size : 0;
+    }
+    return pScratch->pData;
+}
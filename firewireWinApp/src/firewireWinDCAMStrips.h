@@ -0,0 +1,51 @@
+/*
+ * firewireWinDCAMStrips.h
+ *
+ * Strip-parallel frame conversion for the firewireWinDCAM driver.
+ *
+ * Converting a large frame to RGB, or swapping the bytes of a large 16-bit frame, takes one core
+ * long enough to limit the frame rate. The frame is cut into horizontal strips of about
+ * FDC_STRIP_BYTES of output, small enough to stay in the cache of the core that converts them,
+ * and the strips are converted by the calling thread together with the workers of a pool shared
+ * by all the cameras. The call returns when every strip is done, so the frame is complete before
+ * it is published. Frames of less than FDC_STRIP_MIN_BYTES are converted by the calling thread
+ * alone, as starting the workers would cost more than it saves.
+ *
+ * The workers are started when they are first needed and run for the life of the IOC. A worker
+ * takes the priority and CPUs of the job it helps with, see fdcStripJobSchedule().
+ * A conversion that needs working memory for a strip gets it from fdcStripScratch(), which keeps
+ * a buffer for each thread so that it is not allocated again for every strip of every frame.
+ *
+ * License: This file is part of 'areaDetector'
+ */
+
+#ifndef FIREWIREWINDCAMSTRIPS_H
+#define FIREWIREWINDCAMSTRIPS_H
+
+/** Output bytes per strip, about the size of the L2 cache of a core */
+#define FDC_STRIP_BYTES (256 * 1024)
+/** Frames with less output than this are converted by the calling thread alone */
+#define FDC_STRIP_MIN_BYTES (1024 * 1024)
+/** Most worker threads in the pool */
+#define FDC_STRIPS_MAX_WORKERS 63
+
+/** Converts the units [first, first+count) of a frame. A unit is the smallest part of the frame
+ * that can be converted on its own, such as a sample or a YUV group.
+ * \param[in] pvt The pointer given to fdcStripsRun().
+ * \param[in] first The first unit.
+ * \param[in] count The number of units.
+ */
+typedef void (*FDCStripWork)(void *pvt, unsigned long first, unsigned long count);
+
+/** The conversion of one frame; each thread that converts frames needs its own */
+typedef struct FDCStripJob FDCStripJob;
+
+FDCStripJob *fdcStripJobCreate(void);
+void fdcStripJobDestroy(FDCStripJob *pJob);
+void fdcStripJobSchedule(FDCStripJob *pJob, int priority, unsigned long long mask);
+int  fdcStripsRun(FDCStripJob *pJob, int threads, unsigned long units, unsigned long unitBytes,
+                  FDCStripWork work, void *pvt);
+int  fdcStripsWorkers(void);
+void *fdcStripScratch(unsigned long size);
+
+#endif
@@ -23,13 +23,27 @@ epicsEnvSet("CBUFFS", "500")
 # The search path for database files
 epicsEnvSet("EPICS_DB_INCLUDE_PATH", "$(ADCORE)/db")
 
+# Save the camera capabilities so the next start does not need to probe the camera
+#WinFDC_CapabilityCache("./autosave", 0)
+
+# A simulated 1280x960 camera; use it with WinFDC_Config("$(PORT)", "0x0000fdc000000001", 0, 0)
+# or as the first camera found. This is the only kind of camera on Linux.
+#WinFDC_SimCamera("", 1280, 960, 0, 0, 0, 0, 0)
+
+# Play back a recording made with REC_FILE and REC_ENABLE as the camera it was recorded from
+#WinFDC_ReplayCamera("$(TOP)/data/camera.raw", "", 1, 1)
+
+# Grab the frames of all the cameras configured below with one reactor and a worker per CPU core
+#WinFDC_GrabReactor(0)
+
 # This is the Thorlabs camera
 #WinFDC_Config("$(PORT)", "116442682213159680", 0, 0)
 
 # This is the SONY camera
 #WinFDC_Config("$(PORT)", "163818473825504512", 0, 0)
 
-# This will use the first camera found without needing to know its ID
+# This will use the first camera found without needing to know its ID.
+# The optional 7th argument is the number of DMA buffers, 0 sizes the ring automatically.
 WinFDC_Config("$(PORT)", "", 0, 0)
 
 asynSetTraceIOMask("$(PORT)",0,2)
@@ -38,6 +52,10 @@ asynSetTraceIOMask("$(PORT)",0,2)
 dbLoadRecords("$(ADFIREWIREWIN)/db/firewireDCAM.template", "P=$(PREFIX),R=cam1:,PORT=$(PORT),ADDR=0,TIMEOUT=1")
 dbLoadTemplate("firewire.substitutions")
 
+# Group the frames of two cameras taken at the same time into sets; configure a second camera as FW2 first
+#WinFDC_FrameSet("FWSET", "$(PORT) FW2", 0, 0, 0, 0)
+#dbLoadRecords("$(ADFIREWIREWIN)/db/firewireFrameSet.template", "P=$(PREFIX),R=set1:,PORT=FWSET,ADDR=0,TIMEOUT=1")
+
 # Create a standard arrays plugin, set it to get 8-bit data from the driver.
 NDStdArraysConfigure("Image1", 5, 0, "$(PORT)", 0, 0)
 